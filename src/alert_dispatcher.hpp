@@ -0,0 +1,218 @@
+/*
+ * Event-Driven Alert Dispatcher
+ *
+ * Replaces the sleep-then-pop_alerts polling loop. The thread that calls
+ * run() blocks in lt::session::wait_for_alert and wakes as soon as libtorrent
+ * posts an alert; alerts are routed through a table indexed by alert type
+ * instead of a chain of type comparisons. The session alert mask is built
+ * from the categories of the alerts that actually have handlers.
+ *
+ * Periodic work is registered as timers on the same thread, kept in a timer
+ * wheel. The wait timeout is the time until the next timer is due, so
+ * handlers and timers never run concurrently and the thread sleeps for as
+ * long as nothing needs doing.
+ */
+
+#pragma once
+
+#ifndef DISABLE_LIBTORRENT
+#include <libtorrent/session.hpp>
+#include <libtorrent/alert.hpp>
+#include <libtorrent/alert_types.hpp>
+#include <libtorrent/settings_pack.hpp>
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "timer_wheel.hpp"
+
+#ifndef DISABLE_LIBTORRENT
+
+namespace dht_crawler {
+
+class AlertDispatcher {
+public:
+    using Handler = std::function<void(lt::alert*)>;
+    using Task = std::function<void()>;
+
+    AlertDispatcher(lt::session* session, std::function<void(const std::string&)> log_callback = nullptr)
+        : m_session(session)
+        , m_log_callback(log_callback)
+        , m_alert_mask(lt::alert_category::error)
+        , m_timer_wheel(std::chrono::milliseconds(10))
+        , m_trace(false)
+        , m_alerts_dispatched(0)
+        , m_alerts_unhandled(0)
+        , m_wakeups(0)
+        , m_timer_runs(0) {}
+
+    /**
+     * Register a handler for a concrete alert type. The alert's category is
+     * added to the mask applied by apply_alert_mask().
+     */
+    template <typename AlertType>
+    void on(std::function<void(AlertType*)> handler) {
+        m_handlers[AlertType::alert_type] = [handler](lt::alert* alert) {
+            handler(static_cast<AlertType*>(alert));
+        };
+        m_alert_mask |= AlertType::static_category;
+    }
+
+    template <typename AlertType>
+    void remove() {
+        m_handlers[AlertType::alert_type] = nullptr;
+    }
+
+    /**
+     * Register periodic work. The first run happens one interval from now.
+     * May be called from a running task.
+     */
+    void every(const std::string& name, std::chrono::milliseconds interval, Task task) {
+        Timer timer;
+        timer.name = name;
+        timer.interval = interval;
+        timer.task = task;
+        m_timers.push_back(std::move(timer));
+        m_timer_wheel.schedule(interval, m_timers.size() - 1);
+    }
+
+    /**
+     * Drop all periodic work (not from inside a task)
+     */
+    void clear_timers() {
+        m_timer_wheel.clear();
+        m_timers.clear();
+    }
+
+    // Log every dispatched alert (debug mode)
+    void set_trace(bool enabled) {
+        m_trace = enabled;
+    }
+
+    lt::alert_category_t alert_mask() const {
+        return m_alert_mask;
+    }
+
+    /**
+     * Restrict the session to the categories of the registered handlers
+     */
+    void apply_alert_mask() {
+        lt::settings_pack pack;
+        pack.set_int(lt::settings_pack::alert_mask, m_alert_mask);
+        m_session->apply_settings(pack);
+    }
+
+    /**
+     * Dispatch alerts and run timers on the calling thread until
+     * keep_running() returns false
+     * @param max_wait Upper bound on a single wait, so keep_running() is
+     *                 re-checked even when no alerts or timers are due
+     */
+    void run(const std::function<bool()>& keep_running,
+             std::chrono::milliseconds max_wait = std::chrono::milliseconds(500)) {
+        while (keep_running()) {
+            auto now = std::chrono::steady_clock::now();
+            run_due_timers(now);
+            if (!keep_running()) {
+                break;
+            }
+
+            auto wait = m_timer_wheel.time_until_next(std::chrono::steady_clock::now(), max_wait);
+            if (m_session->wait_for_alert(wait) != nullptr) {
+                m_wakeups++;
+                dispatch_pending();
+            }
+        }
+    }
+
+    /**
+     * Pop and dispatch whatever alerts are queued, without waiting
+     */
+    void dispatch_pending() {
+        m_alerts.clear();
+        m_session->pop_alerts(&m_alerts);
+
+        for (lt::alert* alert : m_alerts) {
+            int type = alert->type();
+            if (m_trace) {
+                log("Alert type: " + std::to_string(type) + " - " + alert->message());
+            }
+
+            if (type >= 0 && type < lt::num_alert_types && m_handlers[type]) {
+                m_handlers[type](alert);
+                m_alerts_dispatched++;
+            } else {
+                m_alerts_unhandled++;
+            }
+        }
+    }
+
+    uint64_t get_alerts_dispatched() const { return m_alerts_dispatched.load(); }
+    uint64_t get_alerts_unhandled() const { return m_alerts_unhandled.load(); }
+    uint64_t get_wakeups() const { return m_wakeups.load(); }
+    uint64_t get_timer_runs() const { return m_timer_runs.load(); }
+
+    void print_statistics() const {
+        std::cout << "=== Alert Dispatcher Statistics ===" << std::endl;
+        std::cout << "Alerts dispatched: " << m_alerts_dispatched.load() << std::endl;
+        std::cout << "Alerts without handler: " << m_alerts_unhandled.load() << std::endl;
+        std::cout << "Wakeups: " << m_wakeups.load() << std::endl;
+        std::cout << "Timer runs: " << m_timer_runs.load() << std::endl;
+        std::cout << "===================================" << std::endl;
+    }
+
+private:
+    struct Timer {
+        std::string name;
+        std::chrono::milliseconds interval;
+        Task task;
+    };
+
+    void run_due_timers(std::chrono::steady_clock::time_point now) {
+        m_timer_wheel.advance(now, [this](size_t index) {
+            Timer& timer = m_timers[index];
+
+            // Schedule from now rather than from the missed deadline so a
+            // slow task cannot cause a burst of catch-up runs
+            m_timer_wheel.schedule(timer.interval, index);
+            try {
+                timer.task();
+            } catch (const std::exception& e) {
+                log("Timer '" + timer.name + "' failed: " + e.what());
+            }
+            m_timer_runs++;
+        });
+    }
+
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[AlertDispatcher] " + message);
+        }
+    }
+
+    lt::session* m_session;
+    std::function<void(const std::string&)> m_log_callback;
+
+    std::array<Handler, lt::num_alert_types> m_handlers;
+    lt::alert_category_t m_alert_mask;
+    std::deque<Timer> m_timers;          // Stable under push_back from a task
+    TimerWheel<size_t> m_timer_wheel;    // Payload: index into m_timers
+    std::vector<lt::alert*> m_alerts;
+    bool m_trace;
+
+    std::atomic<uint64_t> m_alerts_dispatched;
+    std::atomic<uint64_t> m_alerts_unhandled;
+    std::atomic<uint64_t> m_wakeups;
+    std::atomic<uint64_t> m_timer_runs;
+};
+
+} // namespace dht_crawler
+
+#endif // DISABLE_LIBTORRENT
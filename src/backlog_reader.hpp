@@ -0,0 +1,277 @@
+/*
+ * Prefetching Backlog Reader
+ *
+ * Streams (id, info_hash) rows of a work backlog from the database on a
+ * background thread using keyset pagination: each fetch asks for rows with
+ * id > last_id, so every batch is an index range scan no matter how deep
+ * into the backlog it is (OFFSET paging rescans all earlier rows).
+ *
+ * A window of ready hashes is kept in memory and topped up whenever it
+ * falls below half full. The batch size follows the consumer: it is sized
+ * to cover lead_time of consumption at the observed rate, clamped to
+ * [min_batch, max_batch], so a fast fetch pipeline is never left waiting on
+ * the database and a slow one does not pull more than it needs.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dht_crawler {
+
+struct BacklogRow {
+    uint64_t id;
+    std::string info_hash;
+};
+
+struct BacklogReaderConfig {
+    size_t window = 1000;                           // Max hashes held ready in memory
+    size_t min_batch = 100;                         // Smallest fetch
+    size_t max_batch = 5000;                        // Largest fetch
+    std::chrono::seconds lead_time{30};             // Consumption a fetch should cover
+    std::chrono::milliseconds retry_delay{2000};    // Wait after a failed fetch
+};
+
+class BacklogReader {
+public:
+    // Fetch up to limit rows with id > after_id in id order; false on error
+    using FetchFunction = std::function<bool(uint64_t after_id, size_t limit, std::vector<BacklogRow>& rows)>;
+
+    BacklogReader(const BacklogReaderConfig& config,
+                  FetchFunction fetch,
+                  std::function<void(const std::string&)> log_callback = nullptr)
+        : m_config(config)
+        , m_fetch(fetch)
+        , m_log_callback(log_callback)
+        , m_running(false)
+        , m_stop_requested(false)
+        , m_end_reached(false)
+        , m_last_id(0)
+        , m_taken_since_sample(0)
+        , m_rate_per_second(0.0)
+        , m_batch_size(config.min_batch)
+        , m_batches(0)
+        , m_rows_fetched(0)
+        , m_rows_taken(0)
+        , m_fetch_errors(0)
+        , m_empty_takes(0)
+        , m_total_fetch_us(0) {}
+
+    ~BacklogReader() {
+        stop();
+    }
+
+    /**
+     * Start prefetching rows with id > start_after_id
+     */
+    void start(uint64_t start_after_id = 0) {
+        if (m_running) return;
+        m_last_id = start_after_id;
+        m_stop_requested = false;
+        m_end_reached = false;
+        m_running = true;
+        m_thread = std::thread(&BacklogReader::reader_loop, this);
+    }
+
+    void stop() {
+        if (!m_running) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop_requested = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_running = false;
+    }
+
+    /**
+     * Take up to max ready hashes without blocking
+     */
+    std::vector<std::string> take(size_t max) {
+        std::vector<std::string> hashes;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t count = std::min(max, m_ready.size());
+            hashes.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                hashes.push_back(std::move(m_ready.front()));
+                m_ready.pop_front();
+            }
+            if (count < max && !m_end_reached) {
+                m_empty_takes++; // Consumer wanted more than was prefetched
+            }
+            m_taken_since_sample += count;
+        }
+        m_rows_taken += hashes.size();
+        if (!hashes.empty()) {
+            m_cv.notify_all();
+        }
+        return hashes;
+    }
+
+    /**
+     * Wait until at least one hash is ready or the backlog is exhausted
+     */
+    bool wait_ready(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_ready_cv.wait_for(lock, timeout, [this]() {
+            return !m_ready.empty() || m_end_reached;
+        }) && !m_ready.empty();
+    }
+
+    /**
+     * True once the end of the backlog was reached and every row was taken
+     */
+    bool exhausted() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_end_reached && m_ready.empty();
+    }
+
+    size_t ready() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ready.size();
+    }
+
+    uint64_t last_id() const { return m_last_id.load(); }
+    uint64_t rows_fetched() const { return m_rows_fetched.load(); }
+
+    void print_statistics() const {
+        uint64_t batches = m_batches.load();
+        std::cout << "=== Backlog Reader Statistics ===" << std::endl;
+        std::cout << "Batches fetched: " << batches << " (errors: " << m_fetch_errors.load() << ")" << std::endl;
+        std::cout << "Rows fetched: " << m_rows_fetched.load() << ", taken: " << m_rows_taken.load() << std::endl;
+        std::cout << "Ready: " << ready() << "/" << m_config.window << std::endl;
+        std::cout << "Last id: " << m_last_id.load() << std::endl;
+        std::cout << "Current batch size: " << m_batch_size.load() << std::endl;
+        std::cout << "Consumption rate: " << static_cast<uint64_t>(m_rate_per_second.load()) << " hashes/s" << std::endl;
+        std::cout << "Avg fetch latency: " << (batches ? m_total_fetch_us.load() / batches : 0) << "us" << std::endl;
+        std::cout << "Underrun takes: " << m_empty_takes.load() << std::endl;
+        std::cout << "=================================" << std::endl;
+    }
+
+private:
+    void reader_loop() {
+        auto last_sample = std::chrono::steady_clock::now();
+        std::vector<BacklogRow> rows;
+
+        for (;;) {
+            size_t limit = 0;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait_for(lock, std::chrono::seconds(1), [this]() {
+                    return m_stop_requested || (!m_end_reached && m_ready.size() <= m_config.window / 2);
+                });
+                if (m_stop_requested) break;
+
+                update_rate_locked(last_sample);
+                if (m_end_reached || m_ready.size() > m_config.window / 2) {
+                    continue;
+                }
+                limit = std::min(next_batch_size(), m_config.window - m_ready.size());
+            }
+            if (limit == 0) continue;
+
+            rows.clear();
+            auto start = std::chrono::steady_clock::now();
+            bool ok = false;
+            try {
+                ok = m_fetch(m_last_id.load(), limit, rows);
+            } catch (const std::exception& e) {
+                log(std::string("Fetch failed: ") + e.what());
+            }
+            m_total_fetch_us += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+
+            if (!ok) {
+                m_fetch_errors++;
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait_for(lock, m_config.retry_delay, [this]() { return m_stop_requested; });
+                continue;
+            }
+
+            m_batches++;
+            m_rows_fetched += rows.size();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& row : rows) {
+                    m_ready.push_back(std::move(row.info_hash));
+                }
+                if (!rows.empty()) {
+                    m_last_id = rows.back().id;
+                }
+                if (rows.size() < limit) {
+                    m_end_reached = true;
+                    log("Reached end of backlog at id " + std::to_string(m_last_id.load()));
+                }
+            }
+            m_ready_cv.notify_all();
+        }
+    }
+
+    // Exponentially weighted hashes/second taken by the consumer
+    void update_rate_locked(std::chrono::steady_clock::time_point& last_sample) {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_sample).count();
+        if (elapsed < 0.5) return;
+
+        double sample = m_taken_since_sample / elapsed;
+        double rate = m_rate_per_second.load();
+        m_rate_per_second = rate == 0.0 ? sample : 0.7 * rate + 0.3 * sample;
+        m_taken_since_sample = 0;
+        last_sample = now;
+    }
+
+    size_t next_batch_size() {
+        double wanted = m_rate_per_second.load() * m_config.lead_time.count();
+        size_t batch = static_cast<size_t>(wanted);
+        batch = std::max(m_config.min_batch, std::min(m_config.max_batch, batch));
+        m_batch_size = batch;
+        return batch;
+    }
+
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[BacklogReader] " + message);
+        }
+    }
+
+    BacklogReaderConfig m_config;
+    FetchFunction m_fetch;
+    std::function<void(const std::string&)> m_log_callback;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;        // Wakes the reader
+    std::condition_variable m_ready_cv;  // Wakes wait_ready()
+    std::deque<std::string> m_ready;
+
+    std::atomic<bool> m_running;
+    bool m_stop_requested;
+    bool m_end_reached;
+    std::atomic<uint64_t> m_last_id;
+    size_t m_taken_since_sample;
+    std::atomic<double> m_rate_per_second;
+    std::atomic<size_t> m_batch_size;
+
+    std::atomic<uint64_t> m_batches;
+    std::atomic<uint64_t> m_rows_fetched;
+    std::atomic<uint64_t> m_rows_taken;
+    std::atomic<uint64_t> m_fetch_errors;
+    std::atomic<uint64_t> m_empty_takes;
+    std::atomic<uint64_t> m_total_fetch_us;
+};
+
+} // namespace dht_crawler
@@ -24,6 +24,8 @@
 #include <functional>
 #include <atomic>
 
+#include "info_hash.hpp"
+
 #ifndef DISABLE_LIBTORRENT
 
 namespace dht_crawler {
@@ -94,7 +96,9 @@ public:
         
         // Store infohashes for metadata fetching
         for (const auto& infohash : response.infohashes) {
-            m_collected_infohashes.insert(infohash);
+            if (infohash.length() == InfoHash::SIZE) {
+                m_collected_infohashes.insert(InfoHash::from_bytes(infohash.data()));
+            }
         }
         
         // Store nodes for further queries
@@ -106,8 +110,8 @@ public:
     }
 
     // Get collected infohashes
-    std::vector<std::string> get_collected_infohashes() const {
-        return std::vector<std::string>(m_collected_infohashes.begin(), m_collected_infohashes.end());
+    std::vector<InfoHash> get_collected_infohashes() const {
+        return std::vector<InfoHash>(m_collected_infohashes.begin(), m_collected_infohashes.end());
     }
 
     // Get known DHT nodes
@@ -115,6 +119,13 @@ public:
         return std::vector<std::string>(m_known_nodes.begin(), m_known_nodes.end());
     }
 
+    // Add a node id remembered from an earlier run
+    void add_known_node(const std::string& node_id) {
+        if (node_id.length() == 20) {
+            m_known_nodes.insert(node_id);
+        }
+    }
+
     // Statistics
     int get_total_queries() const { return m_total_queries; }
     int get_successful_queries() const { return m_successful_queries; }
@@ -161,7 +172,7 @@ private:
     std::atomic<int> m_successful_queries;
     std::atomic<int> m_infohashes_collected;
     
-    std::set<std::string> m_collected_infohashes;
+    InfoHashSet m_collected_infohashes;
     std::set<std::string> m_known_nodes;
 };
 
@@ -0,0 +1,58 @@
+/*
+ * Chunked Transaction
+ *
+ * Runs a batch that is written as several statements (fixed-size chunks,
+ * plus whatever each chunk writes alongside it) as one transaction. If any
+ * chunk fails, or the connection drops before COMMIT, nothing of the batch
+ * is kept, so the caller can retry the whole batch without applying its
+ * first chunks twice. A connection lost during the COMMIT itself still
+ * leaves the outcome unknown; that window is one round trip per batch
+ * instead of one per chunk.
+ *
+ * The transaction statements are supplied as hooks so the same logic serves
+ * any connection type and can be exercised without a database server.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+
+namespace dht_crawler {
+
+struct TransactionHooks {
+    std::function<bool()> begin;
+    std::function<bool()> commit;
+    std::function<void()> rollback;
+};
+
+/**
+ * Call write_chunk(first, count) for consecutive chunks of at most
+ * max_rows of rows rows, all inside one transaction. Stops at the first
+ * chunk that returns false and rolls back. True only if every chunk was
+ * written and the commit succeeded.
+ */
+template <typename WriteChunk>
+bool write_chunked_transaction(const TransactionHooks& hooks, size_t rows, size_t max_rows,
+                               WriteChunk&& write_chunk) {
+    if (rows == 0) return true;
+    if (!hooks.begin()) return false;
+
+    for (size_t first = 0; first < rows; ) {
+        size_t count = std::min(rows - first, max_rows);
+        if (!write_chunk(first, count)) {
+            hooks.rollback();
+            return false;
+        }
+        first += count;
+    }
+
+    if (!hooks.commit()) {
+        hooks.rollback();
+        return false;
+    }
+    return true;
+}
+
+} // namespace dht_crawler
@@ -23,15 +23,18 @@
 #include <memory>
 #include <functional>
 
+#include "info_hash.hpp"
+#include "query_dedup_filter.hpp"
+
 #ifndef DISABLE_LIBTORRENT
 
 struct DHTQuery {
-    std::string hash_str;
+    dht_crawler::InfoHash hash;
     lt::sha1_hash random_hash;
     std::chrono::steady_clock::time_point queued_time;
     
-    DHTQuery(const std::string& hash, const lt::sha1_hash& lt_hash) 
-        : hash_str(hash), random_hash(lt_hash), queued_time(std::chrono::steady_clock::now()) {}
+    DHTQuery(const dht_crawler::InfoHash& info_hash, const lt::sha1_hash& lt_hash) 
+        : hash(info_hash), random_hash(lt_hash), queued_time(std::chrono::steady_clock::now()) {}
 };
 
 class ConcurrentDHTManager {
@@ -57,7 +60,7 @@ private:
     
     // Configuration
     int m_num_workers;
-    int m_query_delay_ms;
+    std::atomic<int> m_query_delay_ms;
     
     // Callbacks for integration with main crawler
     std::function<void(const DHTQuery&)> m_query_callback;
@@ -66,9 +69,11 @@ private:
     // libtorrent session (shared, thread-safe)
     lt::session* m_session;
     
-    // Hash tracking (thread-safe)
-    std::mutex m_queried_hashes_mutex;
-    std::set<std::string> m_queried_hashes;
+    // Query target dedup (lock-free, fixed memory)
+    std::shared_ptr<dht_crawler::QueryDedupFilter> m_query_filter;
+    
+    // Part of the keyspace query targets are drawn from (all of it by default)
+    dht_crawler::KeyspaceSlice m_keyspace;
 
 public:
     ConcurrentDHTManager(lt::session* session, int num_workers = 4, int /* max_queue_size */ = 1000)
@@ -80,6 +85,7 @@ public:
         , m_num_workers(num_workers)
         , m_query_delay_ms(10) // Reduced delay for concurrent processing
         , m_session(session)
+        , m_query_filter(dht_crawler::create_query_dedup_filter(dht_crawler::QueryDedupMode::ROTATING, 4 * 1024 * 1024))
     {
         // Initialize random number generators for each worker
         for (int i = 0; i < m_num_workers; ++i) {
@@ -144,6 +150,22 @@ public:
         m_query_delay_ms = delay_ms;
     }
     
+    int get_query_delay() const {
+        return m_query_delay_ms.load();
+    }
+    
+    // Replace the query target dedup filter (call before start())
+    void set_query_filter(std::shared_ptr<dht_crawler::QueryDedupFilter> filter) {
+        m_query_filter = filter;
+    }
+    
+    // Draw query targets from one slice of the keyspace (call before start())
+    void set_keyspace(const dht_crawler::KeyspaceSlice& keyspace) {
+        m_keyspace = keyspace;
+    }
+    
+    const dht_crawler::KeyspaceSlice& get_keyspace() const { return m_keyspace; }
+    
     // Statistics
     int get_total_queries_sent() const { return m_total_queries_sent.load(); }
     int get_queries_generated() const { return m_queries_generated.load(); }
@@ -160,6 +182,7 @@ public:
         std::cout << "Queries sent: " << m_total_queries_sent.load() << std::endl;
         std::cout << "Queue size: " << get_queue_size() << std::endl;
         std::cout << "Query delay: " << m_query_delay_ms << "ms" << std::endl;
+        m_query_filter->print_statistics();
         std::cout << "=================================" << std::endl;
     }
 
@@ -175,7 +198,7 @@ private:
                 generate_and_send_queries(worker_id);
                 
                 // Small delay to prevent excessive CPU usage
-                std::this_thread::sleep_for(std::chrono::milliseconds(m_query_delay_ms));
+                std::this_thread::sleep_for(std::chrono::milliseconds(m_query_delay_ms.load()));
                 
             } catch (const std::exception& e) {
                 std::cerr << "Worker " << worker_id << " error: " << e.what() << std::endl;
@@ -201,19 +224,19 @@ private:
                 random_hash[j] = static_cast<unsigned char>(dis(gen));
             }
             
-            std::string hash_str = random_hash.to_string();
+            dht_crawler::InfoHash hash(random_hash);
+            if (m_keyspace.count > 1) {
+                m_keyspace.place(hash);
+                random_hash = hash.to_sha1();
+            }
             
-            // Check if we've already queried this hash (thread-safe)
-            {
-                std::lock_guard<std::mutex> lock(m_queried_hashes_mutex);
-                if (m_queried_hashes.find(hash_str) != m_queried_hashes.end()) {
-                    continue; // Skip duplicate
-                }
-                m_queried_hashes.insert(hash_str);
+            // Check if we've already queried this hash (lock-free)
+            if (!m_query_filter->check_and_insert(hash)) {
+                continue; // Skip duplicate
             }
             
             // Create query object
-            DHTQuery query(hash_str, random_hash);
+            DHTQuery query(hash, random_hash);
             m_queries_generated++;
             
             // Send DHT queries (libtorrent session is thread-safe)
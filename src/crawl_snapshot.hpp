@@ -0,0 +1,523 @@
+/*
+ * Crawl State Snapshots
+ *
+ * Compact binary snapshots of the crawler's in-memory state (DHT routing
+ * table, discovered and requested hashes, outstanding metadata requests,
+ * dedup filters), so a restarted crawler resumes where it left off instead
+ * of re-bootstrapping and rediscovering from nothing.
+ *
+ * File layout, all integers in host byte order (a marker in the header
+ * rejects snapshots from a machine of the other endianness):
+ *
+ *   header   "DHTSNAP1", u32 version, u32 byte order marker,
+ *            u64 creation time (unix seconds), u32 section count, u32 0
+ *   section  u32 type, u32 0, u64 payload size, u64 payload checksum,
+ *            payload padded to a multiple of 8 bytes
+ *
+ * A snapshot is written to "<path>.tmp", synced and renamed over <path>, so
+ * a crash mid-write leaves the previous snapshot intact. On startup the file
+ * is memory-mapped and every section checksum verified before any of it is
+ * used; readers parse sections in place with SnapshotCursor.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dht_crawler {
+
+enum class SnapshotSection : uint32_t {
+    DHT_STATE = 1,        // Bencoded lt::session_params holding the DHT state
+    DISCOVERY = 2,        // DiscoveryStore records
+    METADATA_QUEUE = 4,   // Queued and in-flight metadata requests
+    BEP51_NODES = 5,      // BEP51 node ids
+    QUERY_FILTER = 6      // Query dedup filter bits
+};
+
+namespace snapshot_detail {
+
+constexpr char MAGIC[8] = {'D', 'H', 'T', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t SECTION_HEADER_SIZE = 24;
+
+inline size_t padded(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+// Corruption check, not a cryptographic hash: 8 bytes per multiply-rotate step
+inline uint64_t checksum(const char* data, size_t size) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+    auto mix = [&h](uint64_t word) {
+        h ^= word * 0xff51afd7ed558ccdULL;
+        h = ((h << 27) | (h >> 37)) * 0xc4ceb9fe1a85ec53ULL;
+    };
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        mix(word);
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, size - i);
+        mix(word);
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+} // namespace snapshot_detail
+
+/**
+ * Assembles a snapshot in memory, one section at a time
+ */
+class SnapshotBuilder {
+public:
+    SnapshotBuilder() : m_section_start(0), m_sections(0), m_open(false) {
+        m_data.resize(snapshot_detail::HEADER_SIZE);
+    }
+
+    void begin_section(SnapshotSection type) {
+        end_section();
+        m_section_start = m_data.size();
+        m_data.resize(m_data.size() + snapshot_detail::SECTION_HEADER_SIZE);
+        uint32_t raw = static_cast<uint32_t>(type);
+        std::memcpy(&m_data[m_section_start], &raw, sizeof(raw));
+        m_open = true;
+    }
+
+    void put_u8(uint8_t value) { m_data.push_back(static_cast<char>(value)); }
+    void put_u32(uint32_t value) { snapshot_detail::put(m_data, value); }
+    void put_i32(int32_t value) { snapshot_detail::put(m_data, value); }
+    void put_u64(uint64_t value) { snapshot_detail::put(m_data, value); }
+    void put_bytes(const void* data, size_t size) { m_data.append(static_cast<const char*>(data), size); }
+
+    // Length-prefixed (u32) string
+    void put_string(const std::string& value) {
+        put_u32(static_cast<uint32_t>(value.size()));
+        m_data.append(value);
+    }
+
+    /**
+     * Close the last section and return the complete file contents
+     */
+    std::string finish() {
+        end_section();
+        char* header = &m_data[0];
+        uint64_t created = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+        uint32_t zero = 0;
+        std::memcpy(header, snapshot_detail::MAGIC, 8);
+        std::memcpy(header + 8, &snapshot_detail::VERSION, 4);
+        std::memcpy(header + 12, &snapshot_detail::BYTE_ORDER_MARK, 4);
+        std::memcpy(header + 16, &created, 8);
+        std::memcpy(header + 24, &m_sections, 4);
+        std::memcpy(header + 28, &zero, 4);
+        return std::move(m_data);
+    }
+
+    size_t size() const { return m_data.size(); }
+
+private:
+    void end_section() {
+        if (!m_open) return;
+        size_t payload = m_section_start + snapshot_detail::SECTION_HEADER_SIZE;
+        uint64_t size = m_data.size() - payload;
+        uint64_t sum = snapshot_detail::checksum(m_data.data() + payload, size);
+        uint32_t zero = 0;
+        std::memcpy(&m_data[m_section_start + 4], &zero, 4);
+        std::memcpy(&m_data[m_section_start + 8], &size, 8);
+        std::memcpy(&m_data[m_section_start + 16], &sum, 8);
+        m_data.resize(snapshot_detail::padded(m_data.size()), '\0');
+        m_sections++;
+        m_open = false;
+    }
+
+    std::string m_data;
+    size_t m_section_start;
+    uint32_t m_sections;
+    bool m_open;
+};
+
+/**
+ * Bounds-checked reader over one section's payload. Once a read runs past
+ * the end, ok() stays false and every further read returns zeros.
+ */
+class SnapshotCursor {
+public:
+    SnapshotCursor() : m_pos(nullptr), m_end(nullptr), m_ok(false) {}
+    SnapshotCursor(const char* data, size_t size) : m_pos(data), m_end(data + size), m_ok(true) {}
+
+    uint8_t get_u8() { uint8_t value = 0; get_bytes(&value, 1); return value; }
+    uint32_t get_u32() { uint32_t value = 0; get_bytes(&value, 4); return value; }
+    int32_t get_i32() { int32_t value = 0; get_bytes(&value, 4); return value; }
+    uint64_t get_u64() { uint64_t value = 0; get_bytes(&value, 8); return value; }
+
+    bool get_bytes(void* out, size_t size) {
+        if (!m_ok || remaining() < size) {
+            m_ok = false;
+            return false;
+        }
+        std::memcpy(out, m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    std::string get_string() {
+        uint32_t size = get_u32();
+        if (!m_ok || remaining() < size) {
+            m_ok = false;
+            return std::string();
+        }
+        std::string value(m_pos, size);
+        m_pos += size;
+        return value;
+    }
+
+    /**
+     * Skip size bytes and return where they start (nullptr past the end),
+     * for reading large blocks straight from the mapping
+     */
+    const char* take(size_t size) {
+        if (!m_ok || remaining() < size) {
+            m_ok = false;
+            return nullptr;
+        }
+        const char* start = m_pos;
+        m_pos += size;
+        return start;
+    }
+
+    const char* data() const { return m_pos; }
+    size_t remaining() const { return static_cast<size_t>(m_end - m_pos); }
+    bool at_end() const { return m_pos == m_end; }
+    bool ok() const { return m_ok; }
+
+private:
+    const char* m_pos;
+    const char* m_end;
+    bool m_ok;
+};
+
+/**
+ * A verified, memory-mapped snapshot file
+ */
+class CrawlSnapshot {
+public:
+    ~CrawlSnapshot() {
+        if (m_map) {
+            munmap(m_map, m_size);
+        }
+    }
+
+    CrawlSnapshot(const CrawlSnapshot&) = delete;
+    CrawlSnapshot& operator=(const CrawlSnapshot&) = delete;
+
+    /**
+     * Map and verify path
+     * @return nullptr (and error set) if the file is missing, truncated,
+     *         from an incompatible build, or fails a checksum
+     */
+    static std::unique_ptr<CrawlSnapshot> open(const std::string& path, std::string& error) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = std::string("cannot open: ") + std::strerror(errno);
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(snapshot_detail::HEADER_SIZE)) {
+            ::close(fd);
+            error = "file too small";
+            return nullptr;
+        }
+
+        size_t size = static_cast<size_t>(st.st_size);
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            error = std::string("mmap failed: ") + std::strerror(errno);
+            return nullptr;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+
+        std::unique_ptr<CrawlSnapshot> snapshot(new CrawlSnapshot(map, size));
+        if (!snapshot->verify(error)) {
+            return nullptr;
+        }
+        return snapshot;
+    }
+
+    bool has(SnapshotSection type) const {
+        return find(type) != nullptr;
+    }
+
+    /**
+     * Cursor over a section's payload (not ok() if the section is absent)
+     */
+    SnapshotCursor section(SnapshotSection type) const {
+        const Section* found = find(type);
+        return found ? SnapshotCursor(found->data, found->size) : SnapshotCursor();
+    }
+
+    std::chrono::system_clock::time_point created() const { return m_created; }
+    size_t size() const { return m_size; }
+
+private:
+    struct Section {
+        SnapshotSection type;
+        const char* data;
+        size_t size;
+    };
+
+    CrawlSnapshot(void* map, size_t size) : m_map(map), m_size(size) {}
+
+    bool verify(std::string& error) {
+        const char* base = static_cast<const char*>(m_map);
+        uint32_t version, byte_order, count;
+        uint64_t created;
+        std::memcpy(&version, base + 8, 4);
+        std::memcpy(&byte_order, base + 12, 4);
+        std::memcpy(&created, base + 16, 8);
+        std::memcpy(&count, base + 24, 4);
+
+        if (std::memcmp(base, snapshot_detail::MAGIC, 8) != 0) {
+            error = "not a crawl snapshot";
+            return false;
+        }
+        if (version != snapshot_detail::VERSION || byte_order != snapshot_detail::BYTE_ORDER_MARK) {
+            error = "unsupported snapshot version or byte order";
+            return false;
+        }
+        m_created = std::chrono::system_clock::time_point(std::chrono::seconds(created));
+
+        size_t offset = snapshot_detail::HEADER_SIZE;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (m_size - offset < snapshot_detail::SECTION_HEADER_SIZE) {
+                error = "truncated section header";
+                return false;
+            }
+            uint32_t type;
+            uint64_t size, sum;
+            std::memcpy(&type, base + offset, 4);
+            std::memcpy(&size, base + offset + 8, 8);
+            std::memcpy(&sum, base + offset + 16, 8);
+            offset += snapshot_detail::SECTION_HEADER_SIZE;
+
+            if (size > m_size - offset) {
+                error = "truncated section " + std::to_string(type);
+                return false;
+            }
+            if (snapshot_detail::checksum(base + offset, size) != sum) {
+                error = "checksum mismatch in section " + std::to_string(type);
+                return false;
+            }
+            m_sections.push_back(Section{static_cast<SnapshotSection>(type), base + offset, static_cast<size_t>(size)});
+            offset = std::min(m_size, offset + snapshot_detail::padded(size));
+        }
+        return true;
+    }
+
+    const Section* find(SnapshotSection type) const {
+        for (const auto& section : m_sections) {
+            if (section.type == type) return &section;
+        }
+        return nullptr;
+    }
+
+    void* m_map;
+    size_t m_size;
+    std::chrono::system_clock::time_point m_created;
+    std::vector<Section> m_sections;
+};
+
+/**
+ * Writes snapshots atomically, optionally on a background thread that also
+ * builds them, so the caller waits for neither serialization nor the disk
+ */
+class SnapshotWriter {
+public:
+    using Builder = std::function<std::string()>;
+
+    SnapshotWriter(const std::string& path, std::function<void(const std::string&)> log_callback = nullptr)
+        : m_path(path)
+        , m_log_callback(log_callback)
+        , m_busy(false)
+        , m_written(0)
+        , m_skipped(0)
+        , m_failures(0)
+        , m_last_bytes(0)
+        , m_last_build_ms(0)
+        , m_last_write_ms(0) {}
+
+    ~SnapshotWriter() {
+        wait();
+    }
+
+    /**
+     * Build a snapshot and write it, both in the background. build runs on
+     * the writer thread, so it must read shared state under that state's
+     * own locks.
+     * @return false (and build is not called) if the previous snapshot is
+     *         still being built or written
+     */
+    bool write_async(Builder build) {
+        std::lock_guard<std::mutex> lock(m_thread_mutex);
+        if (m_busy) {
+            m_skipped++;
+            return false;
+        }
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_busy = true;
+        m_thread = std::thread([this, build = std::move(build)]() {
+            try {
+                auto start = std::chrono::steady_clock::now();
+                std::string data = build();
+                m_last_build_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+                write_file(data);
+            } catch (const std::exception& e) {
+                fail(std::string("building snapshot failed: ") + e.what());
+            }
+            m_busy = false;
+        });
+        return true;
+    }
+
+    /**
+     * Write data now, after any background write finishes
+     */
+    bool write(const std::string& data) {
+        wait();
+        return write_file(data);
+    }
+
+    void wait() {
+        std::lock_guard<std::mutex> lock(m_thread_mutex);
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    const std::string& path() const { return m_path; }
+
+    void print_statistics() const {
+        std::cout << "=== Crawl Snapshot Statistics ===" << std::endl;
+        std::cout << "Snapshots written: " << m_written.load() << " (failed: " << m_failures.load()
+                  << ", skipped while busy: " << m_skipped.load() << ")" << std::endl;
+        std::cout << "Last snapshot: " << (m_last_bytes.load() / 1024) << " KB, built in "
+                  << m_last_build_ms.load() << "ms, written in " << m_last_write_ms.load() << "ms" << std::endl;
+        std::cout << "=================================" << std::endl;
+    }
+
+private:
+    bool write_file(const std::string& data) {
+        auto start = std::chrono::steady_clock::now();
+        std::string tmp_path = m_path + ".tmp";
+
+        int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return fail("cannot create " + tmp_path + ": " + std::strerror(errno));
+        }
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::string reason = std::strerror(errno);
+                ::close(fd);
+                ::unlink(tmp_path.c_str());
+                return fail("write to " + tmp_path + " failed: " + reason);
+            }
+            written += static_cast<size_t>(n);
+        }
+        if (fsync(fd) != 0) {
+            std::string reason = std::strerror(errno);
+            ::close(fd);
+            ::unlink(tmp_path.c_str());
+            return fail("fsync of " + tmp_path + " failed: " + reason);
+        }
+        ::close(fd);
+
+        if (std::rename(tmp_path.c_str(), m_path.c_str()) != 0) {
+            std::string reason = std::strerror(errno);
+            ::unlink(tmp_path.c_str());
+            return fail("rename to " + m_path + " failed: " + reason);
+        }
+        sync_directory();
+
+        m_written++;
+        m_last_bytes = data.size();
+        m_last_write_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        return true;
+    }
+
+    // Make the rename itself durable
+    void sync_directory() {
+        size_t slash = m_path.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : m_path.substr(0, slash));
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    bool fail(const std::string& message) {
+        m_failures++;
+        log(message);
+        return false;
+    }
+
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[SnapshotWriter] " + message);
+        }
+    }
+
+    std::string m_path;
+    std::function<void(const std::string&)> m_log_callback;
+
+    std::mutex m_thread_mutex;
+    std::thread m_thread;
+    std::atomic<bool> m_busy;
+
+    std::atomic<uint64_t> m_written;
+    std::atomic<uint64_t> m_skipped;
+    std::atomic<uint64_t> m_failures;
+    std::atomic<size_t> m_last_bytes;
+    std::atomic<uint64_t> m_last_build_ms;   // Background builds only
+    std::atomic<uint64_t> m_last_write_ms;
+};
+
+} // namespace dht_crawler
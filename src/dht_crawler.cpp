@@ -9,6 +9,7 @@
 #include <vector>
 #include <memory>
 #include <cstring>
+#include <cstdio>
 #include <signal.h>
 #include <atomic>
 #include <fstream>
@@ -18,6 +19,7 @@
 #include <ctime>
 #include <unistd.h>
 #include <functional>
+#include <mutex>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -36,6 +38,7 @@
 #ifndef DISABLE_MYSQL
 // MySQL includes
 #include <mysql/mysql.h>
+#include <mysql/mysqld_error.h>
 #endif
 
 // Enhanced metadata transfer extension
@@ -44,6 +47,24 @@
 #include "bep51_dht_indexer.hpp"
 #include "smart_dht_crawler.hpp"
 #include "metadata_worker_pool.hpp"
+#include "info_hash.hpp"
+#include "discovery_store.hpp"
+#include "query_dedup_filter.hpp"
+#include "alert_dispatcher.hpp"
+#include "ingest_pipeline.hpp"
+#include "write_behind_writer.hpp"
+#include "prepared_statement.hpp"
+#include "chunked_transaction.hpp"
+#include "backlog_reader.hpp"
+#include "error_log_sink.hpp"
+#include "crawl_snapshot.hpp"
+#include "peer_endpoint.hpp"
+#include "segment_store.hpp"
+#include "hash_list_reader.hpp"
+#include "session_shard.hpp"
+#include "metadata_session.hpp"
+#include "torrent_handle_registry.hpp"
+#include "info_dict_capture.hpp"
 
 // New enhanced components from magnetico upgrade - temporarily disabled for initial build
 // #include "metadata_validator.hpp"
@@ -75,7 +96,7 @@ struct DiscoveredTorrent {
     std::string name;
     size_t size;
     int num_files;
-    std::vector<std::string> peers;
+    dht_crawler::PeerEndpointList peer_endpoints; // Packed endpoints from get_peers replies, written to discovered_peers
     std::vector<std::string> file_names;
     std::vector<size_t> file_sizes;
     std::string comment;
@@ -102,20 +123,173 @@ struct DiscoveredTorrent {
     bool timed_out;
 };
 
+// Repeat DHT sighting of an info-hash. Written with a differential upsert
+// that only inserts a placeholder row for new hashes and otherwise bumps
+// last_seen_at and sighting_count, so stored metadata is never touched.
+struct TorrentSighting {
+    std::string info_hash;
+    std::string name; // Placeholder name if this creates the row
+    std::string source;
+    uint32_t sightings = 1; // Sightings coalesced into this row
+    dht_crawler::PeerEndpointList peer_endpoints; // Written to discovered_peers
+};
+
 struct MySQLConfig {
     std::string server;
     std::string user;
     std::string password;
     std::string database;
     int port = 3306;
-    std::string metadata_hashes = ""; // Comma-delimited hashes for metadata-only mode
+    std::string metadata_hashes = ""; // Comma-delimited hashes, a .txt/.csv file or "-" (stdin) for metadata-only mode
+    std::string metadata_checkpoint = ""; // --metadata progress file (empty: "<file>.progress" for hash files)
     bool metadata_database_mode = false; // Enable metadata-database mode
     bool debug_mode = false; // Enable debug logging
     bool verbose_mode = false; // Enable verbose output (default is counter mode)
     bool metadata_log_mode = false; // Enable metadata-only logging (suppress all other logs)
     bool concurrent_mode = true; // Enable concurrent DHT worker pool
     int num_workers = 4; // Number of concurrent workers
+    size_t session_shards = 1; // DHT sessions on ports 6881.., each crawling its own slice of the keyspace
+    bool metadata_session = false; // Fetch metadata in a separate session with its own alert thread
+    size_t max_torrent_handles = 1200; // Hard cap on live metadata torrents; the oldest is removed past it
+    std::string torrent_archive_dir = ""; // Keep fetched info dicts as compressed .torrent files here (empty = off)
     bool bep51_mode = true; // Enable BEP51 DHT infohash indexing
+    size_t discovery_memory_mb = 64; // Memory budget for the in-memory discovery store
+    int discovery_ttl_hours = 6; // Drop discovered hashes not seen for this long
+    dht_crawler::QueryDedupMode query_dedup_mode = dht_crawler::QueryDedupMode::ROTATING; // Dedup for generated query targets
+    size_t query_dedup_mb = 4; // Memory for the query dedup filter
+    size_t db_batch_rows = 500; // Max rows per batched discovered_torrents upsert
+    int db_flush_ms = 200; // Max time a sighting waits in the write-behind buffer
+    size_t db_buffer_mb = 32; // Write-behind buffer size before the storage stage blocks
+    size_t db_writers = 4; // Writer threads / pooled connections, sharded by info-hash prefix
+    size_t backlog_window = 1000; // Metadata requests kept in flight (--metadata, --metadata_database, discovery)
+    bool peer_load_data = false; // Bulk-load large peer batches with LOAD DATA LOCAL INFILE
+    size_t peer_load_data_min_rows = 1000; // Smallest peer batch worth a LOAD DATA round trip
+    size_t torrent_files_max = 10000; // Files written to torrent_files per torrent; larger torrents are summarized
+    bool file_text_columns = true; // Also write the denormalized file_names/file_sizes TEXT columns
+    std::string error_log_file = "dht_crawler_errors.log"; // Error log fallback while MySQL is unavailable
+    std::string state_file = ""; // Crawl state snapshot path (empty: snapshots disabled)
+    int state_interval_seconds = 60; // Time between crawl state snapshots
+    std::string storage_backend = "mysql"; // Where crawl results go: mysql, local or null
+    std::string storage_dir = "dht_store"; // Segment store directory for --storage local
+    size_t storage_segment_mb = 64; // Segment file size for --storage local
+};
+
+/**
+ * Destination for crawl results. Sighting batches come from the
+ * write-behind writer threads, at most one call per shard at a time;
+ * metadata and timeouts come from the alert thread.
+ */
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    virtual const char* name() const = 0;
+
+    // False when results are being dropped
+    virtual bool isStoring() const = 0;
+
+    virtual bool storeSightingBatch(size_t shard, std::vector<TorrentSighting>& rows) = 0;
+    virtual bool storeTorrent(const DiscoveredTorrent& torrent) = 0;
+    virtual bool markTorrentTimedOut(const std::string& info_hash) = 0;
+
+    // Whether storeTorrent() keeps file and tracker lists, so they are
+    // only extracted from the info dict when they will be written
+    virtual bool storesFileDetails() const { return false; }
+
+    // Alert thread timer: reconnects, keepalives
+    virtual void checkHealth() {}
+    virtual void printStatistics() const {}
+};
+
+/**
+ * Counts and drops everything (--storage null, or MySQL unreachable)
+ */
+class NullStorageBackend : public StorageBackend {
+public:
+    const char* name() const override { return "null"; }
+    bool isStoring() const override { return false; }
+
+    bool storeSightingBatch(size_t, std::vector<TorrentSighting>& rows) override {
+        m_sightings_dropped += rows.size();
+        return true;
+    }
+
+    bool storeTorrent(const DiscoveredTorrent&) override {
+        m_torrents_dropped++;
+        return false;
+    }
+
+    bool markTorrentTimedOut(const std::string&) override {
+        return false;
+    }
+
+    void printStatistics() const override {
+        std::cout << "=== Null Storage ===" << std::endl;
+        std::cout << "Sightings dropped: " << m_sightings_dropped.load() << std::endl;
+        std::cout << "Torrents dropped: " << m_torrents_dropped.load() << std::endl;
+        std::cout << "====================" << std::endl;
+    }
+
+private:
+    std::atomic<uint64_t> m_sightings_dropped{0};
+    std::atomic<uint64_t> m_torrents_dropped{0};
+};
+
+/**
+ * Embedded segment store (--storage local), for nodes without a database.
+ * Keeps sighting counts and the fixed metadata fields per info-hash; peer
+ * endpoints and file lists are not kept.
+ */
+class LocalStorageBackend : public StorageBackend {
+public:
+    LocalStorageBackend(const MySQLConfig& config, std::function<void(const std::string&)> log_callback)
+        : m_store(makeStoreConfig(config), log_callback) {}
+
+    bool open(std::string& error) {
+        return m_store.open(error);
+    }
+
+    const char* name() const override { return "local"; }
+    bool isStoring() const override { return true; }
+
+    bool storeSightingBatch(size_t, std::vector<TorrentSighting>& rows) override {
+        for (const auto& row : rows) {
+            dht_crawler::InfoHash hash;
+            if (!dht_crawler::InfoHash::from_hex(row.info_hash, hash)) continue;
+            m_store.record_sighting(hash, static_cast<uint8_t>(dht_crawler::source_from_name(row.source)),
+                                    row.sightings, static_cast<uint32_t>(row.peer_endpoints.size()));
+        }
+        return m_store.flush();
+    }
+
+    bool storeTorrent(const DiscoveredTorrent& torrent) override {
+        dht_crawler::InfoHash hash;
+        if (!dht_crawler::InfoHash::from_hex(torrent.info_hash, hash)) return false;
+        m_store.record_metadata(hash, torrent.name, torrent.size, static_cast<uint32_t>(torrent.num_files),
+                                static_cast<int64_t>(torrent.creation_date));
+        return true;
+    }
+
+    bool markTorrentTimedOut(const std::string& info_hash) override {
+        dht_crawler::InfoHash hash;
+        if (!dht_crawler::InfoHash::from_hex(info_hash, hash)) return false;
+        m_store.mark_timed_out(hash);
+        return true;
+    }
+
+    void printStatistics() const override {
+        m_store.print_statistics();
+    }
+
+private:
+    static dht_crawler::SegmentStoreConfig makeStoreConfig(const MySQLConfig& config) {
+        dht_crawler::SegmentStoreConfig store_config;
+        store_config.directory = config.storage_dir;
+        store_config.segment_bytes = config.storage_segment_mb * 1024 * 1024;
+        return store_config;
+    }
+
+    dht_crawler::SegmentStore m_store;
 };
 
 #ifndef DISABLE_MYSQL
@@ -123,20 +297,74 @@ class MySQLConnection {
 private:
     MYSQL* m_connection;
     MySQLConfig m_config;
-    bool m_connected;
+    std::atomic<bool> m_connected;
+    std::atomic<uint64_t> m_reconnects;
+    std::chrono::steady_clock::time_point m_last_reconnect_attempt;
+    // Serializes use of m_connection between the storage stage and the alert
+    // thread; recursive because every query path can call logError()
+    mutable std::recursive_mutex m_mutex;
+
+    // Prepared once per connection on first use; values are bound in binary
+    // form, so these paths never escape or rebuild SQL text
+    dht_crawler::PreparedStatement m_store_torrent_stmt;
+    dht_crawler::BatchStatementCache m_sighting_upserts;
+    dht_crawler::BatchStatementCache m_peer_inserts;
+    dht_crawler::BatchStatementCache m_file_upserts;
+    dht_crawler::PreparedStatement m_mark_timed_out_stmt;
+    dht_crawler::PreparedStatement m_update_metadata_stmt;
+    dht_crawler::PreparedStatement m_log_error_stmt;
+
+    // Derived column text for the torrent row; must outlive the execute() it is bound to
+    struct TorrentRowText {
+        std::string file_names;
+        std::string file_sizes;
+        std::string trackers;
+        std::string announce_list;
+        std::string creation_date;
+    };
+    TorrentRowText m_row_text; // Reused across storeTorrent() calls
+    std::vector<std::string> m_peer_addresses; // Bound address text, one per peer row
+    std::vector<std::string> m_file_paths; // Bound file_path text, one per file row
+
+    // When set, logError() hands records to the sink instead of writing them
+    std::shared_ptr<dht_crawler::ErrorLogSink> m_error_sink;
 
 public:
-    MySQLConnection(const MySQLConfig& config) : m_config(config), m_connected(false) {
+    MySQLConnection(const MySQLConfig& config)
+        : m_config(config), m_connected(false), m_reconnects(0),
+          m_store_torrent_stmt(buildTorrentUpsertSql()),
+          m_sighting_upserts(SIGHTING_BATCH_ROWS, buildSightingUpsertSql),
+          m_peer_inserts(PEER_BATCH_ROWS, buildPeerInsertSql),
+          m_file_upserts(FILE_BATCH_ROWS, buildFileUpsertSql),
+          m_mark_timed_out_stmt("UPDATE discovered_torrents SET timed_out = TRUE WHERE info_hash = ?"),
+          m_update_metadata_stmt("UPDATE discovered_torrents SET "
+                                 "name = ?, size = ?, num_files = ?, file_names = ?, file_sizes = ?, "
+                                 "comment = ?, created_by = ?, creation_date = FROM_UNIXTIME(?), encoding = ?, "
+                                 "piece_length = ?, num_pieces = ?, trackers = ?, private_torrent = ?, "
+                                 "content_type = ?, language = ?, category = ?, "
+                                 "metadata_received = TRUE, timed_out = FALSE, updated_at = CURRENT_TIMESTAMP "
+                                 "WHERE info_hash = ?"),
+          m_log_error_stmt("INSERT INTO log ("
+                           "function_name, caller_function, error_code, error_message, "
+                           "stack_trace, severity, thread_id, process_id, additional_data, "
+                           "occurrences, timestamp"
+                           ") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, FROM_UNIXTIME(?))") {
         m_connection = mysql_init(nullptr);
     }
 
     ~MySQLConnection() {
+        closeStatements();
         if (m_connection) {
             mysql_close(m_connection);
         }
     }
 
-    bool connect() {
+    /**
+     * Connect to the server
+     * @param create_tables Create/verify the schema (only needed once per process)
+     */
+    bool connect(bool create_tables = true) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         try {
             if (!m_connection) {
                 std::cerr << "MySQL initialization failed" << std::endl;
@@ -144,6 +372,11 @@ public:
                 return false;
             }
 
+            if (m_config.peer_load_data) {
+                unsigned int local_infile = 1;
+                mysql_options(m_connection, MYSQL_OPT_LOCAL_INFILE, &local_infile);
+            }
+
             if (!mysql_real_connect(m_connection, 
                                    m_config.server.c_str(),
                                    m_config.user.c_str(),
@@ -161,7 +394,9 @@ public:
             std::cout << "Connected to MySQL database: " << m_config.database << std::endl;
             
             // Create tables if they don't exist
-            createTables();
+            if (create_tables) {
+                createTables();
+            }
             return true;
         } catch (const std::exception& e) {
             logException("MySQLConnection::connect", "", e, "server=" + m_config.server + ", database=" + m_config.database);
@@ -170,6 +405,7 @@ public:
     }
 
     void createTables() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         if (!m_connected) return;
 
         // Create enhanced discovered_torrents table
@@ -202,6 +438,7 @@ public:
                 seeders_count INT DEFAULT 0 NULL,
                 leechers_count INT DEFAULT 0 NULL,
                 download_speed BIGINT DEFAULT 0 NULL,
+                sighting_count INT DEFAULT 0 NULL,
                 discovered_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP NULL,
                 last_seen_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP NULL,
                 created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP NULL,
@@ -226,6 +463,9 @@ public:
             std::cout << "Created/verified enhanced discovered_torrents table" << std::endl;
         }
 
+        // Tables created before sighting counts lack the column
+        addColumnIfMissing("discovered_torrents", "sighting_count INT DEFAULT 0 NULL AFTER download_speed");
+
         // Create enhanced discovered_peers table
         std::string createPeersTable = R"(
             CREATE TABLE IF NOT EXISTS discovered_peers (
@@ -294,6 +534,7 @@ public:
                 thread_id VARCHAR(50) NULL,
                 process_id INT NULL,
                 additional_data TEXT NULL,
+                occurrences INT DEFAULT 1 NULL,
                 created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP NULL,
                 INDEX idx_timestamp (timestamp),
                 INDEX idx_function_name (function_name),
@@ -310,184 +551,620 @@ public:
         } else {
             std::cout << "Created/verified log table" << std::endl;
         }
+
+        // Tables created before error aggregation lack the occurrences column
+        addColumnIfMissing("log", "occurrences INT DEFAULT 1 NULL AFTER additional_data");
+    }
+
+    // CREATE TABLE IF NOT EXISTS leaves existing tables alone, so columns
+    // added later are applied here; "duplicate column" means already done
+    void addColumnIfMissing(const std::string& table, const std::string& column_definition) {
+        std::string query = "ALTER TABLE " + table + " ADD COLUMN " + column_definition;
+        if (mysql_query(m_connection, query.c_str()) && mysql_errno(m_connection) != ER_DUP_FIELDNAME) {
+            std::cerr << "Error adding column to " << table << ": " << mysql_error(m_connection) << std::endl;
+        }
     }
 
     bool storeTorrent(const DiscoveredTorrent& torrent) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         try {
             if (!m_connected) {
                 logError("MySQLConnection::storeTorrent", "", -1, "Not connected to database", "", "WARNING");
                 return false;
             }
 
-        // Convert file names to comma-separated string
-        std::string file_names_str;
-        for (size_t i = 0; i < torrent.file_names.size(); ++i) {
-            if (i > 0) file_names_str += ", ";
-            file_names_str += torrent.file_names[i];
+            // Insert or update torrent with all metadata
+            dht_crawler::PreparedStatement& stmt = m_store_torrent_stmt;
+            if (!ensurePrepared(stmt, "MySQLConnection::storeTorrent")) {
+                return false;
+            }
+            bindTorrentRow(stmt, torrent, m_row_text);
+
+            if (!executeStatement(stmt, "MySQLConnection::storeTorrent", "info_hash=" + torrent.info_hash)) {
+                std::cerr << "Error storing torrent: " << stmt.error() << std::endl;
+                return false;
+            }
+
+            storePeers(std::vector<const DiscoveredTorrent*>{&torrent});
+            storeTorrentFiles(torrent);
+            return true;
+        } catch (const std::exception& e) {
+            logException("MySQLConnection::storeTorrent", "", e, "info_hash=" + torrent.info_hash);
+            return false;
         }
+    }
 
-        // Convert file sizes to JSON array
-        std::string file_sizes_str = "[";
-        for (size_t i = 0; i < torrent.file_sizes.size(); ++i) {
-            if (i > 0) file_sizes_str += ", ";
-            file_sizes_str += std::to_string(torrent.file_sizes[i]);
+    /**
+     * Record sightings: new hashes get a placeholder row, known ones only
+     * have last_seen_at and sighting_count bumped. Metadata columns are
+     * never written here; that is storeTorrent()'s job when metadata
+     * arrives. Full chunks of SIGHTING_BATCH_ROWS go through one multi-row
+     * prepared statement, the remainder through the variant of exactly its
+     * size. Rows are written in the order given (callers sort by info_hash).
+     */
+    bool storeSightingBatch(const std::vector<TorrentSighting>& sightings) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        try {
+            if (!m_connected) {
+                logError("MySQLConnection::storeSightingBatch", "", -1, "Not connected to database", "", "WARNING");
+                return false;
+            }
+
+            // One transaction for the whole batch, so a failed chunk or a
+            // dropped connection leaves nothing committed and the caller's
+            // retry of the full batch cannot count a sighting twice
+            return dht_crawler::write_chunked_transaction(transactionHooks(), sightings.size(), SIGHTING_BATCH_ROWS,
+                                                          [&](size_t first, size_t rows) {
+                dht_crawler::PreparedStatement& stmt = m_sighting_upserts.get(rows);
+                if (!ensurePrepared(stmt, "MySQLConnection::storeSightingBatch")) {
+                    return false;
+                }
+                for (size_t i = 0; i < rows; ++i) {
+                    const TorrentSighting& sighting = sightings[first + i];
+                    size_t offset = i * SIGHTING_PARAMS;
+                    stmt.bind_string(offset + 0, sighting.info_hash);
+                    stmt.bind_string(offset + 1, sighting.name);
+                    stmt.bind_string(offset + 2, sighting.source);
+                    stmt.bind_string(offset + 3, sighting.info_hash);
+                    stmt.bind_uint64(offset + 4, sighting.sightings);
+                }
+
+                if (!executeStatement(stmt, "MySQLConnection::storeSightingBatch",
+                                      "rows=" + std::to_string(rows) + ", first_hash=" + sightings[first].info_hash)) {
+                    std::cerr << "Error storing sighting batch: " << stmt.error() << std::endl;
+                    return false;
+                }
+                std::vector<const TorrentSighting*> stored;
+                stored.reserve(rows);
+                for (size_t i = 0; i < rows; ++i) {
+                    stored.push_back(&sightings[first + i]);
+                }
+                return storePeers(stored);
+            });
+        } catch (const std::exception& e) {
+            mysql_query(m_connection, "ROLLBACK");
+            logException("MySQLConnection::storeSightingBatch", "", e, "rows=" + std::to_string(sightings.size()));
+            return false;
+        }
+    }
+
+    bool isConnected() const {
+        return m_connected;
+    }
+
+    /**
+     * Drop the current handle and connect again. Attempts are spaced at
+     * least RECONNECT_INTERVAL apart so a down server is not hammered.
+     */
+    bool reconnect() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (m_reconnects > 0 && now - m_last_reconnect_attempt < RECONNECT_INTERVAL) {
+            return false;
+        }
+        m_last_reconnect_attempt = now;
+        m_reconnects++;
+
+        closeStatements();
+        if (m_connection) {
+            mysql_close(m_connection);
+        }
+        m_connected = false;
+        m_connection = mysql_init(nullptr);
+        return connect(false);
+    }
+
+    /**
+     * Ping the server and reconnect if the connection is gone. Skipped while
+     * another thread holds the connection; that caller will see any failure.
+     */
+    bool checkHealth() {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return m_connected;
+        }
+        if (m_connected && mysql_ping(m_connection) == 0) {
+            return true;
+        }
+        std::cerr << "MySQL connection to " << m_config.server << " lost, reconnecting" << std::endl;
+        return reconnect();
+    }
+
+    uint64_t getReconnectCount() const {
+        return m_reconnects.load();
+    }
+    
+    const MySQLConfig& getConfig() const {
+        return m_config;
+    }
+
+private:
+    static constexpr const char* TORRENT_COLUMNS =
+        "info_hash, name, size, num_files, file_names, file_sizes, "
+        "comment, created_by, creation_date, encoding, piece_length, num_pieces, "
+        "trackers, private_torrent, source, metadata_received, timed_out, magnet_link, "
+        "announce_url, announce_list, content_type, language, category, "
+        "seeders_count, leechers_count, download_speed, last_seen_at";
+
+    // Bound parameters per discovered_torrents row (last_seen_at is CURRENT_TIMESTAMP)
+    static constexpr size_t TORRENT_PARAMS = 26;
+
+    static constexpr const char* TORRENT_UPSERT_CLAUSE =
+        " ON DUPLICATE KEY UPDATE "
+        "name = VALUES(name), "
+        "size = VALUES(size), "
+        "num_files = VALUES(num_files), "
+        "file_names = VALUES(file_names), "
+        "file_sizes = VALUES(file_sizes), "
+        "comment = VALUES(comment), "
+        "created_by = VALUES(created_by), "
+        "creation_date = VALUES(creation_date), "
+        "encoding = VALUES(encoding), "
+        "piece_length = VALUES(piece_length), "
+        "num_pieces = VALUES(num_pieces), "
+        "trackers = VALUES(trackers), "
+        "private_torrent = VALUES(private_torrent), "
+        "metadata_received = VALUES(metadata_received), "
+        "magnet_link = VALUES(magnet_link), "
+        "announce_url = VALUES(announce_url), "
+        "announce_list = VALUES(announce_list), "
+        "content_type = VALUES(content_type), "
+        "language = VALUES(language), "
+        "category = VALUES(category), "
+        "seeders_count = VALUES(seeders_count), "
+        "leechers_count = VALUES(leechers_count), "
+        "download_speed = VALUES(download_speed), "
+        "last_seen_at = CURRENT_TIMESTAMP, "
+        "updated_at = CURRENT_TIMESTAMP";
+
+    // Bound parameters per sighting row and rows per multi-row execution
+    static constexpr size_t SIGHTING_PARAMS = 5;
+    static constexpr size_t SIGHTING_BATCH_ROWS = 100;
+
+    // Only last_seen_at and sighting_count change on a repeat sighting;
+    // updated_at is pinned so it keeps meaning "row content changed"
+    static constexpr const char* SIGHTING_UPSERT_CLAUSE =
+        " ON DUPLICATE KEY UPDATE "
+        "last_seen_at = CURRENT_TIMESTAMP, "
+        "sighting_count = sighting_count + VALUES(sighting_count), "
+        "updated_at = updated_at";
+
+    // Bound parameters and rows per execution for discovered_peers and torrent_files
+    static constexpr size_t PEER_PARAMS = 4;
+    static constexpr size_t PEER_BATCH_ROWS = 100;
+    static constexpr size_t FILE_PARAMS = 4;
+    static constexpr size_t FILE_BATCH_ROWS = 100;
+
+    static constexpr std::chrono::seconds RECONNECT_INTERVAL{5};
+
+    // Explicit transaction statements for write_chunked_transaction()
+    dht_crawler::TransactionHooks transactionHooks() {
+        dht_crawler::TransactionHooks hooks;
+        hooks.begin = [this]() { return runTransactionStatement("START TRANSACTION"); };
+        hooks.commit = [this]() { return runTransactionStatement("COMMIT"); };
+        hooks.rollback = [this]() { mysql_query(m_connection, "ROLLBACK"); };
+        return hooks;
+    }
+
+    bool runTransactionStatement(const char* statement) {
+        if (mysql_query(m_connection, statement) == 0) return true;
+
+        unsigned int error_code = mysql_errno(m_connection);
+        if (error_code == CR_SERVER_GONE_ERROR || error_code == CR_SERVER_LOST) {
+            m_connected = false; // reconnect() re-prepares
         }
-        file_sizes_str += "]";
+        std::cerr << "MySQL error on " << statement << ": " << mysql_error(m_connection) << std::endl;
+        return false;
+    }
+
+    void closeStatements() {
+        // Statements must be closed before the connection they belong to
+        m_store_torrent_stmt.close();
+        m_sighting_upserts.close();
+        m_peer_inserts.close();
+        m_file_upserts.close();
+        m_mark_timed_out_stmt.close();
+        m_update_metadata_stmt.close();
+        m_log_error_stmt.close();
+    }
 
-        // Convert trackers to JSON array
-        std::string trackers_str = "[";
+    static std::string buildTorrentUpsertSql() {
+        std::string sql = std::string("INSERT INTO discovered_torrents (") + TORRENT_COLUMNS + ") VALUES (";
+        for (size_t i = 0; i < TORRENT_PARAMS; ++i) {
+            sql += "?, ";
+        }
+        return sql + "CURRENT_TIMESTAMP)" + TORRENT_UPSERT_CLAUSE;
+    }
+
+    static std::string buildSightingUpsertSql(size_t rows) {
+        std::string sql = "INSERT INTO discovered_torrents (info_hash, name, source, magnet_link, sighting_count, last_seen_at) VALUES ";
+        for (size_t i = 0; i < rows; ++i) {
+            if (i > 0) sql += ", ";
+            sql += "(?, ?, ?, CONCAT('magnet:?xt=urn:btih:', ?), ?, CURRENT_TIMESTAMP)";
+        }
+        return sql + SIGHTING_UPSERT_CLAUSE;
+    }
+
+    static std::string buildPeerInsertSql(size_t rows) {
+        std::string sql = "INSERT IGNORE INTO discovered_peers (torrent_hash, peer_address, peer_port, source) VALUES ";
+        for (size_t i = 0; i < rows; ++i) {
+            if (i > 0) sql += ", ";
+            sql += "(?, ?, ?, ?)";
+        }
+        return sql;
+    }
+
+    static std::string buildFileUpsertSql(size_t rows) {
+        std::string sql = "INSERT INTO torrent_files (torrent_hash, file_index, file_path, file_size) VALUES ";
+        for (size_t i = 0; i < rows; ++i) {
+            if (i > 0) sql += ", ";
+            sql += "(?, ?, ?, ?)";
+        }
+        return sql + " ON DUPLICATE KEY UPDATE file_path = VALUES(file_path), file_size = VALUES(file_size)";
+    }
+
+    static void appendJsonString(std::string& out, const std::string& value) {
+        out += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        out += '"';
+    }
+
+    /**
+     * Bind the parameters of one discovered_torrents row
+     */
+    void bindTorrentRow(dht_crawler::PreparedStatement& stmt, const DiscoveredTorrent& torrent,
+                        TorrentRowText& text) {
+        if (m_config.file_text_columns) {
+            // Convert file names to comma-separated string
+            text.file_names.clear();
+            for (size_t i = 0; i < torrent.file_names.size(); ++i) {
+                if (i > 0) text.file_names += ", ";
+                text.file_names += torrent.file_names[i];
+            }
+
+            // Convert file sizes to JSON array
+            text.file_sizes = "[";
+            for (size_t i = 0; i < torrent.file_sizes.size(); ++i) {
+                if (i > 0) text.file_sizes += ", ";
+                text.file_sizes += std::to_string(torrent.file_sizes[i]);
+            }
+            text.file_sizes += "]";
+        }
+
+        // Convert trackers and announce list to JSON arrays
+        text.trackers = "[";
         for (size_t i = 0; i < torrent.trackers.size(); ++i) {
-            if (i > 0) trackers_str += ", ";
-            trackers_str += "\"" + escapeString(torrent.trackers[i]) + "\"";
+            if (i > 0) text.trackers += ", ";
+            appendJsonString(text.trackers, torrent.trackers[i]);
         }
-        trackers_str += "]";
+        text.trackers += "]";
 
-        // Convert announce list to JSON array
-        std::string announce_list_str = "[";
+        text.announce_list = "[";
         for (size_t i = 0; i < torrent.announce_list.size(); ++i) {
-            if (i > 0) announce_list_str += ", ";
-            announce_list_str += "\"" + escapeString(torrent.announce_list[i]) + "\"";
+            if (i > 0) text.announce_list += ", ";
+            appendJsonString(text.announce_list, torrent.announce_list[i]);
         }
-        announce_list_str += "]";
+        text.announce_list += "]";
 
-        // Format creation date
-        std::string creation_date_str = "NULL";
+        stmt.bind_string(0, torrent.info_hash);
+        stmt.bind_string(1, torrent.name);
+        stmt.bind_uint64(2, torrent.size);
+        stmt.bind_int64(3, torrent.num_files);
+        if (m_config.file_text_columns) {
+            stmt.bind_string(4, text.file_names);
+            stmt.bind_string(5, text.file_sizes);
+        } else {
+            stmt.bind_null(4);
+            stmt.bind_null(5);
+        }
+        stmt.bind_string(6, torrent.comment);
+        stmt.bind_string(7, torrent.created_by);
         if (torrent.creation_date > 0) {
             char buffer[32];
             std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&torrent.creation_date));
-            creation_date_str = "'" + std::string(buffer) + "'";
-        }
-
-        // Insert or update torrent with all metadata
-        std::string query = "INSERT INTO discovered_torrents ("
-                           "info_hash, name, size, num_files, file_names, file_sizes, "
-                           "comment, created_by, creation_date, encoding, piece_length, num_pieces, "
-                           "trackers, private_torrent, source, metadata_received, timed_out, magnet_link, "
-                           "announce_url, announce_list, content_type, language, category, "
-                           "seeders_count, leechers_count, download_speed, last_seen_at"
-                           ") VALUES ("
-                           "'" + escapeString(torrent.info_hash) + "', "
-                           "'" + escapeString(torrent.name) + "', "
-                           + std::to_string(torrent.size) + ", "
-                           + std::to_string(torrent.num_files) + ", "
-                           "'" + escapeString(file_names_str) + "', "
-                           "'" + escapeString(file_sizes_str) + "', "
-                           "'" + escapeString(torrent.comment) + "', "
-                           "'" + escapeString(torrent.created_by) + "', "
-                           + creation_date_str + ", "
-                           "'" + escapeString(torrent.encoding) + "', "
-                           + std::to_string(torrent.piece_length) + ", "
-                           + std::to_string(torrent.num_pieces) + ", "
-                           "'" + escapeString(trackers_str) + "', "
-                           + (torrent.private_torrent ? "TRUE" : "FALSE") + ", "
-                           "'" + escapeString(torrent.source) + "', "
-                           + (torrent.metadata_received ? "TRUE" : "FALSE") + ", "
-                           + (torrent.timed_out ? "TRUE" : "FALSE") + ", "
-                           "'" + escapeString(torrent.magnet_link) + "', "
-                           "'" + escapeString(torrent.announce_url) + "', "
-                           "'" + escapeString(announce_list_str) + "', "
-                           "'" + escapeString(torrent.content_type) + "', "
-                           "'" + escapeString(torrent.language) + "', "
-                           "'" + escapeString(torrent.category) + "', "
-                           + std::to_string(torrent.seeders_count) + ", "
-                           + std::to_string(torrent.leechers_count) + ", "
-                           + std::to_string(torrent.download_speed) + ", "
-                           "CURRENT_TIMESTAMP"
-                           ") ON DUPLICATE KEY UPDATE "
-                           "name = VALUES(name), "
-                           "size = VALUES(size), "
-                           "num_files = VALUES(num_files), "
-                           "file_names = VALUES(file_names), "
-                           "file_sizes = VALUES(file_sizes), "
-                           "comment = VALUES(comment), "
-                           "created_by = VALUES(created_by), "
-                           "creation_date = VALUES(creation_date), "
-                           "encoding = VALUES(encoding), "
-                           "piece_length = VALUES(piece_length), "
-                           "num_pieces = VALUES(num_pieces), "
-                           "trackers = VALUES(trackers), "
-                           "private_torrent = VALUES(private_torrent), "
-                           "metadata_received = VALUES(metadata_received), "
-                           "magnet_link = VALUES(magnet_link), "
-                           "announce_url = VALUES(announce_url), "
-                           "announce_list = VALUES(announce_list), "
-                           "content_type = VALUES(content_type), "
-                           "language = VALUES(language), "
-                           "category = VALUES(category), "
-                           "seeders_count = VALUES(seeders_count), "
-                           "leechers_count = VALUES(leechers_count), "
-                           "download_speed = VALUES(download_speed), "
-                           "last_seen_at = CURRENT_TIMESTAMP, "
-                           "updated_at = CURRENT_TIMESTAMP";
-
-        if (mysql_query(m_connection, query.c_str())) {
-            std::string error_msg = mysql_error(m_connection);
-            std::cerr << "Error storing torrent: " << error_msg << std::endl;
-            logError("MySQLConnection::storeTorrent", "", mysql_errno(m_connection), error_msg, "", "ERROR", 
-                    "info_hash=" + torrent.info_hash);
-            return false;
+            text.creation_date = buffer;
+            stmt.bind_string(8, text.creation_date);
+        } else {
+            stmt.bind_null(8);
         }
+        stmt.bind_string(9, torrent.encoding);
+        stmt.bind_uint64(10, torrent.piece_length);
+        stmt.bind_int64(11, torrent.num_pieces);
+        stmt.bind_string(12, text.trackers);
+        stmt.bind_bool(13, torrent.private_torrent);
+        stmt.bind_string(14, torrent.source);
+        stmt.bind_bool(15, torrent.metadata_received);
+        stmt.bind_bool(16, torrent.timed_out);
+        stmt.bind_string(17, torrent.magnet_link);
+        stmt.bind_string(18, torrent.announce_url);
+        stmt.bind_string(19, text.announce_list);
+        stmt.bind_string(20, torrent.content_type);
+        stmt.bind_string(21, torrent.language);
+        stmt.bind_string(22, torrent.category);
+        stmt.bind_int64(23, torrent.seeders_count);
+        stmt.bind_int64(24, torrent.leechers_count);
+        stmt.bind_uint64(25, torrent.download_speed);
+    }
 
-        // Store peers with enhanced information
-        for (const auto& peer : torrent.peers) {
-            size_t colon_pos = peer.find(':');
-            if (colon_pos != std::string::npos) {
-                std::string address = peer.substr(0, colon_pos);
-                std::string port_str = peer.substr(colon_pos + 1);
-                
-                std::string peerQuery = "INSERT IGNORE INTO discovered_peers (torrent_hash, peer_address, peer_port, source) "
-                                      "VALUES ('" + escapeString(torrent.info_hash) + "', "
-                                      "'" + escapeString(address) + "', "
-                                      + port_str + ", "
-                                      "'" + escapeString(torrent.source) + "')";
-
-                if (mysql_query(m_connection, peerQuery.c_str())) {
-                    std::cerr << "Error storing peer: " << mysql_error(m_connection) << std::endl;
+    /**
+     * Prepare a statement on first use (and again after a lost connection)
+     */
+    bool ensurePrepared(dht_crawler::PreparedStatement& stmt, const std::string& function_name) {
+        if (stmt.is_prepared()) return true;
+        if (stmt.prepare(m_connection)) return true;
+
+        std::cerr << "MySQL error preparing statement: " << stmt.error() << std::endl;
+        if (&stmt != &m_log_error_stmt) {
+            logError(function_name, "", stmt.error_code(), stmt.error(), "", "ERROR", "prepare failed");
+        }
+        return false;
+    }
+
+    bool executeStatement(dht_crawler::PreparedStatement& stmt, const std::string& function_name,
+                          const std::string& additional_data) {
+        if (stmt.execute()) return true;
+
+        if (stmt.connection_lost()) {
+            // Every statement on this handle is gone; reconnect() re-prepares
+            stmt.close();
+            m_connected = false;
+        }
+        logError(function_name, "", stmt.error_code(), stmt.error(), "", "ERROR", additional_data);
+        return false;
+    }
+
+    // Store peers for a run of torrents whose rows already exist (the
+    // discovered_peers foreign key needs them). Peers from all torrents go
+    // into shared multi-row statements, or through LOAD DATA LOCAL INFILE
+    // when enabled and the run is large enough. Row is DiscoveredTorrent or
+    // TorrentSighting (info_hash, source, peer_endpoints). False if any
+    // peer row could not be written.
+    template <typename Row>
+    bool storePeers(const std::vector<const Row*>& torrents) {
+        size_t peer_count = 0;
+        for (const Row* torrent : torrents) {
+            peer_count += torrent->peer_endpoints.size();
+        }
+        if (peer_count == 0) return true;
+
+        if (m_config.peer_load_data && peer_count >= m_config.peer_load_data_min_rows) {
+            if (loadPeersInfile(torrents)) {
+                return true;
+            }
+            std::cerr << "LOAD DATA for peers failed, falling back to INSERT" << std::endl;
+        }
+
+        // Rows are bound in place: hash and source from the torrent, the
+        // formatted address from m_peer_addresses[i]
+        std::vector<std::pair<const Row*, uint16_t>> chunk;
+        chunk.reserve(PEER_BATCH_ROWS);
+        m_peer_addresses.resize(PEER_BATCH_ROWS);
+        bool success = true;
+
+        auto flush = [&]() {
+            if (chunk.empty()) return;
+            dht_crawler::PreparedStatement& stmt = m_peer_inserts.get(chunk.size());
+            if (m_connected && ensurePrepared(stmt, "MySQLConnection::storePeers")) {
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    size_t offset = i * PEER_PARAMS;
+                    stmt.bind_string(offset + 0, chunk[i].first->info_hash);
+                    stmt.bind_string(offset + 1, m_peer_addresses[i]);
+                    stmt.bind_uint64(offset + 2, chunk[i].second);
+                    stmt.bind_string(offset + 3, chunk[i].first->source);
                 }
+                if (!executeStatement(stmt, "MySQLConnection::storePeers",
+                                      "rows=" + std::to_string(chunk.size()) + ", first_hash=" + chunk[0].first->info_hash)) {
+                    std::cerr << "Error storing peers: " << stmt.error() << std::endl;
+                    success = false;
+                }
+            } else {
+                success = false;
             }
+            chunk.clear();
+        };
+
+        char address[INET6_ADDRSTRLEN];
+        for (const Row* torrent : torrents) {
+            torrent->peer_endpoints.for_each([&](const dht_crawler::PeerEndpoint& endpoint) {
+                m_peer_addresses[chunk.size()].assign(address, endpoint.format_address(address));
+                chunk.emplace_back(torrent, endpoint.port());
+                if (chunk.size() == PEER_BATCH_ROWS) {
+                    flush();
+                }
+            });
         }
+        flush();
+        return success;
+    }
 
-        return true;
-        } catch (const std::exception& e) {
-            logException("MySQLConnection::storeTorrent", "", e, "info_hash=" + torrent.info_hash);
-            return false;
+    // torrent_files.file_path is VARCHAR(1000)
+    static constexpr size_t MAX_FILE_PATH_LENGTH = 1000;
+
+    // Index of the summary row written for torrents over torrent_files_max
+    static constexpr int SUMMARY_FILE_INDEX = -1;
+
+    /**
+     * Write one torrent_files row per file in multi-row statements. Torrents
+     * with more than torrent_files_max files keep their largest files plus a
+     * summary row (SUMMARY_FILE_INDEX) carrying the count and total size of
+     * the rest, so a single huge torrent cannot flood the table.
+     */
+    void storeTorrentFiles(const DiscoveredTorrent& torrent) {
+        size_t file_count = std::min(torrent.file_names.size(), torrent.file_sizes.size());
+        if (file_count == 0 || m_config.torrent_files_max == 0) return;
+
+        std::vector<size_t> indices(file_count);
+        for (size_t i = 0; i < file_count; ++i) {
+            indices[i] = i;
+        }
+
+        size_t omitted = 0;
+        uint64_t omitted_bytes = 0;
+        if (file_count > m_config.torrent_files_max) {
+            // Keep the largest files, written in file index order
+            std::nth_element(indices.begin(), indices.begin() + m_config.torrent_files_max, indices.end(),
+                             [&torrent](size_t a, size_t b) { return torrent.file_sizes[a] > torrent.file_sizes[b]; });
+            for (size_t i = m_config.torrent_files_max; i < file_count; ++i) {
+                omitted_bytes += torrent.file_sizes[indices[i]];
+            }
+            omitted = file_count - m_config.torrent_files_max;
+            indices.resize(m_config.torrent_files_max);
+            std::sort(indices.begin(), indices.end());
+        }
+
+        // Paths are bound from m_file_paths[i], so each chunk is executed
+        // before the buffers are refilled
+        std::vector<std::pair<int, uint64_t>> chunk;
+        chunk.reserve(FILE_BATCH_ROWS);
+        m_file_paths.resize(FILE_BATCH_ROWS);
+
+        auto flush = [&]() {
+            if (chunk.empty()) return;
+            dht_crawler::PreparedStatement& stmt = m_file_upserts.get(chunk.size());
+            if (m_connected && ensurePrepared(stmt, "MySQLConnection::storeTorrentFiles")) {
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    size_t offset = i * FILE_PARAMS;
+                    stmt.bind_string(offset + 0, torrent.info_hash);
+                    stmt.bind_int64(offset + 1, chunk[i].first);
+                    stmt.bind_string(offset + 2, m_file_paths[i]);
+                    stmt.bind_uint64(offset + 3, chunk[i].second);
+                }
+                if (!executeStatement(stmt, "MySQLConnection::storeTorrentFiles",
+                                      "info_hash=" + torrent.info_hash + ", rows=" + std::to_string(chunk.size()))) {
+                    std::cerr << "Error storing torrent files: " << stmt.error() << std::endl;
+                }
+            }
+            chunk.clear();
+        };
+
+        auto add_row = [&](int index, const std::string& path, uint64_t size) {
+            m_file_paths[chunk.size()] = truncateUtf8(path, MAX_FILE_PATH_LENGTH);
+            chunk.emplace_back(index, size);
+            if (chunk.size() == FILE_BATCH_ROWS) {
+                flush();
+            }
+        };
+
+        for (size_t index : indices) {
+            add_row(static_cast<int>(index), torrent.file_names[index], torrent.file_sizes[index]);
+        }
+        if (omitted > 0) {
+            add_row(SUMMARY_FILE_INDEX, "[" + std::to_string(omitted) + " more files]", omitted_bytes);
         }
+        flush();
     }
 
-    bool isConnected() const {
-        return m_connected;
+    // Cut to at most max_bytes without splitting a UTF-8 sequence
+    static std::string truncateUtf8(const std::string& str, size_t max_bytes) {
+        if (str.size() <= max_bytes) return str;
+        size_t end = max_bytes;
+        while (end > 0 && (static_cast<unsigned char>(str[end]) & 0xC0) == 0x80) {
+            end--;
+        }
+        return str.substr(0, end);
     }
-    
-    const MySQLConfig& getConfig() const {
-        return m_config;
+
+    // In-memory source for LOAD DATA LOCAL INFILE, so no temp file is needed
+    struct InfileSource {
+        const std::string* data;
+        size_t offset;
+    };
+
+    static int infileInit(void** ptr, const char*, void* userdata) {
+        *ptr = userdata;
+        return 0;
     }
 
-private:
-    std::string escapeString(const std::string& str) {
-        if (!m_connection) return str;
-        
-        char* escaped = new char[str.length() * 2 + 1];
-        mysql_real_escape_string(m_connection, escaped, str.c_str(), str.length());
-        std::string result(escaped);
-        delete[] escaped;
-        return result;
+    static int infileRead(void* ptr, char* buf, unsigned int buf_len) {
+        InfileSource* source = static_cast<InfileSource*>(ptr);
+        size_t n = std::min<size_t>(buf_len, source->data->size() - source->offset);
+        std::memcpy(buf, source->data->data() + source->offset, n);
+        source->offset += n;
+        return static_cast<int>(n);
+    }
+
+    static void infileEnd(void*) {}
+
+    static int infileError(void*, char* error_msg, unsigned int error_msg_len) {
+        std::snprintf(error_msg, error_msg_len, "peer infile buffer error");
+        return 2000; // CR_UNKNOWN_ERROR
+    }
+
+    template <typename Row>
+    bool loadPeersInfile(const std::vector<const Row*>& torrents) {
+        // Tab-separated rows; hashes are hex, addresses are numeric and
+        // sources are fixed names, so no field escaping is required
+        std::string data;
+        char address[INET6_ADDRSTRLEN];
+        for (const Row* torrent : torrents) {
+            torrent->peer_endpoints.for_each([&](const dht_crawler::PeerEndpoint& endpoint) {
+                data += torrent->info_hash;
+                data += '\t';
+                data.append(address, endpoint.format_address(address));
+                data += '\t';
+                data += std::to_string(endpoint.port());
+                data += '\t';
+                data += torrent->source;
+                data += '\n';
+            });
+        }
+
+        InfileSource source{&data, 0};
+        mysql_set_local_infile_handler(m_connection, infileInit, infileRead, infileEnd, infileError, &source);
+        int result = mysql_query(m_connection,
+            "LOAD DATA LOCAL INFILE 'discovered_peers' IGNORE INTO TABLE discovered_peers "
+            "FIELDS TERMINATED BY '\\t' LINES TERMINATED BY '\\n' "
+            "(torrent_hash, peer_address, peer_port, source)");
+        mysql_set_local_infile_default(m_connection);
+
+        if (result) {
+            std::string error_msg = mysql_error(m_connection);
+            logError("MySQLConnection::loadPeersInfile", "", mysql_errno(m_connection), error_msg, "", "WARNING",
+                    "bytes=" + std::to_string(data.size()));
+            return false;
+        }
+        return true;
     }
 
 public:
     bool markTorrentTimedOut(const std::string& info_hash) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         try {
             if (!m_connected) {
                 logError("MySQLConnection::markTorrentTimedOut", "", -1, "Not connected to database", "", "WARNING");
                 return false;
             }
 
-            std::string query = "UPDATE discovered_torrents SET timed_out = TRUE WHERE info_hash = '" + escapeString(info_hash) + "'";
+            if (!ensurePrepared(m_mark_timed_out_stmt, "MySQLConnection::markTorrentTimedOut")) {
+                return false;
+            }
+            m_mark_timed_out_stmt.bind_string(0, info_hash);
             
-            if (mysql_query(m_connection, query.c_str())) {
-                std::string error_msg = mysql_error(m_connection);
-                std::cerr << "MySQL error updating timed_out: " << error_msg << std::endl;
-                logError("MySQLConnection::markTorrentTimedOut", "", mysql_errno(m_connection), error_msg, "", "ERROR", 
-                        "info_hash=" + info_hash);
+            if (!executeStatement(m_mark_timed_out_stmt, "MySQLConnection::markTorrentTimedOut", "info_hash=" + info_hash)) {
+                std::cerr << "MySQL error updating timed_out: " << m_mark_timed_out_stmt.error() << std::endl;
                 return false;
             }
             
@@ -498,6 +1175,10 @@ public:
         }
     }
 
+    void setErrorSink(std::shared_ptr<dht_crawler::ErrorLogSink> sink) {
+        m_error_sink = sink;
+    }
+
     // Error logging functionality
     bool logError(const std::string& function_name, 
                   const std::string& caller_function = "",
@@ -506,34 +1187,70 @@ public:
                   const std::string& stack_trace = "",
                   const std::string& severity = "ERROR",
                   const std::string& additional_data = "") {
-        if (!m_connected) return false;
+        dht_crawler::ErrorLogEntry entry;
+        entry.function_name = function_name;
+        entry.caller_function = caller_function;
+        entry.error_code = error_code;
+        entry.error_message = error_message;
+        entry.stack_trace = stack_trace;
+        entry.severity = severity;
+        entry.thread_id = std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        entry.process_id = getpid();
+        entry.additional_data = additional_data;
 
-        // Get thread ID
-        std::string thread_id = std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
-        
-        // Get process ID
-        int process_id = getpid();
+        // Never touches this connection, so failing queries do not cause
+        // a second failing INSERT each
+        if (m_error_sink) {
+            m_error_sink->submit(std::move(entry));
+            return true;
+        }
 
-        std::string query = "INSERT INTO log ("
-                           "function_name, caller_function, error_code, error_message, "
-                           "stack_trace, severity, thread_id, process_id, additional_data"
-                           ") VALUES ("
-                           "'" + escapeString(function_name) + "', "
-                           "'" + escapeString(caller_function) + "', "
-                           + std::to_string(error_code) + ", "
-                           "'" + escapeString(error_message) + "', "
-                           "'" + escapeString(stack_trace) + "', "
-                           "'" + escapeString(severity) + "', "
-                           "'" + escapeString(thread_id) + "', "
-                           + std::to_string(process_id) + ", "
-                           "'" + escapeString(additional_data) + "'"
-                           ")";
-
-        if (mysql_query(m_connection, query.c_str())) {
-            std::cerr << "MySQL error logging error: " << mysql_error(m_connection) << std::endl;
+        entry.first_seen = entry.last_seen = std::chrono::system_clock::now();
+        return writeErrorLog({entry});
+    }
+
+    /**
+     * Insert aggregated error rows in one transaction (the ErrorLogSink
+     * write function). Errors here are not logged, to avoid recursion.
+     */
+    bool writeErrorLog(const std::vector<dht_crawler::ErrorLogEntry>& entries) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (!m_connected || entries.empty()) return m_connected;
+
+        if (!m_log_error_stmt.is_prepared() && !m_log_error_stmt.prepare(m_connection)) {
+            std::cerr << "MySQL error preparing log statement: " << m_log_error_stmt.error() << std::endl;
+            return false;
+        }
+
+        bool transaction = entries.size() > 1 && mysql_query(m_connection, "START TRANSACTION") == 0;
+        for (const auto& entry : entries) {
+            m_log_error_stmt.bind_string(0, entry.function_name);
+            m_log_error_stmt.bind_string(1, entry.caller_function);
+            m_log_error_stmt.bind_int64(2, entry.error_code);
+            m_log_error_stmt.bind_string(3, entry.error_message);
+            m_log_error_stmt.bind_string(4, entry.stack_trace);
+            m_log_error_stmt.bind_string(5, entry.severity);
+            m_log_error_stmt.bind_string(6, entry.thread_id);
+            m_log_error_stmt.bind_int64(7, entry.process_id);
+            m_log_error_stmt.bind_string(8, entry.additional_data);
+            m_log_error_stmt.bind_uint64(9, entry.occurrences);
+            m_log_error_stmt.bind_int64(10, std::chrono::system_clock::to_time_t(entry.first_seen));
+
+            if (!m_log_error_stmt.execute()) {
+                std::cerr << "MySQL error logging error: " << m_log_error_stmt.error() << std::endl;
+                if (m_log_error_stmt.connection_lost()) {
+                    m_log_error_stmt.close();
+                    m_connected = false;
+                } else if (transaction) {
+                    mysql_query(m_connection, "ROLLBACK");
+                }
+                return false;
+            }
+        }
+        if (transaction && mysql_query(m_connection, "COMMIT")) {
+            std::cerr << "MySQL error committing error log: " << mysql_error(m_connection) << std::endl;
             return false;
         }
-        
         return true;
     }
 
@@ -545,47 +1262,54 @@ public:
     }
 
     // Metadata database mode methods
-    std::vector<std::string> getTorrentsWithMissingMetadata(int limit = 100, int offset = 0) {
-        std::vector<std::string> hashes;
+
+    /**
+     * Next page of the missing-metadata backlog using keyset pagination on
+     * the primary key, so each page is an index range scan from after_id
+     */
+    bool getTorrentsWithMissingMetadata(uint64_t after_id, size_t limit, std::vector<dht_crawler::BacklogRow>& rows) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         try {
             if (!m_connected) {
                 logError("MySQLConnection::getTorrentsWithMissingMetadata", "", -1, "Not connected to database", "", "WARNING");
-                return hashes;
+                return false;
             }
 
-            std::string query = "SELECT info_hash FROM discovered_torrents "
-                               "WHERE (num_files < 1 OR num_files IS NULL) AND timed_out = 0 "
-                               "ORDER BY id ASC LIMIT " + std::to_string(limit) + " OFFSET " + std::to_string(offset);
+            std::string query = "SELECT id, info_hash FROM discovered_torrents "
+                               "WHERE id > " + std::to_string(after_id) + " "
+                               "AND (num_files < 1 OR num_files IS NULL) AND timed_out = 0 "
+                               "ORDER BY id ASC LIMIT " + std::to_string(limit);
 
             if (mysql_query(m_connection, query.c_str())) {
                 std::string error_msg = mysql_error(m_connection);
                 logError("MySQLConnection::getTorrentsWithMissingMetadata", "", mysql_errno(m_connection), error_msg, "", "ERROR");
-                return hashes;
+                return false;
             }
 
             MYSQL_RES* result = mysql_store_result(m_connection);
             if (!result) {
                 logError("MySQLConnection::getTorrentsWithMissingMetadata", "", mysql_errno(m_connection), "Failed to store result", "", "ERROR");
-                return hashes;
+                return false;
             }
 
             MYSQL_ROW row;
             while ((row = mysql_fetch_row(result))) {
-                if (row[0]) {
-                    hashes.push_back(std::string(row[0]));
+                if (row[0] && row[1]) {
+                    rows.push_back(dht_crawler::BacklogRow{std::stoull(row[0]), std::string(row[1])});
                 }
             }
 
             mysql_free_result(result);
-            return hashes;
+            return true;
 
         } catch (const std::exception& e) {
             logException("MySQLConnection::getTorrentsWithMissingMetadata", "", e);
-            return hashes;
+            return false;
         }
     }
 
     int getTotalTorrentsWithMissingMetadata() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         try {
             if (!m_connected) {
                 logError("MySQLConnection::getTotalTorrentsWithMissingMetadata", "", -1, "Not connected to database", "", "WARNING");
@@ -623,47 +1347,175 @@ public:
     }
 
     bool updateTorrentMetadata(const std::string& info_hash, const DiscoveredTorrent& torrent) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         try {
             if (!m_connected) {
                 logError("MySQLConnection::updateTorrentMetadata", "", -1, "Not connected to database", "", "WARNING");
                 return false;
             }
 
-            std::string query = "UPDATE discovered_torrents SET "
-                               "name = '" + escapeString(torrent.name) + "', "
-                               "size = " + std::to_string(torrent.size) + ", "
-                               "num_files = " + std::to_string(torrent.num_files) + ", "
-                               "file_names = '" + escapeString(torrent.file_names.empty() ? "" : torrent.file_names[0]) + "', "
-                               "file_sizes = '" + escapeString(torrent.file_sizes.empty() ? "" : std::to_string(torrent.file_sizes[0])) + "', "
-                               "comment = '" + escapeString(torrent.comment) + "', "
-                               "created_by = '" + escapeString(torrent.created_by) + "', "
-                               "creation_date = " + (torrent.creation_date > 0 ? "FROM_UNIXTIME(" + std::to_string(torrent.creation_date) + ")" : "NULL") + ", "
-                               "encoding = '" + escapeString(torrent.encoding) + "', "
-                               "piece_length = " + std::to_string(torrent.piece_length) + ", "
-                               "num_pieces = " + std::to_string(torrent.num_pieces) + ", "
-                               "trackers = '" + escapeString(torrent.trackers.empty() ? "" : torrent.trackers[0]) + "', "
-                               "private_torrent = " + (torrent.private_torrent ? "TRUE" : "FALSE") + ", "
-                               "content_type = '" + escapeString(torrent.content_type) + "', "
-                               "language = '" + escapeString(torrent.language) + "', "
-                               "category = '" + escapeString(torrent.category) + "', "
-                               "metadata_received = TRUE, "
-                               "timed_out = FALSE, "
-                               "updated_at = CURRENT_TIMESTAMP "
-                               "WHERE info_hash = '" + escapeString(info_hash) + "'";
+            if (!ensurePrepared(m_update_metadata_stmt, "MySQLConnection::updateTorrentMetadata")) {
+                return false;
+            }
 
-            if (mysql_query(m_connection, query.c_str())) {
-                std::string error_msg = mysql_error(m_connection);
-                logError("MySQLConnection::updateTorrentMetadata", "", mysql_errno(m_connection), error_msg, "", "ERROR");
+            // Only the first file name, file size and tracker are kept here
+            std::string first_file_name = torrent.file_names.empty() ? "" : torrent.file_names[0];
+            std::string first_file_size = torrent.file_sizes.empty() ? "" : std::to_string(torrent.file_sizes[0]);
+            std::string first_tracker = torrent.trackers.empty() ? "" : torrent.trackers[0];
+
+            dht_crawler::PreparedStatement& stmt = m_update_metadata_stmt;
+            stmt.bind_string(0, torrent.name);
+            stmt.bind_uint64(1, torrent.size);
+            stmt.bind_int64(2, torrent.num_files);
+            if (m_config.file_text_columns) {
+                stmt.bind_string(3, first_file_name);
+                stmt.bind_string(4, first_file_size);
+            } else {
+                stmt.bind_null(3);
+                stmt.bind_null(4);
+            }
+            stmt.bind_string(5, torrent.comment);
+            stmt.bind_string(6, torrent.created_by);
+            if (torrent.creation_date > 0) {
+                stmt.bind_int64(7, torrent.creation_date);
+            } else {
+                stmt.bind_null(7);
+            }
+            stmt.bind_string(8, torrent.encoding);
+            stmt.bind_uint64(9, torrent.piece_length);
+            stmt.bind_int64(10, torrent.num_pieces);
+            stmt.bind_string(11, first_tracker);
+            stmt.bind_bool(12, torrent.private_torrent);
+            stmt.bind_string(13, torrent.content_type);
+            stmt.bind_string(14, torrent.language);
+            stmt.bind_string(15, torrent.category);
+            stmt.bind_string(16, info_hash);
+
+            if (!executeStatement(stmt, "MySQLConnection::updateTorrentMetadata", "info_hash=" + info_hash)) {
                 return false;
             }
 
-            return true;
+            storeTorrentFiles(torrent);
+            return true;
+
+        } catch (const std::exception& e) {
+            logException("MySQLConnection::updateTorrentMetadata", "", e, "info_hash=" + info_hash);
+            return false;
+        }
+    }
+};
+
+/**
+ * Fixed set of MySQL connections for the sharded sighting writers. The
+ * crawler's primary connection stays with the alert thread; each writer
+ * shard owns one pooled connection, so a slow statement on one shard does
+ * not hold up the others, and all writes for a given info-hash go through
+ * the same connection.
+ */
+class MySQLConnectionPool {
+public:
+    MySQLConnectionPool(const MySQLConfig& config, size_t size,
+                        std::shared_ptr<dht_crawler::ErrorLogSink> error_sink = nullptr) {
+        for (size_t i = 0; i < std::max<size_t>(size, 1); ++i) {
+            m_connections.push_back(std::make_unique<MySQLConnection>(config));
+            m_connections.back()->setErrorSink(error_sink);
+        }
+    }
+
+    /**
+     * Connect every pooled connection (the schema is created by the primary)
+     * @return number of connections that came up
+     */
+    size_t connect() {
+        size_t connected = 0;
+        for (auto& connection : m_connections) {
+            if (connection->connect(false)) {
+                connected++;
+            }
+        }
+        return connected;
+    }
+
+    size_t size() const {
+        return m_connections.size();
+    }
+
+    MySQLConnection& connection(size_t index) {
+        return *m_connections[index];
+    }
+
+    // Ping idle connections and reconnect the ones that dropped
+    void checkHealth() {
+        for (auto& connection : m_connections) {
+            connection->checkHealth();
+        }
+    }
+
+    void printStatistics() const {
+        std::cout << "=== MySQL Connection Pool ===" << std::endl;
+        for (size_t i = 0; i < m_connections.size(); ++i) {
+            std::cout << "Connection " << i << ": "
+                      << (m_connections[i]->isConnected() ? "connected" : "disconnected")
+                      << ", reconnects=" << m_connections[i]->getReconnectCount() << std::endl;
+        }
+        std::cout << "=============================" << std::endl;
+    }
+
+private:
+    std::vector<std::unique_ptr<MySQLConnection>> m_connections;
+};
+
+/**
+ * Central MySQL database (--storage mysql). Metadata and timeouts go
+ * through the crawler's primary connection, sighting batches through the
+ * pooled connection of their writer shard.
+ */
+class MySQLStorageBackend : public StorageBackend {
+public:
+    MySQLStorageBackend(MySQLConnection& primary, std::unique_ptr<MySQLConnectionPool> pool)
+        : m_primary(primary), m_pool(std::move(pool)) {}
 
-        } catch (const std::exception& e) {
-            logException("MySQLConnection::updateTorrentMetadata", "", e, "info_hash=" + info_hash);
+    const char* name() const override { return "mysql"; }
+    bool isStoring() const override { return m_primary.isConnected(); }
+    bool storesFileDetails() const override { return true; }
+
+    // Reconnects (and retries once) if the shard's connection dropped. The
+    // batch is one transaction, so the retry resends only uncommitted rows.
+    bool storeSightingBatch(size_t shard, std::vector<TorrentSighting>& rows) override {
+        MySQLConnection& connection = m_pool->connection(shard % m_pool->size());
+        if (!connection.isConnected() && !connection.reconnect()) {
             return false;
         }
+        if (connection.storeSightingBatch(rows)) {
+            return true;
+        }
+        if (!connection.isConnected() && connection.reconnect()) {
+            return connection.storeSightingBatch(rows);
+        }
+        return false;
+    }
+
+    bool storeTorrent(const DiscoveredTorrent& torrent) override {
+        return m_primary.storeTorrent(torrent);
+    }
+
+    bool markTorrentTimedOut(const std::string& info_hash) override {
+        return m_primary.markTorrentTimedOut(info_hash);
+    }
+
+    // Ping idle connections, reconnect dropped ones
+    void checkHealth() override {
+        m_primary.checkHealth();
+        m_pool->checkHealth();
     }
+
+    void printStatistics() const override {
+        m_pool->printStatistics();
+    }
+
+private:
+    MySQLConnection& m_primary;
+    std::unique_ptr<MySQLConnectionPool> m_pool;
 };
 
 #endif // DISABLE_MYSQL
@@ -671,30 +1523,82 @@ public:
 #ifndef DISABLE_LIBTORRENT
 class DHTTorrentCrawler {
 private:
+    // Ingest pipeline payloads
+    enum class SightingKind : uint8_t {
+        PEER_REPLY,
+        ANNOUNCE,
+        IMMUTABLE_ITEM
+    };
+    
+    // Copied out of the alert on the alert thread (alerts die on the next pop)
+    struct SightingEvent {
+        dht_crawler::InfoHash hash;
+        SightingKind kind = SightingKind::PEER_REPLY;
+        std::vector<lt::tcp::endpoint> peers;
+    };
+    
+    struct DecodedSighting {
+        dht_crawler::InfoHash hash;
+        SightingKind kind = SightingKind::PEER_REPLY;
+        TorrentSighting torrent;
+    };
+    
+    struct MetadataJob {
+        std::string info_hash;
+        int priority = 1;
+        std::string source;
+        std::string label;
+    };
+    
     std::unique_ptr<lt::session> m_session;
     std::unique_ptr<MySQLConnection> m_mysql;
-    std::map<std::string, DiscoveredTorrent> m_discovered_torrents;
-    std::set<std::string> m_queried_hashes;
-    std::set<std::string> m_metadata_requested;
+    std::shared_ptr<dht_crawler::ErrorLogSink> m_error_sink;
+    std::unique_ptr<dht_crawler::DiscoveryStore> m_discovery_store;
+    std::shared_ptr<dht_crawler::QueryDedupFilter> m_query_filter;
     std::random_device m_rd;
     std::mt19937 m_gen;
     std::uniform_int_distribution<> m_dis;
     std::atomic<bool> m_running;
     std::atomic<bool> m_shutdown_requested;
     int m_total_queries;
-    int m_torrents_found;
-    int m_peers_found;
-    int m_metadata_fetched;
+    std::atomic<int> m_torrents_found;
+    std::atomic<int> m_peers_found;
+    std::atomic<int> m_metadata_fetched;
     bool m_metadata_only_mode;
-    std::vector<std::string> m_metadata_hash_list;
+    // Streaming --metadata hash list; hashes are admitted as earlier ones
+    // complete and progress is checkpointed for restarts
+    std::unique_ptr<dht_crawler::HashListReader> m_hash_list_reader;
+    std::unique_ptr<dht_crawler::HashListProgress> m_hash_list_progress;
+    std::unique_ptr<dht_crawler::HashListCheckpoint> m_hash_list_checkpoint;
+    uint64_t m_hash_list_failed;
+    uint64_t m_hash_list_saved_offset;
     bool m_metadata_database_mode;
-    int m_metadata_db_offset;
+    int m_metadata_db_requested;
     int m_metadata_db_total_records;
-    int m_metadata_db_processed;
+    std::atomic<int> m_metadata_db_processed;
+    size_t m_backlog_window;
+    // Backlog reader for --metadata_database, with its own connection so
+    // prefetch queries never hold the primary connection's lock
+    std::unique_ptr<MySQLConnection> m_backlog_mysql;
+    std::unique_ptr<dht_crawler::BacklogReader> m_backlog_reader;
     bool m_debug_mode;
     bool m_verbose_mode;
     bool m_metadata_log_mode;
     
+    // Event-driven alert handling and periodic timers
+    std::unique_ptr<dht_crawler::AlertDispatcher> m_alert_dispatcher;
+    bool m_dht_bootstrapped;
+    
+    // Crawl state snapshots for warm restarts (null when --state-file is unset)
+    std::unique_ptr<dht_crawler::SnapshotWriter> m_snapshot_writer;
+    bool m_dht_state_restored;
+    
+    // Separate session for metadata torrents (--metadata-session), declared
+    // before the components that hold its lt::session pointer
+    std::unique_ptr<dht_crawler::MetadataSession> m_metadata_session;
+    std::shared_ptr<dht_crawler::TorrentHandleRegistry> m_torrent_handles;
+    std::chrono::steady_clock::time_point m_started_at;
+    
     // Enhanced metadata management
     std::unique_ptr<dht_crawler::MetadataManager> m_metadata_manager;
     std::unique_ptr<dht_crawler::PersistentMetadataDownloader> m_metadata_downloader;
@@ -705,6 +1609,10 @@ private:
     std::unique_ptr<ConcurrentDHTManager> m_concurrent_dht;
     std::atomic<bool> m_use_concurrent_mode;
     
+    // Extra sessions for sharded crawling (--shards), each with its own
+    // port, node ID, alert thread and keyspace slice; m_session is shard 0
+    std::vector<std::unique_ptr<dht_crawler::SessionShard>> m_shards;
+    
     // BEP51 DHT Indexing
     std::unique_ptr<dht_crawler::BEP51DHTIndexer> m_bep51_indexer;
     std::atomic<bool> m_use_bep51_mode;
@@ -732,18 +1640,60 @@ private:
     // std::unique_ptr<MetadataPieceManager> m_metadata_piece_manager;
     // std::unique_ptr<PerformanceMonitor> m_performance_monitor;
     // std::unique_ptr<dht_crawler::PerformanceOptimizer> m_performance_optimizer;
+    
+    // Where sightings, metadata and timeouts are stored (set up by
+    // initialize(), before the writers start)
+    std::unique_ptr<StorageBackend> m_storage;
+    
+    // Write-behind buffers for discovered_torrents sightings, sharded by
+    // info-hash prefix; each shard flushes in key order on its own thread
+    // through its own pooled connection
+    std::vector<std::unique_ptr<dht_crawler::WriteBehindWriter<TorrentSighting>>> m_torrent_writers;
+    std::atomic<int> m_backpressured_writers;
+    int m_base_query_delay_ms;
+    std::mutex m_query_delay_mutex;
+    int m_applied_query_delay_ms;
+    
+    // Ingest pipeline stages (declared last so they stop before the
+    // components their handlers use are destroyed)
+    std::unique_ptr<dht_crawler::PipelineStage<SightingEvent, dht_crawler::MpscRing>> m_decode_stage;
+    std::unique_ptr<dht_crawler::PipelineStage<DecodedSighting>> m_state_stage;
+    std::unique_ptr<dht_crawler::PipelineStage<DecodedSighting>> m_storage_stage;
+    std::unique_ptr<dht_crawler::PipelineStage<MetadataJob, dht_crawler::MpscRing>> m_metadata_stage;
+    std::unique_ptr<dht_crawler::PipelineStage<dht_crawler::CapturedInfoDict>> m_info_dict_stage;
+    
+    // Info dicts captured by a session plugin, optionally archived
+    std::shared_ptr<dht_crawler::InfoDictCapture> m_info_dict_capture;
+    std::unique_ptr<dht_crawler::InfoDictArchive> m_torrent_archive;
 
 public:
     DHTTorrentCrawler(const MySQLConfig& config) 
         : m_gen(m_rd()), m_dis(0, 255), m_running(false), m_shutdown_requested(false),
           m_total_queries(0), m_torrents_found(0), m_peers_found(0), m_metadata_fetched(0),
-          m_metadata_only_mode(false), m_metadata_database_mode(config.metadata_database_mode), 
-          m_metadata_db_offset(0), m_metadata_db_total_records(0), m_metadata_db_processed(0),
-          m_debug_mode(config.debug_mode), m_verbose_mode(config.verbose_mode), m_metadata_log_mode(config.metadata_log_mode), 
-          m_use_concurrent_mode(config.concurrent_mode), m_use_bep51_mode(config.bep51_mode), m_use_smart_mode(true) {  // Enable smart mode by default
+          m_metadata_only_mode(false), m_hash_list_failed(0), m_hash_list_saved_offset(0), m_metadata_database_mode(config.metadata_database_mode), 
+          m_metadata_db_requested(0), m_metadata_db_total_records(0), m_metadata_db_processed(0), m_backlog_window(config.backlog_window),
+          m_debug_mode(config.debug_mode), m_verbose_mode(config.verbose_mode), m_metadata_log_mode(config.metadata_log_mode), m_dht_bootstrapped(false), m_dht_state_restored(false),
+          m_use_concurrent_mode(config.concurrent_mode), m_use_bep51_mode(config.bep51_mode), m_use_smart_mode(true), m_backpressured_writers(0) {  // Enable smart mode by default
         
         m_mysql = std::make_unique<MySQLConnection>(config);
         
+        // Error rows are aggregated and written in the background through
+        // the primary connection, or to a local file while it is down
+        dht_crawler::ErrorLogSinkConfig error_log_config;
+        error_log_config.fallback_path = config.error_log_file;
+        m_error_sink = std::make_shared<dht_crawler::ErrorLogSink>(error_log_config,
+            [this](const std::vector<dht_crawler::ErrorLogEntry>& entries) {
+                return m_mysql->writeErrorLog(entries);
+            });
+        m_error_sink->start();
+        m_mysql->setErrorSink(m_error_sink);
+        
+        // Bounded in-memory discovery table (TTL + LRU eviction under a byte budget)
+        dht_crawler::DiscoveryStoreConfig discovery_config;
+        discovery_config.memory_budget_bytes = config.discovery_memory_mb * 1024 * 1024;
+        discovery_config.ttl = std::chrono::hours(config.discovery_ttl_hours);
+        m_discovery_store = std::make_unique<dht_crawler::DiscoveryStore>(discovery_config);
+        
         // Initialize logging callback
         m_log_callback = [this](const std::string& message) {
             // In metadata_log_mode, only show metadata-related logs
@@ -779,22 +1729,42 @@ public:
         // Initialize metadata manager
         m_metadata_manager = std::make_unique<dht_crawler::MetadataManager>(m_log_callback);
         
+        // State saved by the previous run; a missing or damaged snapshot
+        // just means a cold start
+        std::unique_ptr<dht_crawler::CrawlSnapshot> snapshot;
+        if (!config.state_file.empty()) {
+            std::string error;
+            snapshot = dht_crawler::CrawlSnapshot::open(config.state_file, error);
+            if (!snapshot) {
+                std::cout << "No usable crawl state snapshot (" << error << "), starting cold" << std::endl;
+            }
+        }
+        
         // *** ENHANCED SESSION CONFIGURATION FOR METADATA EXCHANGE ***
         lt::session_params params;
         lt::settings_pack& settings = params.settings;
+        
+        // Seed the routing table from the snapshot so the DHT is usable
+        // without a full bootstrap
+        if (snapshot && snapshot->has(dht_crawler::SnapshotSection::DHT_STATE)) {
+            dht_crawler::SnapshotCursor cursor = snapshot->section(dht_crawler::SnapshotSection::DHT_STATE);
+            try {
+                lt::session_params saved = lt::read_session_params(
+                    lt::span<char const>(cursor.data(), static_cast<std::ptrdiff_t>(cursor.remaining())),
+                    lt::session::save_dht_state);
+                params.dht_state = std::move(saved.dht_state);
+                m_dht_state_restored = true;
+            } catch (const std::exception& e) {
+                std::cout << "Ignoring saved DHT state: " << e.what() << std::endl;
+            }
+        }
 
         // DHT configuration
         settings.set_bool(lt::settings_pack::enable_dht, true);
         settings.set_int(lt::settings_pack::dht_announce_interval, 15);
         settings.set_int(lt::settings_pack::dht_bootstrap_nodes, 0);
 
-        // *** ENHANCED: Extended alert mask for metadata ***
-        settings.set_int(lt::settings_pack::alert_mask, 
-            lt::alert_category::dht | 
-            lt::alert_category::peer | 
-            lt::alert_category::status |
-            lt::alert_category::connect |
-            lt::alert_category::error);
+        // Alert mask is applied by AlertDispatcher from the registered handlers
 
         // Port binding
         settings.set_str(lt::settings_pack::listen_interfaces, "0.0.0.0:6881");
@@ -820,17 +1790,98 @@ public:
         settings.set_bool(lt::settings_pack::enable_upnp, true);
         settings.set_bool(lt::settings_pack::enable_natpmp, true);
         
+        // In the metadata-only modes this session does nothing but fetch metadata
+        if (!config.metadata_hashes.empty() || config.metadata_database_mode) {
+            dht_crawler::apply_metadata_fetch_settings(settings);
+        }
+        
+        // Disk I/O is disabled in every mode, not only when the metadata
+        // session takes the torrents away from this one. Whatever the mode,
+        // the only torrents this session ever holds are magnet torrents
+        // added through TorrentHandleRegistry to fetch metadata, and the
+        // registry removes each one when its metadata arrives or its request
+        // ends; none reads or writes piece data, so storage, a file pool and
+        // disk threads would be set up for nothing. The disabled backend
+        // reads zeros, so no unchoke slots either: a seed-mode metadata
+        // torrent can never upload from it in the moment before removal.
+        // (Shards and the metadata session do the same in their constructors.)
+        params.disk_io_constructor = lt::disabled_disk_io_constructor;
+        settings.set_int(lt::settings_pack::unchoke_slots_limit, 0);
+        
         m_session = std::make_unique<lt::session>(params);
+        m_started_at = std::chrono::steady_clock::now();
+        
+        // Metadata torrents get their own session, alert queue and thread so
+        // their peer traffic stays out of the crawling session (discovery
+        // mode; the metadata-only modes have nothing else to isolate)
+        if (config.metadata_session && config.metadata_hashes.empty() && !config.metadata_database_mode) {
+            dht_crawler::MetadataSessionConfig metadata_session_config;
+            metadata_session_config.listen_port = 6881 + static_cast<int>(config.session_shards);
+            m_metadata_session = std::make_unique<dht_crawler::MetadataSession>(metadata_session_config, m_log_callback);
+            std::cout << "Metadata fetching in a separate session on port " << metadata_session_config.listen_port << std::endl;
+        }
+        
+        // Route alerts through a type-indexed handler table; the alert mask is
+        // derived from the registered handlers
+        m_alert_dispatcher = std::make_unique<dht_crawler::AlertDispatcher>(m_session.get(), m_log_callback);
+        setupAlertHandlers();
+        
+        // Every metadata torrent is added and removed through one registry
+        m_torrent_handles = std::make_shared<dht_crawler::TorrentHandleRegistry>(
+            metadataSession(), config.max_torrent_handles, m_log_callback);
         
         // Initialize persistent metadata downloader
         m_metadata_downloader = std::make_unique<dht_crawler::PersistentMetadataDownloader>(
-            m_session.get(), m_log_callback);
+            m_torrent_handles, m_log_callback);
         
         // Initialize metadata worker pool (10 workers, 20s timeout)
-        m_metadata_worker_pool = std::make_unique<MetadataWorkerPool>(m_session.get(), 10, 20, m_log_callback);
+        m_metadata_worker_pool = std::make_unique<MetadataWorkerPool>(m_torrent_handles, 10, 20, m_log_callback);
+        
+        // Query target dedup shared by concurrent and sequential query generation
+        m_query_filter = dht_crawler::create_query_dedup_filter(config.query_dedup_mode, config.query_dedup_mb * 1024 * 1024);
         
         // Initialize concurrent DHT manager
         m_concurrent_dht = std::make_unique<ConcurrentDHTManager>(m_session.get(), config.num_workers, 1000);
+        m_concurrent_dht->set_query_filter(m_query_filter);
+        m_base_query_delay_ms = m_concurrent_dht->get_query_delay();
+        m_applied_query_delay_ms = m_base_query_delay_ms;
+        
+        // Sharded crawling only applies to discovery; the metadata modes
+        // stay on the primary session
+        if (config.session_shards > 1 && config.concurrent_mode &&
+            config.metadata_hashes.empty() && !config.metadata_database_mode) {
+            createSessionShards(config, params);
+        }
+        
+        // Batched, coalescing writers for sightings, one per pooled
+        // connection; while any shard's buffer is above its high watermark,
+        // query generation is slowed down
+        dht_crawler::WriteBehindConfig writer_config;
+        writer_config.max_batch_rows = config.db_batch_rows;
+        writer_config.max_delay = std::chrono::milliseconds(config.db_flush_ms);
+        writer_config.max_buffered_bytes = config.db_buffer_mb * 1024 * 1024 / config.db_writers;
+        for (size_t shard = 0; shard < config.db_writers; ++shard) {
+            auto writer = std::make_unique<dht_crawler::WriteBehindWriter<TorrentSighting>>(
+                "discovered_torrents#" + std::to_string(shard), writer_config,
+                [this, shard](std::vector<TorrentSighting>& rows) { return flushTorrentShard(shard, rows); },
+                [](const TorrentSighting& a, const TorrentSighting& b) { return a.info_hash < b.info_hash; },
+                estimateSightingBytes,
+                m_log_callback);
+            writer->set_merge_function([](TorrentSighting& newer, TorrentSighting& older) {
+                // Repeat sightings in one batch: one row with the summed
+                // count and the peers from every reply
+                newer.sightings += older.sightings;
+                newer.peer_endpoints.append(older.peer_endpoints);
+            });
+            writer->set_backpressure_callback([this](bool active) {
+                int backpressured = active ? ++m_backpressured_writers : --m_backpressured_writers;
+                if (backpressured <= 1) {
+                    // Only the 0 <-> 1 transitions change the delay
+                    applyBackpressureDelay();
+                }
+            });
+            m_torrent_writers.push_back(std::move(writer));
+        }
         
         // Initialize BEP51 DHT indexer
         m_bep51_indexer = std::make_unique<dht_crawler::BEP51DHTIndexer>(m_session.get(), m_log_callback);
@@ -858,11 +1909,33 @@ public:
         // m_performance_monitor = std::make_unique<PerformanceMonitor>();
         // m_performance_optimizer = std::make_unique<dht_crawler::PerformanceOptimizer>();
         
+        // Ingest pipeline: the decode stage is MPSC because every session
+        // shard's alert thread feeds it; the metadata stage is MPSC because
+        // both the state stage and BEP51 harvesting on the alert thread do
+        m_decode_stage = std::make_unique<dht_crawler::PipelineStage<SightingEvent, dht_crawler::MpscRing>>(
+            "decode", 65536, [this](SightingEvent& event) { decodeSighting(event); });
+        m_state_stage = std::make_unique<dht_crawler::PipelineStage<DecodedSighting>>(
+            "state", 16384, [this](DecodedSighting& sighting) { applySighting(sighting); });
+        m_storage_stage = std::make_unique<dht_crawler::PipelineStage<DecodedSighting>>(
+            "storage", 16384, [this](DecodedSighting& sighting) { storeSighting(sighting); });
+        m_metadata_stage = std::make_unique<dht_crawler::PipelineStage<MetadataJob, dht_crawler::MpscRing>>(
+            "metadata", 16384, [this](MetadataJob& job) { scheduleMetadata(job); });
+        
+        // Verified info dicts are captured by a plugin on the metadata
+        // session's network thread (its only producer) and stored from
+        // their own stage instead of the alert thread
+        m_info_dict_stage = std::make_unique<dht_crawler::PipelineStage<dht_crawler::CapturedInfoDict>>(
+            "info_dict", 16384, [this](dht_crawler::CapturedInfoDict& dict) { storeInfoDict(dict); });
+        m_info_dict_capture = std::make_shared<dht_crawler::InfoDictCapture>([this](dht_crawler::CapturedInfoDict&& dict) {
+            return m_info_dict_stage->try_push(std::move(dict));
+        });
+        metadataSession()->add_extension(m_info_dict_capture);
+        
         // Set up concurrent DHT callbacks
         m_concurrent_dht->set_query_callback([this](const DHTQuery& query) {
             // Optional: Track individual queries if needed
             if (m_debug_mode) {
-                std::cout << "[DEBUG] DHT query sent: " << query.hash_str.substr(0, 8) << "..." << std::endl;
+                std::cout << "[DEBUG] DHT query sent: " << query.hash.to_hex().substr(0, 8) << "..." << std::endl;
             }
         });
         
@@ -874,18 +1947,77 @@ public:
         });
         
         // Persistent metadata downloader is configured with defaults
+        
+        if (snapshot) {
+            restoreCrawlSnapshot(*snapshot);
+        }
+        if (!config.state_file.empty()) {
+            m_snapshot_writer = std::make_unique<dht_crawler::SnapshotWriter>(config.state_file, m_log_callback);
+        }
+    }
+
+    ~DHTTorrentCrawler() {
+        // A background snapshot reads the session and most components
+        if (m_snapshot_writer) {
+            m_snapshot_writer->wait();
+        }
+        stopSessionShards();
+        if (m_metadata_session) {
+            m_metadata_session->stop();
+        }
+        
+        // The sessions' network threads outlive the stages
+        if (m_info_dict_capture) {
+            m_info_dict_capture->close();
+        }
+        stopIngestPipeline();
+        m_error_sink->stop();
     }
 
     bool initialize() {
         try {
             std::cout << "Initializing DHT Torrent Crawler..." << std::endl;
             
-            // Connect to MySQL (skip for testing)
-            if (!m_mysql->connect()) {
-                std::cout << "MySQL connection failed - running in test mode without database storage" << std::endl;
-                m_mysql->logError("DHTTorrentCrawler::initialize", "", -1, "MySQL connection failed", "", "WARNING", "Running in test mode");
-                // Continue without MySQL for testing
+            const MySQLConfig& config = m_mysql->getConfig();
+            if (config.storage_backend == "local") {
+                auto local = std::make_unique<LocalStorageBackend>(config, m_log_callback);
+                std::string error;
+                if (!local->open(error)) {
+                    std::cerr << "Cannot open local store " << config.storage_dir << ": " << error << std::endl;
+                    return false;
+                }
+                std::cout << "Storing crawl results in local segment store: " << config.storage_dir << std::endl;
+                m_storage = std::move(local);
+            } else if (config.storage_backend == "null") {
+                std::cout << "Null storage: crawl results are counted but not stored" << std::endl;
+                m_storage = std::make_unique<NullStorageBackend>();
+            } else if (!m_mysql->connect()) {
+                std::cout << "MySQL connection failed - crawl results will NOT be stored (use --storage local to keep them on disk)" << std::endl;
+                m_mysql->logError("DHTTorrentCrawler::initialize", "", -1, "MySQL connection failed", "", "WARNING", "Falling back to null storage");
+                m_storage = std::make_unique<NullStorageBackend>();
+            } else {
+                // One pooled connection per writer shard; shards whose
+                // connection fails here reconnect on their first flush
+                auto pool = std::make_unique<MySQLConnectionPool>(config, m_torrent_writers.size(), m_error_sink);
+                size_t connected = pool->connect();
+                std::cout << "MySQL writer pool: " << connected << "/" << pool->size() << " connections" << std::endl;
+                m_storage = std::make_unique<MySQLStorageBackend>(*m_mysql, std::move(pool));
+            }
+            
+            if (!config.torrent_archive_dir.empty()) {
+                auto archive = std::make_unique<dht_crawler::InfoDictArchive>(config.torrent_archive_dir);
+                std::string error;
+                if (!archive->open(error)) {
+                    std::cerr << "Cannot open torrent archive: " << error << std::endl;
+                    return false;
+                }
+                std::cout << "Archiving fetched .torrent files in " << config.torrent_archive_dir << std::endl;
+                m_torrent_archive = std::move(archive);
             }
+            
+            // Stages (and the writers, which use m_storage) must be running
+            // before the first alerts are dispatched
+            startIngestPipeline();
         
         // Check port forwarding status
         std::cout << "Checking port forwarding status..." << std::endl;
@@ -893,29 +2025,24 @@ public:
         
         // Wait for DHT bootstrap
         std::cout << "Waiting for DHT bootstrap..." << std::endl;
-        bool dht_ready = false;
         int bootstrap_wait = 0;
         
-        while (!dht_ready && bootstrap_wait < 30) {
-            std::vector<lt::alert*> alerts;
-            m_session->pop_alerts(&alerts);
-            
-            for (lt::alert* alert : alerts) {
-                if (alert->type() == lt::dht_bootstrap_alert::alert_type) {
-                    dht_ready = true;
-                    std::cout << "*** DHT Bootstrap completed! ***" << std::endl;
-                    break;
-                }
-            }
-            
-            if (!dht_ready) {
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                bootstrap_wait++;
-                std::cout << "Bootstrap wait: " << bootstrap_wait << "s" << std::endl;
-            }
+        // A restored routing table only needs a moment to confirm its nodes
+        int bootstrap_limit = m_dht_state_restored ? 5 : 30;
+        if (m_dht_state_restored) {
+            std::cout << "Routing table restored from snapshot, waiting at most " << bootstrap_limit << "s" << std::endl;
         }
         
-        if (!dht_ready) {
+        m_alert_dispatcher->every("bootstrap_wait", std::chrono::seconds(1), [&bootstrap_wait]() {
+            bootstrap_wait++;
+            std::cout << "Bootstrap wait: " << bootstrap_wait << "s" << std::endl;
+        });
+        m_alert_dispatcher->run([this, &bootstrap_wait, bootstrap_limit]() {
+            return !m_dht_bootstrapped && bootstrap_wait < bootstrap_limit && !m_shutdown_requested;
+        });
+        m_alert_dispatcher->clear_timers();
+        
+        if (!m_dht_bootstrapped) {
             std::cout << "DHT bootstrap timeout, continuing anyway..." << std::endl;
         }
         
@@ -940,47 +2067,53 @@ public:
         std::cout << "\n=== METADATA-ONLY MODE ===" << std::endl;
         m_metadata_only_mode = true;
         
-        // Check if input is a filename (contains .txt or .csv)
-        std::string hashes_str = m_mysql->getConfig().metadata_hashes;
+        const MySQLConfig& config = m_mysql->getConfig();
+        const std::string& hashes_str = config.metadata_hashes;
         
-        if (hashes_str.find(".txt") != std::string::npos || hashes_str.find(".csv") != std::string::npos) {
-            // Read hashes from file
-            std::ifstream file(hashes_str);
-            if (!file.is_open()) {
-                std::cerr << "Error: Could not open file: " << hashes_str << std::endl;
+        // Hash files (.txt or .csv) and stdin ("-") are streamed, anything
+        // else is an inline comma-delimited list
+        if (hashes_str == "-" || hashes_str.find(".txt") != std::string::npos || hashes_str.find(".csv") != std::string::npos) {
+            std::string error;
+            m_hash_list_reader = dht_crawler::HashListReader::open(hashes_str, error);
+            if (!m_hash_list_reader) {
+                std::cerr << "Error: Could not read hash list: " << error << std::endl;
+                m_shutdown_requested = true;
                 return;
             }
-            
-            std::string line;
-            while (std::getline(file, line)) {
-                // Trim whitespace
-                line.erase(0, line.find_first_not_of(" \t\r\n"));
-                line.erase(line.find_last_not_of(" \t\r\n") + 1);
-                
-                if (!line.empty()) {
-                    m_metadata_hash_list.push_back(line);
-                    std::cout << "Added hash for metadata fetch: " << line << std::endl;
-                }
-            }
-            file.close();
         } else {
-            // Parse comma-delimited hashes
-            std::istringstream ss(hashes_str);
-            std::string hash;
-            
-            while (std::getline(ss, hash, ',')) {
-                // Trim whitespace
-                hash.erase(0, hash.find_first_not_of(" \t\r\n"));
-                hash.erase(hash.find_last_not_of(" \t\r\n") + 1);
-                
-                if (!hash.empty()) {
-                    m_metadata_hash_list.push_back(hash);
-                    std::cout << "Added hash for metadata fetch: " << hash << std::endl;
+            m_hash_list_reader = dht_crawler::HashListReader::from_string(hashes_str);
+        }
+        m_hash_list_reader->set_invalid_callback([](const std::string& token) {
+            std::cerr << "Invalid hash format, skipping: " << token << std::endl;
+        });
+        
+        // Resume from the checkpoint of an earlier run over the same list
+        std::string checkpoint_path = config.metadata_checkpoint;
+        if (checkpoint_path.empty() && m_hash_list_reader->is_file()) {
+            checkpoint_path = hashes_str + ".progress";
+        }
+        dht_crawler::HashListCheckpoint::State resume;
+        if (!checkpoint_path.empty()) {
+            m_hash_list_checkpoint = std::make_unique<dht_crawler::HashListCheckpoint>(checkpoint_path);
+            dht_crawler::HashListCheckpoint::State state;
+            if (m_hash_list_checkpoint->load(state)) {
+                if (m_hash_list_reader->is_file() &&
+                    (state.file_size != m_hash_list_reader->file_size() || state.head_checksum != m_hash_list_reader->head_checksum())) {
+                    std::cout << "Checkpoint " << checkpoint_path << " is for a different hash list, starting from the beginning" << std::endl;
+                } else if (m_hash_list_reader->skip_to(state.offset)) {
+                    resume = state;
+                    std::cout << "Resuming hash list at byte " << state.offset << " (" << state.completed 
+                              << " hashes already completed)" << std::endl;
+                } else {
+                    std::cout << "Checkpoint " << checkpoint_path << " is past the end of the input, nothing left to fetch" << std::endl;
                 }
             }
         }
+        m_hash_list_progress = std::make_unique<dht_crawler::HashListProgress>(resume.offset, resume.completed);
+        m_hash_list_saved_offset = resume.offset;
         
-        std::cout << "Total hashes to fetch metadata for: " << m_metadata_hash_list.size() << std::endl;
+        std::cout << "Streaming hashes from " << m_hash_list_reader->source() << ", up to " << m_backlog_window 
+                  << " requests in flight" << std::endl;
         std::cout << "Starting metadata-only mode..." << std::endl;
     }
 
@@ -999,37 +2132,231 @@ public:
             return;
         }
         
-        // Load initial batch of 100 records
-        loadMetadataDatabaseBatch();
+        // Prefetch the backlog in the background on a dedicated connection
+        m_backlog_mysql = std::make_unique<MySQLConnection>(m_mysql->getConfig());
+        m_backlog_mysql->setErrorSink(m_error_sink);
+        if (!m_backlog_mysql->connect(false)) {
+            std::cout << "Backlog connection failed. Exiting." << std::endl;
+            m_shutdown_requested = true;
+            return;
+        }
+        
+        dht_crawler::BacklogReaderConfig backlog_config;
+        backlog_config.window = m_backlog_window;
+        backlog_config.min_batch = std::min<size_t>(100, m_backlog_window);
+        m_backlog_reader = std::make_unique<dht_crawler::BacklogReader>(
+            backlog_config,
+            [this](uint64_t after_id, size_t limit, std::vector<dht_crawler::BacklogRow>& rows) {
+                return m_backlog_mysql->getTorrentsWithMissingMetadata(after_id, limit, rows);
+            },
+            m_log_callback);
+        m_backlog_reader->start();
+        m_backlog_reader->wait_ready(std::chrono::seconds(30));
         
         std::cout << "Starting metadata-database mode..." << std::endl;
     }
 
-    void loadMetadataDatabaseBatch() {
-        std::vector<std::string> batch_hashes = m_mysql->getTorrentsWithMissingMetadata(100, m_metadata_db_offset);
-        
-        if (batch_hashes.empty()) {
-            std::cout << "No more records to process. All metadata fetched!" << std::endl;
-            m_shutdown_requested = true;
-            return;
+    /**
+     * Keep up to m_backlog_window metadata requests outstanding in the
+     * downloader, topped up from the prefetched backlog
+     * @return number of new requests issued
+     */
+    size_t refillMetadataBacklog() {
+        size_t outstanding = m_metadata_downloader->get_queue_size() + m_metadata_downloader->get_active_requests();
+        if (!m_backlog_reader || outstanding >= m_backlog_window) {
+            return 0;
         }
         
-        std::cout << "Loaded batch of " << batch_hashes.size() << " records (offset: " << m_metadata_db_offset << ")" << std::endl;
-        
-        // Add hashes to the metadata list
+        std::vector<std::string> batch_hashes = m_backlog_reader->take(m_backlog_window - outstanding);
         for (const std::string& hash : batch_hashes) {
-            m_metadata_hash_list.push_back(hash);
             if (m_debug_mode) {
                 std::cout << "[DEBUG] Added database hash for metadata fetch: " << hash << std::endl;
             }
+            requestMetadataForHash(hash);
+        }
+        m_metadata_db_requested += batch_hashes.size();
+        return batch_hashes.size();
+    }
+
+    /**
+     * Admit hashes from the --metadata list until m_backlog_window of them
+     * are in flight
+     * @return number of new requests issued
+     */
+    size_t refillMetadataHashList() {
+        if (!m_hash_list_reader || m_hash_list_progress->in_flight() >= m_backlog_window) {
+            return 0;
+        }
+        
+        std::vector<dht_crawler::HashListEntry> batch;
+        m_hash_list_reader->next(batch, m_backlog_window - m_hash_list_progress->in_flight());
+        size_t requested = 0;
+        for (const auto& entry : batch) {
+            if (m_hash_list_progress->admit(entry)) {
+                requestMetadataForHash(entry.hash.to_hex());
+                requested++;
+            }
+        }
+        return requested;
+    }
+    
+    /**
+     * Complete list hashes whose request ended without metadata: timed out
+     * (the torrent is dropped from the session) or given up by the downloader
+     */
+    void retireMetadataHashList() {
+        if (!m_hash_list_progress) {
+            return;
+        }
+        
+        for (const std::string& hash : m_metadata_downloader->cleanup_timed_out_requests()) {
+            dht_crawler::InfoHash info_hash;
+            if (dht_crawler::InfoHash::from_hex(hash, info_hash) && m_hash_list_progress->complete(info_hash)) {
+                m_hash_list_failed++;
+                if (m_metadata_log_mode) {
+                    std::cout << "[METADATA_LOG] *** METADATA TIMEOUT ***" << std::endl;
+                    std::cout << "[METADATA_LOG] Hash: " << hash << std::endl;
+                    std::cout << "[METADATA_LOG] ------------------------" << std::endl;
+                }
+            }
+        }
+        
+        std::vector<dht_crawler::InfoHash> abandoned;
+        m_hash_list_progress->for_each_in_flight([this, &abandoned](const dht_crawler::InfoHash& hash) {
+            if (!m_metadata_downloader->is_pending(hash.to_hex())) {
+                abandoned.push_back(hash);
+            }
+        });
+        for (const auto& hash : abandoned) {
+            m_hash_list_progress->complete(hash);
+            m_hash_list_failed++;
+        }
+    }
+    
+    bool metadataHashListDone() const {
+        return !m_hash_list_reader || (m_hash_list_reader->exhausted() && m_hash_list_progress->in_flight() == 0);
+    }
+    
+    /**
+     * Record how far the --metadata list is done; a finished list removes
+     * its checkpoint
+     */
+    void saveHashListCheckpoint() {
+        if (!m_hash_list_checkpoint) {
+            return;
+        }
+        if (metadataHashListDone()) {
+            m_hash_list_checkpoint->remove();
+            return;
+        }
+        
+        uint64_t offset = m_hash_list_progress->committed_offset();
+        if (offset == m_hash_list_saved_offset) {
+            return;
+        }
+        dht_crawler::HashListCheckpoint::State state;
+        state.file_size = m_hash_list_reader->file_size();
+        state.head_checksum = m_hash_list_reader->head_checksum();
+        state.offset = offset;
+        state.completed = m_hash_list_progress->completed();
+        std::string error;
+        if (m_hash_list_checkpoint->save(state, error)) {
+            m_hash_list_saved_offset = offset;
+        } else {
+            std::cerr << "Warning: could not save hash list checkpoint: " << error << std::endl;
         }
+    }
+
+    /**
+     * Create sessions 1..N-1 for --shards. The primary session keeps slice
+     * 0 of the keyspace; every shard gets the primary's settings on its own
+     * port and the routing table nodes restored from the snapshot, if any.
+     */
+    void createSessionShards(const MySQLConfig& config, const lt::session_params& primary) {
+        uint32_t count = static_cast<uint32_t>(config.session_shards);
+        m_concurrent_dht->set_keyspace(dht_crawler::KeyspaceSlice{0, count});
         
-        m_metadata_db_offset += batch_hashes.size();
+        for (uint32_t index = 1; index < count; ++index) {
+            // Settings only; SessionShard sets its own port and disk I/O
+            lt::session_params params(primary.settings);
+            params.settings.set_bool(lt::settings_pack::enable_lsd, false); // Shards never hold torrents
+            params.dht_state.nodes = primary.dht_state.nodes;
+            params.dht_state.nodes6 = primary.dht_state.nodes6;
+            
+            dht_crawler::SessionShardConfig shard_config;
+            shard_config.index = index;
+            shard_config.count = count;
+            shard_config.listen_port = 6881 + static_cast<int>(index);
+            shard_config.num_workers = config.num_workers;
+            auto shard = std::make_unique<dht_crawler::SessionShard>(shard_config, std::move(params), m_query_filter, m_log_callback);
+            
+            // Same sighting handlers as the primary; they only enqueue into
+            // the MPSC decode stage
+            shard->dispatcher().on<lt::dht_get_peers_reply_alert>([this](lt::dht_get_peers_reply_alert* alert) {
+                if (!alert->peers().empty()) {
+                    handlePeerReply(alert);
+                }
+            });
+            shard->dispatcher().on<lt::dht_announce_alert>([this](lt::dht_announce_alert* alert) {
+                handleAnnounce(alert);
+            });
+            shard->dispatcher().on<lt::dht_immutable_item_alert>([this](lt::dht_immutable_item_alert* alert) {
+                handleImmutableItem(alert);
+            });
+            m_shards.push_back(std::move(shard));
+        }
+        std::cout << "Sharded crawl: " << count << " DHT sessions on ports 6881-" << (6881 + count - 1) << std::endl;
+    }
+    
+    void startSessionShards() {
+        for (auto& shard : m_shards) {
+            shard->start();
+        }
+    }
+    
+    void stopSessionShards() {
+        for (auto& shard : m_shards) {
+            shard->stop();
+        }
+    }
+    
+    // Called from writer threads on storage backpressure. The target is
+    // read from the counter under the lock, so when two writers cross the
+    // watermarks in opposite directions at once, the delay applied last
+    // matches the final count rather than whichever thread ran last.
+    void applyBackpressureDelay() {
+        std::lock_guard<std::mutex> lock(m_query_delay_mutex);
+        int target = m_backpressured_writers.load() > 0 ? m_base_query_delay_ms * 10 : m_base_query_delay_ms;
+        if (target == m_applied_query_delay_ms) {
+            return;
+        }
+        m_applied_query_delay_ms = target;
+        setQueryDelay(target);
+        if (target != m_base_query_delay_ms) {
+            std::cout << "Storage backlog high, slowing DHT queries" << std::endl;
+        } else {
+            std::cout << "Storage backlog cleared, resuming DHT query rate" << std::endl;
+        }
+    }
+    
+    void setQueryDelay(int delay_ms) {
+        m_concurrent_dht->set_query_delay(delay_ms);
+        for (auto& shard : m_shards) {
+            shard->queries().set_query_delay(delay_ms);
+        }
+    }
+    
+    int totalQueriesSent() const {
+        int total = m_concurrent_dht->get_total_queries_sent();
+        for (const auto& shard : m_shards) {
+            total += shard->get_total_queries_sent();
+        }
+        return total;
     }
 
     void startCrawling(int max_queries = -1) {
-        if (!m_mysql->isConnected()) {
-            std::cout << "MySQL not connected, running in test mode without database storage" << std::endl;
+        if (!m_storage->isStoring()) {
+            std::cout << "Storage backend: " << m_storage->name() << ", crawl results will not be stored" << std::endl;
         }
         
         m_running = true;
@@ -1037,34 +2364,55 @@ public:
         if (m_metadata_only_mode) {
             if (m_verbose_mode) {
                 std::cout << "\n=== Starting Metadata-Only Mode ===" << std::endl;
-                std::cout << "Fetching metadata for " << m_metadata_hash_list.size() << " torrents..." << std::endl;
+                if (m_hash_list_reader) {
+                    std::cout << "Fetching metadata for hashes from " << m_hash_list_reader->source() << "..." << std::endl;
+                }
             }
             
-            // Request metadata for all specified hashes
-            for (const std::string& hash : m_metadata_hash_list) {
-                requestMetadataForHash(hash);
+            // Fill the request window; the progress timer tops it up as
+            // requests complete
+            refillMetadataHashList();
+            if (m_metadata_database_mode) {
+                refillMetadataBacklog();
             }
             
-            // Wait for metadata to arrive
+            // Wait for metadata to arrive. A hash list completes hash by
+            // hash (metadata, or its request timing out), so it has no
+            // overall deadline. In database mode the timeout only fires
+            // after 5 minutes without any completed record.
             auto start_time = std::chrono::steady_clock::now();
+            auto timeout_start = start_time;
+            int last_completed = 0;
             int timeout_seconds = 300; // 5 minutes timeout
+            bool metadata_done = false;
             
-            while (m_running && !m_shutdown_requested) {
-                processAlerts();
-                
-                auto elapsed = std::chrono::steady_clock::now() - start_time;
-                auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
-                
-                if (m_debug_mode && elapsed_seconds % 10 == 0) {
+            if (m_debug_mode) {
+                m_alert_dispatcher->every("metadata_wait_status", std::chrono::seconds(10), [this, start_time]() {
+                    auto elapsed = std::chrono::steady_clock::now() - start_time;
+                    auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
+                    
                     if (m_metadata_database_mode) {
                         std::cout << "[DEBUG] Metadata wait: " << elapsed_seconds << "s, fetched: " << m_metadata_fetched 
-                                  << "/" << m_metadata_hash_list.size() << ", processed: " << m_metadata_db_processed 
-                                  << "/" << m_metadata_db_total_records << std::endl;
-                    } else {
+                                  << "/" << m_metadata_db_requested << ", processed: " << m_metadata_db_processed 
+                                  << "/" << m_metadata_db_total_records
+                                  << ", prefetched: " << m_backlog_reader->ready() << std::endl;
+                    } else if (m_hash_list_reader) {
                         std::cout << "[DEBUG] Metadata wait: " << elapsed_seconds << "s, fetched: " << m_metadata_fetched 
-                                  << "/" << m_metadata_hash_list.size() << std::endl;
+                                  << ", completed: " << m_hash_list_progress->completed() 
+                                  << ", in flight: " << m_hash_list_progress->in_flight() 
+                                  << ", invalid: " << m_hash_list_reader->invalid_tokens() 
+                                  << ", input offset: " << m_hash_list_reader->position() << std::endl;
                     }
+                });
+            }
+            
+            m_alert_dispatcher->every("metadata_progress", std::chrono::milliseconds(100), [this, &timeout_start, &last_completed, timeout_seconds, &metadata_done]() {
+                if (m_metadata_database_mode && m_metadata_db_processed != last_completed) {
+                    last_completed = m_metadata_db_processed;
+                    timeout_start = std::chrono::steady_clock::now();
                 }
+                auto elapsed = std::chrono::steady_clock::now() - timeout_start;
+                auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
                 
                 // Handle timeout requests in metadata database mode
                 if (m_metadata_database_mode) {
@@ -1075,39 +2423,53 @@ public:
                     }
                 }
                 
-                // Refill queue in metadata database mode when we're running low
-                if (m_metadata_database_mode && m_metadata_hash_list.size() < 50) {
-                    loadMetadataDatabaseBatch();
-                    if (!m_metadata_hash_list.empty()) {
-                        // Request metadata for new hashes
-                        for (size_t i = m_metadata_hash_list.size() - 50; i < m_metadata_hash_list.size(); ++i) {
-                            if (i < m_metadata_hash_list.size()) {
-                                requestMetadataForHash(m_metadata_hash_list[i]);
-                            }
-                        }
-                    }
+                // Keep the downloader fed from the list and the prefetched backlog
+                refillMetadataHashList();
+                if (m_metadata_database_mode) {
+                    refillMetadataBacklog();
                 }
                 
-                if (elapsed_seconds >= timeout_seconds) {
+                if (m_metadata_database_mode && elapsed_seconds >= timeout_seconds) {
                     std::cout << "\n*** METADATA TIMEOUT REACHED ***" << std::endl;
-                    break;
+                    metadata_done = true;
+                    return;
                 }
                 
                 if (m_metadata_database_mode) {
-                    // In database mode, check if we've processed all records
-                    if (m_metadata_db_processed >= m_metadata_db_total_records || m_metadata_hash_list.empty()) {
+                    // In database mode, done once the backlog is drained and
+                    // nothing is left in flight
+                    size_t outstanding = m_metadata_downloader->get_queue_size() + m_metadata_downloader->get_active_requests();
+                    if (m_backlog_reader->exhausted() && outstanding == 0 && metadataHashListDone()) {
                         std::cout << "\n*** ALL DATABASE METADATA PROCESSED ***" << std::endl;
                         std::cout << "Processed " << m_metadata_db_processed << " records successfully" << std::endl;
-                        break;
+                        metadata_done = true;
+                    }
+                } else if (metadataHashListDone()) {
+                    std::cout << "\n*** HASH LIST COMPLETE ***" << std::endl;
+                    if (m_hash_list_reader) {
+                        std::cout << "Fetched " << m_metadata_fetched << ", no metadata for " << m_hash_list_failed 
+                                  << ", invalid entries skipped: " << m_hash_list_reader->invalid_tokens() << std::endl;
                     }
-                } else if (m_metadata_fetched >= static_cast<int>(m_metadata_hash_list.size())) {
-                    std::cout << "\n*** ALL METADATA FETCHED ***" << std::endl;
-                    break;
+                    metadata_done = true;
                 }
-                
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            });
+            
+            if (m_hash_list_reader) {
+                m_alert_dispatcher->every("metadata_list_retire", std::chrono::seconds(1), [this]() {
+                    retireMetadataHashList();
+                });
+                m_alert_dispatcher->every("metadata_list_checkpoint", std::chrono::seconds(10), [this]() {
+                    saveHashListCheckpoint();
+                });
             }
             
+            // Alerts are handled as they arrive; the progress timer ends the wait
+            m_alert_dispatcher->run([this, &metadata_done]() {
+                return m_running && !m_shutdown_requested && !metadata_done;
+            });
+            m_alert_dispatcher->clear_timers();
+            saveHashListCheckpoint();
+            
             gracefulShutdown();
             return;
         }
@@ -1122,99 +2484,100 @@ public:
         }
         
         auto start_time = std::chrono::steady_clock::now();
-        int progress_counter = 0;
         
         if (m_use_concurrent_mode) {
             if (m_verbose_mode) {
                 std::cout << "Using concurrent DHT worker pool (4 workers)" << std::endl;
             }
             
-            // Start concurrent DHT manager
+            // Start concurrent DHT manager, and the other session shards
             m_concurrent_dht->start();
+            startSessionShards();
             
-            // Main processing loop - now focuses on alert processing and metadata management
-            while (m_running && !m_shutdown_requested && 
-                   (max_queries < 0 || m_concurrent_dht->get_total_queries_sent() < max_queries)) {
-                
-                // Process alerts from libtorrent (this is the main bottleneck now)
-                processAlerts();
-                
-                // Request metadata for some discovered torrents (every 5 iterations for faster processing)
-                if (progress_counter % 5 == 0) {
-                    requestMetadataForDiscoveredTorrents();
-                }
-                
-                // Use BEP51 to get real infohashes (every 30 iterations)
-                if (progress_counter % 30 == 0) {
-                    queryBEP51Infohashes();
-                }
-                
-                // Use smart crawling for better infohash discovery (every 20 iterations)
-                if (progress_counter % 20 == 0 && m_smart_crawler && m_use_smart_mode) {
+            m_alert_dispatcher->every("db_health", std::chrono::seconds(10), [this]() {
+                checkDatabaseHealth();
+            });
+            
+            // Request metadata for some discovered torrents
+            m_alert_dispatcher->every("request_metadata", std::chrono::milliseconds(250), [this]() {
+                requestMetadataForDiscoveredTorrents();
+            });
+            
+            // Use BEP51 to get real infohashes
+            m_alert_dispatcher->every("bep51", std::chrono::milliseconds(1500), [this]() {
+                queryBEP51Infohashes();
+            });
+            
+            // Use smart crawling for better infohash discovery
+            if (m_smart_crawler && m_use_smart_mode) {
+                m_alert_dispatcher->every("smart_queries", std::chrono::seconds(1), [this]() {
                     m_smart_crawler->send_smart_queries();
-                }
-                
-                // Clean up timed out metadata requests (every 3 iterations for frequent cleanup)
-                if (progress_counter % 3 == 0) {
-                    m_metadata_worker_pool->cleanup_timeouts();
-                    // Mark timed out torrents in database
-                    auto timed_out_requests = m_metadata_worker_pool->get_timed_out_requests();
-                    for (const auto& hash : timed_out_requests) {
-                        m_mysql->markTorrentTimedOut(hash);
-                        
-                        // Enhanced timeout logging for metadata_log_mode
-                        if (m_metadata_log_mode) {
-                            std::cout << "[METADATA_LOG] *** METADATA TIMEOUT ***" << std::endl;
-                            std::cout << "[METADATA_LOG] Hash: " << hash << std::endl;
-                            std::cout << "[METADATA_LOG] Reason: Request timed out after 20 seconds" << std::endl;
-                            std::cout << "[METADATA_LOG] Status: No metadata received from peers" << std::endl;
-                            std::cout << "[METADATA_LOG] ------------------------" << std::endl;
-                        }
-                    }
-                }
-                
-                // Adjust concurrent limit dynamically (every 50 iterations)
-                if (progress_counter % 50 == 0) {
-                    m_metadata_downloader->adjust_concurrent_limit();
-                }
-                
-                progress_counter++;
+                });
+            }
+            
+            // Clean up timed out metadata requests
+            m_alert_dispatcher->every("metadata_timeouts", std::chrono::milliseconds(150), [this]() {
+                handleMetadataTimeouts();
+            });
+            
+            // Adjust concurrent limit dynamically
+            m_alert_dispatcher->every("adjust_concurrency", std::chrono::milliseconds(2500), [this]() {
+                m_metadata_downloader->adjust_concurrent_limit();
+            });
+            
+            // Crawl state snapshot, built and written in the background
+            if (m_snapshot_writer) {
+                m_alert_dispatcher->every("state_snapshot", std::chrono::seconds(m_mysql->getConfig().state_interval_seconds), [this]() {
+                    saveCrawlSnapshot(false);
+                });
+            }
+            
+            // Progress update
+            m_alert_dispatcher->every("progress", std::chrono::seconds(5), [this, start_time]() {
+                auto elapsed = std::chrono::steady_clock::now() - start_time;
+                auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
                 
-                // Progress update every 100 iterations
-                if (progress_counter % 100 == 0) {
-                    auto elapsed = std::chrono::steady_clock::now() - start_time;
-                    auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
+                if (m_verbose_mode) {
+                    std::cout << "\n*** PROGRESS UPDATE (CONCURRENT MODE) ***" << std::endl;
+                    std::cout << "Queries sent: " << totalQueriesSent() << std::endl;
+                    std::cout << "Queries generated: " << m_concurrent_dht->get_queries_generated() << std::endl;
+                    std::cout << "Active workers: " << m_concurrent_dht->get_active_workers() << std::endl;
+                    std::cout << "Torrents found: " << m_torrents_found << std::endl;
+                    std::cout << "Peers found: " << m_peers_found << std::endl;
+                    std::cout << "Metadata fetched: " << m_metadata_fetched << std::endl;
+                    std::cout << "Metadata queue: " << m_metadata_downloader->get_queue_size() << " pending, " << m_discovery_store->pending_count() << " waiting in discovery store" << std::endl;
+                    std::cout << "Active metadata requests: " << m_metadata_downloader->get_active_requests() << std::endl;
+                    std::cout << "Elapsed time: " << elapsed_seconds << " seconds" << std::endl;
+                    std::cout << "Rate: " << (totalQueriesSent() / (elapsed_seconds + 1)) << " queries/sec" << std::endl;
                     
-                    if (m_verbose_mode) {
-                        std::cout << "\n*** PROGRESS UPDATE (CONCURRENT MODE) ***" << std::endl;
-                        std::cout << "Queries sent: " << m_concurrent_dht->get_total_queries_sent() << std::endl;
-                        std::cout << "Queries generated: " << m_concurrent_dht->get_queries_generated() << std::endl;
-                        std::cout << "Active workers: " << m_concurrent_dht->get_active_workers() << std::endl;
-                        std::cout << "Torrents found: " << m_torrents_found << std::endl;
-                        std::cout << "Peers found: " << m_peers_found << std::endl;
-                        std::cout << "Metadata fetched: " << m_metadata_fetched << std::endl;
-                    std::cout << "Metadata queue: " << m_metadata_worker_pool->get_queue_size() << " pending (WORKER POOL)" << std::endl;
-                    std::cout << "Active metadata requests: " << m_metadata_worker_pool->get_active_requests() << " (10 workers)" << std::endl;
-                        std::cout << "Elapsed time: " << elapsed_seconds << " seconds" << std::endl;
-                        std::cout << "Rate: " << (m_concurrent_dht->get_total_queries_sent() / (elapsed_seconds + 1)) << " queries/sec" << std::endl;
-                        
-                        // Port forwarding status
-                        std::cout << "Listening on: 0.0.0.0:6881 (configured)" << std::endl;
-                        
-                        // Print concurrent DHT statistics
-                        m_concurrent_dht->print_statistics();
-                    } else {
-                        // Simple counter display
-                        std::cout << "\rHashes found - " << m_torrents_found << std::flush;
+                    // Port forwarding status
+                    std::cout << "Listening on: 0.0.0.0:6881 (configured)" << std::endl;
+                    
+                    // Print concurrent DHT statistics
+                    m_concurrent_dht->print_statistics();
+                    for (const auto& shard : m_shards) {
+                        shard->print_statistics();
                     }
+                    
+                    // Print ingest pipeline depth and latency
+                    printPipelineStatistics();
+                    printSessionStatistics();
+                } else {
+                    // Simple counter display
+                    std::cout << "\rHashes found - " << m_torrents_found << std::flush;
                 }
-                
-                // Reduced delay since workers are handling query generation
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            }
+            });
             
-            // Stop concurrent DHT manager
+            // Main processing loop - workers generate queries, this thread handles alerts and timers
+            m_alert_dispatcher->run([this, max_queries]() {
+                return m_running && !m_shutdown_requested && 
+                       (max_queries < 0 || totalQueriesSent() < max_queries);
+            });
+            m_alert_dispatcher->clear_timers();
+            
+            // Stop concurrent DHT manager and the other shards' sessions
             m_concurrent_dht->stop();
+            stopSessionShards();
             
         } else {
             // Fallback to original sequential mode
@@ -1223,24 +2586,25 @@ public:
             }
             
             int query_count = 0;
-            while (m_running && !m_shutdown_requested && (max_queries < 0 || query_count < max_queries)) {
+            
+            // One DHT query every 100ms
+            m_alert_dispatcher->every("dht_query", std::chrono::milliseconds(100), [this, &query_count]() {
                 // Generate random info hash
                 lt::sha1_hash random_hash;
                 for (int i = 0; i < 20; ++i) {
                     random_hash[i] = static_cast<unsigned char>(m_dis(m_gen));
                 }
                 
-                std::string hash_str = random_hash.to_string();
+                dht_crawler::InfoHash hash(random_hash);
                 
                 // Skip if we've already queried this hash
-                if (m_queried_hashes.find(hash_str) != m_queried_hashes.end()) {
-                    continue;
+                if (!m_query_filter->check_and_insert(hash)) {
+                    return;
                 }
-                m_queried_hashes.insert(hash_str);
                 
                 if (query_count % 50 == 0) {
                     std::cout << "\n--- Query " << (query_count + 1) << " ---" << std::endl;
-                    std::cout << "Hash: " << hash_str << std::endl;
+                    std::cout << "Hash: " << hash.to_hex() << std::endl;
                 }
                 
                 // Query DHT for peers
@@ -1252,68 +2616,71 @@ public:
                     std::cerr << "Error sending DHT queries: " << e.what() << std::endl;
                 }
                 
-                // Process alerts
-                processAlerts();
-                
-                // Request metadata for some discovered torrents (every 10 queries for faster processing)
-                if (query_count % 10 == 0) {
-                    requestMetadataForDiscoveredTorrents();
-                }
-                
-                // Clean up timed out metadata requests (every 5 queries for frequent cleanup)
-                if (query_count % 5 == 0) {
-                    m_metadata_worker_pool->cleanup_timeouts();
-                    // Mark timed out torrents in database
-                    auto timed_out_requests = m_metadata_worker_pool->get_timed_out_requests();
-                    for (const auto& hash : timed_out_requests) {
-                        m_mysql->markTorrentTimedOut(hash);
-                        
-                        // Enhanced timeout logging for metadata_log_mode
-                        if (m_metadata_log_mode) {
-                            std::cout << "[METADATA_LOG] *** METADATA TIMEOUT ***" << std::endl;
-                            std::cout << "[METADATA_LOG] Hash: " << hash << std::endl;
-                            std::cout << "[METADATA_LOG] Reason: Request timed out after 20 seconds" << std::endl;
-                            std::cout << "[METADATA_LOG] Status: No metadata received from peers" << std::endl;
-                            std::cout << "[METADATA_LOG] ------------------------" << std::endl;
-                        }
-                    }
-                }
-                
-                // Adjust concurrent limit dynamically (every 25 queries)
-                if (query_count % 25 == 0) {
-                    m_metadata_downloader->adjust_concurrent_limit();
-                }
-                
                 query_count++;
+            });
+            
+            // Request metadata for some discovered torrents
+            m_alert_dispatcher->every("db_health", std::chrono::seconds(10), [this]() {
+                checkDatabaseHealth();
+            });
+            
+            m_alert_dispatcher->every("request_metadata", std::chrono::seconds(1), [this]() {
+                requestMetadataForDiscoveredTorrents();
+            });
+            
+            // Clean up timed out metadata requests
+            m_alert_dispatcher->every("metadata_timeouts", std::chrono::milliseconds(500), [this]() {
+                handleMetadataTimeouts();
+            });
+            
+            // Adjust concurrent limit dynamically
+            m_alert_dispatcher->every("adjust_concurrency", std::chrono::milliseconds(2500), [this]() {
+                m_metadata_downloader->adjust_concurrent_limit();
+            });
+            
+            // Crawl state snapshot, built and written in the background
+            if (m_snapshot_writer) {
+                m_alert_dispatcher->every("state_snapshot", std::chrono::seconds(m_mysql->getConfig().state_interval_seconds), [this]() {
+                    saveCrawlSnapshot(false);
+                });
+            }
+            
+            // Progress update
+            m_alert_dispatcher->every("progress", std::chrono::seconds(10), [this, start_time]() {
+                auto elapsed = std::chrono::steady_clock::now() - start_time;
+                auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
                 
-                // Progress update every 100 queries
-                if (query_count % 100 == 0) {
-                    auto elapsed = std::chrono::steady_clock::now() - start_time;
-                    auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
+                if (m_verbose_mode) {
+                    std::cout << "\n*** PROGRESS UPDATE (SEQUENTIAL MODE) ***" << std::endl;
+                    std::cout << "Queries sent: " << m_total_queries << std::endl;
+                    std::cout << "Torrents found: " << m_torrents_found << std::endl;
+                    std::cout << "Peers found: " << m_peers_found << std::endl;
+                    std::cout << "Metadata fetched: " << m_metadata_fetched << std::endl;
+                    std::cout << "Metadata queue: " << m_metadata_downloader->get_queue_size() << " pending, " << m_discovery_store->pending_count() << " waiting in discovery store" << std::endl;
+                    std::cout << "Active metadata requests: " << m_metadata_downloader->get_active_requests() << std::endl;
+                    std::cout << "Elapsed time: " << elapsed_seconds << " seconds" << std::endl;
+                    std::cout << "Rate: " << (m_total_queries / (elapsed_seconds + 1)) << " queries/sec" << std::endl;
                     
-                    if (m_verbose_mode) {
-                        std::cout << "\n*** PROGRESS UPDATE (SEQUENTIAL MODE) ***" << std::endl;
-                        std::cout << "Queries sent: " << m_total_queries << std::endl;
-                        std::cout << "Torrents found: " << m_torrents_found << std::endl;
-                        std::cout << "Peers found: " << m_peers_found << std::endl;
-                        std::cout << "Metadata fetched: " << m_metadata_fetched << std::endl;
-                    std::cout << "Metadata queue: " << m_metadata_worker_pool->get_queue_size() << " pending (WORKER POOL)" << std::endl;
-                    std::cout << "Active metadata requests: " << m_metadata_worker_pool->get_active_requests() << " (10 workers)" << std::endl;
-                        std::cout << "Elapsed time: " << elapsed_seconds << " seconds" << std::endl;
-                        std::cout << "Rate: " << (m_total_queries / (elapsed_seconds + 1)) << " queries/sec" << std::endl;
-                    } else {
-                        // Simple counter display
-                        std::cout << "\rHashes found - " << m_torrents_found << std::flush;
-                    }
+                    // Print ingest pipeline depth and latency
+                    printPipelineStatistics();
+                    printSessionStatistics();
+                } else {
+                    // Simple counter display
+                    std::cout << "\rHashes found - " << m_torrents_found << std::flush;
                 }
-                
-                // Small delay between queries
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            }
+            });
+            
+            m_alert_dispatcher->run([this, max_queries, &query_count]() {
+                return m_running && !m_shutdown_requested && (max_queries < 0 || query_count < max_queries);
+            });
+            m_alert_dispatcher->clear_timers();
         }
         
         m_running = false;
         
+        // Flush sightings still in flight to MySQL and the metadata queue
+        stopIngestPipeline();
+        
         // Final summary
         auto total_elapsed = std::chrono::steady_clock::now() - start_time;
         auto total_seconds = std::chrono::duration_cast<std::chrono::seconds>(total_elapsed).count();
@@ -1322,7 +2689,7 @@ public:
             std::cout << "\n=== CRAWLING COMPLETE ===" << std::endl;
             if (m_use_concurrent_mode) {
                 std::cout << "Mode: Concurrent DHT Worker Pool" << std::endl;
-                std::cout << "Total queries sent: " << m_concurrent_dht->get_total_queries_sent() << std::endl;
+                std::cout << "Total queries sent: " << totalQueriesSent() << std::endl;
                 std::cout << "Total queries generated: " << m_concurrent_dht->get_queries_generated() << std::endl;
                 std::cout << "Active workers: " << m_concurrent_dht->get_active_workers() << std::endl;
             } else {
@@ -1337,7 +2704,7 @@ public:
             std::cout << "Total metadata processed: " << m_metadata_downloader->get_total_processed() << std::endl;
             std::cout << "Total elapsed time: " << total_seconds << " seconds" << std::endl;
             
-            int total_queries = m_use_concurrent_mode ? m_concurrent_dht->get_total_queries_sent() : m_total_queries;
+            int total_queries = m_use_concurrent_mode ? totalQueriesSent() : m_total_queries;
             std::cout << "Average rate: " << (total_queries / (total_seconds + 1)) << " queries/sec" << std::endl;
         } else {
             // Simple final counter
@@ -1405,22 +2772,11 @@ public:
         }
         
         // Process collected infohashes for metadata fetching
-        auto infohashes = m_bep51_indexer->get_collected_infohashes();
-        for (const auto& infohash : infohashes) {
-            // Convert binary infohash to hex string
-            std::string hex_hash;
-            for (unsigned char c : infohash) {
-                char hex[3];
-                snprintf(hex, sizeof(hex), "%02x", c);
-                hex_hash += hex;
-            }
-            
-            // Queue for metadata fetching
-            if (m_metadata_requested.find(hex_hash) == m_metadata_requested.end()) {
-                if (m_metadata_downloader->request_metadata(hex_hash, 5, "BEP51")) { // Highest priority
-                    m_metadata_requested.insert(hex_hash);
-                    std::cout << "BEP51: Queued metadata request for: " << hex_hash << std::endl;
-                }
+        auto infohashes = m_bep51_indexer->get_collected_infohashes();
+        for (const auto& infohash : infohashes) {
+            // New hashes join the discovery store's request queue
+            if (!m_discovery_store->contains(infohash)) {
+                m_discovery_store->record_sighting(infohash, dht_crawler::DiscoverySource::BEP51);
             }
         }
         
@@ -1433,12 +2789,36 @@ public:
         std::cout << "\n*** GRACEFUL SHUTDOWN INITIATED ***" << std::endl;
         std::cout << "Saving final statistics..." << std::endl;
         
+        // No more metadata alerts once storage starts shutting down
+        if (m_metadata_session) {
+            m_metadata_session->stop();
+        }
+        
+        // Flush sightings still in flight to MySQL and the metadata queue
+        stopIngestPipeline();
+        
+        // Final snapshot, after the pipeline has drained into the stores
+        if (m_snapshot_writer) {
+            saveCrawlSnapshot(true);
+            m_snapshot_writer->print_statistics();
+        }
+        
+        if (m_backlog_reader) {
+            m_backlog_reader->stop();
+            m_backlog_reader->print_statistics();
+        }
+        
+        // Write out aggregated errors while the connection is still up
+        m_error_sink->stop();
+        m_error_sink->print_statistics();
+        
         // Save final statistics
         std::cout << "Final Statistics:" << std::endl;
         std::cout << "- Total queries sent: " << m_total_queries << std::endl;
         std::cout << "- Total torrents found: " << m_torrents_found << std::endl;
         std::cout << "- Total peers found: " << m_peers_found << std::endl;
         std::cout << "- Total metadata fetched: " << m_metadata_fetched << std::endl;
+        printSessionStatistics();
         
         // Print enhanced metadata statistics
         if (m_metadata_manager) {
@@ -1459,6 +2839,19 @@ public:
             std::cout << "- Queue size: " << m_metadata_worker_pool->get_queue_size() << std::endl;
         }
         
+        // Print alert dispatch counters
+        if (m_alert_dispatcher) {
+            m_alert_dispatcher->print_statistics();
+        }
+        
+        // Print per-stage queue depth and latency
+        printPipelineStatistics();
+        
+        // Print discovery store usage and eviction counters
+        if (m_discovery_store) {
+            m_discovery_store->print_statistics();
+        }
+        
         // Clean up metadata worker pool
         if (m_metadata_worker_pool) {
             std::cout << "Shutting down metadata worker pool..." << std::endl;
@@ -1466,311 +2859,488 @@ public:
             m_metadata_worker_pool.reset();
         }
         
+        // Remove the metadata torrents still in the session
+        if (m_torrent_handles) {
+            m_torrent_handles->release_all();
+        }
+        
         std::cout << "*** SHUTDOWN COMPLETE ***" << std::endl;
     }
 
 private:
-    void processAlerts() {
-        std::vector<lt::alert*> alerts;
-        m_session->pop_alerts(&alerts);
-        
-        if (m_debug_mode && !alerts.empty()) {
-            std::cout << "[DEBUG] Processing " << alerts.size() << " alerts" << std::endl;
-        }
+    void setupAlertHandlers() {
+        m_alert_dispatcher->set_trace(m_debug_mode);
         
-        for (lt::alert* alert : alerts) {
-            if (m_debug_mode) {
-                std::cout << "[DEBUG] Alert type: " << alert->type() << " - " << alert->message() << std::endl;
-            }
-            // Handle DHT get peers reply
-            if (alert->type() == lt::dht_get_peers_reply_alert::alert_type) {
-                auto* reply_alert = lt::alert_cast<lt::dht_get_peers_reply_alert>(alert);
-                if (reply_alert && !reply_alert->peers().empty()) {
-                    handlePeerReply(reply_alert);
-                }
-            }
-            
-            // Handle DHT announce
-            if (alert->type() == lt::dht_announce_alert::alert_type) {
-                auto* announce_alert = lt::alert_cast<lt::dht_announce_alert>(alert);
-                if (announce_alert) {
-                    handleAnnounce(announce_alert);
-                }
-            }
-            
-            // Handle DHT immutable item
-            if (alert->type() == lt::dht_immutable_item_alert::alert_type) {
-                auto* item_alert = lt::alert_cast<lt::dht_immutable_item_alert>(alert);
-                if (item_alert) {
-                    handleImmutableItem(item_alert);
-                }
+        // DHT bootstrap (initialize() waits on this)
+        m_alert_dispatcher->on<lt::dht_bootstrap_alert>([this](lt::dht_bootstrap_alert*) {
+            if (!m_dht_bootstrapped) {
+                m_dht_bootstrapped = true;
+                std::cout << "*** DHT Bootstrap completed! ***" << std::endl;
             }
-            
-            // Handle peer connect alerts
-            if (alert->type() == lt::peer_connect_alert::alert_type) {
-                auto* peer_alert = lt::alert_cast<lt::peer_connect_alert>(alert);
-                if (peer_alert) {
-                    std::cout << "[DEBUG] *** PEER CONNECTED *** " << peer_alert->endpoint << std::endl;
-                    if (m_debug_mode) {
-                        std::cout << "[DEBUG] Peer connection details: " << peer_alert->message() << std::endl;
-                    }
-                }
+        });
+        
+        // Handle DHT get peers reply
+        m_alert_dispatcher->on<lt::dht_get_peers_reply_alert>([this](lt::dht_get_peers_reply_alert* alert) {
+            if (!alert->peers().empty()) {
+                handlePeerReply(alert);
             }
+        });
+        
+        // Handle DHT announce
+        m_alert_dispatcher->on<lt::dht_announce_alert>([this](lt::dht_announce_alert* alert) {
+            handleAnnounce(alert);
+        });
+        
+        // Handle DHT immutable item
+        m_alert_dispatcher->on<lt::dht_immutable_item_alert>([this](lt::dht_immutable_item_alert* alert) {
+            handleImmutableItem(alert);
+        });
+        
+        // Torrent alerts come from whichever session holds the metadata
+        // torrents; a separate metadata session dispatches them on its own thread
+        if (m_metadata_session) {
+            setupMetadataAlertHandlers(m_metadata_session->dispatcher());
+            m_metadata_session->start();
+        } else {
+            setupMetadataAlertHandlers(*m_alert_dispatcher);
+        }
+        
+        m_alert_dispatcher->apply_alert_mask();
+    }
+    
+    void setupMetadataAlertHandlers(dht_crawler::AlertDispatcher& dispatcher) {
+        dispatcher.set_trace(m_debug_mode);
+        
+        // Handle metadata received
+        dispatcher.on<lt::metadata_received_alert>([this](lt::metadata_received_alert* alert) {
+            handleMetadataReceived(alert);
+        });
+        
+        // Invalid metadata or a torrent error ends the request
+        dispatcher.on<lt::metadata_failed_alert>([this](lt::metadata_failed_alert* alert) {
+            handleMetadataFailed(alert->handle, alert->message());
+        });
+        dispatcher.on<lt::torrent_error_alert>([this](lt::torrent_error_alert* alert) {
+            handleMetadataFailed(alert->handle, alert->message());
+        });
+        
+        // Peer, connection and state alerts are only logged, so only subscribe
+        // to their categories when debugging
+        if (m_debug_mode) {
+            dispatcher.on<lt::peer_connect_alert>([](lt::peer_connect_alert* alert) {
+                std::cout << "[DEBUG] *** PEER CONNECTED *** " << alert->endpoint << std::endl;
+                std::cout << "[DEBUG] Peer connection details: " << alert->message() << std::endl;
+            });
             
-            // Handle peer disconnect alerts
-            if (alert->type() == lt::peer_disconnected_alert::alert_type) {
-                auto* peer_alert = lt::alert_cast<lt::peer_disconnected_alert>(alert);
-                if (peer_alert) {
-                    std::cout << "[DEBUG] *** PEER DISCONNECTED *** " << peer_alert->endpoint << " - " << peer_alert->message() << std::endl;
-                }
-            }
+            dispatcher.on<lt::peer_disconnected_alert>([](lt::peer_disconnected_alert* alert) {
+                std::cout << "[DEBUG] *** PEER DISCONNECTED *** " << alert->endpoint << " - " << alert->message() << std::endl;
+            });
             
-            // Handle connection errors
-            if (alert->type() == lt::peer_error_alert::alert_type) {
-                auto* error_alert = lt::alert_cast<lt::peer_error_alert>(alert);
-                if (error_alert) {
-                    std::cout << "[DEBUG] *** PEER ERROR *** " << error_alert->endpoint << " - " << error_alert->message() << std::endl;
-                }
-            }
+            dispatcher.on<lt::peer_error_alert>([](lt::peer_error_alert* alert) {
+                std::cout << "[DEBUG] *** PEER ERROR *** " << alert->endpoint << " - " << alert->message() << std::endl;
+            });
             
-            // Handle torrent connection alerts
-            if (alert->type() == lt::add_torrent_alert::alert_type) {
-                auto* torrent_alert = lt::alert_cast<lt::add_torrent_alert>(alert);
-                if (torrent_alert) {
-                    std::cout << "[DEBUG] *** TORRENT ADDED *** " << torrent_alert->message() << std::endl;
-                }
-            }
+            dispatcher.on<lt::add_torrent_alert>([](lt::add_torrent_alert* alert) {
+                std::cout << "[DEBUG] *** TORRENT ADDED *** " << alert->message() << std::endl;
+            });
             
-            // Handle state change alerts
-            if (alert->type() == lt::state_changed_alert::alert_type) {
-                auto* state_alert = lt::alert_cast<lt::state_changed_alert>(alert);
-                if (state_alert && m_debug_mode) {
-                    std::cout << "[DEBUG] State changed: " << state_alert->message() << std::endl;
-                }
-            }
+            dispatcher.on<lt::state_changed_alert>([](lt::state_changed_alert* alert) {
+                std::cout << "[DEBUG] State changed: " << alert->message() << std::endl;
+            });
+        }
+    }
+    
+    void handleMetadataTimeouts() {
+        // Mark timed out torrents in database
+        auto timed_out_requests = m_metadata_worker_pool->cleanup_timeouts();
+        for (const auto& hash : timed_out_requests) {
+            m_storage->markTorrentTimedOut(hash);
             
-            // Handle metadata received
-            if (alert->type() == lt::metadata_received_alert::alert_type) {
-                auto* metadata_alert = lt::alert_cast<lt::metadata_received_alert>(alert);
-                if (metadata_alert) {
-                    handleMetadataReceived(metadata_alert);
-                }
+            // Enhanced timeout logging for metadata_log_mode
+            if (m_metadata_log_mode) {
+                std::cout << "[METADATA_LOG] *** METADATA TIMEOUT ***" << std::endl;
+                std::cout << "[METADATA_LOG] Hash: " << hash << std::endl;
+                std::cout << "[METADATA_LOG] Reason: Request timed out after 20 seconds" << std::endl;
+                std::cout << "[METADATA_LOG] Status: No metadata received from peers" << std::endl;
+                std::cout << "[METADATA_LOG] ------------------------" << std::endl;
             }
         }
     }
     
+    // *** INGEST PIPELINE ***
+    // alert thread -> decode -> state -> {storage, metadata scheduling}
+    
+    dht_crawler::DiscoverySource sightingSource(SightingKind kind) const {
+        switch (kind) {
+            case SightingKind::PEER_REPLY: return dht_crawler::DiscoverySource::DHT_PEERS;
+            case SightingKind::ANNOUNCE: return dht_crawler::DiscoverySource::DHT_ANNOUNCE;
+            case SightingKind::IMMUTABLE_ITEM: return dht_crawler::DiscoverySource::DHT_ITEM;
+        }
+        return dht_crawler::DiscoverySource::UNKNOWN;
+    }
+    
+    // Noun used in log output ("announced torrent", "DHT item")
+    const char* sightingLabel(SightingKind kind) const {
+        switch (kind) {
+            case SightingKind::PEER_REPLY: return "torrent";
+            case SightingKind::ANNOUNCE: return "announced torrent";
+            case SightingKind::IMMUTABLE_ITEM: return "DHT item";
+        }
+        return "torrent";
+    }
+    
+    void startIngestPipeline() {
+        for (auto& writer : m_torrent_writers) {
+            writer->start();
+        }
+        m_decode_stage->start();
+        m_state_stage->start();
+        m_storage_stage->start();
+        m_metadata_stage->start();
+        m_info_dict_stage->start();
+    }
+    
+    // Drain and stop the stages in pipeline order so nothing queued is lost
+    void stopIngestPipeline() {
+        if (m_decode_stage) m_decode_stage->stop();
+        if (m_state_stage) m_state_stage->stop();
+        if (m_storage_stage) m_storage_stage->stop();
+        if (m_metadata_stage) m_metadata_stage->stop();
+        if (m_info_dict_stage) m_info_dict_stage->stop();
+        for (auto& writer : m_torrent_writers) {
+            writer->stop(); // Flushes buffered sightings
+        }
+    }
+    
+    // Session holding the metadata torrents: the dedicated one when enabled
+    lt::session* metadataSession() {
+        return m_metadata_session ? m_metadata_session->session() : m_session.get();
+    }
+    
+    // Throughput of the crawling session, and of the metadata session when separate
+    void printSessionStatistics() const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - m_started_at).count();
+        std::cout << "=== DHT Session Statistics ===" << std::endl;
+        std::cout << "Alerts dispatched: " << m_alert_dispatcher->get_alerts_dispatched()
+                  << " (" << m_alert_dispatcher->get_alerts_dispatched() / (elapsed + 1) << "/s)" << std::endl;
+        std::cout << "Sightings stored: " << m_torrents_found
+                  << " (" << m_torrents_found / (elapsed + 1) << "/s)" << std::endl;
+        std::cout << "==============================" << std::endl;
+        if (m_metadata_session) {
+            m_metadata_session->print_statistics();
+        }
+        if (m_torrent_handles) {
+            m_torrent_handles->print_statistics();
+        }
+    }
+    
+    void printPipelineStatistics() const {
+        std::cout << "=== Ingest Pipeline Statistics ===" << std::endl;
+        m_decode_stage->print_statistics();
+        m_state_stage->print_statistics();
+        m_storage_stage->print_statistics();
+        m_metadata_stage->print_statistics();
+        m_info_dict_stage->print_statistics();
+        std::cout << "Info dicts captured: " << m_info_dict_capture->get_captured()
+                  << " (dropped " << m_info_dict_capture->get_dropped() << ")" << std::endl;
+        std::cout << "==================================" << std::endl;
+        if (m_torrent_archive) {
+            m_torrent_archive->print_statistics();
+        }
+        for (const auto& writer : m_torrent_writers) {
+            writer->print_statistics();
+        }
+        if (m_storage) {
+            m_storage->printStatistics();
+        }
+    }
+    
+    // Alert thread: copy what we need out of the alert and hand off. Never
+    // blocks; if the decode stage is full the sighting is dropped and counted.
+    void enqueueSighting(const dht_crawler::InfoHash& hash, SightingKind kind, std::vector<lt::tcp::endpoint> peers = {}) {
+        SightingEvent event;
+        event.hash = hash;
+        event.kind = kind;
+        event.peers = std::move(peers);
+        if (!m_decode_stage->try_push(std::move(event)) && m_debug_mode) {
+            std::cout << "[DEBUG] Decode stage full, dropped sighting: " << hash.to_hex() << std::endl;
+        }
+    }
+    
     void handlePeerReply(lt::dht_get_peers_reply_alert* alert) {
-        std::string hash_binary = alert->info_hash.to_string();
-        std::string hash_str;
-        for (unsigned char c : hash_binary) {
-            char hex[3];
-            snprintf(hex, sizeof(hex), "%02x", c);
-            hash_str += hex;
-        }
-        
-        DiscoveredTorrent torrent;
-        torrent.info_hash = hash_str;
-        torrent.name = "Unknown Torrent";
-        torrent.size = 0;
-        torrent.num_files = 0;
-        torrent.source = "DHT_PEERS";
-        torrent.metadata_received = false;
-        torrent.timed_out = false;
-        torrent.discovered_time = std::chrono::steady_clock::now();
-        torrent.last_seen_time = std::chrono::steady_clock::now();
-        
-        // Initialize all metadata fields
-        torrent.comment = "";
-        torrent.created_by = "";
-        torrent.creation_date = 0;
-        torrent.encoding = "";
-        torrent.piece_length = 0;
-        torrent.num_pieces = 0;
-        torrent.private_torrent = false;
-        torrent.magnet_link = "magnet:?xt=urn:btih:" + hash_str;
-        torrent.announce_url = "";
-        torrent.content_type = "";
-        torrent.language = "";
-        torrent.category = "";
-        torrent.seeders_count = 0;
-        torrent.leechers_count = 0;
-        torrent.download_speed = 0;
-        
-        // Store peer information
-        for (const auto& peer : alert->peers()) {
-            std::string peer_str = peer.address().to_string() + ":" + std::to_string(peer.port());
-            torrent.peers.push_back(peer_str);
-            m_peers_found++;
+        enqueueSighting(dht_crawler::InfoHash(alert->info_hash), SightingKind::PEER_REPLY, alert->peers());
+    }
+    
+    void handleAnnounce(lt::dht_announce_alert* alert) {
+        enqueueSighting(dht_crawler::InfoHash(alert->info_hash), SightingKind::ANNOUNCE);
+    }
+    
+    void handleImmutableItem(lt::dht_immutable_item_alert* alert) {
+        enqueueSighting(dht_crawler::InfoHash(alert->target), SightingKind::IMMUTABLE_ITEM);
+    }
+    
+    // Decode stage: hex-encode and build the sighting row
+    void decodeSighting(SightingEvent& event) {
+        DecodedSighting sighting;
+        sighting.hash = event.hash;
+        sighting.kind = event.kind;
+        
+        TorrentSighting& torrent = sighting.torrent;
+        torrent.info_hash = event.hash.to_hex();
+        switch (event.kind) {
+            case SightingKind::PEER_REPLY: torrent.name = "Unknown Torrent"; break;
+            case SightingKind::ANNOUNCE: torrent.name = "Announced Torrent"; break;
+            case SightingKind::IMMUTABLE_ITEM: torrent.name = "DHT Item"; break;
         }
+        torrent.source = dht_crawler::source_name(sightingSource(event.kind));
+        
+        // Pack peers into compact 6/18-byte form; they are only formatted
+        // again when written out
+        torrent.peer_endpoints.assign(event.peers);
+        m_peers_found += static_cast<int>(torrent.peer_endpoints.size());
+        
+        m_state_stage->push(std::move(sighting));
+    }
+    
+    // State stage: discovery bookkeeping, then on to storage
+    void applySighting(DecodedSighting& sighting) {
+        const std::string& hash_str = sighting.torrent.info_hash;
         
         // Record observation for smart crawling
-        if (m_smart_crawler && m_use_smart_mode) {
+        if (sighting.kind == SightingKind::PEER_REPLY && m_smart_crawler && m_use_smart_mode) {
             m_smart_crawler->record_incoming_observation(hash_str, "peer_reply", 
-                                                       torrent.peers.size(), torrent.peers);
+                                                       sighting.torrent.peer_endpoints.size(), sighting.torrent.peer_endpoints);
         }
         
-        // Store in memory and database
-        m_discovered_torrents[hash_str] = torrent;
-        if (m_mysql->isConnected() && m_mysql->storeTorrent(torrent)) {
-            m_torrents_found++;
-            std::cout << "Stored torrent with " << torrent.peers.size() << " peers: " << hash_str << std::endl;
-        } else {
-            m_torrents_found++;
-            std::cout << "Found torrent with " << torrent.peers.size() << " peers: " << hash_str << " (test mode)" << std::endl;
+        m_discovery_store->record_sighting(sighting.hash, sightingSource(sighting.kind), sighting.torrent.peer_endpoints.size());
+        
+        // New hashes wait in the discovery store's request queue, best source
+        // first, until requestMetadataForDiscoveredTorrents() hands them out;
+        // the reply's peers are kept for when the request starts
+        if (sighting.kind == SightingKind::PEER_REPLY) {
+            m_metadata_downloader->add_peer_hints(hash_str, sighting.torrent.peer_endpoints);
         }
         
-        // Automatically queue for metadata fetching if we haven't already requested it
-        if (m_metadata_requested.find(hash_str) == m_metadata_requested.end()) {
-            if (m_metadata_downloader->request_metadata(hash_str, 3, "DHT_PEERS")) { // High priority for peer-discovered torrents
-                m_metadata_requested.insert(hash_str);
-                std::cout << "Auto-queued metadata request for: " << hash_str << std::endl;
-            } else {
-                std::cout << "Failed to auto-queue metadata for: " << hash_str << std::endl;
-                if (m_debug_mode) {
-                    std::cout << "[DEBUG] Active metadata requests: " << m_metadata_downloader->get_active_requests() << std::endl;
-                    std::cout << "[DEBUG] Available slots: " << m_metadata_downloader->get_available_slots() << std::endl;
-                    m_metadata_downloader->print_status();
-                }
-            }
+        m_storage_stage->push(std::move(sighting));
+    }
+    
+    // Storage stage: hands sightings to the write-behind writer, blocking
+    // only while its buffer is full
+    void storeSighting(DecodedSighting& sighting) {
+        std::string what = sighting.kind == SightingKind::PEER_REPLY
+            ? "torrent with " + std::to_string(sighting.torrent.peer_endpoints.size()) + " peers"
+            : sightingLabel(sighting.kind);
+        std::string info_hash = sighting.torrent.info_hash;
+        
+        // Writes to the same info-hash always go through the same shard
+        size_t shard = static_cast<size_t>(sighting.hash.prefix64() % m_torrent_writers.size());
+        if (!m_torrent_writers[shard]->add(std::move(sighting.torrent))) {
+            return; // Writer stopped during shutdown
+        }
+        m_torrents_found++;
+        
+        if (m_storage->isStoring()) {
+            std::cout << "Queued " << what << " for storage: " << info_hash << std::endl;
+        } else {
+            std::cout << "Found " << what << ": " << info_hash << " (test mode)" << std::endl;
+        }
+    }
+    
+    // Rough heap footprint of a buffered row, for the writer's byte budget
+    static size_t estimateSightingBytes(const TorrentSighting& torrent) {
+        return sizeof(TorrentSighting) + torrent.info_hash.capacity() + torrent.name.capacity() +
+               torrent.source.capacity() + torrent.peer_endpoints.memory_bytes();
+    }
+    
+    // Writer thread of one shard: store a sorted batch
+    bool flushTorrentShard(size_t shard, std::vector<TorrentSighting>& rows) {
+        return m_storage->storeSightingBatch(shard, rows);
+    }
+    
+    // Alert thread timer: storage upkeep (reconnects, keepalives)
+    void checkDatabaseHealth() {
+        m_storage->checkHealth();
+    }
+    
+    // Metadata scheduling stage: owns request submission to the downloader
+    void scheduleMetadata(MetadataJob& job) {
+        if (m_metadata_downloader->request_metadata(job.info_hash, job.priority, job.source)) {
+            std::cout << "Auto-queued metadata request for " << job.label << ": " << job.info_hash << std::endl;
         } else {
+            std::cout << "Failed to auto-queue metadata for " << job.label << ": " << job.info_hash << std::endl;
             if (m_debug_mode) {
-                std::cout << "[DEBUG] Metadata already requested for peer torrent: " << hash_str << std::endl;
+                std::cout << "[DEBUG] Active metadata requests: " << m_metadata_downloader->get_active_requests() << std::endl;
+                std::cout << "[DEBUG] Available slots: " << m_metadata_downloader->get_available_slots() << std::endl;
+                m_metadata_downloader->print_status();
             }
         }
     }
     
-    void handleAnnounce(lt::dht_announce_alert* alert) {
-        std::string hash_binary = alert->info_hash.to_string();
-        std::string hash_str;
-        for (unsigned char c : hash_binary) {
-            char hex[3];
-            snprintf(hex, sizeof(hex), "%02x", c);
-            hash_str += hex;
-        }
-        
-        DiscoveredTorrent torrent;
-        torrent.info_hash = hash_str;
-        torrent.name = "Announced Torrent";
-        torrent.size = 0;
-        torrent.num_files = 0;
-        torrent.source = "DHT_ANNOUNCE";
-        torrent.metadata_received = false;
-        torrent.timed_out = false;
-        torrent.discovered_time = std::chrono::steady_clock::now();
-        torrent.last_seen_time = std::chrono::steady_clock::now();
-        
-        // Initialize all metadata fields
-        torrent.comment = "";
-        torrent.created_by = "";
-        torrent.creation_date = 0;
-        torrent.encoding = "";
-        torrent.piece_length = 0;
-        torrent.num_pieces = 0;
-        torrent.private_torrent = false;
-        torrent.magnet_link = "magnet:?xt=urn:btih:" + hash_str;
-        torrent.announce_url = "";
-        torrent.content_type = "";
-        torrent.language = "";
-        torrent.category = "";
-        torrent.seeders_count = 0;
-        torrent.leechers_count = 0;
-        torrent.download_speed = 0;
-        
-        // Store in memory and database
-        m_discovered_torrents[hash_str] = torrent;
-        if (m_mysql->isConnected() && m_mysql->storeTorrent(torrent)) {
-            m_torrents_found++;
-            std::cout << "Stored announced torrent: " << hash_str << std::endl;
-        } else {
-            m_torrents_found++;
-            std::cout << "Found announced torrent: " << hash_str << " (test mode)" << std::endl;
+    // Serialize the crawl state. Runs on the snapshot writer's thread (on
+    // the calling thread at shutdown): DHT state comes from the session, the
+    // discovery store is walked one shard at a time under that shard's lock,
+    // and the metadata queues and query filter are read under their own
+    // locks. The BEP51 indexer has no lock, so the alert thread copies its
+    // nodes beforehand.
+    std::string buildCrawlSnapshot(const std::vector<std::string>& bep51_nodes) {
+        dht_crawler::SnapshotBuilder builder;
+        
+        std::vector<char> dht_state = lt::write_session_params_buf(
+            m_session->session_state(lt::session::save_dht_state), lt::session::save_dht_state);
+        builder.begin_section(dht_crawler::SnapshotSection::DHT_STATE);
+        builder.put_bytes(dht_state.data(), dht_state.size());
+        
+        // Times are stored as seconds before the snapshot was taken
+        auto now = std::chrono::steady_clock::now();
+        auto age = [now](std::chrono::steady_clock::time_point time) {
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(now - time).count();
+            return static_cast<uint32_t>(std::max<int64_t>(seconds, 0));
+        };
+        builder.begin_section(dht_crawler::SnapshotSection::DISCOVERY);
+        m_discovery_store->for_each([&builder, &age](const dht_crawler::DiscoveryRecord& record) {
+            builder.put_bytes(record.info_hash.bytes.data(), dht_crawler::InfoHash::SIZE);
+            builder.put_u8(static_cast<uint8_t>(record.source));
+            builder.put_u8((record.metadata_stored ? 1 : 0) | (record.request_pending ? 2 : 0) | (record.requested ? 4 : 0));
+            builder.put_u32(age(record.first_seen));
+            builder.put_u32(age(record.last_seen));
+            builder.put_u32(record.sightings);
+            builder.put_u32(record.peer_count);
+        });
+        
+        // Target 0: persistent downloader (hex hashes), 1: worker pool
+        builder.begin_section(dht_crawler::SnapshotSection::METADATA_QUEUE);
+        for (const auto& entry : m_metadata_downloader->get_outstanding_requests()) {
+            dht_crawler::InfoHash hash;
+            if (!dht_crawler::InfoHash::parse(entry.hash, hash)) continue;
+            builder.put_u8(0);
+            builder.put_bytes(hash.bytes.data(), dht_crawler::InfoHash::SIZE);
+            builder.put_i32(entry.priority);
+            builder.put_string(entry.source);
         }
+        for (const auto& request : m_metadata_worker_pool->get_outstanding_requests()) {
+            builder.put_u8(1);
+            builder.put_bytes(request.info_hash.bytes.data(), dht_crawler::InfoHash::SIZE);
+            builder.put_i32(request.priority);
+            builder.put_string(request.source);
+        }
+        
+        builder.begin_section(dht_crawler::SnapshotSection::BEP51_NODES);
+        for (const auto& node_id : bep51_nodes) {
+            builder.put_bytes(node_id.data(), node_id.size());
+        }
+        
+        builder.begin_section(dht_crawler::SnapshotSection::QUERY_FILTER);
+        builder.put_string(m_query_filter->name());
+        std::string filter_state;
+        m_query_filter->save_state(filter_state);
+        builder.put_bytes(filter_state.data(), filter_state.size());
         
-        // Automatically queue for metadata fetching if we haven't already requested it
-        if (m_metadata_requested.find(hash_str) == m_metadata_requested.end()) {
-            if (m_metadata_downloader->request_metadata(hash_str, 2, "DHT_ANNOUNCE")) { // Medium priority for announced torrents
-                m_metadata_requested.insert(hash_str);
-                std::cout << "Auto-queued metadata request for announced torrent: " << hash_str << std::endl;
+        return builder.finish();
+    }
+    
+    // @param wait Build and write on the calling thread (shutdown) instead
+    //             of handing both to the writer thread
+    void saveCrawlSnapshot(bool wait) {
+        try {
+            std::vector<std::string> bep51_nodes = m_bep51_indexer->get_known_nodes();
+            if (wait) {
+                m_snapshot_writer->wait();
+                m_snapshot_writer->write(buildCrawlSnapshot(bep51_nodes));
             } else {
-                std::cout << "Failed to auto-queue metadata for announced torrent: " << hash_str << std::endl;
-                if (m_debug_mode) {
-                    std::cout << "[DEBUG] Active metadata requests: " << m_metadata_downloader->get_active_requests() << std::endl;
-                    std::cout << "[DEBUG] Available slots: " << m_metadata_downloader->get_available_slots() << std::endl;
-                    m_metadata_downloader->print_status();
-                }
-            }
-        } else {
-            if (m_debug_mode) {
-                std::cout << "[DEBUG] Metadata already requested for announced torrent: " << hash_str << std::endl;
+                // Skipped, without serializing anything, while the previous
+                // snapshot is still in progress
+                m_snapshot_writer->write_async([this, bep51_nodes = std::move(bep51_nodes)]() {
+                    return buildCrawlSnapshot(bep51_nodes);
+                });
             }
+        } catch (const std::exception& e) {
+            m_mysql->logException("DHTTorrentCrawler::saveCrawlSnapshot", "", e);
         }
     }
     
-    void handleImmutableItem(lt::dht_immutable_item_alert* alert) {
-        std::string hash_binary = alert->target.to_string();
-        std::string hash_str;
-        for (unsigned char c : hash_binary) {
-            char hex[3];
-            snprintf(hex, sizeof(hex), "%02x", c);
-            hash_str += hex;
-        }
-        
-        DiscoveredTorrent torrent;
-        torrent.info_hash = hash_str;
-        torrent.name = "DHT Item";
-        torrent.size = 0;
-        torrent.num_files = 0;
-        torrent.source = "DHT_ITEM";
-        torrent.metadata_received = false;
-        torrent.timed_out = false;
-        torrent.discovered_time = std::chrono::steady_clock::now();
-        torrent.last_seen_time = std::chrono::steady_clock::now();
-        
-        // Initialize all metadata fields
-        torrent.comment = "";
-        torrent.created_by = "";
-        torrent.creation_date = 0;
-        torrent.encoding = "";
-        torrent.piece_length = 0;
-        torrent.num_pieces = 0;
-        torrent.private_torrent = false;
-        torrent.magnet_link = "magnet:?xt=urn:btih:" + hash_str;
-        torrent.announce_url = "";
-        torrent.content_type = "";
-        torrent.language = "";
-        torrent.category = "";
-        torrent.seeders_count = 0;
-        torrent.leechers_count = 0;
-        torrent.download_speed = 0;
-        
-        // Store in memory and database
-        m_discovered_torrents[hash_str] = torrent;
-        if (m_mysql->isConnected() && m_mysql->storeTorrent(torrent)) {
-            m_torrents_found++;
-            std::cout << "Stored DHT item: " << hash_str << std::endl;
-        } else {
-            m_torrents_found++;
-            std::cout << "Found DHT item: " << hash_str << " (test mode)" << std::endl;
+    // Load each section into its component. Sections are independent: one
+    // that fails to parse is skipped without affecting the others.
+    void restoreCrawlSnapshot(const dht_crawler::CrawlSnapshot& snapshot) {
+        using dht_crawler::SnapshotSection;
+        
+        // Ages in the snapshot are relative to when it was taken; the
+        // crawler was down for a while since
+        auto downtime = std::chrono::system_clock::now() - snapshot.created();
+        auto taken = std::chrono::steady_clock::now() -
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::max(downtime, decltype(downtime)::zero()));
+        
+        std::vector<dht_crawler::DiscoveryRecord> records;
+        dht_crawler::SnapshotCursor cursor = snapshot.section(SnapshotSection::DISCOVERY);
+        while (cursor.ok() && !cursor.at_end()) {
+            dht_crawler::DiscoveryRecord record;
+            cursor.get_bytes(record.info_hash.bytes.data(), dht_crawler::InfoHash::SIZE);
+            record.source = dht_crawler::source_from_byte(cursor.get_u8());
+            uint8_t flags = cursor.get_u8();
+            record.metadata_stored = (flags & 1) != 0;
+            record.request_pending = (flags & 2) != 0;
+            record.requested = (flags & 4) != 0;
+            record.first_seen = taken - std::chrono::seconds(cursor.get_u32());
+            record.last_seen = taken - std::chrono::seconds(cursor.get_u32());
+            record.sightings = cursor.get_u32();
+            record.peer_count = cursor.get_u32();
+            if (cursor.ok()) {
+                records.push_back(record);
+            }
         }
+        size_t discovered = m_discovery_store->restore(std::move(records));
         
-        // Automatically queue for metadata fetching if we haven't already requested it
-        if (m_metadata_requested.find(hash_str) == m_metadata_requested.end()) {
-            if (m_metadata_downloader->request_metadata(hash_str, 1, "DHT_ITEM")) { // Lower priority for DHT items
-                m_metadata_requested.insert(hash_str);
-                std::cout << "Auto-queued metadata request for DHT item: " << hash_str << std::endl;
-            } else {
-                std::cout << "Failed to auto-queue metadata for DHT item: " << hash_str << std::endl;
-                if (m_debug_mode) {
-                    std::cout << "[DEBUG] Active metadata requests: " << m_metadata_downloader->get_active_requests() << std::endl;
-                    std::cout << "[DEBUG] Available slots: " << m_metadata_downloader->get_available_slots() << std::endl;
-                    m_metadata_downloader->print_status();
-                }
+        size_t requested = m_discovery_store->requested_count();
+        
+        size_t requeued = 0;
+        cursor = snapshot.section(SnapshotSection::METADATA_QUEUE);
+        while (cursor.ok() && !cursor.at_end()) {
+            uint8_t target = cursor.get_u8();
+            dht_crawler::InfoHash hash;
+            cursor.get_bytes(hash.bytes.data(), dht_crawler::InfoHash::SIZE);
+            int priority = cursor.get_i32();
+            std::string source = cursor.get_string();
+            if (!cursor.ok()) break;
+            
+            bool queued = target == 0
+                ? m_metadata_downloader->request_metadata(hash.to_hex(), priority, source)
+                : m_metadata_worker_pool->queue_request(hash, priority, source);
+            if (queued) {
+                requeued++;
             }
-        } else {
-            if (m_debug_mode) {
-                std::cout << "[DEBUG] Metadata already requested for DHT item: " << hash_str << std::endl;
+        }
+        
+        size_t nodes = 0;
+        cursor = snapshot.section(SnapshotSection::BEP51_NODES);
+        while (const char* node_id = cursor.take(20)) {
+            m_bep51_indexer->add_known_node(std::string(node_id, 20));
+            nodes++;
+        }
+        
+        bool filter_restored = false;
+        if (snapshot.has(SnapshotSection::QUERY_FILTER)) {
+            cursor = snapshot.section(SnapshotSection::QUERY_FILTER);
+            std::string filter_name = cursor.get_string();
+            if (cursor.ok() && filter_name == m_query_filter->name()) {
+                filter_restored = m_query_filter->load_state(cursor.data(), cursor.remaining());
+            } else {
+                std::cout << "Saved query filter (" << filter_name << ") does not match --query-dedup, not restored" << std::endl;
             }
         }
+        
+        std::cout << "Restored crawl state: " << discovered << " discovered, "
+                  << requested << " requested, " << requeued << " metadata requests, "
+                  << nodes << " BEP51 nodes, query filter " << (filter_restored ? "restored" : "empty")
+                  << (m_dht_state_restored ? ", routing table restored" : "") << std::endl;
+    }
+    
+    // Returns true if the hash was not already marked as requested. The
+    // flag lives in the discovery record, so it is evicted with it.
+    bool markMetadataRequested(const dht_crawler::InfoHash& hash, dht_crawler::DiscoverySource source) {
+        return m_discovery_store->mark_requested(hash, source);
+    }
+    
+    size_t metadataRequestedCount() const {
+        return m_discovery_store->requested_count();
     }
     
     void requestMetadataForHash(const std::string& hash) {
@@ -1778,12 +3348,19 @@ private:
             std::cout << "[DEBUG] Requesting metadata for hash: " << hash << std::endl;
         }
         
+        dht_crawler::InfoHash info_hash;
+        if (!dht_crawler::InfoHash::parse(hash, info_hash)) {
+            std::cerr << "Invalid hash format, skipping: " << hash << std::endl;
+            m_metadata_manager->log_metadata_failure(hash, "Invalid hash format");
+            return;
+        }
+        
         // Log metadata request
         m_metadata_manager->log_metadata_request(hash);
         
         // Use enhanced metadata downloader
         if (m_metadata_downloader->request_metadata(hash, 4, "MANUAL")) { // Highest priority for manual requests
-            m_metadata_requested.insert(hash);
+            markMetadataRequested(info_hash, dht_crawler::DiscoverySource::MANUAL);
             std::cout << "Requesting metadata for hash: " << hash << std::endl;
             
             if (m_debug_mode) {
@@ -1795,7 +3372,7 @@ private:
             m_metadata_manager->log_metadata_failure(hash, "Failed to add torrent to session");
             m_metadata_downloader->log_failure();
             // Mark as requested even if failed to avoid repeated attempts
-            m_metadata_requested.insert(hash);
+            markMetadataRequested(info_hash, dht_crawler::DiscoverySource::MANUAL);
         }
     }
     
@@ -1819,34 +3396,34 @@ private:
             std::strftime(timestamp, sizeof(timestamp), "%H:%M:%S", &tm);
             
             // Single line debug output with timestamp
-            std::cout << "[" << timestamp << "] METADATA: torrents=" << m_discovered_torrents.size() 
-                      << " requested=" << m_metadata_requested.size() 
-                      << " active=" << m_metadata_worker_pool->get_active_requests()
-                      << " queue=" << m_metadata_worker_pool->get_queue_size() << std::endl;
+            std::cout << "[" << timestamp << "] METADATA: torrents=" << m_discovery_store->size() 
+                      << " requested=" << metadataRequestedCount() 
+                      << " active=" << m_metadata_downloader->get_active_requests()
+                      << " queue=" << m_metadata_downloader->get_queue_size() << std::endl;
         }
         
-        // Request metadata for up to 20 discovered torrents that don't have metadata yet
+        // Drop discovery records that have outlived their TTL
+        m_discovery_store->expire();
+        
+        // This is the only place discovered hashes become metadata requests:
+        // keep up to m_backlog_window of them outstanding in the downloader,
+        // best source first. Everything else waits in the discovery store,
+        // whose queue is ordered and bounded; each record is handed out once.
         int requested = 0;
-        for (auto& pair : m_discovered_torrents) {
-            if (requested >= 20) break; // Increased batch size for worker pool
-            
-            DiscoveredTorrent& torrent = pair.second;
-            if (!torrent.metadata_received && m_metadata_requested.find(torrent.info_hash) == m_metadata_requested.end()) {
-                // Use worker pool for metadata requests with priority based on source
-                int priority = 1; // Default priority
-                if (torrent.source == "DHT_PEERS") priority = 3; // High priority for peer-discovered
-                else if (torrent.source == "DHT_ANNOUNCE") priority = 2; // Medium priority for announced
-                
-                if (m_metadata_worker_pool->queue_request(torrent.info_hash, priority, torrent.source)) {
-                    m_metadata_requested.insert(torrent.info_hash);
-                    requested++;
-                    std::cout << "Queued metadata request for: " << torrent.info_hash << " (priority: " << priority << ")" << std::endl;
-                } else {
-                    std::cerr << "Failed to queue metadata request for " << torrent.info_hash << std::endl;
-                    m_metadata_manager->log_metadata_failure(torrent.info_hash, "Failed to queue request");
-                    // Mark as requested even if failed to avoid repeated attempts
-                    m_metadata_requested.insert(torrent.info_hash);
+        size_t outstanding = m_metadata_stage->depth() + m_metadata_downloader->get_queue_size() +
+                             m_metadata_downloader->get_active_requests();
+        if (outstanding < m_backlog_window) {
+            for (const auto& record : m_discovery_store->pop_pending(m_backlog_window - outstanding)) {
+                MetadataJob job;
+                job.info_hash = record.info_hash.to_hex();
+                job.priority = dht_crawler::source_priority(record.source);
+                job.source = dht_crawler::source_name(record.source);
+                job.label = "discovered torrent";
+                if (!m_metadata_stage->try_push(std::move(job))) {
+                    m_discovery_store->requeue(record.info_hash); // Back into the request queue
+                    continue;
                 }
+                requested++;
             }
         }
         
@@ -1862,47 +3439,87 @@ private:
             std::strftime(timestamp, sizeof(timestamp), "%H:%M:%S", &tm);
             
             std::cout << "[" << timestamp << "] METADATA: queued=" << requested 
-                      << " worker_queue=" << m_metadata_worker_pool->get_queue_size() 
-                      << " worker_active=" << m_metadata_worker_pool->get_active_requests() << std::endl;
+                      << " downloader_queue=" << m_metadata_downloader->get_queue_size() 
+                      << " downloader_active=" << m_metadata_downloader->get_active_requests() << std::endl;
+        }
+    }
+    
+    // Release a metadata torrent that cannot complete and end its request
+    void handleMetadataFailed(const lt::torrent_handle& handle, const std::string& reason) {
+        dht_crawler::InfoHash info_hash(handle.info_hash());
+        if (!m_torrent_handles->release(info_hash, dht_crawler::HandleRelease::FAILED)) {
+            return; // Already completed, timed out or evicted
+        }
+        
+        std::string hash_str = info_hash.to_hex();
+        m_metadata_manager->log_metadata_failure(hash_str, reason);
+        m_metadata_downloader->handle_metadata_failed(hash_str);
+        m_metadata_worker_pool->handle_metadata_failed(info_hash);
+        
+        if (m_metadata_log_mode) {
+            std::cout << "[METADATA_LOG] *** METADATA FAILED ***" << std::endl;
+            std::cout << "[METADATA_LOG] Hash: " << hash_str << std::endl;
+            std::cout << "[METADATA_LOG] Reason: " << reason << std::endl;
+            std::cout << "[METADATA_LOG] ------------------------" << std::endl;
         }
     }
     
+    // Alert thread: request bookkeeping only. The info dict itself was
+    // captured on the network thread and is stored by the info_dict stage.
     void handleMetadataReceived(lt::metadata_received_alert* alert) {
         try {
-            auto torrent_info = alert->handle.torrent_file();
-            if (!torrent_info) {
-                std::cout << "Metadata alert received but torrent_info is null" << std::endl;
-                m_mysql->logError("DHTTorrentCrawler::handleMetadataReceived", "", -1, "torrent_info is null", "", "WARNING");
-                return;
-            }
-            
             std::cout << "*** METADATA RECEIVED ***" << std::endl;
             
             // Get info hash
-            auto info_hash = alert->handle.info_hash();
-            std::string hash_str;
-            // Convert info_hash_t to hex string
-            for (int i = 0; i < 20; ++i) {
-                char hex[3];
-                snprintf(hex, sizeof(hex), "%02x", static_cast<unsigned char>(info_hash[i]));
-                hash_str += hex;
-            }
-            
-            // Log successful metadata reception
-            m_metadata_manager->log_metadata_success(hash_str, torrent_info->total_size());
+            dht_crawler::InfoHash info_hash(alert->handle.info_hash());
+            std::string hash_str = info_hash.to_hex();
             
             // Notify enhanced metadata downloader
             m_metadata_downloader->handle_metadata_received(hash_str);
             m_metadata_downloader->log_success();
             
             // Notify metadata worker pool
-            m_metadata_worker_pool->handle_metadata_received(hash_str);
+            m_metadata_worker_pool->handle_metadata_received(info_hash);
+            
+            // A --metadata list hash is done as soon as its metadata arrives
+            if (m_hash_list_progress) {
+                m_hash_list_progress->complete(info_hash);
+            }
+            
+            if (m_metadata_session) {
+                m_metadata_session->record_metadata();
+            }
+            
+            // Remove torrent from session to free resources; the captured
+            // info dict keeps its own reference to the metadata
+            m_torrent_handles->release(info_hash, dht_crawler::HandleRelease::COMPLETED);
+            
+        } catch (const std::exception& e) {
+            std::cerr << "Error processing metadata: " << e.what() << std::endl;
+            m_mysql->logException("DHTTorrentCrawler::handleMetadataReceived", "", e);
+        }
+    }
+    
+    // Info-dict stage: archive the dict, then extract the fields the
+    // storage backend and the log output need and store them
+    void storeInfoDict(dht_crawler::CapturedInfoDict& dict) {
+        try {
+            const dht_crawler::InfoHash& info_hash = dict.hash;
+            std::string hash_str = info_hash.to_hex();
+            dht_crawler::InfoDictView view(dict);
+            
+            // Log successful metadata reception
+            m_metadata_manager->log_metadata_success(hash_str, view.total_size());
             
-            // Extract comprehensive metadata using enhanced extraction (inspired by dump_torrent example)
-            auto enhanced_metadata = m_metadata_downloader->extract_comprehensive_metadata(*torrent_info, hash_str);
+            if (m_torrent_archive) {
+                std::string error;
+                if (!m_torrent_archive->write(dict, error)) {
+                    std::cerr << "Cannot archive " << hash_str << ": " << error << std::endl;
+                }
+            }
             
             // Update torrent information
-            DiscoveredTorrent torrent;
+            DiscoveredTorrent torrent{};
             
             if (m_metadata_only_mode) {
                 // In metadata-only mode, create a new torrent record
@@ -1914,53 +3531,57 @@ private:
                 torrent.last_seen_time = std::chrono::steady_clock::now();
             } else {
                 // In normal mode, find existing torrent
-                auto it = m_discovered_torrents.find(hash_str);
-                if (it != m_discovered_torrents.end()) {
-                    torrent = it->second;
+                dht_crawler::DiscoveryRecord record;
+                torrent.info_hash = hash_str;
+                if (m_discovery_store->lookup(info_hash, record)) {
+                    torrent.source = dht_crawler::source_name(record.source);
+                    torrent.discovered_time = record.first_seen;
+                    torrent.last_seen_time = record.last_seen;
                 } else {
-                    std::cout << "Warning: Received metadata for unknown torrent: " << hash_str << std::endl;
-                    return;
+                    // The record was evicted while its request was in flight;
+                    // the metadata is verified, so store it under a new record
+                    markMetadataRequested(info_hash, dht_crawler::DiscoverySource::UNKNOWN);
+                    torrent.source = dht_crawler::source_name(dht_crawler::DiscoverySource::UNKNOWN);
+                    torrent.discovered_time = std::chrono::steady_clock::now();
+                    torrent.last_seen_time = torrent.discovered_time;
                 }
             }
             
-            // Use enhanced metadata extraction results
-            torrent.magnet_link = enhanced_metadata.magnet_link;
-            torrent.name = enhanced_metadata.name;
-            torrent.size = enhanced_metadata.total_size;
-            torrent.num_files = enhanced_metadata.num_files;
-            torrent.num_pieces = enhanced_metadata.num_pieces;
-            torrent.piece_length = enhanced_metadata.piece_length;
-            torrent.comment = enhanced_metadata.comment;
-            torrent.created_by = enhanced_metadata.created_by;
-            torrent.creation_date = enhanced_metadata.creation_date;
-            torrent.private_torrent = enhanced_metadata.private_torrent;
+            // Fixed fields are read straight from the info dict
+            torrent.magnet_link = view.magnet_link();
+            torrent.name = view.name();
+            torrent.size = view.total_size();
+            torrent.num_files = view.num_files();
+            torrent.num_pieces = view.num_pieces();
+            torrent.piece_length = view.piece_length();
+            torrent.comment = view.comment();
+            torrent.created_by = view.created_by();
+            torrent.creation_date = view.creation_date();
+            torrent.private_torrent = view.private_torrent();
             torrent.metadata_received = true;
             torrent.last_seen_time = std::chrono::steady_clock::now();
             
-            // Enhanced file information with flags and offsets
-            torrent.file_names = enhanced_metadata.file_names;
-            torrent.file_sizes = enhanced_metadata.file_sizes;
-            
-            // Enhanced tracker information with tiers
-            torrent.trackers = enhanced_metadata.trackers;
-            torrent.announce_list = enhanced_metadata.trackers; // Use trackers as announce_list
-            
-            // Set announce URL from first tracker
-            if (!enhanced_metadata.trackers.empty()) {
-                torrent.announce_url = enhanced_metadata.trackers[0];
-            }
-            
-            // Log enhanced metadata extraction
-            std::cout << "Enhanced metadata extracted: " << enhanced_metadata.num_files << " files, " 
-                      << enhanced_metadata.trackers.size() << " trackers, " 
-                      << enhanced_metadata.web_seeds.size() << " web seeds" << std::endl;
+            // File and tracker lists are only copied out when they are
+            // stored, or printed in test mode
+            bool stores_lists = m_metadata_database_mode || m_storage->storesFileDetails();
+            if (stores_lists || !m_storage->isStoring()) {
+                torrent.file_names = view.file_names();
+                torrent.file_sizes = view.file_sizes();
+                torrent.trackers = view.trackers();
+                torrent.announce_list = torrent.trackers; // Use trackers as announce_list
+                
+                // Set announce URL from first tracker
+                if (!torrent.trackers.empty()) {
+                    torrent.announce_url = torrent.trackers[0];
+                }
                 
                 // Determine content type based on file extensions
                 torrent.content_type = determineContentType(torrent.file_names);
+            }
                 
                 // Update in database
                 bool db_success = false;
-                if (m_mysql->isConnected()) {
+                if (m_storage->isStoring()) {
                     if (m_metadata_database_mode) {
                         // In metadata database mode, update existing record
                         db_success = m_mysql->updateTorrentMetadata(hash_str, torrent);
@@ -1970,11 +3591,12 @@ private:
                         }
                     } else {
                         // In normal mode, store new torrent
-                        db_success = m_mysql->storeTorrent(torrent);
+                        db_success = m_storage->storeTorrent(torrent);
                     }
                     
                     if (db_success) {
                         m_metadata_fetched++;
+                        m_discovery_store->mark_metadata_stored(info_hash);
                     
                     // Enhanced metadata logging for metadata_log_mode
                     if (m_metadata_log_mode) {
@@ -1983,7 +3605,9 @@ private:
                         std::cout << "[METADATA_LOG] Name: " << torrent.name << std::endl;
                         std::cout << "[METADATA_LOG] Size: " << torrent.size << " bytes (" << formatBytes(torrent.size) << ")" << std::endl;
                         std::cout << "[METADATA_LOG] Files: " << torrent.num_files << std::endl;
-                        std::cout << "[METADATA_LOG] Content Type: " << torrent.content_type << std::endl;
+                        if (!torrent.content_type.empty()) {
+                            std::cout << "[METADATA_LOG] Content Type: " << torrent.content_type << std::endl;
+                        }
                         
                         // Show file details
                         if (!torrent.file_names.empty()) {
@@ -2003,7 +3627,7 @@ private:
                         if (!torrent.comment.empty()) {
                             std::cout << "[METADATA_LOG] Comment: " << torrent.comment.substr(0, 200) << (torrent.comment.length() > 200 ? "..." : "") << std::endl;
                         }
-                        std::cout << "[METADATA_LOG] Trackers: " << torrent.trackers.size() << std::endl;
+                        std::cout << "[METADATA_LOG] Trackers: " << view.num_trackers() << std::endl;
                         std::cout << "[METADATA_LOG] Magnet: " << torrent.magnet_link << std::endl;
                         std::cout << "[METADATA_LOG] ------------------------" << std::endl;
                     } else {
@@ -2012,7 +3636,9 @@ private:
                         std::cout << "Name: " << torrent.name << std::endl;
                         std::cout << "Size: " << torrent.size << " bytes (" << formatBytes(torrent.size) << ")" << std::endl;
                         std::cout << "Files: " << torrent.num_files << std::endl;
-                        std::cout << "Content Type: " << torrent.content_type << std::endl;
+                        if (!torrent.content_type.empty()) {
+                            std::cout << "Content Type: " << torrent.content_type << std::endl;
+                        }
                         std::cout << "Magnet Link: " << torrent.magnet_link << std::endl;
                         if (!torrent.file_names.empty()) {
                             std::cout << "First file: " << torrent.file_names[0] << std::endl;
@@ -2020,7 +3646,7 @@ private:
                         if (!torrent.comment.empty()) {
                             std::cout << "Comment: " << torrent.comment.substr(0, 100) << (torrent.comment.length() > 100 ? "..." : "") << std::endl;
                         }
-                        std::cout << "Trackers: " << torrent.trackers.size() << std::endl;
+                        std::cout << "Trackers: " << view.num_trackers() << std::endl;
                         std::cout << "------------------------" << std::endl;
                     }
                 } else {
@@ -2053,7 +3679,7 @@ private:
                         if (!torrent.comment.empty()) {
                             std::cout << "[METADATA_LOG] Comment: " << torrent.comment.substr(0, 200) << (torrent.comment.length() > 200 ? "..." : "") << std::endl;
                         }
-                        std::cout << "[METADATA_LOG] Trackers: " << torrent.trackers.size() << std::endl;
+                        std::cout << "[METADATA_LOG] Trackers: " << view.num_trackers() << std::endl;
                         std::cout << "[METADATA_LOG] Magnet: " << torrent.magnet_link << std::endl;
                         std::cout << "[METADATA_LOG] ------------------------" << std::endl;
                     } else {
@@ -2070,18 +3696,15 @@ private:
                         if (!torrent.comment.empty()) {
                             std::cout << "Comment: " << torrent.comment.substr(0, 100) << (torrent.comment.length() > 100 ? "..." : "") << std::endl;
                         }
-                        std::cout << "Trackers: " << torrent.trackers.size() << std::endl;
+                        std::cout << "Trackers: " << view.num_trackers() << std::endl;
                         std::cout << "------------------------" << std::endl;
                     }
                 }
             }
             
-            // Remove torrent from session to free resources
-            m_session->remove_torrent(alert->handle);
-            
         } catch (const std::exception& e) {
-            std::cerr << "Error processing metadata: " << e.what() << std::endl;
-            m_mysql->logException("DHTTorrentCrawler::handleMetadataReceived", "", e);
+            std::cerr << "Error storing metadata: " << e.what() << std::endl;
+            m_mysql->logException("DHTTorrentCrawler::storeInfoDict", "", e);
         }
     }
 };
@@ -2345,9 +3968,13 @@ void printUsage(const char* program_name, bool test_missing_libs = false) {
     std::cout << "                    Default: infinite (run until Ctrl+C)" << std::endl;
     std::cout << "                    Example: --queries 10000" << std::endl;
     std::cout << "  --metadata HASHES Comma-delimited torrent hashes for metadata-only mode" << std::endl;
-    std::cout << "                    Can also be a file path (.txt or .csv) containing hashes" << std::endl;
+    std::cout << "                    Can also be a file path (.txt or .csv) containing hashes, or -" << std::endl;
+    std::cout << "                    for stdin; lists are streamed, --backlog-window hashes at a time" << std::endl;
     std::cout << "                    Example: --metadata abc123def456,789xyz012" << std::endl;
     std::cout << "                    Example: --metadata /path/to/hashes.txt" << std::endl;
+    std::cout << "  --metadata-checkpoint PATH Progress file for a --metadata list; a restart resumes" << std::endl;
+    std::cout << "                    from it (default: <file>.progress for hash files)" << std::endl;
+    std::cout << "                    Example: --metadata-checkpoint /var/lib/dht_crawler/hashes.progress" << std::endl;
     std::cout << "  --metadata_database Process existing database records with missing metadata" << std::endl;
     std::cout << "                    Fetches metadata for records where num_files < 1 or NULL" << std::endl;
     std::cout << "                    Example: --metadata_database" << std::endl;
@@ -2362,8 +3989,67 @@ void printUsage(const char* program_name, bool test_missing_libs = false) {
     std::cout << "                    Example: --sequential" << std::endl;
     std::cout << "  --workers NUM     Number of concurrent DHT workers (default: 4)" << std::endl;
     std::cout << "                    Example: --workers 8" << std::endl;
+    std::cout << "  --shards N        Run N DHT sessions on ports 6881..6881+N-1, each with its own" << std::endl;
+    std::cout << "                    node ID, alert thread, --workers query workers and keyspace slice" << std::endl;
+    std::cout << "                    (default: 1; discovery mode only)" << std::endl;
+    std::cout << "                    Example: --shards 16" << std::endl;
+    std::cout << "  --metadata-session Fetch metadata in a separate session (port after the shards)" << std::endl;
+    std::cout << "                    with its own alert queue and thread (discovery mode only)" << std::endl;
+    std::cout << "                    Example: --metadata-session" << std::endl;
+    std::cout << "  --max-torrent-handles N Hard cap on live metadata torrents; the oldest is removed" << std::endl;
+    std::cout << "                    to make room (default: 1200)" << std::endl;
+    std::cout << "                    Example: --max-torrent-handles 2000" << std::endl;
+    std::cout << "  --torrent-archive DIR Keep every fetched info dict as a gzip-compressed .torrent" << std::endl;
+    std::cout << "                    file under DIR (default: off)" << std::endl;
+    std::cout << "                    Example: --torrent-archive ./torrents" << std::endl;
     std::cout << "  --no-bep51        Disable BEP51 DHT infohash indexing (use random generation)" << std::endl;
     std::cout << "                    Example: --no-bep51" << std::endl;
+    std::cout << "  --query-dedup MODE Dedup for generated DHT query targets: none, bloom, rotating" << std::endl;
+    std::cout << "                    Default: rotating (two Bloom filters, fixed memory)" << std::endl;
+    std::cout << "                    Example: --query-dedup none" << std::endl;
+    std::cout << "  --query-dedup-mb MB Memory for the query dedup filter (default: 4)" << std::endl;
+    std::cout << "                    Example: --query-dedup-mb 16" << std::endl;
+    std::cout << "  --discovery-memory-mb MB Memory budget for discovered hashes (default: 64)" << std::endl;
+    std::cout << "                    Hashes with stored metadata are evicted first" << std::endl;
+    std::cout << "                    Example: --discovery-memory-mb 256" << std::endl;
+    std::cout << "  --discovery-ttl-hours H Forget discovered hashes not seen for H hours (default: 6)" << std::endl;
+    std::cout << "                    Example: --discovery-ttl-hours 24" << std::endl;
+    std::cout << "  --db-batch-rows N Max rows per batched torrent upsert (default: 500)" << std::endl;
+    std::cout << "                    Example: --db-batch-rows 1000" << std::endl;
+    std::cout << "  --db-flush-ms MS  Max time a sighting is buffered before it is written (default: 200)" << std::endl;
+    std::cout << "                    Repeat sightings of a hash within it are written as one row" << std::endl;
+    std::cout << "                    Example: --db-flush-ms 500" << std::endl;
+    std::cout << "  --db-buffer-mb MB Write buffer size; DHT queries slow down as it fills (default: 32)" << std::endl;
+    std::cout << "                    Example: --db-buffer-mb 128" << std::endl;
+    std::cout << "  --backlog-window N Metadata requests kept in flight (--metadata," << std::endl;
+    std::cout << "                    --metadata_database and discovery; default: 1000)" << std::endl;
+    std::cout << "                    Example: --backlog-window 5000" << std::endl;
+    std::cout << "  --db-writers N    Writer threads, each with its own MySQL connection (default: 4)" << std::endl;
+    std::cout << "                    Example: --db-writers 8" << std::endl;
+    std::cout << "  --peer-load-data  Bulk-load large peer batches with LOAD DATA LOCAL INFILE" << std::endl;
+    std::cout << "                    Requires local_infile=ON on the server" << std::endl;
+    std::cout << "                    Example: --peer-load-data" << std::endl;
+    std::cout << "  --torrent-files-max N Files stored per torrent in torrent_files (default: 10000)" << std::endl;
+    std::cout << "                    Larger torrents keep their largest files plus a summary row" << std::endl;
+    std::cout << "                    Example: --torrent-files-max 50000" << std::endl;
+    std::cout << "  --no-file-text-columns Leave discovered_torrents.file_names/file_sizes empty" << std::endl;
+    std::cout << "                    (file lists are only written to torrent_files)" << std::endl;
+    std::cout << "                    Example: --no-file-text-columns" << std::endl;
+    std::cout << "  --error-log-file PATH Error log fallback while MySQL is unavailable" << std::endl;
+    std::cout << "                    (default: dht_crawler_errors.log)" << std::endl;
+    std::cout << "                    Example: --error-log-file /var/log/dht_crawler_errors.log" << std::endl;
+    std::cout << "  --state-file PATH Save crawl state here and resume from it on restart" << std::endl;
+    std::cout << "                    (default: disabled)" << std::endl;
+    std::cout << "                    Example: --state-file /var/lib/dht_crawler/state.snap" << std::endl;
+    std::cout << "  --state-interval SEC Seconds between crawl state snapshots (default: 60)" << std::endl;
+    std::cout << "                    Example: --state-interval 300" << std::endl;
+    std::cout << "  --storage MODE    Where crawl results go: mysql, local, null (default: mysql)" << std::endl;
+    std::cout << "                    local: embedded segment store in --storage-dir; null: count only" << std::endl;
+    std::cout << "                    Example: --storage local" << std::endl;
+    std::cout << "  --storage-dir PATH Segment store directory for --storage local (default: dht_store)" << std::endl;
+    std::cout << "                    Example: --storage-dir /var/lib/dht_crawler/store" << std::endl;
+    std::cout << "  --storage-segment-mb N Segment file size for --storage local (default: 64)" << std::endl;
+    std::cout << "                    Example: --storage-segment-mb 256" << std::endl;
     std::cout << "  --test-missing-libs Show help with simulated missing libraries (for testing)" << std::endl;
     std::cout << "                    Example: --test-missing-libs" << std::endl;
     std::cout << "  --help            Show this help message and exit" << std::endl;
@@ -2459,6 +4145,8 @@ int main(int argc, char* argv[]) {
             max_queries = std::stoi(argv[++i]);
         } else if (arg == "--metadata" && i + 1 < argc) {
             config.metadata_hashes = argv[++i];
+        } else if (arg == "--metadata-checkpoint" && i + 1 < argc) {
+            config.metadata_checkpoint = argv[++i];
         } else if (arg == "--metadata_database") {
             config.metadata_database_mode = true;
         } else if (arg == "--debug") {
@@ -2475,8 +4163,108 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Error: Number of workers must be between 1 and 16" << std::endl;
                 return 1;
             }
+        } else if (arg == "--shards" && i + 1 < argc) {
+            config.session_shards = std::stoul(argv[++i]);
+            if (config.session_shards < 1 || config.session_shards > 64) {
+                std::cerr << "Error: Number of shards must be between 1 and 64" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--metadata-session") {
+            config.metadata_session = true;
+        } else if (arg == "--torrent-archive" && i + 1 < argc) {
+            config.torrent_archive_dir = argv[++i];
+        } else if (arg == "--max-torrent-handles" && i + 1 < argc) {
+            config.max_torrent_handles = std::stoul(argv[++i]);
+            if (config.max_torrent_handles < 1) {
+                std::cerr << "Error: --max-torrent-handles must be at least 1" << std::endl;
+                return 1;
+            }
         } else if (arg == "--no-bep51") {
             config.bep51_mode = false;
+        } else if (arg == "--query-dedup" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (!dht_crawler::parse_query_dedup_mode(mode, config.query_dedup_mode)) {
+                std::cerr << "Error: --query-dedup must be one of none, bloom, rotating" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--query-dedup-mb" && i + 1 < argc) {
+            config.query_dedup_mb = std::stoul(argv[++i]);
+            if (config.query_dedup_mb < 1) {
+                std::cerr << "Error: Query dedup memory must be at least 1 MB" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--discovery-memory-mb" && i + 1 < argc) {
+            config.discovery_memory_mb = std::stoul(argv[++i]);
+            if (config.discovery_memory_mb < 1) {
+                std::cerr << "Error: Discovery memory budget must be at least 1 MB" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--db-batch-rows" && i + 1 < argc) {
+            config.db_batch_rows = std::stoul(argv[++i]);
+            if (config.db_batch_rows < 1) {
+                std::cerr << "Error: Batch size must be at least 1 row" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--db-flush-ms" && i + 1 < argc) {
+            config.db_flush_ms = std::stoi(argv[++i]);
+            if (config.db_flush_ms < 1) {
+                std::cerr << "Error: Flush interval must be at least 1 ms" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--db-buffer-mb" && i + 1 < argc) {
+            config.db_buffer_mb = std::stoul(argv[++i]);
+            if (config.db_buffer_mb < 1) {
+                std::cerr << "Error: Write buffer must be at least 1 MB" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--backlog-window" && i + 1 < argc) {
+            config.backlog_window = std::stoul(argv[++i]);
+            if (config.backlog_window < 1) {
+                std::cerr << "Error: Backlog window must be at least 1" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--db-writers" && i + 1 < argc) {
+            config.db_writers = std::stoul(argv[++i]);
+            if (config.db_writers < 1 || config.db_writers > 32) {
+                std::cerr << "Error: Number of DB writers must be between 1 and 32" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--peer-load-data") {
+            config.peer_load_data = true;
+        } else if (arg == "--torrent-files-max" && i + 1 < argc) {
+            config.torrent_files_max = std::stoul(argv[++i]);
+        } else if (arg == "--no-file-text-columns") {
+            config.file_text_columns = false;
+        } else if (arg == "--error-log-file" && i + 1 < argc) {
+            config.error_log_file = argv[++i];
+        } else if (arg == "--state-file" && i + 1 < argc) {
+            config.state_file = argv[++i];
+        } else if (arg == "--state-interval" && i + 1 < argc) {
+            config.state_interval_seconds = std::stoi(argv[++i]);
+            if (config.state_interval_seconds < 1) {
+                std::cerr << "Error: State interval must be at least 1 second" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--storage" && i + 1 < argc) {
+            config.storage_backend = argv[++i];
+            if (config.storage_backend != "mysql" && config.storage_backend != "local" && config.storage_backend != "null") {
+                std::cerr << "Error: Storage must be one of: mysql, local, null" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--storage-dir" && i + 1 < argc) {
+            config.storage_dir = argv[++i];
+        } else if (arg == "--storage-segment-mb" && i + 1 < argc) {
+            config.storage_segment_mb = std::stoul(argv[++i]);
+            if (config.storage_segment_mb < 1) {
+                std::cerr << "Error: Segment size must be at least 1 MB" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--discovery-ttl-hours" && i + 1 < argc) {
+            config.discovery_ttl_hours = std::stoi(argv[++i]);
+            if (config.discovery_ttl_hours < 1) {
+                std::cerr << "Error: Discovery TTL must be at least 1 hour" << std::endl;
+                return 1;
+            }
         } else {
             std::cerr << "Unknown argument: " << arg << std::endl;
             printUsage(argv[0]);
@@ -2484,9 +4272,26 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (config.metadata_database_mode && config.storage_backend != "mysql") {
+        std::cerr << "Error: --metadata_database requires --storage mysql" << std::endl;
+        return 1;
+    }
+    
+    if (config.session_shards > 1 && !config.concurrent_mode) {
+        std::cerr << "Error: --shards cannot be combined with --sequential" << std::endl;
+        return 1;
+    }
+    
+    if (config.metadata_session && (!config.metadata_hashes.empty() || config.metadata_database_mode)) {
+        std::cerr << "Error: --metadata-session only applies to discovery mode" << std::endl;
+        return 1;
+    }
+    
     // Validate required parameters (skip for testing)
     if (config.user.empty() || config.password.empty() || config.database.empty()) {
-        std::cout << "Running in test mode without MySQL..." << std::endl;
+        if (config.storage_backend == "mysql") {
+            std::cout << "Running in test mode without MySQL..." << std::endl;
+        }
         config.user = "test";
         config.password = "test";
         config.database = "test";
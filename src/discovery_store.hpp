@@ -0,0 +1,793 @@
+/*
+ * Bounded Discovery Store
+ *
+ * Memory-capped replacement for the crawler's unbounded discovered-torrent
+ * map. Each info-hash sighting is kept as a small fixed-size record (hash,
+ * source, first/last seen, sighting and peer counts) in one of several
+ * independently locked shards. Records expire after a TTL and, once the
+ * configured byte budget is reached, the least recently seen record is
+ * evicted. Records whose metadata is already durable in MySQL sit on their
+ * own LRU list and are always evicted before records still waiting for
+ * metadata.
+ *
+ * New records are also pushed onto a per-shard intrusive binary heap of
+ * hashes that still need a metadata request, ordered by source priority and
+ * then discovery time. pop_pending() takes the best entries off the heaps in
+ * O(log n) each, so the request scheduler never rescans records it has
+ * already handed out. A record that has been handed out (or claimed with
+ * mark_requested()) carries a requested flag, so the crawler needs no
+ * separate set of requested hashes; the flag goes away with the record.
+ *
+ * for_each() and restore() carry the records across a restart through a
+ * crawl snapshot, ages and request state included.
+ */
+
+#pragma once
+
+#include "info_hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dht_crawler {
+
+/**
+ * Where a hash was discovered; stored as one byte per record
+ */
+enum class DiscoverySource : uint8_t {
+    UNKNOWN,
+    DHT_PEERS,
+    DHT_ANNOUNCE,
+    DHT_ITEM,
+    BEP51,
+    MANUAL,
+    METADATA_ONLY
+};
+
+// Name used in the database and logs
+inline const char* source_name(DiscoverySource source) {
+    switch (source) {
+        case DiscoverySource::DHT_PEERS: return "DHT_PEERS";
+        case DiscoverySource::DHT_ANNOUNCE: return "DHT_ANNOUNCE";
+        case DiscoverySource::DHT_ITEM: return "DHT_ITEM";
+        case DiscoverySource::BEP51: return "BEP51";
+        case DiscoverySource::MANUAL: return "MANUAL";
+        case DiscoverySource::METADATA_ONLY: return "METADATA_ONLY";
+        case DiscoverySource::UNKNOWN: break;
+    }
+    return "UNKNOWN";
+}
+
+inline DiscoverySource source_from_name(const std::string& name) {
+    for (uint8_t value = 1; value <= static_cast<uint8_t>(DiscoverySource::METADATA_ONLY); ++value) {
+        DiscoverySource source = static_cast<DiscoverySource>(value);
+        if (name == source_name(source)) return source;
+    }
+    return DiscoverySource::UNKNOWN;
+}
+
+// Source stored as a byte (snapshots); unknown values read as UNKNOWN
+inline DiscoverySource source_from_byte(uint8_t value) {
+    if (value > static_cast<uint8_t>(DiscoverySource::METADATA_ONLY)) {
+        return DiscoverySource::UNKNOWN;
+    }
+    return static_cast<DiscoverySource>(value);
+}
+
+// Metadata request priority (higher first): hashes with known peers are the
+// most likely to yield metadata, and BEP 51 samples come from a node's own
+// storage, so someone announced them
+inline int source_priority(DiscoverySource source) {
+    switch (source) {
+        case DiscoverySource::BEP51: return 5;
+        case DiscoverySource::MANUAL: return 4;
+        case DiscoverySource::DHT_PEERS: return 3;
+        case DiscoverySource::DHT_ANNOUNCE: return 2;
+        default: return 1;
+    }
+}
+
+/**
+ * Snapshot of a discovery record handed out to callers
+ */
+struct DiscoveryRecord {
+    InfoHash info_hash;
+    DiscoverySource source = DiscoverySource::UNKNOWN;
+    std::chrono::steady_clock::time_point first_seen;
+    std::chrono::steady_clock::time_point last_seen;
+    uint32_t sightings = 0;
+    uint32_t peer_count = 0;
+    bool metadata_stored = false;
+    bool request_pending = false;  // Not yet handed out by pop_pending()
+    bool requested = false;        // Handed to a metadata fetcher
+};
+
+/**
+ * Configuration for DiscoveryStore
+ */
+struct DiscoveryStoreConfig {
+    size_t memory_budget_bytes = 64 * 1024 * 1024;  // Upper bound for all shards
+    std::chrono::seconds ttl = std::chrono::hours(6); // Drop records not seen for this long
+    size_t num_shards = 16;                         // Rounded up to a power of two
+};
+
+/**
+ * Sharded, TTL- and LRU-evicting store of discovered info-hashes
+ */
+class DiscoveryStore {
+public:
+    explicit DiscoveryStore(const DiscoveryStoreConfig& config = DiscoveryStoreConfig())
+        : m_ttl(config.ttl)
+        , m_epoch(std::chrono::steady_clock::now() - config.ttl) // Restored records keep their ages
+        , m_inserts(0)
+        , m_updates(0)
+        , m_evicted_ttl(0)
+        , m_evicted_stored(0)
+        , m_evicted_pending(0)
+        , m_popped(0)
+        , m_restored(0) {
+        size_t shards = 1;
+        while (shards < config.num_shards) {
+            shards <<= 1;
+        }
+        m_shard_mask = shards - 1;
+
+        m_max_entries_per_shard = entries_for_budget(config.memory_budget_bytes / shards);
+
+        m_shards.reserve(shards);
+        for (size_t i = 0; i < shards; ++i) {
+            m_shards.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    /**
+     * Record a sighting of an info-hash
+     * @param hash Info-hash that was seen
+     * @param source Discovery source
+     * @param peer_count Number of peers reported with this sighting
+     * @return true if the hash was not in the store before
+     */
+    bool record_sighting(const InfoHash& hash, DiscoverySource source, size_t peer_count = 0) {
+        uint32_t now = now_seconds();
+        Shard& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        expire_locked(shard, now);
+
+        auto it = shard.index.find(hash);
+        if (it != shard.index.end()) {
+            Entry& entry = shard.entries[it->second];
+            entry.last_seen = now;
+            if (entry.sightings < UINT32_MAX) {
+                entry.sightings++;
+            }
+            entry.peer_count = static_cast<uint32_t>(peer_count);
+            if (entry.source != source) {
+                entry.source = source;
+                if (entry.heap_pos != NIL) {
+                    // Priority may have changed; restore heap order
+                    heap_sift_up(shard, entry.heap_pos);
+                    heap_sift_down(shard, entry.heap_pos);
+                }
+            }
+            touch_locked(shard, it->second);
+            m_updates++;
+            return false;
+        }
+
+        uint32_t slot = insert_locked(shard, hash);
+        Entry& entry = shard.entries[slot];
+        entry.first_seen = now;
+        entry.last_seen = now;
+        entry.sightings = 1;
+        entry.peer_count = static_cast<uint32_t>(peer_count);
+        entry.source = source;
+        entry.metadata_stored = false;
+        entry.requested = false;
+
+        shard.pending.push_front(shard.entries, slot);
+        heap_push(shard, slot);
+        m_inserts++;
+        return true;
+    }
+
+    /**
+     * Re-insert records saved by an earlier run. They are sorted by
+     * last_seen first: for_each() is only ordered within a shard, and a
+     * restarted store assigns hashes to shards with a new seed, so each
+     * LRU list is rebuilt oldest first only if the input is in global order.
+     * Records that have outlived the TTL or are already present are skipped.
+     * @return Number of records restored
+     */
+    size_t restore(std::vector<DiscoveryRecord> records) {
+        std::stable_sort(records.begin(), records.end(), [](const DiscoveryRecord& a, const DiscoveryRecord& b) {
+            return a.last_seen < b.last_seen;
+        });
+        size_t restored = 0;
+        for (const DiscoveryRecord& record : records) {
+            if (restore_one(record)) {
+                restored++;
+            }
+        }
+        return restored;
+    }
+
+    /**
+     * Visit every record, one shard at a time under its lock, least
+     * recently seen first within each shard
+     */
+    void for_each(const std::function<void(const DiscoveryRecord&)>& visit) const {
+        DiscoveryRecord record;
+        for (const auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            for (const LruList* list : {&shard->stored, &shard->pending}) {
+                for (uint32_t slot = list->tail; slot != NIL; slot = shard->entries[slot].prev) {
+                    fill_record(shard->entries[slot], record);
+                    visit(record);
+                }
+            }
+        }
+    }
+
+    /**
+     * Mark a hash as having its metadata stored in the database. The record
+     * moves to the stored LRU list and becomes the first eviction candidate.
+     * @return false if the hash is not in the store
+     */
+    bool mark_metadata_stored(const InfoHash& hash) {
+        Shard& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(hash);
+        if (it == shard.index.end()) {
+            return false;
+        }
+
+        uint32_t slot = it->second;
+        Entry& entry = shard.entries[slot];
+        if (!entry.metadata_stored) {
+            heap_remove(shard, slot);
+            shard.pending.unlink(shard.entries, slot);
+            entry.metadata_stored = true;
+            shard.stored.push_front(shard.entries, slot);
+        }
+        return true;
+    }
+
+    /**
+     * Look up a hash
+     * @return true and fills record if the hash is in the store
+     */
+    bool lookup(const InfoHash& hash, DiscoveryRecord& record) const {
+        const Shard& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(hash);
+        if (it == shard.index.end()) {
+            return false;
+        }
+
+        fill_record(shard.entries[it->second], record);
+        return true;
+    }
+
+    bool contains(const InfoHash& hash) const {
+        const Shard& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.index.contains(hash);
+    }
+
+    /**
+     * Claim a hash for a metadata request made outside pop_pending()
+     * (manual requests, hash lists). A hash not in the store gets a record
+     * with no sightings, so later sightings do not request it again.
+     * @return true if the hash was not already requested
+     */
+    bool mark_requested(const InfoHash& hash, DiscoverySource source) {
+        uint32_t now = now_seconds();
+        Shard& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        uint32_t slot;
+        auto it = shard.index.find(hash);
+        if (it != shard.index.end()) {
+            slot = it->second;
+            if (shard.entries[slot].requested) {
+                return false;
+            }
+            heap_remove(shard, slot);
+        } else {
+            slot = insert_locked(shard, hash);
+            Entry& entry = shard.entries[slot];
+            entry.first_seen = now;
+            entry.last_seen = now;
+            entry.sightings = 0;
+            entry.peer_count = 0;
+            entry.source = source;
+            entry.metadata_stored = false;
+            shard.pending.push_front(shard.entries, slot);
+            m_inserts++;
+        }
+        shard.entries[slot].requested = true;
+        shard.requested++;
+        return true;
+    }
+
+    bool is_requested(const InfoHash& hash) const {
+        const Shard& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(hash);
+        return it != shard.index.end() && shard.entries[it->second].requested;
+    }
+
+    /**
+     * Put a requested hash back in the request queue, e.g. when its request
+     * could not be submitted or was dropped before it finished
+     * @return false if the hash is gone, has its metadata, or was not requested
+     */
+    bool requeue(const InfoHash& hash) {
+        Shard& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(hash);
+        if (it == shard.index.end()) {
+            return false;
+        }
+        Entry& entry = shard.entries[it->second];
+        if (!entry.requested || entry.metadata_stored) {
+            return false;
+        }
+        entry.requested = false;
+        shard.requested--;
+        heap_push(shard, it->second);
+        return true;
+    }
+
+    /**
+     * Remove and return up to max_count records that have not been handed
+     * out for a metadata request yet: highest source priority first, then
+     * earliest discovered. Records stay in the store, marked requested;
+     * only their place in the request queue is consumed.
+     */
+    std::vector<DiscoveryRecord> pop_pending(size_t max_count) {
+        std::vector<DiscoveryRecord> result;
+
+        while (result.size() < max_count) {
+            // Peek every shard's best entry and pop from the best shard
+            Shard* best = nullptr;
+            HeapKey best_key{};
+            for (auto& shard : m_shards) {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                if (!shard->heap.empty()) {
+                    HeapKey key = heap_key(shard->entries[shard->heap.front()]);
+                    if (!best || key_before(key, best_key)) {
+                        best = shard.get();
+                        best_key = key;
+                    }
+                }
+            }
+            if (!best) break;
+
+            std::lock_guard<std::mutex> lock(best->mutex);
+            if (best->heap.empty()) continue; // Raced with eviction
+            uint32_t slot = best->heap.front();
+            heap_remove(*best, slot);
+            m_popped++;
+
+            Entry& entry = best->entries[slot];
+            entry.requested = true;
+            best->requested++;
+            DiscoveryRecord record;
+            fill_record(entry, record);
+            result.push_back(std::move(record));
+        }
+
+        return result;
+    }
+
+    // Records still queued for a metadata request
+    size_t pending_count() const {
+        size_t total = 0;
+        for (const auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->heap.size();
+        }
+        return total;
+    }
+
+    // Records handed to a metadata fetcher and still in the store
+    size_t requested_count() const {
+        size_t total = 0;
+        for (const auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->requested;
+        }
+        return total;
+    }
+
+    /**
+     * Drop every record whose TTL has elapsed. Sightings already expire the
+     * shard they land in; this sweeps shards that have gone quiet.
+     * @return Number of records removed
+     */
+    size_t expire() {
+        uint32_t now = now_seconds();
+        size_t removed = 0;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            removed += expire_locked(*shard, now);
+        }
+        return removed;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->index.size();
+        }
+        return total;
+    }
+
+    /**
+     * Approximate heap usage of all shards in bytes
+     */
+    size_t memory_usage() const {
+        size_t total = 0;
+        for (const auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->index.memory_usage();
+            total += shard->entries.capacity() * sizeof(Entry);
+            total += shard->free_slots.capacity() * sizeof(uint32_t);
+            total += shard->heap.capacity() * sizeof(uint32_t);
+        }
+        return total;
+    }
+
+    size_t capacity() const { return m_max_entries_per_shard * m_shards.size(); }
+    uint64_t get_inserts() const { return m_inserts.load(); }
+    uint64_t get_updates() const { return m_updates.load(); }
+    uint64_t get_evicted_ttl() const { return m_evicted_ttl.load(); }
+    uint64_t get_evicted_stored() const { return m_evicted_stored.load(); }
+    uint64_t get_evicted_pending() const { return m_evicted_pending.load(); }
+    uint64_t get_restored() const { return m_restored.load(); }
+
+    void print_statistics() const {
+        std::cout << "=== Discovery Store Statistics ===" << std::endl;
+        std::cout << "Records: " << size() << " / " << capacity() << std::endl;
+        std::cout << "Awaiting metadata request: " << pending_count() << " (popped: " << m_popped.load() << ")" << std::endl;
+        std::cout << "Metadata requested: " << requested_count() << std::endl;
+        std::cout << "Memory usage: " << (memory_usage() / 1024) << " KB" << std::endl;
+        std::cout << "Inserts: " << m_inserts.load() << " (restored from snapshot: " << m_restored.load() << ")" << std::endl;
+        std::cout << "Repeat sightings: " << m_updates.load() << std::endl;
+        std::cout << "Evicted (TTL): " << m_evicted_ttl.load() << std::endl;
+        std::cout << "Evicted (budget, metadata stored): " << m_evicted_stored.load() << std::endl;
+        std::cout << "Evicted (budget, metadata pending): " << m_evicted_pending.load() << std::endl;
+        std::cout << "=================================" << std::endl;
+    }
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    struct Entry {
+        InfoHash hash;
+        uint32_t first_seen = 0;   // Seconds since store epoch
+        uint32_t last_seen = 0;    // Seconds since store epoch
+        uint32_t sightings = 0;
+        uint32_t peer_count = 0;
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint32_t heap_pos = NIL;   // Index in Shard::heap, NIL once popped
+        DiscoverySource source = DiscoverySource::UNKNOWN;
+        bool metadata_stored = false;
+        bool requested = false;
+    };
+
+    // Heap order: higher source priority, then earlier first_seen
+    struct HeapKey {
+        int priority;
+        uint32_t first_seen;
+    };
+
+    // Intrusive doubly-linked list over Entry indices, head = most recent
+    struct LruList {
+        uint32_t head = NIL;
+        uint32_t tail = NIL;
+
+        void push_front(std::vector<Entry>& entries, uint32_t slot) {
+            entries[slot].prev = NIL;
+            entries[slot].next = head;
+            if (head != NIL) {
+                entries[head].prev = slot;
+            } else {
+                tail = slot;
+            }
+            head = slot;
+        }
+
+        void unlink(std::vector<Entry>& entries, uint32_t slot) {
+            Entry& entry = entries[slot];
+            if (entry.prev != NIL) {
+                entries[entry.prev].next = entry.next;
+            } else {
+                head = entry.next;
+            }
+            if (entry.next != NIL) {
+                entries[entry.next].prev = entry.prev;
+            } else {
+                tail = entry.prev;
+            }
+            entry.prev = NIL;
+            entry.next = NIL;
+        }
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        InfoHashMap<uint32_t> index;
+        std::vector<Entry> entries;
+        std::vector<uint32_t> free_slots;
+        LruList pending;
+        LruList stored;
+        std::vector<uint32_t> heap;  // Entry slots awaiting a metadata request
+        size_t requested = 0;        // Entries with the requested flag
+    };
+
+    /**
+     * Largest per-shard entry count whose entry array plus fully grown index
+     * table fits in the budget. The index doubles in steps and holds at most
+     * 4/5 of its capacity, so every power-of-two table size is tried.
+     */
+    static size_t entries_for_budget(size_t budget) {
+        const size_t index_slot = sizeof(std::pair<InfoHash, uint32_t>) + 1;
+        const size_t entry_bytes = sizeof(Entry) + sizeof(uint32_t); // Entry plus its heap slot
+        size_t best = 16;
+        for (size_t table = 16; table * index_slot <= budget; table <<= 1) {
+            size_t fit = std::min(table * 4 / 5, (budget - table * index_slot) / entry_bytes);
+            best = std::max(best, fit);
+        }
+        return best;
+    }
+
+    uint32_t now_seconds() const {
+        auto elapsed = std::chrono::steady_clock::now() - m_epoch;
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count());
+    }
+
+    // Seconds since the epoch for a time point, clamped to [0, now]
+    uint32_t seconds_at(std::chrono::steady_clock::time_point time, uint32_t now) const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(time - m_epoch).count();
+        return static_cast<uint32_t>(std::max<int64_t>(0, std::min<int64_t>(elapsed, now)));
+    }
+
+    bool restore_one(const DiscoveryRecord& record) {
+        uint32_t now = now_seconds();
+        uint32_t last_seen = seconds_at(record.last_seen, now);
+        if (now - last_seen >= static_cast<uint32_t>(m_ttl.count())) {
+            return false;
+        }
+
+        Shard& shard = shard_for(record.info_hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.index.contains(record.info_hash)) {
+            return false;
+        }
+
+        uint32_t slot = insert_locked(shard, record.info_hash);
+        Entry& entry = shard.entries[slot];
+        entry.first_seen = seconds_at(record.first_seen, now);
+        entry.last_seen = last_seen;
+        entry.sightings = record.sightings;
+        entry.peer_count = record.peer_count;
+        entry.source = record.source;
+        entry.metadata_stored = record.metadata_stored;
+        entry.requested = record.requested;
+        if (entry.requested) {
+            shard.requested++;
+        }
+
+        list_for(shard, entry).push_front(shard.entries, slot);
+        if (!record.metadata_stored && !record.requested && record.request_pending) {
+            heap_push(shard, slot);
+        }
+        m_restored++;
+        return true;
+    }
+
+    void fill_record(const Entry& entry, DiscoveryRecord& record) const {
+        record.info_hash = entry.hash;
+        record.source = entry.source;
+        record.first_seen = m_epoch + std::chrono::seconds(entry.first_seen);
+        record.last_seen = m_epoch + std::chrono::seconds(entry.last_seen);
+        record.sightings = entry.sightings;
+        record.peer_count = entry.peer_count;
+        record.metadata_stored = entry.metadata_stored;
+        record.request_pending = entry.heap_pos != NIL;
+        record.requested = entry.requested;
+    }
+
+    // High bits pick the shard; the shard's index uses the low ones
+    size_t shard_index(const InfoHash& hash) const {
+        return (m_hasher(hash) >> 32) & m_shard_mask;
+    }
+
+    Shard& shard_for(const InfoHash& hash) {
+        return *m_shards[shard_index(hash)];
+    }
+
+    const Shard& shard_for(const InfoHash& hash) const {
+        return *m_shards[shard_index(hash)];
+    }
+
+    LruList& list_for(Shard& shard, const Entry& entry) {
+        return entry.metadata_stored ? shard.stored : shard.pending;
+    }
+
+    void touch_locked(Shard& shard, uint32_t slot) {
+        LruList& list = list_for(shard, shard.entries[slot]);
+        if (list.head != slot) {
+            list.unlink(shard.entries, slot);
+            list.push_front(shard.entries, slot);
+        }
+    }
+
+    // Make room, then claim and index a slot for a new hash
+    uint32_t insert_locked(Shard& shard, const InfoHash& hash) {
+        while (shard.index.size() >= m_max_entries_per_shard) {
+            if (!evict_one_locked(shard)) {
+                break;
+            }
+        }
+
+        uint32_t slot = allocate_locked(shard);
+        shard.entries[slot].hash = hash;
+        shard.index.insert_or_assign(hash, slot);
+        return slot;
+    }
+
+    uint32_t allocate_locked(Shard& shard) {
+        if (!shard.free_slots.empty()) {
+            uint32_t slot = shard.free_slots.back();
+            shard.free_slots.pop_back();
+            return slot;
+        }
+        if (shard.entries.size() == shard.entries.capacity()) {
+            // Grow geometrically but never past the per-shard cap
+            size_t grown = std::max<size_t>(16, shard.entries.capacity() * 2);
+            shard.entries.reserve(std::min(grown, m_max_entries_per_shard));
+        }
+        shard.entries.emplace_back();
+        return static_cast<uint32_t>(shard.entries.size() - 1);
+    }
+
+    static HeapKey heap_key(const Entry& entry) {
+        return HeapKey{source_priority(entry.source), entry.first_seen};
+    }
+
+    static bool key_before(const HeapKey& a, const HeapKey& b) {
+        if (a.priority != b.priority) return a.priority > b.priority;
+        return a.first_seen < b.first_seen;
+    }
+
+    bool heap_before(const Shard& shard, size_t a, size_t b) const {
+        return key_before(heap_key(shard.entries[shard.heap[a]]), heap_key(shard.entries[shard.heap[b]]));
+    }
+
+    void heap_swap(Shard& shard, size_t a, size_t b) {
+        std::swap(shard.heap[a], shard.heap[b]);
+        shard.entries[shard.heap[a]].heap_pos = static_cast<uint32_t>(a);
+        shard.entries[shard.heap[b]].heap_pos = static_cast<uint32_t>(b);
+    }
+
+    void heap_sift_up(Shard& shard, size_t pos) {
+        while (pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            if (!heap_before(shard, pos, parent)) break;
+            heap_swap(shard, pos, parent);
+            pos = parent;
+        }
+    }
+
+    void heap_sift_down(Shard& shard, size_t pos) {
+        size_t size = shard.heap.size();
+        for (;;) {
+            size_t best = pos;
+            size_t left = pos * 2 + 1;
+            size_t right = left + 1;
+            if (left < size && heap_before(shard, left, best)) best = left;
+            if (right < size && heap_before(shard, right, best)) best = right;
+            if (best == pos) break;
+            heap_swap(shard, pos, best);
+            pos = best;
+        }
+    }
+
+    void heap_push(Shard& shard, uint32_t slot) {
+        shard.entries[slot].heap_pos = static_cast<uint32_t>(shard.heap.size());
+        shard.heap.push_back(slot);
+        heap_sift_up(shard, shard.heap.size() - 1);
+    }
+
+    // Remove slot from the heap if it is still queued
+    void heap_remove(Shard& shard, uint32_t slot) {
+        uint32_t pos = shard.entries[slot].heap_pos;
+        if (pos == NIL) return;
+        size_t last = shard.heap.size() - 1;
+        if (pos != last) {
+            heap_swap(shard, pos, last);
+        }
+        shard.heap.pop_back();
+        shard.entries[slot].heap_pos = NIL;
+        if (pos < shard.heap.size()) {
+            heap_sift_up(shard, pos);
+            heap_sift_down(shard, shard.entries[shard.heap[pos]].heap_pos);
+        }
+    }
+
+    void remove_locked(Shard& shard, uint32_t slot) {
+        Entry& entry = shard.entries[slot];
+        heap_remove(shard, slot);
+        if (entry.requested) {
+            entry.requested = false;
+            shard.requested--;
+        }
+        list_for(shard, entry).unlink(shard.entries, slot);
+        shard.index.erase(entry.hash);
+        shard.free_slots.push_back(slot);
+    }
+
+    bool evict_one_locked(Shard& shard) {
+        if (shard.stored.tail != NIL) {
+            remove_locked(shard, shard.stored.tail);
+            m_evicted_stored++;
+            return true;
+        }
+        if (shard.pending.tail != NIL) {
+            remove_locked(shard, shard.pending.tail);
+            m_evicted_pending++;
+            return true;
+        }
+        return false;
+    }
+
+    size_t expire_list_locked(Shard& shard, LruList& list, uint32_t now) {
+        uint32_t ttl = static_cast<uint32_t>(m_ttl.count());
+        size_t removed = 0;
+        while (list.tail != NIL && now - shard.entries[list.tail].last_seen >= ttl) {
+            remove_locked(shard, list.tail);
+            removed++;
+        }
+        return removed;
+    }
+
+    size_t expire_locked(Shard& shard, uint32_t now) {
+        size_t removed = expire_list_locked(shard, shard.stored, now);
+        removed += expire_list_locked(shard, shard.pending, now);
+        m_evicted_ttl += removed;
+        return removed;
+    }
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    size_t m_shard_mask;
+    InfoHashHasher m_hasher;
+    size_t m_max_entries_per_shard;
+    std::chrono::seconds m_ttl;
+    std::chrono::steady_clock::time_point m_epoch;
+
+    std::atomic<uint64_t> m_inserts;
+    std::atomic<uint64_t> m_updates;
+    std::atomic<uint64_t> m_evicted_ttl;
+    std::atomic<uint64_t> m_evicted_stored;
+    std::atomic<uint64_t> m_evicted_pending;
+    std::atomic<uint64_t> m_popped;
+    std::atomic<uint64_t> m_restored;
+};
+
+} // namespace dht_crawler
@@ -23,90 +23,34 @@
 #include <libtorrent/error_code.hpp>
 #endif
 
+#include "info_hash.hpp"
+#include "peer_endpoint.hpp"
+#include "timer_wheel.hpp"
+#include "torrent_handle_registry.hpp"
+
 #include <vector>
 #include <utility>
 #include <numeric>
 #include <memory>
 #include <chrono>
 #include <atomic>
+#include <mutex>
 #include <functional>
 #include <string>
 #include <sstream>
 #include <iomanip>
 #include <map>
+#include <deque>
+#include <unordered_map>
 #include <set>
 
 namespace dht_crawler {
 
-// Utility function to convert hash formats
+// Utility function to convert hash formats (hex, base32 or binary) to
+// lowercase hex; empty if the input is none of them
 inline std::string convert_hash_to_hex(const std::string& hash) {
-    // If it's already hex (40 characters), return as is
-    if (hash.length() == 40) {
-        // Check if it's valid hex
-        bool is_hex = true;
-        for (char c : hash) {
-            if (!std::isxdigit(c)) {
-                is_hex = false;
-                break;
-            }
-        }
-        if (is_hex) {
-            return hash;
-        }
-    }
-    
-    // If it's base32 (32 characters), convert to hex
-    if (hash.length() == 32) {
-        // Simple base32 to hex conversion for SHA1 hashes
-        // This is a basic implementation - for production use, consider a proper base32 library
-        const std::string base32_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-        std::string result;
-        
-        try {
-            // Convert base32 to binary, then to hex
-            std::string binary;
-            for (char c : hash) {
-                size_t pos = base32_chars.find(std::toupper(c));
-                if (pos == std::string::npos) {
-                    return ""; // Invalid base32 character
-                }
-                
-                // Convert to 5-bit binary
-                for (int i = 4; i >= 0; i--) {
-                    binary += ((pos >> i) & 1) ? '1' : '0';
-                }
-            }
-            
-            // Convert binary to hex
-            for (size_t i = 0; i < binary.length(); i += 4) {
-                std::string nibble = binary.substr(i, 4);
-                int value = 0;
-                for (int j = 0; j < 4; j++) {
-                    if (nibble[j] == '1') {
-                        value |= (1 << (3 - j));
-                    }
-                }
-                result += "0123456789abcdef"[value];
-            }
-            
-            return result;
-        } catch (...) {
-            return "";
-        }
-    }
-    
-    // Handle binary hash (20 bytes = 40 hex chars)
-    if (hash.length() == 20) {
-        std::string result;
-        for (unsigned char c : hash) {
-            char hex[3];
-            snprintf(hex, sizeof(hex), "%02x", c);
-            result += hex;
-        }
-        return result;
-    }
-    
-    return ""; // Invalid format
+    InfoHash parsed;
+    return InfoHash::parse(hash, parsed) ? parsed.to_hex() : std::string();
 }
 
 // Enhanced metadata manager for better tracking and logging
@@ -200,43 +144,60 @@ struct QueueEntry {
         : hash(h), priority(p), source(s), queued_time(std::chrono::steady_clock::now()) {}
 };
 
-// Active request tracker - keeps track of currently processing requests
+// Active request tracker - keeps track of currently processing requests.
+// Each request's timeout is a timer wheel deadline; expired requests stay
+// tracked (and reported) until removed.
 class ActiveRequestTracker {
 public:
+    using DeadlineWheel = dht_crawler::TimerWheel<std::string>;
+
     struct RequestInfo {
         std::chrono::steady_clock::time_point request_time;
         int priority; // Higher number = higher priority
         std::string source; // DHT_PEERS, DHT_ANNOUNCE, DHT_ITEM, etc.
         lt::torrent_handle handle; // Keep the libtorrent handle
+        DeadlineWheel::TimerId deadline;
     };
 
-    ActiveRequestTracker() = default;
+    explicit ActiveRequestTracker(std::chrono::seconds timeout = std::chrono::seconds(120))
+        : m_timeout(timeout)
+        , m_deadlines(std::chrono::milliseconds(100)) {}
+
+    // Applies to requests added from now on
+    void set_timeout(std::chrono::seconds timeout) {
+        m_timeout = timeout;
+    }
 
     void add_request(const std::string& hash, const std::chrono::steady_clock::time_point& request_time, 
                     int priority = 1, const std::string& source = "UNKNOWN", lt::torrent_handle handle = lt::torrent_handle()) {
-        m_requests[hash] = {request_time, priority, source, handle};
+        remove_request(hash);
+        auto deadline = m_deadlines.schedule_at(request_time + m_timeout, hash);
+        m_requests[hash] = {request_time, priority, source, handle, deadline};
     }
 
     void remove_request(const std::string& hash) {
-        m_requests.erase(hash);
+        auto it = m_requests.find(hash);
+        if (it == m_requests.end()) return;
+        m_deadlines.cancel(it->second.deadline);
+        m_timed_out.erase(hash);
+        m_requests.erase(it);
     }
 
     bool has_request(const std::string& hash) const {
         return m_requests.find(hash) != m_requests.end();
     }
 
-    std::vector<std::string> get_timed_out_requests(int timeout_seconds = 120) const {
-        std::vector<std::string> timed_out;
-        auto now = std::chrono::steady_clock::now();
-        
-        for (const auto& pair : m_requests) {
-            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - pair.second.request_time).count();
-            if (elapsed >= timeout_seconds) {
-                timed_out.push_back(pair.first);
-            }
-        }
-        
-        return timed_out;
+    /**
+     * Move requests whose deadline passed into the timed-out set
+     */
+    void expire(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) {
+        m_deadlines.advance(now, [this](const std::string& hash) {
+            m_timed_out.insert(hash);
+        });
+    }
+
+    std::vector<std::string> get_timed_out_requests() const {
+        return std::vector<std::string>(m_timed_out.begin(), m_timed_out.end());
     }
 
     size_t get_active_requests() const {
@@ -249,6 +210,8 @@ public:
 
     void clear() {
         m_requests.clear();
+        m_timed_out.clear();
+        m_deadlines.clear();
     }
 
     const std::map<std::string, RequestInfo>& get_requests() const {
@@ -257,6 +220,9 @@ public:
 
 private:
     std::map<std::string, RequestInfo> m_requests;
+    std::set<std::string> m_timed_out;
+    std::chrono::seconds m_timeout;
+    DeadlineWheel m_deadlines;
 };
 
 // Unlimited queue for metadata requests
@@ -347,6 +313,10 @@ public:
         return stats;
     }
 
+    const std::vector<QueueEntry>& entries() const {
+        return m_queue;
+    }
+
 private:
     std::vector<QueueEntry> m_queue;
     std::set<std::string> m_queue_set; // For fast lookup
@@ -355,23 +325,31 @@ private:
 // Persistent metadata downloader with unlimited queue
 class PersistentMetadataDownloader {
 public:
-    PersistentMetadataDownloader(lt::session* session, 
+    PersistentMetadataDownloader(std::shared_ptr<TorrentHandleRegistry> handles, 
                                 std::function<void(const std::string&)> log_callback = nullptr)
-        : m_session(session)
+        : m_handles(handles)
         , m_log_callback(log_callback)
         , m_max_concurrent_requests(1000) // Match libtorrent active_limit
         , m_request_timeout_seconds(20) // Reduced timeout for faster cleanup
         , m_success_count(0)
         , m_failure_count(0)
         , m_timeout_count(0)
+        , m_eviction_count(0)
         , m_total_queued(0)
         , m_total_processed(0)
     {
+        m_active_tracker.set_timeout(std::chrono::seconds(m_request_timeout_seconds));
+        if (m_handles) {
+            m_handles->add_release_listener([this](const InfoHash& hash, HandleRelease reason) {
+                handle_released(hash, reason);
+            });
+        }
     }
 
     // Always succeeds - adds to unlimited queue
     bool request_metadata(const std::string& info_hash, int priority = 1, const std::string& source = "UNKNOWN") {
-        if (!m_session) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (!m_handles) {
             log("Session not available for metadata request");
             return false;
         }
@@ -399,12 +377,15 @@ public:
 
     // Process items from the queue into active requests - UNLIMITED QUEUE VERSION
     void process_queue() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         int processed_this_round = 0;
         const int max_per_round = 50; // Process more requests per round for unlimited queue
         
         // Process as many requests as possible up to the concurrent limit
+        // and the session-wide handle cap
         while (!m_queue.is_empty() && 
                m_active_tracker.get_active_requests() < static_cast<size_t>(m_max_concurrent_requests) &&
+               m_handles->has_capacity() &&
                processed_this_round < max_per_round) {
             std::string hash;
             int priority;
@@ -424,6 +405,7 @@ public:
                     log("Re-queued failed request with lower priority: " + hash.substr(0, 8) + "...");
                 } else {
                     log("Failed to process queued request for: " + hash.substr(0, 8) + "... (final attempt)");
+                    m_peer_hints.erase(hash);
                     m_failure_count++;
                 }
             }
@@ -437,27 +419,17 @@ public:
 
     // Process a single metadata request
     bool process_single_request(const std::string& info_hash, int priority, const std::string& source) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         try {
-            // Convert hash format if needed (base32 to hex)
-            std::string hex_hash = convert_hash_to_hex(info_hash);
-            if (hex_hash.empty()) {
+            // Accept hex, base32 or binary hashes
+            InfoHash hash;
+            if (!InfoHash::parse(info_hash, hash)) {
                 log("Invalid hash format: " + info_hash.substr(0, 8) + "... (length: " + std::to_string(info_hash.length()) + ")");
                 return false;
             }
             
-            // Create magnet link
-            std::string magnet = "magnet:?xt=urn:btih:" + hex_hash;
-            
-            // Create torrent parameters
-            lt::add_torrent_params params;
-            
-            // Try to parse magnet URI first
-            lt::error_code ec;
-            params = lt::parse_magnet_uri(magnet, ec);
-            if (ec) {
-                log("Failed to parse magnet URI: " + ec.message());
-                return false;
-            }
+            // Create torrent parameters straight from the binary hash
+            lt::add_torrent_params params = hash.to_add_torrent_params();
             
             params.save_path = ".";  // Current directory
             params.flags |= lt::torrent_flags::auto_managed;
@@ -467,8 +439,19 @@ public:
             // Instead, use seed_mode which allows metadata download but no data upload
             params.flags |= lt::torrent_flags::seed_mode;  // Allow metadata download, no data upload
             
+            // Start with the peers the crawler already saw for this hash
+            auto hints = m_peer_hints.find(info_hash);
+            if (hints != m_peer_hints.end()) {
+                hints->second.for_each([&params](const PeerEndpoint& peer) {
+                    if (params.peers.size() < MAX_HINTED_PEERS) {
+                        params.peers.push_back(peer.to_endpoint());
+                    }
+                });
+                m_peer_hints.erase(hints);
+            }
+            
             // Add torrent to session
-            auto handle = m_session->add_torrent(params);
+            auto handle = m_handles->add(hash, params);
             
             if (handle.is_valid()) {
                 m_active_tracker.add_request(info_hash, std::chrono::steady_clock::now(), priority, source, handle);
@@ -485,7 +468,32 @@ public:
         }
     }
 
+    /**
+     * Remember peers already seen for a hash (from its get_peers reply) and
+     * hand them to the torrent when its request starts, so it does not wait
+     * for its own DHT lookup. Only the first reply's peers are kept, and
+     * only for hashes not yet being fetched. Hints usually arrive before the
+     * hash is requested, so at MAX_PEER_HINTS the oldest are dropped.
+     */
+    void add_peer_hints(const std::string& info_hash, const PeerEndpointList& peers) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (peers.empty() || m_active_tracker.has_request(info_hash)) {
+            return;
+        }
+        if (!m_peer_hints.emplace(info_hash, peers).second) {
+            return;
+        }
+        // The order list may name hints already consumed; bounding it
+        // bounds both
+        m_peer_hint_order.push_back(info_hash);
+        while (m_peer_hint_order.size() > MAX_PEER_HINTS) {
+            m_peer_hints.erase(m_peer_hint_order.front());
+            m_peer_hint_order.pop_front();
+        }
+    }
+
     void handle_metadata_received(const std::string& info_hash) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         m_active_tracker.remove_request(info_hash);
         m_success_count++;
         log("Metadata received and request removed for: " + info_hash.substr(0, 8) + "... (success: " + std::to_string(m_success_count) + ")");
@@ -494,6 +502,46 @@ public:
         process_queue();
     }
 
+    // The torrent failed in the session (its handle is already released)
+    void handle_metadata_failed(const std::string& info_hash) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (!m_active_tracker.has_request(info_hash)) {
+            return;
+        }
+        m_active_tracker.remove_request(info_hash);
+        m_failure_count++;
+        log("Metadata failed and request removed for: " + info_hash.substr(0, 8) + "... (failures: " + std::to_string(m_failure_count) + ")");
+        process_queue();
+    }
+
+    // The registry removed a handle on its own (evicted at its cap). If it
+    // was ours, end the request now rather than at its timeout, and retry
+    // it at lower priority like a request that failed to start. No
+    // process_queue() here: we may be inside an add() of our own.
+    void handle_released(const InfoHash& hash, HandleRelease reason) {
+        if (reason != HandleRelease::EVICTED) {
+            return;
+        }
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        std::string info_hash = hash.to_hex();
+        auto it = m_active_tracker.get_requests().find(info_hash);
+        if (it == m_active_tracker.get_requests().end()) {
+            return;
+        }
+        int priority = it->second.priority;
+        std::string source = it->second.source;
+        m_active_tracker.remove_request(info_hash);
+        m_eviction_count++;
+        
+        if (priority > 1) {
+            m_queue.enqueue(info_hash, priority - 1, source + "_RETRY");
+            log("Re-queued evicted request with lower priority: " + info_hash.substr(0, 8) + "...");
+        } else {
+            m_failure_count++;
+            log("Evicted request dropped: " + info_hash.substr(0, 8) + "... (evictions: " + std::to_string(m_eviction_count) + ")");
+        }
+    }
+
     // Enhanced metadata extraction using libtorrent dump_torrent techniques
     struct EnhancedTorrentMetadata {
         std::string info_hash;
@@ -597,24 +645,20 @@ public:
     std::function<void(const EnhancedTorrentMetadata&)> m_metadata_callback;
     
     void set_metadata_callback(std::function<void(const EnhancedTorrentMetadata&)> callback) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         m_metadata_callback = callback;
     }
 
-    void cleanup_timed_out_requests() {
-        auto timed_out = m_active_tracker.get_timed_out_requests(m_request_timeout_seconds);
+    // Remove timed out requests from the session; returns their hashes
+    std::vector<std::string> cleanup_timed_out_requests() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        m_active_tracker.expire();
+        auto timed_out = m_active_tracker.get_timed_out_requests();
         int cleaned_count = 0;
         
         for (const auto& hash : timed_out) {
             // Remove the torrent from libtorrent session
-            auto it = m_active_tracker.get_requests().find(hash);
-            if (it != m_active_tracker.get_requests().end() && it->second.handle.is_valid()) {
-                try {
-                    m_session->remove_torrent(it->second.handle);
-                } catch (const std::exception& e) {
-                    log("Error removing timed out torrent: " + std::string(e.what()));
-                }
-            }
-            
+            m_handles->release(hash, HandleRelease::TIMED_OUT);
             m_active_tracker.remove_request(hash);
             m_timeout_count++;
             cleaned_count++;
@@ -626,17 +670,21 @@ public:
             // Process more items from the queue after cleanup
             process_queue();
         }
+        return timed_out;
     }
 
     void log_success() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         m_success_count++;
     }
 
     void log_failure() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         m_failure_count++;
     }
 
     int get_available_slots() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         return m_active_tracker.get_available_slots(m_max_concurrent_requests);
     }
 
@@ -644,22 +692,34 @@ public:
         return true; // Always true now - we have unlimited queue
     }
 
-    std::vector<std::string> get_timed_out_requests() const {
-        return m_active_tracker.get_timed_out_requests(m_request_timeout_seconds);
+    // Still queued or being fetched
+    bool is_pending(const std::string& info_hash) const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        return m_active_tracker.has_request(info_hash) || m_queue.contains(info_hash);
+    }
+
+    std::vector<std::string> get_timed_out_requests() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        m_active_tracker.expire();
+        return m_active_tracker.get_timed_out_requests();
     }
 
     void set_max_concurrent_requests(int max) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         m_max_concurrent_requests = max;
         log("Set max concurrent requests to: " + std::to_string(max));
     }
 
     void set_request_timeout(int timeout_seconds) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         m_request_timeout_seconds = timeout_seconds;
+        m_active_tracker.set_timeout(std::chrono::seconds(timeout_seconds));
         log("Set request timeout to: " + std::to_string(timeout_seconds) + " seconds");
     }
     
     // Dynamically adjust concurrent limit based on performance
     void adjust_concurrent_limit() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         // If we have a large queue and low timeout rate, increase the limit
         if (m_queue.size() > 2000 && m_timeout_count < m_success_count / 10) {
             if (m_max_concurrent_requests < 1000) {
@@ -675,31 +735,48 @@ public:
     }
 
     size_t get_active_requests() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         return m_active_tracker.get_active_requests();
     }
     
     int get_max_concurrent_requests() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         return m_max_concurrent_requests;
     }
 
     size_t get_queue_size() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         return m_queue.size();
     }
 
+    // Queued and in-flight requests, for a crawl snapshot
+    std::vector<QueueEntry> get_outstanding_requests() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        std::vector<QueueEntry> requests = m_queue.entries();
+        for (const auto& pair : m_active_tracker.get_requests()) {
+            requests.emplace_back(pair.first, pair.second.priority, pair.second.source);
+        }
+        return requests;
+    }
+
     size_t get_total_queued() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         return m_total_queued;
     }
 
     size_t get_total_processed() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         return m_total_processed;
     }
 
     // Force process queue (useful for periodic processing)
     void force_process_queue() {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         process_queue();
     }
 
     void print_status() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         auto queue_stats = m_queue.get_stats();
         log("Metadata Downloader Status:");
         log("  Active requests: " + std::to_string(m_active_tracker.get_active_requests()));
@@ -715,24 +792,35 @@ public:
         log("  Success count: " + std::to_string(m_success_count));
         log("  Failure count: " + std::to_string(m_failure_count));
         log("  Timeout count: " + std::to_string(m_timeout_count));
+        log("  Eviction count: " + std::to_string(m_eviction_count));
     }
 
 private:
+    // Guards the queue and active tracker; requests arrive from the metadata
+    // scheduling stage while timers and metadata alerts run on the alert thread
+    mutable std::recursive_mutex m_mutex;
+    
     void log(const std::string& message) const {
         if (m_log_callback) {
             m_log_callback("[MetadataDownloader] " + message);
         }
     }
 
-    lt::session* m_session;
+    static constexpr size_t MAX_PEER_HINTS = 100000;    // Hashes with hints waiting to be requested
+    static constexpr size_t MAX_HINTED_PEERS = 32;      // Peers added with one torrent
+
+    std::shared_ptr<TorrentHandleRegistry> m_handles;
     std::function<void(const std::string&)> m_log_callback;
     ActiveRequestTracker m_active_tracker;
     MetadataRequestQueue m_queue;
+    std::unordered_map<std::string, PeerEndpointList> m_peer_hints;
+    std::deque<std::string> m_peer_hint_order;          // Insertion order, oldest first
     int m_max_concurrent_requests;
     int m_request_timeout_seconds;
     int m_success_count;
     int m_failure_count;
     int m_timeout_count;
+    int m_eviction_count;
     int m_total_queued;
     int m_total_processed;
 };
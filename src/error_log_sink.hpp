@@ -0,0 +1,235 @@
+/*
+ * Error Log Sink
+ *
+ * Collects error records in memory and writes them from a background thread,
+ * so reporting an error never waits on (or adds load to) the database the
+ * error came from. Records with the same (function, code, message) within a
+ * flush interval are collapsed into one row with an occurrence count, which
+ * keeps an error storm during an outage down to a handful of rows.
+ *
+ * The buffer holds at most `capacity` distinct records per interval; beyond
+ * that new records are counted as dropped and reported in a summary row.
+ * When the write function fails (database down), the batch is appended to a
+ * local fallback file instead.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace dht_crawler {
+
+struct ErrorLogEntry {
+    std::string function_name;
+    std::string caller_function;
+    int error_code = 0;
+    std::string error_message;
+    std::string stack_trace;
+    std::string severity;
+    std::string thread_id;        // First occurrence
+    int process_id = 0;
+    std::string additional_data;  // First occurrence
+    uint64_t occurrences = 1;
+    std::chrono::system_clock::time_point first_seen;
+    std::chrono::system_clock::time_point last_seen;
+};
+
+struct ErrorLogSinkConfig {
+    size_t capacity = 1024;                             // Distinct records buffered per interval
+    std::chrono::milliseconds flush_interval{5000};     // How often the buffer is written
+    std::string fallback_path = "dht_crawler_errors.log"; // Used while the write function fails
+};
+
+class ErrorLogSink {
+public:
+    using WriteFunction = std::function<bool(const std::vector<ErrorLogEntry>&)>;
+
+    ErrorLogSink(const ErrorLogSinkConfig& config, WriteFunction write)
+        : m_config(config)
+        , m_write(write)
+        , m_running(false)
+        , m_stop_requested(false)
+        , m_dropped_pending(0)
+        , m_submitted(0)
+        , m_aggregated(0)
+        , m_dropped(0)
+        , m_rows_written(0)
+        , m_rows_fallback(0)
+        , m_write_failures(0) {}
+
+    ~ErrorLogSink() {
+        stop();
+    }
+
+    void start() {
+        if (m_running) return;
+        m_stop_requested = false;
+        m_running = true;
+        m_thread = std::thread(&ErrorLogSink::drain_loop, this);
+    }
+
+    /**
+     * Stop the drain thread after writing everything buffered
+     */
+    void stop() {
+        if (!m_running) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop_requested = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_running = false;
+    }
+
+    /**
+     * Record an error; never performs I/O
+     */
+    void submit(ErrorLogEntry entry) {
+        auto now = std::chrono::system_clock::now();
+        std::string key = entry.function_name + '\x1f' + std::to_string(entry.error_code) + '\x1f' + entry.error_message;
+        m_submitted++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            ErrorLogEntry& existing = m_entries[it->second];
+            existing.occurrences++;
+            existing.last_seen = now;
+            m_aggregated++;
+            return;
+        }
+        if (m_entries.size() >= m_config.capacity) {
+            m_dropped_pending++;
+            m_dropped++;
+            return;
+        }
+        entry.occurrences = 1;
+        entry.first_seen = now;
+        entry.last_seen = now;
+        m_index.emplace(std::move(key), m_entries.size());
+        m_entries.push_back(std::move(entry));
+    }
+
+    void print_statistics() const {
+        std::cout << "=== Error Log Sink Statistics ===" << std::endl;
+        std::cout << "Errors submitted: " << m_submitted.load() << std::endl;
+        std::cout << "Aggregated into existing rows: " << m_aggregated.load() << std::endl;
+        std::cout << "Dropped (buffer full): " << m_dropped.load() << std::endl;
+        std::cout << "Rows written: " << m_rows_written.load() << std::endl;
+        std::cout << "Rows written to " << m_config.fallback_path << ": " << m_rows_fallback.load()
+                  << " (write failures: " << m_write_failures.load() << ")" << std::endl;
+        std::cout << "=================================" << std::endl;
+    }
+
+private:
+    void drain_loop() {
+        std::vector<ErrorLogEntry> batch;
+
+        for (;;) {
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait_for(lock, m_config.flush_interval, [this]() { return m_stop_requested; });
+                stopping = m_stop_requested;
+
+                batch.swap(m_entries);
+                m_index.clear();
+                if (m_dropped_pending > 0) {
+                    batch.push_back(dropped_summary_locked());
+                }
+            }
+
+            if (!batch.empty()) {
+                write_batch(batch);
+                batch.clear();
+            }
+            if (stopping) break;
+        }
+    }
+
+    ErrorLogEntry dropped_summary_locked() {
+        ErrorLogEntry summary;
+        summary.function_name = "ErrorLogSink";
+        summary.error_code = -1;
+        summary.error_message = "Error log buffer full, records dropped";
+        summary.severity = "WARNING";
+        summary.occurrences = m_dropped_pending;
+        summary.first_seen = summary.last_seen = std::chrono::system_clock::now();
+        m_dropped_pending = 0;
+        return summary;
+    }
+
+    void write_batch(const std::vector<ErrorLogEntry>& batch) {
+        bool ok = false;
+        try {
+            ok = m_write && m_write(batch);
+        } catch (const std::exception& e) {
+            std::cerr << "Error log write failed: " << e.what() << std::endl;
+        }
+        if (ok) {
+            m_rows_written += batch.size();
+            return;
+        }
+
+        m_write_failures++;
+        std::ofstream out(m_config.fallback_path, std::ios::app);
+        if (!out) {
+            std::cerr << "Error log fallback file " << m_config.fallback_path << " not writable, "
+                      << batch.size() << " rows lost" << std::endl;
+            return;
+        }
+        for (const auto& entry : batch) {
+            out << format_time(entry.first_seen) << " " << entry.severity << " " << entry.function_name;
+            if (!entry.caller_function.empty()) out << " <- " << entry.caller_function;
+            out << " code=" << entry.error_code << " x" << entry.occurrences
+                << " (last " << format_time(entry.last_seen) << "): " << entry.error_message;
+            if (!entry.additional_data.empty()) out << " [" << entry.additional_data << "]";
+            out << "\n";
+        }
+        m_rows_fallback += batch.size();
+    }
+
+    static std::string format_time(std::chrono::system_clock::time_point time) {
+        std::time_t t = std::chrono::system_clock::to_time_t(time);
+        char buffer[32];
+        std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&t));
+        return buffer;
+    }
+
+    ErrorLogSinkConfig m_config;
+    WriteFunction m_write;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<ErrorLogEntry> m_entries;
+    std::unordered_map<std::string, size_t> m_index;   // Aggregation key -> m_entries slot
+
+    std::atomic<bool> m_running;
+    bool m_stop_requested;
+    uint64_t m_dropped_pending;
+
+    std::atomic<uint64_t> m_submitted;
+    std::atomic<uint64_t> m_aggregated;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_rows_written;
+    std::atomic<uint64_t> m_rows_fallback;
+    std::atomic<uint64_t> m_write_failures;
+};
+
+} // namespace dht_crawler
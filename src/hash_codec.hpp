@@ -0,0 +1,226 @@
+/*
+ * Hex and Base32 Codec
+ *
+ * Allocation-free encoders/decoders for info-hash text forms: lowercase hex
+ * (either case accepted on input) and RFC4648 base32 as used in magnet
+ * links. Callers supply the output buffers.
+ *
+ * Hex runs 16 bytes (32 chars) per step with SSE2, which every x86-64 target
+ * has, and 32 bytes per step with AVX2 when the build enables it
+ * (-DENABLE_NATIVE_ARCH=ON or -mavx2). Base32 works on 5-byte / 8-char
+ * groups with table lookups; its bit shuffling does not map onto byte
+ * lanes, and a 20-byte hash is only four groups. Other targets use the
+ * scalar paths, which give identical results.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DHT_CRAWLER_CODEC_SSE2 1
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DHT_CRAWLER_CODEC_AVX2 1
+#endif
+
+namespace dht_crawler {
+namespace codec {
+
+namespace detail {
+
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+constexpr char BASE32_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+// 0-15 for hex digits, 0xff otherwise
+struct HexTable {
+    uint8_t values[256];
+    constexpr HexTable() : values() {
+        for (int i = 0; i < 256; ++i) values[i] = 0xff;
+        for (int i = 0; i < 10; ++i) values['0' + i] = static_cast<uint8_t>(i);
+        for (int i = 0; i < 6; ++i) {
+            values['a' + i] = static_cast<uint8_t>(10 + i);
+            values['A' + i] = static_cast<uint8_t>(10 + i);
+        }
+    }
+};
+
+// 0-31 for base32 characters (either case), 0xff otherwise
+struct Base32Table {
+    uint8_t values[256];
+    constexpr Base32Table() : values() {
+        for (int i = 0; i < 256; ++i) values[i] = 0xff;
+        for (int i = 0; i < 26; ++i) {
+            values['A' + i] = static_cast<uint8_t>(i);
+            values['a' + i] = static_cast<uint8_t>(i);
+        }
+        for (int i = 0; i < 6; ++i) values['2' + i] = static_cast<uint8_t>(26 + i);
+    }
+};
+
+constexpr HexTable HEX_TABLE{};
+constexpr Base32Table BASE32_TABLE{};
+
+inline void hex_encode_scalar(const uint8_t* in, size_t size, char* out) {
+    for (size_t i = 0; i < size; ++i) {
+        out[i * 2] = HEX_DIGITS[in[i] >> 4];
+        out[i * 2 + 1] = HEX_DIGITS[in[i] & 0x0f];
+    }
+}
+
+inline bool hex_decode_scalar(const char* in, size_t size, uint8_t* out) {
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t hi = HEX_TABLE.values[static_cast<uint8_t>(in[i * 2])];
+        uint8_t lo = HEX_TABLE.values[static_cast<uint8_t>(in[i * 2 + 1])];
+        invalid |= (hi | lo) & 0xf0;
+        out[i] = static_cast<uint8_t>((hi << 4) | (lo & 0x0f));
+    }
+    return invalid == 0;
+}
+
+#ifdef DHT_CRAWLER_CODEC_SSE2
+// Nibbles 0-15 to ASCII: '0' + n, plus 39 more for n > 9 to land on 'a'
+inline __m128i nibbles_to_hex_sse2(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8(39));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+inline void hex_encode_16_sse2(const uint8_t* in, char* out) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i hi = nibbles_to_hex_sse2(_mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+    __m128i lo = nibbles_to_hex_sse2(_mm_and_si128(bytes, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+// Values of 16 hex chars, with all-ones lanes in *valid where the char was a hex digit
+inline __m128i hex_values_sse2(__m128i chars, __m128i* valid) {
+    // Digits: '0'..'9'. Letters: fold to lowercase, then 'a'..'f'. Signed
+    // compares are fine since every candidate is below 0x80 and bytes
+    // >= 0x80 compare negative, i.e. out of range.
+    __m128i digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digits, _mm_set1_epi8(-1)),
+                                     _mm_cmplt_epi8(digits, _mm_set1_epi8(10)));
+    __m128i letters = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(letters, _mm_set1_epi8(-1)),
+                                      _mm_cmplt_epi8(letters, _mm_set1_epi8(6)));
+    *valid = _mm_or_si128(is_digit, is_letter);
+    return _mm_or_si128(_mm_and_si128(is_digit, digits),
+                        _mm_and_si128(is_letter, _mm_add_epi8(letters, _mm_set1_epi8(10))));
+}
+
+// 32 hex chars to 16 bytes
+inline bool hex_decode_16_sse2(const char* in, uint8_t* out) {
+    __m128i valid0, valid1;
+    __m128i v0 = hex_values_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), &valid0);
+    __m128i v1 = hex_values_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16)), &valid1);
+
+    // Each 16-bit lane holds (lo << 8) | hi; combine into (hi << 4) | lo
+    __m128i low_byte = _mm_set1_epi16(0x00ff);
+    __m128i b0 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v0, low_byte), 4), _mm_srli_epi16(v0, 8));
+    __m128i b1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v1, low_byte), 4), _mm_srli_epi16(v1, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(b0, b1));
+
+    return _mm_movemask_epi8(_mm_and_si128(valid0, valid1)) == 0xffff;
+}
+#endif
+
+#ifdef DHT_CRAWLER_CODEC_AVX2
+inline __m256i nibbles_to_hex_avx2(__m256i nibbles) {
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)), _mm256_set1_epi8(39));
+    return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+}
+
+inline void hex_encode_32_avx2(const uint8_t* in, char* out) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    __m256i hi = nibbles_to_hex_avx2(_mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+    __m256i lo = nibbles_to_hex_avx2(_mm256_and_si256(bytes, mask));
+    // Unpacks work per 128-bit lane; put the four 16-char runs back in order
+    __m256i first = _mm256_unpacklo_epi8(hi, lo);
+    __m256i second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+}
+#endif
+
+} // namespace detail
+
+/**
+ * Encode size bytes as 2 * size lowercase hex chars (no terminator)
+ */
+inline void hex_encode(const uint8_t* in, size_t size, char* out) {
+    size_t i = 0;
+#ifdef DHT_CRAWLER_CODEC_AVX2
+    for (; i + 32 <= size; i += 32) {
+        detail::hex_encode_32_avx2(in + i, out + i * 2);
+    }
+#endif
+#ifdef DHT_CRAWLER_CODEC_SSE2
+    for (; i + 16 <= size; i += 16) {
+        detail::hex_encode_16_sse2(in + i, out + i * 2);
+    }
+#endif
+    detail::hex_encode_scalar(in + i, size - i, out + i * 2);
+}
+
+/**
+ * Decode 2 * size hex chars (either case) into size bytes
+ * @return false if any char is not a hex digit (out is then unspecified)
+ */
+inline bool hex_decode(const char* in, size_t size, uint8_t* out) {
+    size_t i = 0;
+    bool valid = true;
+#ifdef DHT_CRAWLER_CODEC_SSE2
+    for (; i + 16 <= size; i += 16) {
+        valid &= detail::hex_decode_16_sse2(in + i * 2, out + i);
+    }
+#endif
+    valid &= detail::hex_decode_scalar(in + i * 2, size - i, out + i);
+    return valid;
+}
+
+/**
+ * Encode size bytes (a multiple of 5) as size * 8 / 5 uppercase base32 chars
+ */
+inline void base32_encode(const uint8_t* in, size_t size, char* out) {
+    for (size_t i = 0; i + 5 <= size; i += 5, out += 8) {
+        uint64_t group = (static_cast<uint64_t>(in[i]) << 32) | (static_cast<uint64_t>(in[i + 1]) << 24) |
+                         (static_cast<uint64_t>(in[i + 2]) << 16) | (static_cast<uint64_t>(in[i + 3]) << 8) |
+                         static_cast<uint64_t>(in[i + 4]);
+        for (int c = 0; c < 8; ++c) {
+            out[c] = detail::BASE32_ALPHABET[(group >> (35 - c * 5)) & 0x1f];
+        }
+    }
+}
+
+/**
+ * Decode chars (a multiple of 8, either case, no padding) into chars * 5 / 8 bytes
+ * @return false if any char is outside the base32 alphabet
+ */
+inline bool base32_decode(const char* in, size_t chars, uint8_t* out) {
+    uint8_t invalid = 0;
+    for (size_t i = 0; i + 8 <= chars; i += 8, out += 5) {
+        uint64_t group = 0;
+        for (int c = 0; c < 8; ++c) {
+            uint8_t value = detail::BASE32_TABLE.values[static_cast<uint8_t>(in[i + c])];
+            invalid |= value & 0xe0;
+            group = (group << 5) | (value & 0x1f);
+        }
+        out[0] = static_cast<uint8_t>(group >> 32);
+        out[1] = static_cast<uint8_t>(group >> 24);
+        out[2] = static_cast<uint8_t>(group >> 16);
+        out[3] = static_cast<uint8_t>(group >> 8);
+        out[4] = static_cast<uint8_t>(group);
+    }
+    return invalid == 0;
+}
+
+} // namespace codec
+} // namespace dht_crawler
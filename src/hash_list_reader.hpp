@@ -0,0 +1,467 @@
+/*
+ * Streaming Hash-List Input for --metadata
+ *
+ * HashListReader hands out info-hashes from a list a batch at a time, so a
+ * list of tens of millions of hashes never has to sit in memory. A file is
+ * memory-mapped and scanned sequentially (pages already consumed are given
+ * back to the kernel); "-" reads stdin through a fixed buffer; anything
+ * else is taken as an inline comma-delimited list. Tokens are separated by
+ * commas or whitespace, and each is decoded in place by the shared
+ * hex/base32 codec (SSE2/AVX2 for hex). Tokens that are not a 40-char hex
+ * or 32-char base32 hash are counted and skipped.
+ *
+ * Every hash carries the byte offset just past its token. HashListProgress
+ * tracks the admitted hashes in list order and reports the offset below
+ * which every hash has completed; HashListCheckpoint persists that offset
+ * so a restarted run skips straight to it. Hashes that were in flight when
+ * the run stopped are requested again, none are lost.
+ */
+
+#pragma once
+
+#include "info_hash.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dht_crawler {
+
+struct HashListEntry {
+    InfoHash hash;
+    uint64_t end_offset; // Input offset just past this hash's token
+};
+
+class HashListReader {
+public:
+    static constexpr size_t STREAM_BUFFER_BYTES = 1024 * 1024;
+    // Consumed mapped pages are released in steps of this size
+    static constexpr uint64_t RELEASE_BYTES = 64ull * 1024 * 1024;
+
+    /**
+     * Open a hash file, or stdin for "-"
+     * @return nullptr with error set if the file cannot be read
+     */
+    static std::unique_ptr<HashListReader> open(const std::string& path, std::string& error) {
+        std::unique_ptr<HashListReader> reader(new HashListReader());
+        reader->m_source = path;
+        if (path == "-") {
+            reader->m_fd = STDIN_FILENO;
+            reader->m_streaming = true;
+            reader->m_buffer.resize(STREAM_BUFFER_BYTES);
+            return reader;
+        }
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + std::strerror(errno);
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            error = "cannot stat " + path + ": " + std::strerror(errno);
+            ::close(fd);
+            return nullptr;
+        }
+        reader->m_fd = fd;
+        reader->m_file_size = static_cast<uint64_t>(st.st_size);
+        if (reader->m_file_size > 0) {
+            void* map = mmap(nullptr, reader->m_file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                error = "cannot map " + path + ": " + std::strerror(errno);
+                return nullptr;
+            }
+            madvise(map, reader->m_file_size, MADV_SEQUENTIAL);
+            reader->m_map = static_cast<const char*>(map);
+            reader->m_data = reader->m_map;
+            reader->m_data_size = reader->m_file_size;
+        }
+        reader->m_eof = true;
+        return reader;
+    }
+
+    // Inline comma-delimited list
+    static std::unique_ptr<HashListReader> from_string(const std::string& text) {
+        std::unique_ptr<HashListReader> reader(new HashListReader());
+        reader->m_source = "command line";
+        reader->m_buffer.assign(text.begin(), text.end());
+        reader->m_data = reader->m_buffer.data();
+        reader->m_data_size = reader->m_buffer.size();
+        reader->m_eof = true;
+        return reader;
+    }
+
+    ~HashListReader() {
+        if (m_map) {
+            munmap(const_cast<char*>(m_map), m_file_size);
+        }
+        if (m_fd >= 0 && m_fd != STDIN_FILENO) {
+            ::close(m_fd);
+        }
+    }
+
+    HashListReader(const HashListReader&) = delete;
+    HashListReader& operator=(const HashListReader&) = delete;
+
+    /**
+     * Append up to max valid hashes to out
+     * @return Number appended; 0 once the input is exhausted
+     */
+    size_t next(std::vector<HashListEntry>& out, size_t max) {
+        size_t added = 0;
+        while (added < max) {
+            const char* token = nullptr;
+            size_t length = 0;
+            if (!next_token(token, length)) {
+                break;
+            }
+
+            HashListEntry entry;
+            if (!decode(token, length, entry.hash)) {
+                m_invalid++;
+                if (m_invalid <= MAX_INVALID_REPORTS && m_invalid_callback) {
+                    m_invalid_callback(std::string(token, std::min<size_t>(length, 64)));
+                }
+                continue;
+            }
+            entry.end_offset = m_offset + m_pos;
+            out.push_back(entry);
+            m_hashes++;
+            added++;
+        }
+        release_consumed();
+        return added;
+    }
+
+    /**
+     * Resume from an input offset recorded by HashListProgress. A file seeks
+     * there; stdin discards that many bytes, so it only resumes correctly if
+     * the same input is replayed.
+     */
+    bool skip_to(uint64_t offset) {
+        if (!m_streaming) {
+            if (offset > m_data_size) return false;
+            m_pos = static_cast<size_t>(offset);
+            return true;
+        }
+        while (m_offset + m_data_size < offset) {
+            m_offset += m_data_size;
+            m_pos = 0;
+            m_data_size = 0;
+            if (!fill()) return false;
+        }
+        m_pos = static_cast<size_t>(offset - m_offset);
+        return true;
+    }
+
+    // Called with the first few invalid tokens, for logging
+    void set_invalid_callback(std::function<void(const std::string&)> callback) {
+        m_invalid_callback = std::move(callback);
+    }
+
+    bool exhausted() const { return m_eof && m_pos >= m_data_size; }
+    bool is_file() const { return m_map != nullptr || (!m_streaming && m_fd >= 0); }
+    const std::string& source() const { return m_source; }
+    uint64_t position() const { return m_offset + m_pos; }
+    uint64_t file_size() const { return m_file_size; }
+    uint64_t hashes_read() const { return m_hashes; }
+    uint64_t invalid_tokens() const { return m_invalid; }
+
+    /**
+     * FNV-1a of the first few KB of a file, to tell a checkpoint for this
+     * list from one for a different list at the same path
+     */
+    uint64_t head_checksum() const {
+        uint64_t hash = 1469598103934665603ULL;
+        size_t count = m_map ? static_cast<size_t>(std::min<uint64_t>(m_file_size, 4096)) : 0;
+        for (size_t i = 0; i < count; ++i) {
+            hash ^= static_cast<uint8_t>(m_map[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t MAX_INVALID_REPORTS = 10;
+    static constexpr size_t MAX_TOKEN_BYTES = 4096;
+
+    HashListReader() = default;
+
+    static bool is_separator(char c) {
+        return c == ',' || c == '\n' || c == '\r' || c == ' ' || c == '\t' || c == ';';
+    }
+
+    static bool decode(const char* token, size_t length, InfoHash& out) {
+        if (length == InfoHash::SIZE * 2) {
+            return codec::hex_decode(token, InfoHash::SIZE, out.bytes.data());
+        }
+        if (length == 32) {
+            return codec::base32_decode(token, length, out.bytes.data());
+        }
+        return false;
+    }
+
+    /**
+     * Find the next token in the input, refilling the stream buffer as
+     * needed so a token is never split across reads
+     */
+    bool next_token(const char*& token, size_t& length) {
+        for (;;) {
+            while (m_pos < m_data_size && is_separator(m_data[m_pos])) {
+                m_pos++;
+            }
+            size_t end = m_pos;
+            while (end < m_data_size && !is_separator(m_data[end])) {
+                end++;
+            }
+            if (end < m_data_size || (m_eof && end > m_pos)) {
+                token = m_data + m_pos;
+                length = end - m_pos;
+                m_pos = end;
+                return true;
+            }
+            if (m_eof) {
+                return false;
+            }
+            // Partial token (or nothing) left: keep it and read more
+            size_t partial = m_data_size - m_pos;
+            if (partial > MAX_TOKEN_BYTES) {
+                // Not a hash; count it once and drop what we have
+                m_invalid++;
+                partial = 0;
+                m_pos = m_data_size;
+                m_skipping = true;
+            }
+            if (partial > 0) {
+                std::memmove(m_buffer.data(), m_data + m_pos, partial);
+            }
+            m_offset += m_pos;
+            m_data_size = partial;
+            m_pos = 0;
+            if (!fill()) {
+                m_eof = true;
+            }
+            if (m_skipping) {
+                while (m_pos < m_data_size && !is_separator(m_data[m_pos])) {
+                    m_pos++;
+                }
+                if (m_pos < m_data_size || m_eof) {
+                    m_skipping = false;
+                }
+            }
+        }
+    }
+
+    // Read more stdin into the buffer after the first m_data_size bytes
+    bool fill() {
+        m_data = m_buffer.data();
+        for (;;) {
+            ssize_t n = ::read(m_fd, m_buffer.data() + m_data_size, m_buffer.size() - m_data_size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            m_data_size += static_cast<size_t>(n);
+            return true;
+        }
+    }
+
+    // Drop mapped pages we have scanned past; they will not be read again
+    void release_consumed() {
+        if (!m_map) return;
+        uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        uint64_t consumed = m_pos / page * page;
+        if (consumed >= m_released + RELEASE_BYTES) {
+            madvise(const_cast<char*>(m_map) + m_released, consumed - m_released, MADV_DONTNEED);
+            m_released = consumed;
+        }
+    }
+
+    std::string m_source;
+    int m_fd = -1;
+    bool m_streaming = false;
+    bool m_eof = false;
+    bool m_skipping = false;
+
+    const char* m_map = nullptr;
+    uint64_t m_file_size = 0;
+    uint64_t m_released = 0;
+    std::vector<char> m_buffer;
+
+    // Current window of input: m_data[0, m_data_size) starts at m_offset
+    const char* m_data = nullptr;
+    size_t m_data_size = 0;
+    size_t m_pos = 0;
+    uint64_t m_offset = 0;
+
+    uint64_t m_hashes = 0;
+    uint64_t m_invalid = 0;
+    std::function<void(const std::string&)> m_invalid_callback;
+};
+
+/**
+ * In-flight hashes in admission order. A hash is done when its metadata
+ * arrives or its request ends without it; committed_offset() only moves
+ * past a hash once it and every hash before it are done.
+ */
+class HashListProgress {
+public:
+    // Resuming from a checkpoint starts from its offset and completed count
+    explicit HashListProgress(uint64_t start_offset = 0, uint64_t start_completed = 0)
+        : m_committed_offset(start_offset), m_completed(start_completed) {}
+
+    /**
+     * @return false if the same hash is already in flight (the entry then
+     *         completes with it and needs no request of its own)
+     */
+    bool admit(const HashListEntry& entry) {
+        uint64_t sequence = m_base_sequence + m_entries.size();
+        // A hash listed twice while still in flight completes with its first copy
+        bool duplicate = !m_in_flight.try_emplace(entry.hash, sequence).second;
+        m_entries.push_back(Slot{entry.hash, entry.end_offset, duplicate});
+        if (duplicate) {
+            m_completed++;
+            advance();
+        }
+        return !duplicate;
+    }
+
+    /**
+     * @return false if the hash was not in flight
+     */
+    bool complete(const InfoHash& hash) {
+        auto it = m_in_flight.find(hash);
+        if (it == m_in_flight.end()) {
+            return false;
+        }
+        m_entries[it->second - m_base_sequence].done = true;
+        m_in_flight.erase(it);
+        m_completed++;
+        advance();
+        return true;
+    }
+
+    template <typename Visitor>
+    void for_each_in_flight(Visitor&& visit) const {
+        for (const auto& slot : m_entries) {
+            if (!slot.done) visit(slot.hash);
+        }
+    }
+
+    size_t in_flight() const { return m_in_flight.size(); }
+    uint64_t completed() const { return m_completed; }
+    uint64_t committed_offset() const { return m_committed_offset; }
+
+private:
+    struct Slot {
+        InfoHash hash;
+        uint64_t end_offset;
+        bool done;
+    };
+
+    void advance() {
+        while (!m_entries.empty() && m_entries.front().done) {
+            m_committed_offset = m_entries.front().end_offset;
+            m_entries.pop_front();
+            m_base_sequence++;
+        }
+    }
+
+    std::deque<Slot> m_entries;
+    FlatHashMap<InfoHash, uint64_t> m_in_flight;
+    uint64_t m_base_sequence = 0;
+    uint64_t m_committed_offset;
+    uint64_t m_completed;
+};
+
+/**
+ * Resume point for a hash list, as a small text file replaced atomically
+ * (write "<path>.tmp", fsync, rename)
+ */
+class HashListCheckpoint {
+public:
+    struct State {
+        uint64_t file_size = 0;
+        uint64_t head_checksum = 0;
+        uint64_t offset = 0;
+        uint64_t completed = 0;
+    };
+
+    explicit HashListCheckpoint(const std::string& path) : m_path(path) {}
+
+    const std::string& path() const { return m_path; }
+
+    bool load(State& state) const {
+        std::ifstream file(m_path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string header;
+        if (!std::getline(file, header) || header != HEADER) {
+            return false;
+        }
+        bool have_offset = false;
+        std::string key;
+        uint64_t value;
+        while (file >> key >> value) {
+            if (key == "file_size") state.file_size = value;
+            else if (key == "head_checksum") state.head_checksum = value;
+            else if (key == "offset") { state.offset = value; have_offset = true; }
+            else if (key == "completed") state.completed = value;
+        }
+        return have_offset;
+    }
+
+    bool save(const State& state, std::string& error) const {
+        std::ostringstream text;
+        text << HEADER << "\n"
+             << "file_size " << state.file_size << "\n"
+             << "head_checksum " << state.head_checksum << "\n"
+             << "offset " << state.offset << "\n"
+             << "completed " << state.completed << "\n";
+        const std::string data = text.str();
+
+        std::string tmp_path = m_path + ".tmp";
+        int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            error = "cannot create " + tmp_path + ": " + std::strerror(errno);
+            return false;
+        }
+        bool ok = ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) && fsync(fd) == 0;
+        if (!ok) {
+            error = "cannot write " + tmp_path + ": " + std::strerror(errno);
+        }
+        ::close(fd);
+        if (ok && std::rename(tmp_path.c_str(), m_path.c_str()) != 0) {
+            error = "cannot rename " + tmp_path + ": " + std::strerror(errno);
+            ok = false;
+        }
+        if (!ok) {
+            std::remove(tmp_path.c_str());
+        }
+        return ok;
+    }
+
+    void remove() const {
+        std::remove(m_path.c_str());
+    }
+
+private:
+    static constexpr const char* HEADER = "dht_crawler hash list checkpoint v1";
+
+    std::string m_path;
+};
+
+} // namespace dht_crawler
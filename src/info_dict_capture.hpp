@@ -0,0 +1,332 @@
+/*
+ * Info-Dict Capture
+ *
+ * Once a metadata torrent has verified its metadata, libtorrent parses it
+ * into a torrent_info. That object keeps the raw bencoded info dict, so
+ * nothing needs to be rebuilt from the metadata alert on the alert thread.
+ *
+ * InfoDictCapture is a session plugin that adds one InfoDictTorrentPlugin
+ * to every torrent. The first time a torrent has valid metadata (on its
+ * state change out of downloading_metadata, or on the next tick), the
+ * plugin passes a CapturedInfoDict to the sink on the network thread. A
+ * CapturedInfoDict shares ownership of the torrent_info and points at its
+ * info section, so the buffer is never copied and stays valid after the
+ * torrent is removed. The sink is expected to only enqueue it.
+ *
+ * InfoDictView reads fields from a captured dict on demand; file and
+ * tracker lists are only copied out when asked for. InfoDictArchive
+ * optionally stores the dict as a canonical .torrent ("d4:info...e"),
+ * gzip-compressed unless zlib is disabled.
+ */
+
+#pragma once
+
+#ifndef DISABLE_LIBTORRENT
+#include <libtorrent/extensions.hpp>
+#include <libtorrent/torrent.hpp>
+#include <libtorrent/torrent_handle.hpp>
+#include <libtorrent/torrent_info.hpp>
+#include <libtorrent/magnet_uri.hpp>
+#endif
+
+#ifndef DISABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "info_hash.hpp"
+
+#ifndef DISABLE_LIBTORRENT
+
+namespace dht_crawler {
+
+// Verified info dict of one torrent; bytes() points into the torrent_info
+struct CapturedInfoDict {
+    InfoHash hash;
+    std::shared_ptr<const lt::torrent_info> torrent;
+
+    lt::span<char const> bytes() const { return torrent->info_section(); }
+};
+
+using InfoDictSink = std::function<bool(CapturedInfoDict&&)>;
+
+// Sink and counters shared by the session plugin and its torrent plugins
+struct InfoDictCaptureState {
+    std::mutex mutex;
+    InfoDictSink sink; // Cleared by InfoDictCapture::close()
+    std::atomic<uint64_t> captured{0};
+    std::atomic<uint64_t> dropped{0};
+
+    void deliver(CapturedInfoDict&& dict) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (sink && sink(std::move(dict))) {
+            captured++;
+        } else {
+            dropped++;
+        }
+    }
+};
+
+class InfoDictTorrentPlugin : public lt::torrent_plugin {
+public:
+    InfoDictTorrentPlugin(std::weak_ptr<lt::torrent> torrent, std::shared_ptr<InfoDictCaptureState> state)
+        : m_torrent(std::move(torrent))
+        , m_state(std::move(state))
+        , m_captured(false)
+    {
+    }
+
+    // Runs inside set_metadata, before the metadata alert can be handled
+    void on_state(lt::torrent_status::state_t) override { capture(); }
+    void tick() override { capture(); }
+
+private:
+    void capture() {
+        if (m_captured) return;
+        std::shared_ptr<lt::torrent> torrent = m_torrent.lock();
+        if (!torrent || !torrent->valid_metadata()) return;
+        m_captured = true;
+
+        std::shared_ptr<const lt::torrent_info> info = torrent->get_torrent_file();
+        if (!info || info->info_section().empty()) return;
+        m_state->deliver(CapturedInfoDict{InfoHash(info->info_hash()), std::move(info)});
+    }
+
+    std::weak_ptr<lt::torrent> m_torrent;
+    std::shared_ptr<InfoDictCaptureState> m_state;
+    bool m_captured; // Network thread only
+};
+
+class InfoDictCapture : public lt::plugin {
+public:
+    explicit InfoDictCapture(InfoDictSink sink)
+        : m_state(std::make_shared<InfoDictCaptureState>())
+    {
+        m_state->sink = std::move(sink);
+    }
+
+    lt::feature_flags_t implemented_features() override { return {}; }
+
+    std::shared_ptr<lt::torrent_plugin> new_torrent(lt::torrent_handle const& handle, lt::client_data_t) override {
+        return std::make_shared<InfoDictTorrentPlugin>(handle.native_handle(), m_state);
+    }
+
+    /**
+     * Stop delivering; dicts captured afterwards count as dropped. Call
+     * before whatever the sink feeds is destroyed, since the session's
+     * network thread may outlive it.
+     */
+    void close() {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->sink = nullptr;
+    }
+
+    uint64_t get_captured() const { return m_state->captured.load(); }
+    uint64_t get_dropped() const { return m_state->dropped.load(); } // Sink full or closed
+
+private:
+    std::shared_ptr<InfoDictCaptureState> m_state;
+};
+
+/**
+ * Fields of a captured info dict, read on demand. Scalars come straight
+ * from the torrent_info; file and tracker lists are only copied out by
+ * the calls that return them.
+ */
+class InfoDictView {
+public:
+    explicit InfoDictView(const CapturedInfoDict& dict)
+        : m_info(*dict.torrent)
+    {
+    }
+
+    std::string name() const { return m_info.name(); }
+    size_t total_size() const { return static_cast<size_t>(m_info.total_size()); }
+    int num_files() const { return m_info.num_files(); }
+    int num_pieces() const { return m_info.num_pieces(); }
+    int piece_length() const { return m_info.piece_length(); }
+    const std::string& comment() const { return m_info.comment(); }
+    const std::string& created_by() const { return m_info.creator(); }
+    std::time_t creation_date() const { return m_info.creation_date(); }
+    bool private_torrent() const { return m_info.priv(); }
+    std::string magnet_link() const { return lt::make_magnet_uri(m_info); }
+    size_t num_trackers() const { return m_info.trackers().size(); }
+
+    std::vector<std::string> file_names() const {
+        const lt::file_storage& files = m_info.files();
+        std::vector<std::string> names;
+        names.reserve(files.num_files());
+        for (auto i : files.file_range()) {
+            names.push_back(files.file_path(i));
+        }
+        return names;
+    }
+
+    std::vector<size_t> file_sizes() const {
+        const lt::file_storage& files = m_info.files();
+        std::vector<size_t> sizes;
+        sizes.reserve(files.num_files());
+        for (auto i : files.file_range()) {
+            sizes.push_back(static_cast<size_t>(files.file_size(i)));
+        }
+        return sizes;
+    }
+
+    std::vector<std::string> trackers() const {
+        std::vector<std::string> urls;
+        urls.reserve(m_info.trackers().size());
+        for (const auto& tracker : m_info.trackers()) {
+            urls.push_back(tracker.url);
+        }
+        return urls;
+    }
+
+private:
+    const lt::torrent_info& m_info;
+};
+
+/**
+ * Stores captured info dicts as <directory>/<xx>/<hash>.torrent.gz, where
+ * xx is the first hex byte of the hash. Files are written to a temporary
+ * name and renamed, so a file that exists is complete.
+ */
+class InfoDictArchive {
+public:
+    explicit InfoDictArchive(const std::string& directory)
+        : m_directory(directory)
+        , m_written(0)
+        , m_bytes_in(0)
+        , m_bytes_out(0)
+        , m_failed(0)
+    {
+    }
+
+    bool open(std::string& error) {
+        if (::mkdir(m_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            error = "cannot create " + m_directory + ": " + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool write(const CapturedInfoDict& dict, std::string& error) {
+        std::string hex = dict.hash.to_hex();
+        std::string subdir = m_directory + "/" + hex.substr(0, 2);
+        if (::mkdir(subdir.c_str(), 0755) != 0 && errno != EEXIST) {
+            error = "cannot create " + subdir + ": " + std::strerror(errno);
+            m_failed++;
+            return false;
+        }
+
+        // A trackerless .torrent is just the info dict under "info"
+        lt::span<char const> info = dict.bytes();
+        std::string torrent;
+        torrent.reserve(static_cast<size_t>(info.size()) + 8);
+        torrent.append("d4:info");
+        torrent.append(info.data(), static_cast<size_t>(info.size()));
+        torrent.append("e");
+
+        std::string data;
+        if (!compress(torrent, data, error)) {
+            m_failed++;
+            return false;
+        }
+
+        std::string path = subdir + "/" + hex + EXTENSION;
+        std::string tmp_path = path + ".tmp";
+        FILE* file = std::fopen(tmp_path.c_str(), "wb");
+        if (!file) {
+            error = "cannot open " + tmp_path + ": " + std::strerror(errno);
+            m_failed++;
+            return false;
+        }
+        bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+        ok = std::fclose(file) == 0 && ok;
+        if (ok && std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            ok = false;
+        }
+        if (!ok) {
+            error = "cannot write " + path + ": " + std::strerror(errno);
+            ::unlink(tmp_path.c_str());
+            m_failed++;
+            return false;
+        }
+
+        m_written++;
+        m_bytes_in += torrent.size();
+        m_bytes_out += data.size();
+        return true;
+    }
+
+    void print_statistics() const {
+        uint64_t bytes_in = m_bytes_in.load();
+        std::cout << "=== Torrent Archive Statistics ===" << std::endl;
+        std::cout << "Directory: " << m_directory << std::endl;
+        std::cout << "Written: " << m_written.load() << " (failed " << m_failed.load() << ")" << std::endl;
+        std::cout << "Bytes: " << bytes_in << " -> " << m_bytes_out.load();
+        if (bytes_in > 0) {
+            std::cout << " (" << (m_bytes_out.load() * 100 / bytes_in) << "%)";
+        }
+        std::cout << std::endl;
+        std::cout << "==================================" << std::endl;
+    }
+
+private:
+#ifndef DISABLE_ZLIB
+    static constexpr const char* EXTENSION = ".torrent.gz";
+
+    static bool compress(const std::string& input, std::string& output, std::string& error) {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        // 15 window bits + 16 selects the gzip wrapper
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            error = "deflateInit2 failed";
+            return false;
+        }
+        output.resize(deflateBound(&stream, static_cast<uLong>(input.size())) + 32);
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream.avail_in = static_cast<uInt>(input.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+        stream.avail_out = static_cast<uInt>(output.size());
+        int result = deflate(&stream, Z_FINISH);
+        output.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (result != Z_STREAM_END) {
+            error = "deflate failed";
+            return false;
+        }
+        return true;
+    }
+#else
+    static constexpr const char* EXTENSION = ".torrent";
+
+    static bool compress(const std::string& input, std::string& output, std::string&) {
+        output = input;
+        return true;
+    }
+#endif
+
+    std::string m_directory;
+    std::atomic<uint64_t> m_written;
+    std::atomic<uint64_t> m_bytes_in;
+    std::atomic<uint64_t> m_bytes_out;
+    std::atomic<uint64_t> m_failed;
+};
+
+} // namespace dht_crawler
+
+#endif // DISABLE_LIBTORRENT
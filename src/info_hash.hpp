@@ -0,0 +1,496 @@
+/*
+ * Compact Info-Hash Key Type and Open-Addressing Hash Containers
+ *
+ * InfoHash is a fixed-size 20-byte value type used as the key for all
+ * crawler bookkeeping in place of 40-char hex std::strings. FlatHashMap and
+ * FlatHashSet store keys inline in a single power-of-two slot array with
+ * linear probing, so a lookup never allocates and an entry costs roughly
+ * the key plus one control byte instead of a tree node plus a heap string.
+ */
+
+#pragma once
+
+#ifndef DISABLE_LIBTORRENT
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/add_torrent_params.hpp>
+#endif
+
+#include "hash_codec.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <random>
+#include <type_traits>
+
+namespace dht_crawler {
+
+struct InfoHash {
+    static constexpr size_t SIZE = 20;
+
+    std::array<uint8_t, SIZE> bytes{};
+
+    InfoHash() = default;
+
+    // Raw 20-byte binary hash
+    static InfoHash from_bytes(const void* data) {
+        InfoHash hash;
+        std::memcpy(hash.bytes.data(), data, SIZE);
+        return hash;
+    }
+
+    // Parse a 40-char hex string (either case)
+    static bool from_hex(const std::string& hex, InfoHash& out) {
+        return hex.size() == SIZE * 2 && codec::hex_decode(hex.data(), SIZE, out.bytes.data());
+    }
+
+    // Parse a 32-char RFC4648 base32 string (either case)
+    static bool from_base32(const std::string& b32, InfoHash& out) {
+        return b32.size() == 32 && codec::base32_decode(b32.data(), b32.size(), out.bytes.data());
+    }
+
+    // Accept any of the representations seen on the wire or from users:
+    // 40-char hex, 32-char base32 or 20-byte binary
+    static bool parse(const std::string& str, InfoHash& out) {
+        if (str.size() == SIZE * 2) return from_hex(str, out);
+        if (str.size() == 32) return from_base32(str, out);
+        if (str.size() == SIZE) {
+            out = from_bytes(str.data());
+            return true;
+        }
+        return false;
+    }
+
+#ifndef DISABLE_LIBTORRENT
+    explicit InfoHash(const lt::sha1_hash& hash) {
+        std::memcpy(bytes.data(), hash.data(), SIZE);
+    }
+
+    lt::sha1_hash to_sha1() const {
+        return lt::sha1_hash(reinterpret_cast<const char*>(bytes.data()));
+    }
+
+    // Parameters for adding this hash to a session, without formatting and
+    // re-parsing a magnet URI
+    lt::add_torrent_params to_add_torrent_params() const {
+        lt::add_torrent_params params;
+        params.info_hashes = lt::info_hash_t(to_sha1());
+        return params;
+    }
+#endif
+
+    std::string to_hex() const {
+        std::string hex(SIZE * 2, '\0');
+        codec::hex_encode(bytes.data(), SIZE, &hex[0]);
+        return hex;
+    }
+
+    // Write 40 lowercase hex chars to out (no terminator)
+    void to_hex(char* out) const {
+        codec::hex_encode(bytes.data(), SIZE, out);
+    }
+
+    std::string to_base32() const {
+        std::string b32(32, '\0');
+        codec::base32_encode(bytes.data(), SIZE, &b32[0]);
+        return b32;
+    }
+
+    std::string to_binary() const {
+        return std::string(reinterpret_cast<const char*>(bytes.data()), SIZE);
+    }
+
+    // First 8 bytes as an integer; uniform for real torrents (SHA-1
+    // output), but a peer can send any 20 bytes it likes
+    uint64_t prefix64() const {
+        uint64_t value;
+        std::memcpy(&value, bytes.data(), sizeof(value));
+        return value;
+    }
+
+    bool operator==(const InfoHash& other) const { return bytes == other.bytes; }
+    bool operator!=(const InfoHash& other) const { return bytes != other.bytes; }
+    bool operator<(const InfoHash& other) const { return bytes < other.bytes; }
+
+};
+
+/**
+ * Slice index of count equal slices of the 160-bit keyspace, split on the
+ * top 32 bits of the hash (XOR-metric neighbours share those bits, so a
+ * slice is a contiguous region of the DHT)
+ */
+struct KeyspaceSlice {
+    uint32_t index = 0;
+    uint32_t count = 1;
+
+    uint64_t begin() const { return (static_cast<uint64_t>(index) << 32) / count; }
+    uint64_t end() const { return (static_cast<uint64_t>(index + 1) << 32) / count; }
+
+    bool contains(const InfoHash& hash) const {
+        uint64_t top = top_bits(hash);
+        return top >= begin() && top < end();
+    }
+
+    // Move a uniformly random hash into the slice; the low 128 bits are kept
+    void place(InfoHash& hash) const {
+        if (count <= 1) return;
+        uint32_t top = static_cast<uint32_t>(begin() + top_bits(hash) % (end() - begin()));
+        hash.bytes[0] = static_cast<uint8_t>(top >> 24);
+        hash.bytes[1] = static_cast<uint8_t>(top >> 16);
+        hash.bytes[2] = static_cast<uint8_t>(top >> 8);
+        hash.bytes[3] = static_cast<uint8_t>(top);
+    }
+
+private:
+    static uint64_t top_bits(const InfoHash& hash) {
+        return (static_cast<uint64_t>(hash.bytes[0]) << 24) | (static_cast<uint64_t>(hash.bytes[1]) << 16) |
+               (static_cast<uint64_t>(hash.bytes[2]) << 8) | hash.bytes[3];
+    }
+};
+
+namespace hash_detail {
+
+// MurmurHash3 64-bit finalizer
+inline uint64_t fmix64(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+// Drawn once per process
+inline uint64_t process_seed() {
+    static const uint64_t seed = [] {
+        std::random_device device;
+        return (static_cast<uint64_t>(device()) << 32) ^ device();
+    }();
+    return seed;
+}
+
+} // namespace hash_detail
+
+/**
+ * Fixed hash of an info-hash, for positions that are written to disk
+ * (SegmentStore's index). It must not change without bumping the on-disk
+ * format version. It is a plain finalizer of prefix64(): anyone can
+ * compute it, so it offers no protection against crafted keys.
+ */
+struct StableInfoHashHasher {
+    size_t operator()(const InfoHash& hash) const {
+        return static_cast<size_t>(hash_detail::fmix64(hash.prefix64()));
+    }
+};
+
+/**
+ * Hash for in-memory containers. Keys come from remote peers, who choose
+ * them freely, so all 20 bytes are mixed with a per-process random seed
+ * in between finalizer rounds. Without the seed, colliding keys cannot be
+ * computed offline; this is not a keyed PRF, only enough to keep linear
+ * probing from being steered. Never persist values computed with it.
+ */
+struct InfoHashHasher {
+    uint64_t seed = hash_detail::process_seed();
+
+    size_t operator()(const InfoHash& hash) const {
+        uint64_t middle;
+        uint32_t tail;
+        std::memcpy(&middle, hash.bytes.data() + 8, sizeof(middle));
+        std::memcpy(&tail, hash.bytes.data() + 16, sizeof(tail));
+        uint64_t value = hash_detail::fmix64(hash.prefix64() ^ seed);
+        value = hash_detail::fmix64(value ^ middle);
+        return static_cast<size_t>(hash_detail::fmix64(value ^ tail));
+    }
+};
+
+/*
+ * Open-addressing hash map with linear probing and backward-shift deletion
+ * (no tombstones). Capacity is always a power of two; the table grows once
+ * it is 80% full.
+ */
+template <typename Key, typename Value, typename Hash = InfoHashHasher>
+class FlatHashMap {
+public:
+    struct Slot {
+        Key first;
+        Value second;
+    };
+
+    template <bool Const>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Slot;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::conditional<Const, const Slot*, Slot*>::type;
+        using reference = typename std::conditional<Const, const Slot&, Slot&>::type;
+        using map_pointer = typename std::conditional<Const, const FlatHashMap*, FlatHashMap*>::type;
+
+        Iterator(map_pointer map, size_t index) : m_map(map), m_index(index) { skip_empty(); }
+
+        reference operator*() const { return m_map->m_slots[m_index]; }
+        pointer operator->() const { return &m_map->m_slots[m_index]; }
+
+        Iterator& operator++() {
+            ++m_index;
+            skip_empty();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        friend class FlatHashMap;
+
+        void skip_empty() {
+            while (m_index < m_map->m_used.size() && !m_map->m_used[m_index]) {
+                ++m_index;
+            }
+        }
+
+        map_pointer m_map;
+        size_t m_index;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashMap() = default;
+
+    explicit FlatHashMap(size_t expected_size) {
+        reserve(expected_size);
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_used.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_used.size()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    size_t capacity() const { return m_used.size(); }
+
+    // Approximate heap footprint of the table itself (excludes memory owned by values)
+    size_t memory_usage() const {
+        return m_slots.capacity() * sizeof(Slot) + m_used.capacity();
+    }
+
+    void reserve(size_t expected_size) {
+        size_t needed = 16;
+        while (needed * 4 / 5 < expected_size) {
+            needed <<= 1;
+        }
+        if (needed > m_used.size()) {
+            rehash(needed);
+        }
+    }
+
+    void clear() {
+        m_slots.clear();
+        m_used.clear();
+        m_size = 0;
+    }
+
+    iterator find(const Key& key) {
+        size_t index;
+        return locate(key, index) ? iterator(this, index) : end();
+    }
+
+    const_iterator find(const Key& key) const {
+        size_t index;
+        return locate(key, index) ? const_iterator(this, index) : end();
+    }
+
+    bool contains(const Key& key) const {
+        size_t index;
+        return locate(key, index);
+    }
+
+    size_t count(const Key& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    // Returns the slot for key and whether it was newly inserted
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        size_t index;
+        if (locate(key, index)) {
+            return {iterator(this, index), false};
+        }
+        grow_if_needed();
+        index = probe_free(key);
+        m_slots[index].first = key;
+        m_slots[index].second = Value(std::forward<Args>(args)...);
+        m_used[index] = 1;
+        ++m_size;
+        return {iterator(this, index), true};
+    }
+
+    std::pair<iterator, bool> insert_or_assign(const Key& key, Value value) {
+        auto result = try_emplace(key);
+        result.first->second = std::move(value);
+        return result;
+    }
+
+    Value& operator[](const Key& key) {
+        return try_emplace(key).first->second;
+    }
+
+    size_t erase(const Key& key) {
+        size_t index;
+        if (!locate(key, index)) {
+            return 0;
+        }
+        erase_at(index);
+        return 1;
+    }
+
+    iterator erase(iterator it) {
+        size_t index = it.m_index;
+        erase_at(index);
+        // Backward shift may have moved an unvisited entry into this slot.
+        // An entry that wrapped around from the front of the table can be
+        // visited twice, so erase-while-iterating callers must be idempotent.
+        return iterator(this, index);
+    }
+
+private:
+    size_t mask() const { return m_used.size() - 1; }
+
+    size_t ideal_slot(const Key& key) const {
+        return m_hasher(key) & mask();
+    }
+
+    bool locate(const Key& key, size_t& index) const {
+        if (m_size == 0) return false;
+        index = ideal_slot(key);
+        while (m_used[index]) {
+            if (m_slots[index].first == key) {
+                return true;
+            }
+            index = (index + 1) & mask();
+        }
+        return false;
+    }
+
+    size_t probe_free(const Key& key) const {
+        size_t index = ideal_slot(key);
+        while (m_used[index]) {
+            index = (index + 1) & mask();
+        }
+        return index;
+    }
+
+    void grow_if_needed() {
+        if (m_used.empty()) {
+            rehash(16);
+        } else if ((m_size + 1) > m_used.size() * 4 / 5) {
+            rehash(m_used.size() * 2);
+        }
+    }
+
+    void rehash(size_t new_capacity) {
+        std::vector<Slot> old_slots;
+        std::vector<uint8_t> old_used;
+        old_slots.swap(m_slots);
+        old_used.swap(m_used);
+
+        m_slots.resize(new_capacity);
+        m_used.assign(new_capacity, 0);
+
+        for (size_t i = 0; i < old_used.size(); ++i) {
+            if (old_used[i]) {
+                size_t index = probe_free(old_slots[i].first);
+                m_slots[index] = std::move(old_slots[i]);
+                m_used[index] = 1;
+            }
+        }
+    }
+
+    void erase_at(size_t hole) {
+        size_t next = hole;
+        for (;;) {
+            next = (next + 1) & mask();
+            if (!m_used[next]) {
+                break;
+            }
+            // An entry may move back into the hole only if the hole lies on
+            // its probe path, i.e. between its ideal slot and where it sits now
+            size_t ideal = ideal_slot(m_slots[next].first);
+            if (((hole - ideal) & mask()) < ((next - ideal) & mask())) {
+                m_slots[hole] = std::move(m_slots[next]);
+                hole = next;
+            }
+        }
+        m_slots[hole] = Slot();
+        m_used[hole] = 0;
+        --m_size;
+    }
+
+    std::vector<Slot> m_slots;
+    std::vector<uint8_t> m_used;
+    size_t m_size = 0;
+    Hash m_hasher;
+};
+
+// Set variant built on FlatHashMap with an empty mapped type
+template <typename Key, typename Hash = InfoHashHasher>
+class FlatHashSet {
+    struct Unit {};
+    using Map = FlatHashMap<Key, Unit, Hash>;
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Key;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Key*;
+        using reference = const Key&;
+
+        explicit const_iterator(typename Map::const_iterator it) : m_it(it) {}
+
+        reference operator*() const { return m_it->first; }
+        pointer operator->() const { return &m_it->first; }
+        const_iterator& operator++() { ++m_it; return *this; }
+        bool operator==(const const_iterator& other) const { return m_it == other.m_it; }
+        bool operator!=(const const_iterator& other) const { return m_it != other.m_it; }
+
+    private:
+        typename Map::const_iterator m_it;
+    };
+
+    FlatHashSet() = default;
+    explicit FlatHashSet(size_t expected_size) : m_map(expected_size) {}
+
+    const_iterator begin() const { return const_iterator(m_map.begin()); }
+    const_iterator end() const { return const_iterator(m_map.end()); }
+
+    size_t size() const { return m_map.size(); }
+    bool empty() const { return m_map.empty(); }
+    size_t memory_usage() const { return m_map.memory_usage(); }
+    void reserve(size_t expected_size) { m_map.reserve(expected_size); }
+    void clear() { m_map.clear(); }
+
+    // Returns true if key was not present before
+    bool insert(const Key& key) { return m_map.try_emplace(key).second; }
+    bool contains(const Key& key) const { return m_map.contains(key); }
+    size_t count(const Key& key) const { return m_map.count(key); }
+    size_t erase(const Key& key) { return m_map.erase(key); }
+
+private:
+    Map m_map;
+};
+
+using InfoHashSet = FlatHashSet<InfoHash>;
+
+template <typename Value>
+using InfoHashMap = FlatHashMap<InfoHash, Value>;
+
+} // namespace dht_crawler
@@ -0,0 +1,369 @@
+/*
+ * Staged Ingest Pipeline Primitives
+ *
+ * Bounded lock-free ring buffers and a worker-per-stage wrapper used to
+ * decouple the alert thread from decoding, state updates, MySQL writes and
+ * metadata scheduling. Each stage owns one consumer thread and records its
+ * queue depth, drops and enqueue-to-handle latency.
+ *
+ *  - SpscRing: single producer / single consumer (Lamport ring)
+ *  - MpscRing: multiple producers / single consumer (Vyukov bounded queue)
+ *
+ * The alert thread only ever uses try_push() so a slow downstream stage
+ * can never stall libtorrent's alert queue; internal stages use push(),
+ * which applies backpressure to the stage before them.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace dht_crawler {
+
+inline size_t round_up_power_of_two(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+/**
+ * Bounded single-producer/single-consumer ring buffer
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : m_capacity(round_up_power_of_two(capacity < 2 ? 2 : capacity))
+        , m_mask(m_capacity - 1)
+        , m_buffer(new T[m_capacity])
+        , m_head(0)
+        , m_tail(0) {}
+
+    bool try_push(T&& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) >= m_capacity) {
+            return false;
+        }
+        m_buffer[tail & m_mask] = std::move(item);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(m_buffer[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<T[]> m_buffer;
+    alignas(64) std::atomic<size_t> m_head;  // Consumer position
+    alignas(64) std::atomic<size_t> m_tail;  // Producer position
+};
+
+/**
+ * Bounded multi-producer/single-consumer ring buffer. Each cell carries a
+ * sequence number so producers claim slots with one CAS and never block
+ * each other.
+ */
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity)
+        : m_capacity(round_up_power_of_two(capacity < 2 ? 2 : capacity))
+        , m_mask(m_capacity - 1)
+        , m_cells(new Cell[m_capacity])
+        , m_enqueue_pos(0)
+        , m_dequeue_pos(0) {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(T&& item) {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& item) {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        Cell& cell = m_cells[pos & m_mask];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+            return false; // Empty (or a producer has not finished writing)
+        }
+        item = std::move(cell.data);
+        cell.sequence.store(pos + m_capacity, std::memory_order_release);
+        m_dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t size() const {
+        size_t enqueued = m_enqueue_pos.load(std::memory_order_acquire);
+        size_t dequeued = m_dequeue_pos.load(std::memory_order_acquire);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<size_t> m_enqueue_pos;
+    alignas(64) std::atomic<size_t> m_dequeue_pos;
+};
+
+/**
+ * Point-in-time metrics for one pipeline stage
+ */
+struct StageMetrics {
+    std::string name;
+    size_t depth = 0;
+    size_t capacity = 0;
+    size_t max_depth = 0;
+    uint64_t processed = 0;
+    uint64_t dropped = 0;
+    double avg_latency_us = 0.0;
+    uint64_t max_latency_us = 0;
+};
+
+/**
+ * One pipeline stage: a bounded ring feeding a dedicated consumer thread
+ * that calls the handler for each item
+ */
+template <typename T, template <typename> class Ring = SpscRing>
+class PipelineStage {
+public:
+    using Handler = std::function<void(T&)>;
+
+    PipelineStage(const std::string& name, size_t capacity, Handler handler)
+        : m_name(name)
+        , m_ring(capacity)
+        , m_handler(handler)
+        , m_running(false)
+        , m_stop_requested(false)
+        , m_consumer_waiting(false)
+        , m_processed(0)
+        , m_dropped(0)
+        , m_max_depth(0)
+        , m_total_latency_us(0)
+        , m_max_latency_us(0) {}
+
+    ~PipelineStage() {
+        stop();
+    }
+
+    void start() {
+        if (m_running) return;
+        m_stop_requested = false;
+        m_running = true;
+        m_thread = std::thread(&PipelineStage::consumer_loop, this);
+    }
+
+    /**
+     * Stop the consumer thread after draining everything already queued
+     */
+    void stop() {
+        if (!m_running) return;
+        m_stop_requested = true;
+        wake_consumer();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_running = false;
+    }
+
+    /**
+     * Enqueue without blocking
+     * @return false (and counts a drop) if the stage is full
+     */
+    bool try_push(T item) {
+        if (!m_ring.try_push(Envelope{std::move(item), std::chrono::steady_clock::now()})) {
+            m_dropped++;
+            return false;
+        }
+        after_push();
+        return true;
+    }
+
+    /**
+     * Enqueue, waiting for space while the stage is running
+     * @return false if the stage stopped before the item was accepted
+     */
+    bool push(T item) {
+        Envelope envelope{std::move(item), std::chrono::steady_clock::now()};
+        int spins = 0;
+        while (!m_ring.try_push(std::move(envelope))) {
+            if (!m_running || m_stop_requested) {
+                m_dropped++;
+                return false;
+            }
+            if (++spins < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        after_push();
+        return true;
+    }
+
+    size_t depth() const { return m_ring.size(); }
+    const std::string& name() const { return m_name; }
+
+    StageMetrics get_metrics() const {
+        StageMetrics metrics;
+        metrics.name = m_name;
+        metrics.depth = m_ring.size();
+        metrics.capacity = m_ring.capacity();
+        metrics.max_depth = m_max_depth.load();
+        metrics.processed = m_processed.load();
+        metrics.dropped = m_dropped.load();
+        metrics.avg_latency_us = metrics.processed == 0 ? 0.0 :
+            static_cast<double>(m_total_latency_us.load()) / metrics.processed;
+        metrics.max_latency_us = m_max_latency_us.load();
+        return metrics;
+    }
+
+    void print_statistics() const {
+        StageMetrics metrics = get_metrics();
+        std::cout << "Stage " << metrics.name
+                  << ": depth=" << metrics.depth << "/" << metrics.capacity
+                  << " max_depth=" << metrics.max_depth
+                  << " processed=" << metrics.processed
+                  << " dropped=" << metrics.dropped
+                  << " avg_latency=" << static_cast<uint64_t>(metrics.avg_latency_us) << "us"
+                  << " max_latency=" << metrics.max_latency_us << "us" << std::endl;
+    }
+
+private:
+    struct Envelope {
+        T item;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void after_push() {
+        size_t depth = m_ring.size();
+        size_t max_depth = m_max_depth.load(std::memory_order_relaxed);
+        while (depth > max_depth && !m_max_depth.compare_exchange_weak(max_depth, depth)) {
+        }
+        if (m_consumer_waiting.load()) {
+            wake_consumer();
+        }
+    }
+
+    void wake_consumer() {
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_wait_cv.notify_one();
+    }
+
+    void consumer_loop() {
+        Envelope envelope;
+        int idle_spins = 0;
+
+        for (;;) {
+            if (m_ring.try_pop(envelope)) {
+                idle_spins = 0;
+                record_latency(envelope.enqueued);
+                try {
+                    m_handler(envelope.item);
+                } catch (const std::exception& e) {
+                    std::cerr << "[Pipeline] Stage " << m_name << " handler error: " << e.what() << std::endl;
+                }
+                m_processed++;
+                continue;
+            }
+
+            if (m_stop_requested) {
+                break; // Queue drained
+            }
+
+            if (++idle_spins < 64) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Park until a producer signals; the timeout bounds any missed wakeup
+            std::unique_lock<std::mutex> lock(m_wait_mutex);
+            m_consumer_waiting = true;
+            m_wait_cv.wait_for(lock, std::chrono::milliseconds(10), [this]() {
+                return m_ring.size() > 0 || m_stop_requested.load();
+            });
+            m_consumer_waiting = false;
+        }
+    }
+
+    void record_latency(std::chrono::steady_clock::time_point enqueued) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - enqueued).count();
+        uint64_t latency_us = latency < 0 ? 0 : static_cast<uint64_t>(latency);
+        m_total_latency_us += latency_us;
+        if (latency_us > m_max_latency_us.load(std::memory_order_relaxed)) {
+            m_max_latency_us = latency_us;
+        }
+    }
+
+    std::string m_name;
+    Ring<Envelope> m_ring;
+    Handler m_handler;
+    std::thread m_thread;
+
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stop_requested;
+    std::atomic<bool> m_consumer_waiting;
+    std::mutex m_wait_mutex;
+    std::condition_variable m_wait_cv;
+
+    std::atomic<uint64_t> m_processed;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<size_t> m_max_depth;
+    std::atomic<uint64_t> m_total_latency_us;
+    std::atomic<uint64_t> m_max_latency_us;
+};
+
+} // namespace dht_crawler
@@ -0,0 +1,195 @@
+/*
+ * Dedicated Metadata Session
+ *
+ * Metadata fetching keeps up to a thousand magnet torrents in a session.
+ * Sharing the crawling session with them means their peer, connection and
+ * status alerts compete with DHT alerts for one alert queue, and their
+ * bookkeeping runs on the same network thread as the DHT. MetadataSession
+ * is a second lt::session that only holds metadata torrents. It has its
+ * own settings profile (many peer connections and active torrents, no port
+ * mapping or local discovery), its own alert queue and its own alert
+ * thread.
+ *
+ * Work reaches it the way it always has: the state stage hands info-hashes,
+ * with the peers from their get_peers replies as hints, to the metadata
+ * scheduling stage through a lock-free ring, and the downloader adds the
+ * torrents to this session instead of the crawling one.
+ *
+ * No torrent in the crawler ever reads or writes piece data, so sessions
+ * are built with libtorrent's disabled disk I/O backend: no storage, file
+ * pool or disk threads are set up per torrent.
+ */
+
+#pragma once
+
+#ifndef DISABLE_LIBTORRENT
+#include <libtorrent/session.hpp>
+#include <libtorrent/session_params.hpp>
+#include <libtorrent/settings_pack.hpp>
+#include <libtorrent/disabled_disk_io.hpp>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "alert_dispatcher.hpp"
+
+#ifndef DISABLE_LIBTORRENT
+
+namespace dht_crawler {
+
+struct MetadataSessionConfig {
+    int listen_port = 6882;         // Peer connections for metadata torrents
+    int connections_limit = 800;    // Peer connections across all metadata torrents
+    int active_limit = 1000;        // Torrents fetching at once (matches the downloader)
+    int alert_queue_size = 10000;   // Room for bursts of peer alerts between wakeups
+};
+
+/**
+ * Peer settings for a session whose torrents only fetch metadata: many
+ * short-lived connections that exchange a few extension messages each and
+ * never transfer pieces. libtorrent has no half-open limit any more;
+ * connection_speed is the connection attempt throttle.
+ */
+inline void apply_metadata_fetch_settings(lt::settings_pack& settings) {
+    settings.set_int(lt::settings_pack::connection_speed, 200);           // Connection attempts per second (default 30)
+    settings.set_int(lt::settings_pack::torrent_connect_boost, 32);       // Connect to all hinted peers right away
+    settings.set_int(lt::settings_pack::peer_connect_timeout, 7);         // Give up on unreachable peers sooner (default 15)
+    settings.set_int(lt::settings_pack::max_peerlist_size, 200);          // Peers remembered per torrent (default 3000)
+    settings.set_int(lt::settings_pack::max_paused_peerlist_size, 50);
+    settings.set_int(lt::settings_pack::max_out_request_queue, 16);       // Pieces are never requested
+    settings.set_int(lt::settings_pack::max_allowed_in_request_queue, 16); // Nor served
+    settings.set_int(lt::settings_pack::unchoke_slots_limit, 0);
+    settings.set_int(lt::settings_pack::send_buffer_watermark, 64 * 1024);
+}
+
+// Session parameters for sessions that never touch piece data
+inline lt::session_params metadata_only_params(lt::settings_pack settings) {
+    lt::session_params params(std::move(settings));
+    params.disk_io_constructor = lt::disabled_disk_io_constructor;
+    return params;
+}
+
+class MetadataSession {
+public:
+    MetadataSession(const MetadataSessionConfig& config,
+                    std::function<void(const std::string&)> log_callback = nullptr)
+        : m_config(config)
+        , m_log_callback(log_callback)
+        , m_running(false)
+        , m_metadata_received(0)
+        , m_started(std::chrono::steady_clock::now())
+    {
+        m_session = std::make_unique<lt::session>(metadata_only_params(settings(config)));
+        m_dispatcher = std::make_unique<AlertDispatcher>(m_session.get(), log_callback);
+    }
+
+    ~MetadataSession() {
+        stop();
+    }
+
+    MetadataSession(const MetadataSession&) = delete;
+    MetadataSession& operator=(const MetadataSession&) = delete;
+
+    /**
+     * Settings profile for a session that only fetches metadata: the DHT
+     * stays on so magnet torrents can find peers, everything that serves
+     * a crawler or a long-lived download is off
+     */
+    static lt::settings_pack settings(const MetadataSessionConfig& config) {
+        lt::settings_pack settings;
+        settings.set_str(lt::settings_pack::listen_interfaces, "0.0.0.0:" + std::to_string(config.listen_port));
+        settings.set_bool(lt::settings_pack::enable_dht, true);
+        settings.set_bool(lt::settings_pack::enable_lsd, false);
+        settings.set_bool(lt::settings_pack::enable_upnp, false);
+        settings.set_bool(lt::settings_pack::enable_natpmp, false);
+
+        settings.set_bool(lt::settings_pack::enable_outgoing_utp, true);
+        settings.set_bool(lt::settings_pack::enable_incoming_utp, true);
+        settings.set_bool(lt::settings_pack::enable_outgoing_tcp, true);
+        settings.set_bool(lt::settings_pack::enable_incoming_tcp, true);
+
+        settings.set_int(lt::settings_pack::handshake_timeout, 30);
+        settings.set_int(lt::settings_pack::peer_timeout, 180);
+        settings.set_int(lt::settings_pack::connections_limit, config.connections_limit);
+        settings.set_int(lt::settings_pack::active_limit, config.active_limit);
+        settings.set_int(lt::settings_pack::active_downloads, config.active_limit);
+        settings.set_int(lt::settings_pack::active_seeds, config.active_limit);
+        settings.set_int(lt::settings_pack::alert_queue_size, config.alert_queue_size);
+        apply_metadata_fetch_settings(settings);
+
+        // Only the categories of registered handlers, applied by start()
+        settings.set_int(lt::settings_pack::alert_mask, 0);
+        return settings;
+    }
+
+    lt::session* session() { return m_session.get(); }
+
+    /**
+     * Handlers must be registered before start(); the dispatcher is only
+     * used by the session's own alert thread after that
+     */
+    AlertDispatcher& dispatcher() { return *m_dispatcher; }
+
+    void start() {
+        if (m_running.exchange(true)) return;
+        m_started = std::chrono::steady_clock::now();
+        m_dispatcher->apply_alert_mask();
+        m_alert_thread = std::thread([this]() {
+            m_dispatcher->run([this]() { return m_running.load(); });
+        });
+        log("Started on port " + std::to_string(m_config.listen_port));
+    }
+
+    void stop() {
+        if (!m_running.exchange(false)) return;
+        if (m_alert_thread.joinable()) {
+            m_alert_thread.join();
+        }
+    }
+
+    // Called by the metadata handler for each torrent completed in this session
+    void record_metadata() { m_metadata_received++; }
+
+    int listen_port() const { return m_config.listen_port; }
+    uint64_t get_metadata_received() const { return m_metadata_received.load(); }
+
+    void print_statistics() const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - m_started).count();
+        std::cout << "=== Metadata Session Statistics ===" << std::endl;
+        std::cout << "Port: " << m_config.listen_port << std::endl;
+        std::cout << "Alerts dispatched: " << m_dispatcher->get_alerts_dispatched()
+                  << " (" << m_dispatcher->get_alerts_dispatched() / (elapsed + 1) << "/s)" << std::endl;
+        std::cout << "Metadata received: " << m_metadata_received.load()
+                  << " (" << m_metadata_received.load() * 60 / (elapsed + 1) << "/min)" << std::endl;
+        std::cout << "===================================" << std::endl;
+    }
+
+private:
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[MetadataSession] " + message);
+        }
+    }
+
+    MetadataSessionConfig m_config;
+    std::function<void(const std::string&)> m_log_callback;
+
+    std::unique_ptr<lt::session> m_session;
+    std::unique_ptr<AlertDispatcher> m_dispatcher;
+    std::thread m_alert_thread;
+
+    std::atomic<bool> m_running;
+    std::atomic<uint64_t> m_metadata_received;
+    std::chrono::steady_clock::time_point m_started;
+};
+
+} // namespace dht_crawler
+
+#endif // DISABLE_LIBTORRENT
@@ -14,15 +14,19 @@
 #include <libtorrent/session.hpp>
 #include <libtorrent/torrent_handle.hpp>
 
+#include "info_hash.hpp"
+#include "timer_wheel.hpp"
+#include "torrent_handle_registry.hpp"
+
 class MetadataWorkerPool {
 public:
     struct MetadataRequest {
-        std::string info_hash;
+        dht_crawler::InfoHash info_hash;
         int priority;
         std::string source;
         std::chrono::steady_clock::time_point queued_time;
         
-        MetadataRequest(const std::string& hash, int prio = 1, const std::string& src = "UNKNOWN")
+        MetadataRequest(const dht_crawler::InfoHash& hash, int prio = 1, const std::string& src = "UNKNOWN")
             : info_hash(hash), priority(prio), source(src), queued_time(std::chrono::steady_clock::now()) {}
     };
 
@@ -47,8 +51,10 @@ private:
     mutable std::mutex m_queue_mutex;
     std::condition_variable m_queue_cv;
     
-    // Track pending metadata requests
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> m_pending_requests;
+    // Track pending metadata requests; each holds its timeout in the wheel
+    using DeadlineWheel = dht_crawler::TimerWheel<dht_crawler::InfoHash>;
+    dht_crawler::InfoHashMap<DeadlineWheel::TimerId> m_pending_requests;
+    DeadlineWheel m_pending_deadlines{std::chrono::milliseconds(100)};
     mutable std::mutex m_pending_mutex;
     
     // Statistics
@@ -57,19 +63,19 @@ private:
     std::atomic<int> m_total_processed{0};
     
     // Dependencies
-    lt::session* m_session;
+    std::shared_ptr<dht_crawler::TorrentHandleRegistry> m_handles;
     std::function<void(const std::string&)> m_log_callback;
     
     // Configuration
     int m_request_timeout_seconds;
 
 public:
-    MetadataWorkerPool(lt::session* session, 
+    MetadataWorkerPool(std::shared_ptr<dht_crawler::TorrentHandleRegistry> handles, 
                       int num_workers = 10,
                       int request_timeout = 20,
                       std::function<void(const std::string&)> log_callback = nullptr)
         : m_num_workers(num_workers)
-        , m_session(session)
+        , m_handles(handles)
         , m_log_callback(log_callback)
         , m_request_timeout_seconds(request_timeout)
     {
@@ -79,6 +85,13 @@ public:
             m_worker_stats[i] = std::make_unique<WorkerStats>();
         }
         
+        // Before the workers start adding handles
+        if (m_handles) {
+            m_handles->add_release_listener([this](const dht_crawler::InfoHash& hash, dht_crawler::HandleRelease reason) {
+                handle_released(hash, reason);
+            });
+        }
+        
         // Start worker threads
         start_workers();
         
@@ -89,17 +102,29 @@ public:
         shutdown();
     }
     
-    // Add a metadata request to the queue
+    // Add a metadata request to the queue (hex, base32 or binary hash)
     bool queue_request(const std::string& info_hash, int priority = 1, const std::string& source = "UNKNOWN") {
+        dht_crawler::InfoHash hash;
+        if (!dht_crawler::InfoHash::parse(info_hash, hash)) {
+            log("Invalid hash format: " + info_hash.substr(0, 8) + "... (length: " + 
+                std::to_string(info_hash.length()) + ")");
+            return false;
+        }
+        return queue_request(hash, priority, source);
+    }
+    
+    bool queue_request(const dht_crawler::InfoHash& info_hash, int priority = 1, const std::string& source = "UNKNOWN") {
         if (m_shutdown) {
             return false;
         }
         
+        std::string short_hash = info_hash.to_hex().substr(0, 8);
+        
         // Check if already active
         {
             std::lock_guard<std::mutex> lock(m_pending_mutex);
-            if (m_pending_requests.find(info_hash) != m_pending_requests.end()) {
-                log("Request already active for: " + info_hash.substr(0, 8) + "...");
+            if (m_pending_requests.contains(info_hash)) {
+                log("Request already active for: " + short_hash + "...");
                 return true;
             }
         }
@@ -113,7 +138,7 @@ public:
         
         m_queue_cv.notify_one();
         
-        log("Queued metadata request for: " + info_hash.substr(0, 8) + "... (priority: " + 
+        log("Queued metadata request for: " + short_hash + "... (priority: " + 
             std::to_string(priority) + ", source: " + source + ", queue size: " + 
             std::to_string(get_queue_size()) + ")");
         
@@ -132,6 +157,25 @@ public:
         return m_pending_requests.size();
     }
     
+    // Queued and in-flight requests, for a crawl snapshot. In-flight
+    // requests no longer carry their priority and come back at 1.
+    std::vector<MetadataRequest> get_outstanding_requests() const {
+        std::vector<MetadataRequest> requests;
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            std::queue<MetadataRequest> queued = m_request_queue;
+            while (!queued.empty()) {
+                requests.push_back(queued.front());
+                queued.pop();
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        for (const auto& entry : m_pending_requests) {
+            requests.emplace_back(entry.first);
+        }
+        return requests;
+    }
+    
     // Get total statistics
     void get_stats(int& total_queued, int& total_processed, int& total_successful, 
                   int& total_failed, int& total_timeout) const {
@@ -150,12 +194,13 @@ public:
     }
     
     // Handle metadata received alert from main alert loop
-    void handle_metadata_received(const std::string& info_hash) {
+    void handle_metadata_received(const dht_crawler::InfoHash& info_hash) {
         std::lock_guard<std::mutex> lock(m_pending_mutex);
         auto it = m_pending_requests.find(info_hash);
         if (it != m_pending_requests.end()) {
+            m_pending_deadlines.cancel(it->second);
             m_pending_requests.erase(it);
-            log("Metadata received for: " + info_hash.substr(0, 8) + "...");
+            log("Metadata received for: " + info_hash.to_hex().substr(0, 8) + "...");
             
             // Update statistics
             for (auto& stats : m_worker_stats) {
@@ -164,26 +209,57 @@ public:
         }
     }
     
-    // Get pending requests for timeout cleanup
+    // The torrent failed in the session (its handle is already released)
+    void handle_metadata_failed(const dht_crawler::InfoHash& info_hash) {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        auto it = m_pending_requests.find(info_hash);
+        if (it != m_pending_requests.end()) {
+            m_pending_deadlines.cancel(it->second);
+            m_pending_requests.erase(it);
+            log("Metadata failed for: " + info_hash.to_hex().substr(0, 8) + "...");
+            
+            for (auto& stats : m_worker_stats) {
+                stats->requests_failed++;
+            }
+        }
+    }
+    
+    // The registry evicted the handle to stay under its cap: drop the
+    // request now instead of reporting it as timed out later
+    void handle_released(const dht_crawler::InfoHash& info_hash, dht_crawler::HandleRelease reason) {
+        if (reason != dht_crawler::HandleRelease::EVICTED) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        auto it = m_pending_requests.find(info_hash);
+        if (it != m_pending_requests.end()) {
+            m_pending_deadlines.cancel(it->second);
+            m_pending_requests.erase(it);
+            log("Handle evicted for: " + info_hash.to_hex().substr(0, 8) + "...");
+            
+            for (auto& stats : m_worker_stats) {
+                stats->requests_failed++;
+            }
+        }
+    }
+    
+    // Remove and return requests whose timeout has passed (hex-encoded),
+    // releasing their torrents; only the expired deadlines are visited
     std::vector<std::string> get_timed_out_requests() {
         std::vector<std::string> timed_out;
-        auto now = std::chrono::steady_clock::now();
         
         std::lock_guard<std::mutex> lock(m_pending_mutex);
-        for (auto it = m_pending_requests.begin(); it != m_pending_requests.end();) {
-            if (now - it->second > std::chrono::seconds(m_request_timeout_seconds)) {
-                timed_out.push_back(it->first);
-                it = m_pending_requests.erase(it);
-            } else {
-                ++it;
-            }
-        }
+        m_pending_deadlines.advance(std::chrono::steady_clock::now(), [this, &timed_out](const dht_crawler::InfoHash& hash) {
+            m_pending_requests.erase(hash);
+            m_handles->release(hash, dht_crawler::HandleRelease::TIMED_OUT);
+            timed_out.push_back(hash.to_hex());
+        });
         
         return timed_out;
     }
     
-    // Clean up timed out requests
-    void cleanup_timeouts() {
+    // Clean up timed out requests and return them (hex-encoded)
+    std::vector<std::string> cleanup_timeouts() {
         auto timed_out = get_timed_out_requests();
         for (const auto& hash : timed_out) {
             log("Cleaned up timed out request for: " + hash.substr(0, 8) + "...");
@@ -193,6 +269,7 @@ public:
                 stats->requests_timeout++;
             }
         }
+        return timed_out;
     }
     
     // Shutdown the worker pool
@@ -212,6 +289,7 @@ public:
         {
             std::lock_guard<std::mutex> lock(m_pending_mutex);
             m_pending_requests.clear();
+            m_pending_deadlines.clear();
         }
         
         log("Metadata worker pool shutdown complete");
@@ -230,7 +308,7 @@ private:
         auto& stats = *m_worker_stats[worker_id];
         
         while (!m_shutdown) {
-            MetadataRequest request("", 0, "");
+            MetadataRequest request(dht_crawler::InfoHash(), 0, "");
             bool got_request = false;
             
             // Wait for a request
@@ -257,79 +335,54 @@ private:
     }
     
     void process_metadata_request(int worker_id, const MetadataRequest& request, WorkerStats& stats) {
+        std::string hex_hash = request.info_hash.to_hex();
         try {
-            // Convert hash format if needed
-            std::string hex_hash = convert_hash_to_hex(request.info_hash);
-            if (hex_hash.empty()) {
-                log("Worker " + std::to_string(worker_id) + ": Invalid hash format: " + 
-                    request.info_hash.substr(0, 8) + "...");
-                stats.requests_failed++;
-                return;
-            }
-            
-            // Create magnet link
-            std::string magnet = "magnet:?xt=urn:btih:" + hex_hash;
-            
-            // Create torrent parameters
-            lt::add_torrent_params params;
-            lt::error_code ec;
-            params = lt::parse_magnet_uri(magnet, ec);
-            if (ec) {
-                log("Worker " + std::to_string(worker_id) + ": Failed to parse magnet URI: " + ec.message());
-                stats.requests_failed++;
-                return;
-            }
+            // Create torrent parameters straight from the binary hash
+            lt::add_torrent_params params = request.info_hash.to_add_torrent_params();
             
             params.save_path = ".";
             params.flags |= lt::torrent_flags::auto_managed;
             params.flags |= lt::torrent_flags::duplicate_is_error;
             params.flags |= lt::torrent_flags::seed_mode;  // Allow metadata download, no data upload
             
-            // Add torrent to session
-            auto handle = m_session->add_torrent(params);
+            // Add torrent to session (the registry evicts its oldest handle at the cap)
+            auto handle = m_handles->add(request.info_hash, params);
             
             if (handle.is_valid()) {
                 // Track this request as pending
                 {
                     std::lock_guard<std::mutex> lock(m_pending_mutex);
-                    m_pending_requests[request.info_hash] = std::chrono::steady_clock::now();
+                    auto deadline = m_pending_deadlines.schedule(std::chrono::seconds(m_request_timeout_seconds), request.info_hash);
+                    auto result = m_pending_requests.try_emplace(request.info_hash, deadline);
+                    if (!result.second) {
+                        m_pending_deadlines.cancel(result.first->second);
+                        result.first->second = deadline;
+                    }
                 }
                 
                 stats.requests_processed++;
                 m_total_processed++;
                 
                 log("Worker " + std::to_string(worker_id) + ": Queued metadata request for " + 
-                    request.info_hash.substr(0, 8) + "... (priority: " + std::to_string(request.priority) + 
+                    hex_hash.substr(0, 8) + "... (priority: " + std::to_string(request.priority) + 
                     ", source: " + request.source + ")");
                 
                 // Don't wait here - let the main alert loop handle metadata reception
-                // The handle will be cleaned up by the main alert loop when metadata is received
+                // The registry releases the handle on metadata, failure or timeout
                 
             } else {
                 log("Worker " + std::to_string(worker_id) + ": Failed to add torrent for " + 
-                    request.info_hash.substr(0, 8) + "...");
+                    hex_hash.substr(0, 8) + "...");
                 stats.requests_failed++;
             }
             
         } catch (const std::exception& e) {
             log("Worker " + std::to_string(worker_id) + ": Exception processing " + 
-                request.info_hash.substr(0, 8) + "...: " + e.what());
+                hex_hash.substr(0, 8) + "...: " + e.what());
             stats.requests_failed++;
         }
     }
     
-    std::string convert_hash_to_hex(const std::string& hash) {
-        if (hash.length() == 40) {
-            // Already hex format
-            return hash;
-        } else if (hash.length() == 32) {
-            // Base32 format - convert to hex
-            // This is a simplified conversion - in practice you'd use a proper base32 decoder
-            return hash; // For now, assume it's already hex
-        }
-        return "";
-    }
-    
     void log(const std::string& message) {
         if (m_log_callback) {
             m_log_callback(message);
@@ -391,7 +444,7 @@ public:
     int get_active_requests() const { return 0; }
     int get_queue_size() const { return 0; }
     
-    void cleanup_timeouts() {}
+    std::vector<std::string> cleanup_timeouts() { return {}; }
     
     // convert_hash_to_hex function removed - using the one from enhanced_metadata_manager.hpp
     
@@ -0,0 +1,208 @@
+/*
+ * Compact Peer Endpoints
+ *
+ * Peers from get_peers replies are kept in the DHT's own compact form:
+ * 4-byte address + 2-byte port for IPv4 (BEP 5), 16 + 2 bytes for IPv6
+ * (BEP 32), both in network byte order. A PeerEndpointList packs a
+ * torrent's peers into one buffer per address family, so a reply with a
+ * hundred peers costs at most two allocations instead of one string per
+ * peer, and a list is merged by appending bytes.
+ *
+ * Addresses are only formatted as text where they leave the crawler (SQL
+ * rows, LOAD DATA files, logs), straight into a caller-provided buffer.
+ * IPv4-mapped IPv6 addresses are stored as IPv4, so the same peer always
+ * packs to the same bytes.
+ */
+
+#pragma once
+
+#ifndef DISABLE_LIBTORRENT
+#include <libtorrent/socket.hpp>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace dht_crawler {
+
+/**
+ * One packed endpoint (6 or 18 significant bytes)
+ */
+class PeerEndpoint {
+public:
+    static constexpr size_t V4_SIZE = 6;
+    static constexpr size_t V6_SIZE = 18;
+
+    // Longest text form: "[" + 45-char IPv6 + "]:" + 5-digit port
+    static constexpr size_t MAX_TEXT_SIZE = 54;
+
+    PeerEndpoint() : m_size(0) {}
+
+    // Compact bytes as they appear in a DHT reply (size 6 or 18)
+    PeerEndpoint(const void* compact, size_t size) : m_size(static_cast<uint8_t>(size)) {
+        std::memcpy(m_bytes.data(), compact, std::min(size, V6_SIZE));
+    }
+
+#ifndef DISABLE_LIBTORRENT
+    explicit PeerEndpoint(const lt::tcp::endpoint& endpoint) {
+        const lt::address address = endpoint.address();
+        if (address.is_v4()) {
+            auto bytes = address.to_v4().to_bytes();
+            std::memcpy(m_bytes.data(), bytes.data(), 4);
+            m_size = V4_SIZE;
+        } else if (address.to_v6().is_v4_mapped()) {
+            // ::ffff:a.b.c.d, the address is in the last four bytes
+            auto bytes = address.to_v6().to_bytes();
+            std::memcpy(m_bytes.data(), bytes.data() + 12, 4);
+            m_size = V4_SIZE;
+        } else {
+            auto bytes = address.to_v6().to_bytes();
+            std::memcpy(m_bytes.data(), bytes.data(), 16);
+            m_size = V6_SIZE;
+        }
+        m_bytes[m_size - 2] = static_cast<uint8_t>(endpoint.port() >> 8);
+        m_bytes[m_size - 1] = static_cast<uint8_t>(endpoint.port() & 0xff);
+    }
+
+    lt::tcp::endpoint to_endpoint() const {
+        if (is_v6()) {
+            lt::address_v6::bytes_type bytes;
+            std::memcpy(bytes.data(), m_bytes.data(), 16);
+            return lt::tcp::endpoint(lt::address_v6(bytes), port());
+        }
+        lt::address_v4::bytes_type bytes;
+        std::memcpy(bytes.data(), m_bytes.data(), 4);
+        return lt::tcp::endpoint(lt::address_v4(bytes), port());
+    }
+#endif
+
+    bool is_v6() const { return m_size == V6_SIZE; }
+    bool valid() const { return m_size == V4_SIZE || m_size == V6_SIZE; }
+
+    const uint8_t* data() const { return m_bytes.data(); }
+    size_t size() const { return m_size; }
+
+    uint16_t port() const {
+        if (!valid()) return 0;
+        return static_cast<uint16_t>((m_bytes[m_size - 2] << 8) | m_bytes[m_size - 1]);
+    }
+
+    /**
+     * Write the numeric address (no port) to out, which must hold at least
+     * INET6_ADDRSTRLEN bytes
+     * @return Length written, without the terminator
+     */
+    size_t format_address(char* out) const {
+        if (!valid()) {
+            out[0] = '\0';
+            return 0;
+        }
+        const char* result = inet_ntop(is_v6() ? AF_INET6 : AF_INET, m_bytes.data(), out, INET6_ADDRSTRLEN);
+        return result ? std::strlen(out) : 0;
+    }
+
+    std::string address_string() const {
+        char buffer[INET6_ADDRSTRLEN];
+        return std::string(buffer, format_address(buffer));
+    }
+
+    // "ip:port", or "[ip]:port" for IPv6
+    std::string to_string() const {
+        std::string text;
+        text.reserve(MAX_TEXT_SIZE);
+        if (is_v6()) text += '[';
+        text += address_string();
+        if (is_v6()) text += ']';
+        text += ':';
+        text += std::to_string(port());
+        return text;
+    }
+
+    bool operator==(const PeerEndpoint& other) const {
+        return m_size == other.m_size && std::memcmp(m_bytes.data(), other.m_bytes.data(), m_size) == 0;
+    }
+    bool operator!=(const PeerEndpoint& other) const { return !(*this == other); }
+
+private:
+    std::array<uint8_t, V6_SIZE> m_bytes{};
+    uint8_t m_size;
+};
+
+/**
+ * A torrent's peers, packed per address family
+ */
+class PeerEndpointList {
+public:
+    void push_back(const PeerEndpoint& endpoint) {
+        if (!endpoint.valid()) return;
+        std::vector<uint8_t>& bytes = endpoint.is_v6() ? m_v6 : m_v4;
+        bytes.insert(bytes.end(), endpoint.data(), endpoint.data() + endpoint.size());
+    }
+
+#ifndef DISABLE_LIBTORRENT
+    void push_back(const lt::tcp::endpoint& endpoint) {
+        push_back(PeerEndpoint(endpoint));
+    }
+
+    void assign(const std::vector<lt::tcp::endpoint>& endpoints) {
+        clear();
+        m_v4.reserve(endpoints.size() * PeerEndpoint::V4_SIZE);
+        for (const auto& endpoint : endpoints) {
+            push_back(endpoint);
+        }
+    }
+#endif
+
+    void append(const PeerEndpointList& other) {
+        m_v4.insert(m_v4.end(), other.m_v4.begin(), other.m_v4.end());
+        m_v6.insert(m_v6.end(), other.m_v6.begin(), other.m_v6.end());
+    }
+
+    /**
+     * Call visit(const PeerEndpoint&) for every peer, IPv4 first
+     */
+    template <typename Visitor>
+    void for_each(Visitor&& visit) const {
+        for (size_t i = 0; i < m_v4.size(); i += PeerEndpoint::V4_SIZE) {
+            visit(PeerEndpoint(&m_v4[i], PeerEndpoint::V4_SIZE));
+        }
+        for (size_t i = 0; i < m_v6.size(); i += PeerEndpoint::V6_SIZE) {
+            visit(PeerEndpoint(&m_v6[i], PeerEndpoint::V6_SIZE));
+        }
+    }
+
+    size_t size() const {
+        return m_v4.size() / PeerEndpoint::V4_SIZE + m_v6.size() / PeerEndpoint::V6_SIZE;
+    }
+    size_t v4_count() const { return m_v4.size() / PeerEndpoint::V4_SIZE; }
+    size_t v6_count() const { return m_v6.size() / PeerEndpoint::V6_SIZE; }
+    bool empty() const { return m_v4.empty() && m_v6.empty(); }
+
+    // BEP 5 / BEP 32 compact peer strings, back to back
+    const std::vector<uint8_t>& compact_v4() const { return m_v4; }
+    const std::vector<uint8_t>& compact_v6() const { return m_v6; }
+
+    // Heap bytes held, for memory budgets
+    size_t memory_bytes() const { return m_v4.capacity() + m_v6.capacity(); }
+
+    void clear() {
+        m_v4.clear();
+        m_v6.clear();
+    }
+
+private:
+    std::vector<uint8_t> m_v4;
+    std::vector<uint8_t> m_v6;
+};
+
+} // namespace dht_crawler
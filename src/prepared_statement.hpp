@@ -0,0 +1,234 @@
+/*
+ * MySQL Prepared Statement Wrapper
+ *
+ * Owns one server-side prepared statement (mysql_stmt_*) and the parameter
+ * bind array for it. The statement is parsed once per connection and then
+ * executed with binary parameters, so values need no client-side escaping
+ * and no SQL text is rebuilt per call.
+ *
+ * String parameters are bound by reference: the caller's std::string must
+ * stay alive and unchanged until execute() returns. Integer parameters are
+ * copied into storage owned by the statement. The bind array, lengths and
+ * null flags are allocated once in prepare() and reused for every call.
+ */
+
+#pragma once
+
+#ifndef DISABLE_MYSQL
+#include <mysql/mysql.h>
+#include <mysql/errmsg.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifndef DISABLE_MYSQL
+
+namespace dht_crawler {
+
+class PreparedStatement {
+public:
+    explicit PreparedStatement(const std::string& sql)
+        : m_sql(sql)
+        , m_stmt(nullptr)
+        , m_param_count(0)
+        , m_error_code(0)
+        , m_executions(0) {}
+
+    ~PreparedStatement() {
+        close();
+    }
+
+    PreparedStatement(const PreparedStatement&) = delete;
+    PreparedStatement& operator=(const PreparedStatement&) = delete;
+
+    /**
+     * Prepare the statement on a connection, replacing any earlier handle
+     */
+    bool prepare(MYSQL* connection) {
+        close();
+        m_stmt = mysql_stmt_init(connection);
+        if (!m_stmt) {
+            set_error(CR_UNKNOWN_ERROR, "mysql_stmt_init failed");
+            return false;
+        }
+        if (mysql_stmt_prepare(m_stmt, m_sql.c_str(), m_sql.size())) {
+            set_error(mysql_stmt_errno(m_stmt), mysql_stmt_error(m_stmt));
+            close();
+            return false;
+        }
+
+        m_param_count = mysql_stmt_param_count(m_stmt);
+        m_binds.assign(m_param_count, MYSQL_BIND());
+        m_lengths.assign(m_param_count, 0);
+        m_integers.assign(m_param_count, 0);
+        m_nulls.reset(new NullFlag[m_param_count]());
+        for (size_t i = 0; i < m_param_count; ++i) {
+            std::memset(&m_binds[i], 0, sizeof(MYSQL_BIND));
+            m_binds[i].length = &m_lengths[i];
+            m_binds[i].is_null = &m_nulls[i];
+        }
+        set_error(0, "");
+        return true;
+    }
+
+    void close() {
+        if (m_stmt) {
+            mysql_stmt_close(m_stmt);
+            m_stmt = nullptr;
+        }
+    }
+
+    bool is_prepared() const { return m_stmt != nullptr; }
+    size_t param_count() const { return m_param_count; }
+    const std::string& sql() const { return m_sql; }
+
+    void bind_string(size_t index, const std::string& value) {
+        MYSQL_BIND& bind = m_binds[index];
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = const_cast<char*>(value.data());
+        bind.buffer_length = value.size();
+        m_lengths[index] = value.size();
+        m_nulls[index] = 0;
+    }
+
+    void bind_int64(size_t index, int64_t value) {
+        bind_integer(index, static_cast<uint64_t>(value), false);
+    }
+
+    void bind_uint64(size_t index, uint64_t value) {
+        bind_integer(index, value, true);
+    }
+
+    void bind_bool(size_t index, bool value) {
+        bind_integer(index, value ? 1 : 0, false);
+    }
+
+    void bind_null(size_t index) {
+        MYSQL_BIND& bind = m_binds[index];
+        bind.buffer_type = MYSQL_TYPE_NULL;
+        bind.buffer = nullptr;
+        m_nulls[index] = 1;
+    }
+
+    /**
+     * Execute with the currently bound parameters
+     */
+    bool execute() {
+        if (!m_stmt) {
+            set_error(CR_UNKNOWN_ERROR, "Statement not prepared");
+            return false;
+        }
+        if (mysql_stmt_bind_param(m_stmt, m_binds.data()) || mysql_stmt_execute(m_stmt)) {
+            set_error(mysql_stmt_errno(m_stmt), mysql_stmt_error(m_stmt));
+            return false;
+        }
+        m_executions++;
+        return true;
+    }
+
+    uint64_t affected_rows() const {
+        return m_stmt ? mysql_stmt_affected_rows(m_stmt) : 0;
+    }
+
+    const std::string& error() const { return m_error; }
+    unsigned int error_code() const { return m_error_code; }
+    uint64_t executions() const { return m_executions; }
+
+    /**
+     * True if the last error means the connection, and with it every
+     * statement prepared on it, is gone
+     */
+    bool connection_lost() const {
+        return m_error_code == CR_SERVER_GONE_ERROR || m_error_code == CR_SERVER_LOST;
+    }
+
+private:
+    // bool in MySQL 8, my_bool (char) in older clients and MariaDB
+    using NullFlag = std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+
+    void bind_integer(size_t index, uint64_t value, bool is_unsigned) {
+        MYSQL_BIND& bind = m_binds[index];
+        m_integers[index] = value;
+        bind.buffer_type = MYSQL_TYPE_LONGLONG;
+        bind.buffer = &m_integers[index];
+        bind.buffer_length = sizeof(uint64_t);
+        bind.is_unsigned = is_unsigned;
+        m_lengths[index] = sizeof(uint64_t);
+        m_nulls[index] = 0;
+    }
+
+    void set_error(unsigned int code, const std::string& message) {
+        m_error_code = code;
+        m_error = message;
+    }
+
+    std::string m_sql;
+    MYSQL_STMT* m_stmt;
+    size_t m_param_count;
+
+    std::vector<MYSQL_BIND> m_binds;
+    std::vector<unsigned long> m_lengths;
+    std::vector<uint64_t> m_integers;
+    std::unique_ptr<NullFlag[]> m_nulls;
+
+    std::string m_error;
+    unsigned int m_error_code;
+    uint64_t m_executions;
+};
+
+/**
+ * The row-count variants (1..max_rows) of one multi-row statement, each
+ * created and prepared on first use. A batch of n rows then costs
+ * n / max_rows full-size executions plus one for the remainder, whatever
+ * n is, instead of one round trip per leftover row.
+ */
+class BatchStatementCache {
+public:
+    using SqlBuilder = std::function<std::string(size_t rows)>;
+
+    BatchStatementCache(size_t max_rows, SqlBuilder build_sql)
+        : m_max_rows(max_rows)
+        , m_build_sql(std::move(build_sql))
+        , m_statements(max_rows + 1) {}
+
+    size_t max_rows() const { return m_max_rows; }
+
+    // Statement for rows rows (1..max_rows); the caller prepares it
+    PreparedStatement& get(size_t rows) {
+        std::unique_ptr<PreparedStatement>& stmt = m_statements[rows];
+        if (!stmt) {
+            stmt.reset(new PreparedStatement(m_build_sql(rows)));
+        }
+        return *stmt;
+    }
+
+    // Variants currently prepared on the connection
+    size_t prepared_count() const {
+        size_t count = 0;
+        for (const auto& stmt : m_statements) {
+            if (stmt && stmt->is_prepared()) count++;
+        }
+        return count;
+    }
+
+    void close() {
+        for (auto& stmt : m_statements) {
+            if (stmt) stmt->close();
+        }
+    }
+
+private:
+    size_t m_max_rows;
+    SqlBuilder m_build_sql;
+    std::vector<std::unique_ptr<PreparedStatement>> m_statements;
+};
+
+} // namespace dht_crawler
+
+#endif // DISABLE_MYSQL
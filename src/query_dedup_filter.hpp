@@ -0,0 +1,423 @@
+/*
+ * Query Target Dedup Filters
+ *
+ * Pluggable "have we already queried this target?" check for generated DHT
+ * query targets. Random 160-bit targets practically never repeat, so the
+ * exact set used previously only cost memory and a global lock. These
+ * filters have a fixed memory footprint and are lock-free on the hot path:
+ *
+ *  - NullQueryDedupFilter:     no dedup at all
+ *  - BloomQueryDedupFilter:    one blocked Bloom filter (saturates over time)
+ *  - RotatingQueryDedupFilter: two blocked Bloom filters; when the active one
+ *                              reaches its design capacity the older one is
+ *                              cleared and takes over, bounding the FP rate
+ *
+ * save_state()/load_state() copy the filter bits to and from a crawl
+ * snapshot, so targets queried before a restart are still skipped after it.
+ */
+
+#pragma once
+
+#include "info_hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dht_crawler {
+
+enum class QueryDedupMode {
+    NONE,
+    BLOOM,
+    ROTATING
+};
+
+inline bool parse_query_dedup_mode(const std::string& name, QueryDedupMode& mode) {
+    if (name == "none") {
+        mode = QueryDedupMode::NONE;
+    } else if (name == "bloom") {
+        mode = QueryDedupMode::BLOOM;
+    } else if (name == "rotating") {
+        mode = QueryDedupMode::ROTATING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Blocked Bloom filter over InfoHash keys
+ *
+ * Every key maps to a single 512-bit block, allocated on a cache-line
+ * boundary, and sets K bits inside it with atomic fetch_or at an odd stride
+ * (so the K bits are distinct), so an insert touches one cache line and
+ * never takes a lock. Concurrent inserts of the same key may both report
+ * "new", which is harmless for query dedup.
+ */
+class BlockedBloomFilter {
+public:
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+    static constexpr size_t BITS_PER_BLOCK = WORDS_PER_BLOCK * 64;
+    static constexpr int NUM_PROBES = 7;
+
+    explicit BlockedBloomFilter(size_t memory_bytes)
+        : m_inserted(0) {
+        size_t blocks = 1;
+        while ((blocks << 1) * WORDS_PER_BLOCK * sizeof(uint64_t) <= memory_bytes) {
+            blocks <<= 1;
+        }
+        m_block_mask = blocks - 1;
+        m_blocks.reset(new Block[blocks]);
+        clear();
+    }
+
+    /**
+     * Insert a key
+     * @return true if the key was (probably) not present before
+     */
+    bool insert(const InfoHash& hash) {
+        uint64_t h1, h2;
+        hash_key(hash, h1, h2);
+        std::atomic<uint64_t>* block = m_blocks[h1 & m_block_mask].words;
+        uint64_t step = (h1 >> 32) | 1;
+
+        bool added = false;
+        for (int i = 0; i < NUM_PROBES; ++i) {
+            uint32_t bit = static_cast<uint32_t>((h2 + i * step) % BITS_PER_BLOCK);
+            uint64_t mask = uint64_t(1) << (bit & 63);
+            uint64_t old = block[bit >> 6].fetch_or(mask, std::memory_order_relaxed);
+            if (!(old & mask)) {
+                added = true;
+            }
+        }
+
+        if (added) {
+            m_inserted.fetch_add(1, std::memory_order_relaxed);
+        }
+        return added;
+    }
+
+    bool contains(const InfoHash& hash) const {
+        uint64_t h1, h2;
+        hash_key(hash, h1, h2);
+        const std::atomic<uint64_t>* block = m_blocks[h1 & m_block_mask].words;
+        uint64_t step = (h1 >> 32) | 1;
+
+        for (int i = 0; i < NUM_PROBES; ++i) {
+            uint32_t bit = static_cast<uint32_t>((h2 + i * step) % BITS_PER_BLOCK);
+            uint64_t mask = uint64_t(1) << (bit & 63);
+            if (!(block[bit >> 6].load(std::memory_order_relaxed) & mask)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < word_count(); ++i) {
+            word(i).store(0, std::memory_order_relaxed);
+        }
+        m_inserted.store(0, std::memory_order_relaxed);
+    }
+
+    size_t inserted() const { return m_inserted.load(std::memory_order_relaxed); }
+    size_t bit_count() const { return word_count() * 64; }
+    size_t memory_usage() const { return word_count() * sizeof(uint64_t); }
+    size_t saved_size() const { return sizeof(uint64_t) + memory_usage(); }
+
+    /**
+     * Append the insert count and filter words to out. Concurrent inserts
+     * may or may not be included.
+     */
+    void save(std::string& out) const {
+        uint64_t count = inserted();
+        size_t offset = out.size();
+        out.resize(offset + saved_size());
+        std::memcpy(&out[offset], &count, sizeof(count));
+        offset += sizeof(count);
+        for (size_t i = 0; i < word_count(); ++i) {
+            uint64_t value = word(i).load(std::memory_order_relaxed);
+            std::memcpy(&out[offset], &value, sizeof(value));
+            offset += sizeof(value);
+        }
+    }
+
+    /**
+     * Replace the contents with saved_size() bytes written by save() on a
+     * filter of the same size
+     */
+    bool load(const char* data, size_t size) {
+        if (size != saved_size()) {
+            return false;
+        }
+        uint64_t count;
+        std::memcpy(&count, data, sizeof(count));
+        data += sizeof(count);
+        for (size_t i = 0; i < word_count(); ++i) {
+            uint64_t value;
+            std::memcpy(&value, data, sizeof(value));
+            word(i).store(value, std::memory_order_relaxed);
+            data += sizeof(value);
+        }
+        m_inserted.store(static_cast<size_t>(count), std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Number of keys at which the false-positive rate reaches about 1%
+     */
+    size_t design_capacity() const {
+        return static_cast<size_t>(bit_count() / 9.6);
+    }
+
+    /**
+     * Textbook estimate (1 - e^(-kn/m))^k for the current fill
+     */
+    double estimated_false_positive_rate() const {
+        double n = static_cast<double>(inserted());
+        double m = static_cast<double>(bit_count());
+        return std::pow(1.0 - std::exp(-NUM_PROBES * n / m), NUM_PROBES);
+    }
+
+private:
+    // alignas makes new[] use the aligned allocator, so blocks never
+    // straddle two cache lines
+    struct alignas(64) Block {
+        std::atomic<uint64_t> words[WORDS_PER_BLOCK];
+    };
+
+    static_assert(sizeof(Block) == 64, "one block per cache line");
+
+    size_t word_count() const { return (m_block_mask + 1) * WORDS_PER_BLOCK; }
+
+    std::atomic<uint64_t>& word(size_t i) const {
+        return m_blocks[i / WORDS_PER_BLOCK].words[i % WORDS_PER_BLOCK];
+    }
+
+    static void hash_key(const InfoHash& hash, uint64_t& h1, uint64_t& h2) {
+        uint64_t a, b;
+        std::memcpy(&a, hash.bytes.data(), sizeof(a));
+        std::memcpy(&b, hash.bytes.data() + 8, sizeof(b));
+        h1 = fmix64(a);
+        h2 = fmix64(b ^ 0x9e3779b97f4a7c15ULL);
+    }
+
+    static uint64_t fmix64(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    std::unique_ptr<Block[]> m_blocks;
+    size_t m_block_mask;
+    std::atomic<size_t> m_inserted;
+};
+
+/**
+ * Interface for query target dedup
+ */
+class QueryDedupFilter {
+public:
+    QueryDedupFilter() : m_checks(0), m_duplicates(0) {}
+    virtual ~QueryDedupFilter() = default;
+
+    /**
+     * Record a query target
+     * @return true if the target should be queried, false if it is a (probable) repeat
+     */
+    bool check_and_insert(const InfoHash& hash) {
+        m_checks.fetch_add(1, std::memory_order_relaxed);
+        if (!do_check_and_insert(hash)) {
+            m_duplicates.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    virtual const char* name() const = 0;
+    virtual size_t memory_usage() const = 0;
+    virtual double estimated_false_positive_rate() const = 0;
+
+    /**
+     * Append the filter contents to out (nothing for stateless filters)
+     */
+    virtual void save_state(std::string&) const {}
+
+    /**
+     * Restore contents saved by a filter of the same type and size
+     * @return false if the saved state does not fit this filter
+     */
+    virtual bool load_state(const char*, size_t size) { return size == 0; }
+
+    uint64_t get_checks() const { return m_checks.load(); }
+    uint64_t get_duplicates() const { return m_duplicates.load(); }
+
+    /**
+     * Fraction of checks rejected as repeats. Random targets essentially never
+     * repeat, so this is the observed false-positive rate.
+     */
+    double observed_duplicate_rate() const {
+        uint64_t checks = m_checks.load();
+        return checks == 0 ? 0.0 : static_cast<double>(m_duplicates.load()) / checks;
+    }
+
+    void print_statistics() const {
+        std::cout << "Query dedup: " << name()
+                  << ", memory=" << (memory_usage() / 1024) << " KB"
+                  << ", checks=" << get_checks()
+                  << ", rejected=" << get_duplicates()
+                  << ", observed FPR=" << observed_duplicate_rate()
+                  << ", estimated FPR=" << estimated_false_positive_rate() << std::endl;
+    }
+
+protected:
+    virtual bool do_check_and_insert(const InfoHash& hash) = 0;
+
+private:
+    std::atomic<uint64_t> m_checks;
+    std::atomic<uint64_t> m_duplicates;
+};
+
+class NullQueryDedupFilter : public QueryDedupFilter {
+public:
+    const char* name() const override { return "none"; }
+    size_t memory_usage() const override { return 0; }
+    double estimated_false_positive_rate() const override { return 0.0; }
+
+protected:
+    bool do_check_and_insert(const InfoHash&) override { return true; }
+};
+
+class BloomQueryDedupFilter : public QueryDedupFilter {
+public:
+    explicit BloomQueryDedupFilter(size_t memory_bytes)
+        : m_filter(memory_bytes) {}
+
+    const char* name() const override { return "bloom"; }
+    size_t memory_usage() const override { return m_filter.memory_usage(); }
+    double estimated_false_positive_rate() const override { return m_filter.estimated_false_positive_rate(); }
+
+    void save_state(std::string& out) const override { m_filter.save(out); }
+    bool load_state(const char* data, size_t size) override { return m_filter.load(data, size); }
+
+protected:
+    bool do_check_and_insert(const InfoHash& hash) override { return m_filter.insert(hash); }
+
+private:
+    BlockedBloomFilter m_filter;
+};
+
+/**
+ * Two Bloom filters sharing the memory budget. Lookups consult both; inserts
+ * go to the active one. When the active filter reaches its design capacity
+ * the older filter is cleared and becomes active, so targets are remembered
+ * for between one and two generations. A target inserted into the filter
+ * being cleared may be forgotten early, which only costs a repeated query.
+ */
+class RotatingQueryDedupFilter : public QueryDedupFilter {
+public:
+    explicit RotatingQueryDedupFilter(size_t memory_bytes)
+        : m_active(0), m_rotations(0) {
+        m_filters[0] = std::make_unique<BlockedBloomFilter>(memory_bytes / 2);
+        m_filters[1] = std::make_unique<BlockedBloomFilter>(memory_bytes / 2);
+        m_capacity = m_filters[0]->design_capacity();
+    }
+
+    const char* name() const override { return "rotating"; }
+
+    size_t memory_usage() const override {
+        return m_filters[0]->memory_usage() + m_filters[1]->memory_usage();
+    }
+
+    double estimated_false_positive_rate() const override {
+        double p0 = m_filters[0]->estimated_false_positive_rate();
+        double p1 = m_filters[1]->estimated_false_positive_rate();
+        return 1.0 - (1.0 - p0) * (1.0 - p1);
+    }
+
+    uint64_t get_rotations() const { return m_rotations.load(); }
+
+    void save_state(std::string& out) const override {
+        uint32_t active = static_cast<uint32_t>(m_active.load(std::memory_order_acquire));
+        out.append(reinterpret_cast<const char*>(&active), sizeof(active));
+        m_filters[0]->save(out);
+        m_filters[1]->save(out);
+    }
+
+    bool load_state(const char* data, size_t size) override {
+        size_t filter_size = m_filters[0]->saved_size();
+        if (size != sizeof(uint32_t) + 2 * filter_size) {
+            return false;
+        }
+        uint32_t active;
+        std::memcpy(&active, data, sizeof(active));
+        data += sizeof(active);
+        if (!m_filters[0]->load(data, filter_size) || !m_filters[1]->load(data + filter_size, filter_size)) {
+            return false;
+        }
+        m_active.store(static_cast<int>(active & 1), std::memory_order_release);
+        return true;
+    }
+
+protected:
+    bool do_check_and_insert(const InfoHash& hash) override {
+        int active = m_active.load(std::memory_order_acquire);
+        BlockedBloomFilter& current = *m_filters[active];
+        BlockedBloomFilter& previous = *m_filters[active ^ 1];
+
+        if (previous.contains(hash)) {
+            return false;
+        }
+        if (!current.insert(hash)) {
+            return false;
+        }
+
+        if (current.inserted() >= m_capacity) {
+            rotate(active);
+        }
+        return true;
+    }
+
+private:
+    void rotate(int expected_active) {
+        std::unique_lock<std::mutex> lock(m_rotate_mutex, std::try_to_lock);
+        if (!lock.owns_lock() || m_active.load() != expected_active) {
+            return; // Another thread is rotating or already has
+        }
+
+        int next = expected_active ^ 1;
+        m_filters[next]->clear();
+        m_active.store(next, std::memory_order_release);
+        m_rotations++;
+    }
+
+    std::unique_ptr<BlockedBloomFilter> m_filters[2];
+    std::atomic<int> m_active;
+    std::atomic<uint64_t> m_rotations;
+    std::mutex m_rotate_mutex;
+    size_t m_capacity;
+};
+
+inline std::unique_ptr<QueryDedupFilter> create_query_dedup_filter(QueryDedupMode mode, size_t memory_bytes) {
+    switch (mode) {
+        case QueryDedupMode::NONE:
+            return std::make_unique<NullQueryDedupFilter>();
+        case QueryDedupMode::BLOOM:
+            return std::make_unique<BloomQueryDedupFilter>(memory_bytes);
+        case QueryDedupMode::ROTATING:
+        default:
+            return std::make_unique<RotatingQueryDedupFilter>(memory_bytes);
+    }
+}
+
+} // namespace dht_crawler
@@ -0,0 +1,959 @@
+/*
+ * Embedded Log-Structured Segment Store
+ *
+ * Local storage for crawl results on nodes without a database. Every
+ * change is appended as a fixed-size 128-byte record to the active segment
+ * file; a segment is sealed once it reaches segment_bytes and never
+ * written again. An info-hash's current state is its newest SIGHTING record
+ * (cumulative counts, so one record says everything) plus its newest
+ * METADATA record; older records for the same hash are dead.
+ *
+ * An open-addressing hash index in a memory-mapped file maps each info-hash
+ * to the location of those two records and mirrors the sighting counts, so
+ * recording a sighting never reads a segment. The index is marked clean on
+ * close; after a crash it is rebuilt by scanning the segments in order, and
+ * a torn record at the end of a segment is cut off (each record carries a
+ * checksum).
+ *
+ * A background thread syncs the active segment and compacts sealed
+ * segments whose live fraction has dropped below compact_below_live_ratio:
+ * live records are copied to the active segment, the copies are synced,
+ * and the old file is deleted. Sealed segments are immutable files, so they
+ * can be shipped elsewhere (e.g. bulk-loaded into the central database)
+ * with plain file copies.
+ *
+ * All public methods are thread-safe.
+ */
+
+#pragma once
+
+#include "info_hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dht_crawler {
+
+enum class SegmentRecordType : uint8_t {
+    SIGHTING = 1,
+    METADATA = 2
+};
+
+/**
+ * On-disk record, host byte order
+ */
+struct SegmentRecord {
+    static constexpr uint16_t TIMED_OUT = 1; // Metadata fetch timed out
+
+    uint8_t info_hash[20];
+    uint8_t type;              // SegmentRecordType
+    uint8_t source;            // DiscoverySource of the latest sighting
+    uint16_t flags;
+    uint32_t first_seen;       // Unix seconds
+    uint32_t last_seen;
+    uint32_t sightings;        // Total so far
+    uint32_t peer_count;       // Peers in the latest reply
+    uint64_t total_size;       // Metadata only, as are the fields below
+    int64_t creation_date;
+    uint32_t num_files;
+    uint32_t checksum;         // Over the whole record with this field zeroed
+    char name[64];             // Truncated, NUL-padded
+};
+
+static_assert(sizeof(SegmentRecord) == 128, "segment records are fixed-size");
+
+struct SegmentStoreConfig {
+    std::string directory = "dht_store";                 // Created if missing
+    size_t segment_bytes = 64 * 1024 * 1024;             // Seal the active segment at this size
+    size_t initial_index_slots = 1 << 16;                // Index doubles at 75% load
+    double compact_below_live_ratio = 0.5;               // Compact sealed segments below this
+    std::chrono::seconds maintenance_interval{10};       // Sync + compaction cadence
+};
+
+namespace segment_detail {
+
+constexpr char SEGMENT_MAGIC[8] = {'D', 'H', 'T', 'S', 'E', 'G', '0', '1'};
+constexpr char INDEX_MAGIC[8] = {'D', 'H', 'T', 'I', 'D', 'X', '0', '1'};
+constexpr uint32_t VERSION = 1;
+constexpr size_t RECORD_SIZE = sizeof(SegmentRecord);
+constexpr size_t SEGMENT_HEADER_SIZE = RECORD_SIZE; // Keeps records 128-byte aligned
+constexpr size_t INDEX_HEADER_SIZE = 64;
+constexpr size_t WRITE_BUFFER_BYTES = 1024 * 1024;
+constexpr size_t COMPACTION_CHUNK = 4096;          // Records copied per lock hold
+
+inline uint32_t record_checksum(const SegmentRecord& record) {
+    SegmentRecord copy = record;
+    copy.checksum = 0;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&copy);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(copy); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+inline uint32_t unix_now() {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+} // namespace segment_detail
+
+class SegmentStore {
+public:
+    SegmentStore(const SegmentStoreConfig& config, std::function<void(const std::string&)> log_callback = nullptr)
+        : m_config(config)
+        , m_log_callback(log_callback)
+        , m_segment_records(std::max<size_t>(config.segment_bytes / segment_detail::RECORD_SIZE, 1024) - 1)
+        , m_open(false)
+        , m_stop_requested(false)
+        , m_index_map(nullptr)
+        , m_index_size(0)
+        , m_slots(nullptr)
+        , m_capacity(0)
+        , m_count(0)
+        , m_active_id(0)
+        , m_active_fd(-1)
+        , m_flushed_records(0)
+        , m_records_appended(0)
+        , m_records_copied(0)
+        , m_segments_sealed(0)
+        , m_segments_compacted(0)
+        , m_bytes_reclaimed(0)
+        , m_write_errors(0)
+        , m_index_rebuilt(false) {}
+
+    ~SegmentStore() {
+        close();
+    }
+
+    /**
+     * Open or create the store and start the maintenance thread
+     */
+    bool open(std::string& error) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_open) return true;
+
+        if (::mkdir(m_config.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            error = "cannot create " + m_config.directory + ": " + std::strerror(errno);
+            return false;
+        }
+        if (!load_segments(error)) return false;
+
+        if (!open_index(error)) return false;
+        if (!open_active(error)) return false;
+
+        m_open = true;
+        m_stop_requested = false;
+        m_maintenance_thread = std::thread(&SegmentStore::maintenance_loop, this);
+        log("Opened " + m_config.directory + ": " + std::to_string(m_segments.size()) + " segments, " +
+            std::to_string(m_count) + " info-hashes" + (m_index_rebuilt ? " (index rebuilt)" : ""));
+        return true;
+    }
+
+    /**
+     * Stop maintenance, sync everything and mark the index clean
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_open) return;
+            m_stop_requested = true;
+        }
+        m_maintenance_cv.notify_all();
+        if (m_maintenance_thread.joinable()) {
+            m_maintenance_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bool synced = sync_locked();
+        if (m_active_fd >= 0) {
+            ::close(m_active_fd);
+            m_active_fd = -1;
+        }
+        if (m_index_map) {
+            // Slots must be on disk before the header says they are good
+            ::msync(m_index_map, m_index_size, MS_SYNC);
+            if (synced) {
+                index_header().clean = 1;
+                ::msync(m_index_map, segment_detail::INDEX_HEADER_SIZE, MS_SYNC);
+            }
+            ::munmap(m_index_map, m_index_size);
+            m_index_map = nullptr;
+            m_slots = nullptr;
+        }
+        m_open = false;
+    }
+
+    /**
+     * Record count more sightings of hash
+     */
+    void record_sighting(const InfoHash& hash, uint8_t source, uint32_t count, uint32_t peer_count) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_open) return;
+
+        uint32_t now = segment_detail::unix_now();
+        Slot& slot = find_or_insert(hash);
+        if (slot.sightings == 0 && slot.first_seen == 0) {
+            slot.first_seen = now;
+        }
+        slot.source = source;
+        slot.last_seen = now;
+        slot.sightings += count;
+        slot.peer_count = peer_count;
+        append_sighting(slot);
+    }
+
+    /**
+     * Remember that fetching metadata for hash timed out
+     */
+    void mark_timed_out(const InfoHash& hash) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_open) return;
+
+        Slot& slot = find_or_insert(hash);
+        if (slot.first_seen == 0) {
+            slot.first_seen = slot.last_seen = segment_detail::unix_now();
+        }
+        slot.flags |= SegmentRecord::TIMED_OUT;
+        append_sighting(slot);
+    }
+
+    void record_metadata(const InfoHash& hash, const std::string& name, uint64_t total_size,
+                         uint32_t num_files, int64_t creation_date) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_open) return;
+
+        Slot& slot = find_or_insert(hash);
+        SegmentRecord record{};
+        std::memcpy(record.info_hash, hash.bytes.data(), InfoHash::SIZE);
+        record.type = static_cast<uint8_t>(SegmentRecordType::METADATA);
+        record.last_seen = segment_detail::unix_now();
+        record.total_size = total_size;
+        record.creation_date = creation_date;
+        record.num_files = num_files;
+        std::memcpy(record.name, name.data(), std::min(name.size(), sizeof(record.name)));
+
+        release(slot.metadata_segment);
+        append(record, slot.metadata_segment, slot.metadata_record);
+    }
+
+    /**
+     * Current record of the given type for hash
+     * @return false if there is none
+     */
+    bool get(const InfoHash& hash, SegmentRecordType type, SegmentRecord& out) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_open) return false;
+
+        const Slot* slot = find(hash);
+        if (!slot) return false;
+        if (type == SegmentRecordType::SIGHTING) {
+            return slot->sighting_segment != 0 && read_record(slot->sighting_segment, slot->sighting_record, out);
+        }
+        return slot->metadata_segment != 0 && read_record(slot->metadata_segment, slot->metadata_record, out);
+    }
+
+    bool contains(const InfoHash& hash) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_open && find(hash) != nullptr;
+    }
+
+    /**
+     * Hand buffered records to the OS (no fsync)
+     */
+    bool flush() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_open && flush_locked();
+    }
+
+    /**
+     * Flush and fsync the active segment
+     */
+    bool sync() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_open && sync_locked();
+    }
+
+    /**
+     * Compact every sealed segment below the live ratio now
+     * @return Number of segments removed
+     */
+    size_t compact() {
+        std::vector<uint32_t> candidates;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_open) return 0;
+            for (const auto& pair : m_segments) {
+                const SegmentInfo& info = pair.second;
+                if (pair.first != m_active_id &&
+                    info.live < info.records * m_config.compact_below_live_ratio) {
+                    candidates.push_back(pair.first);
+                }
+            }
+        }
+
+        size_t removed = 0;
+        for (uint32_t id : candidates) {
+            if (m_stop_requested) break;
+            if (compact_segment(id)) removed++;
+        }
+        return removed;
+    }
+
+    /**
+     * Paths of sealed segments, oldest first. Their contents never change
+     * (a compacted segment is deleted, not rewritten).
+     */
+    std::vector<std::string> sealed_segments() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::string> paths;
+        for (const auto& pair : m_segments) {
+            if (pair.first != m_active_id) {
+                paths.push_back(segment_path(pair.first));
+            }
+        }
+        return paths;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    uint64_t get_records_appended() const { return m_records_appended.load(); }
+    uint64_t get_write_errors() const { return m_write_errors.load(); }
+
+    void print_statistics() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t records = 0;
+        uint64_t live = 0;
+        for (const auto& pair : m_segments) {
+            records += pair.second.records;
+            live += pair.second.live;
+        }
+        std::cout << "=== Segment Store Statistics ===" << std::endl;
+        std::cout << "Directory: " << m_config.directory << std::endl;
+        std::cout << "Info-hashes: " << m_count << " (index slots: " << m_capacity << ")" << std::endl;
+        std::cout << "Segments: " << m_segments.size() << " (active: " << m_active_id << ")" << std::endl;
+        std::cout << "Records: " << records << " (live: " << live << ")" << std::endl;
+        std::cout << "Records appended: " << m_records_appended.load() << std::endl;
+        std::cout << "Segments sealed: " << m_segments_sealed.load() << std::endl;
+        std::cout << "Segments compacted: " << m_segments_compacted.load()
+                  << " (records copied: " << m_records_copied.load()
+                  << ", bytes reclaimed: " << m_bytes_reclaimed.load() << ")" << std::endl;
+        std::cout << "Write errors: " << m_write_errors.load() << std::endl;
+        std::cout << "================================" << std::endl;
+    }
+
+private:
+    // Index slot: locations of the current records plus a copy of the
+    // sighting state, so appends never read a segment
+    struct Slot {
+        uint8_t info_hash[20];
+        uint16_t flags;
+        uint8_t source;
+        uint8_t reserved;
+        uint32_t sighting_segment;  // 0: no record (segment ids start at 1)
+        uint32_t sighting_record;
+        uint32_t metadata_segment;
+        uint32_t metadata_record;
+        uint32_t first_seen;
+        uint32_t last_seen;
+        uint32_t sightings;
+        uint32_t peer_count;
+        uint8_t padding[8];
+    };
+
+    static_assert(sizeof(Slot) == 64, "index slots are one cache line");
+
+    struct IndexHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t slot_size;
+        uint64_t capacity;
+        uint64_t count;
+        uint32_t clean;             // Closed cleanly; otherwise rebuild
+        uint32_t reserved[7];
+    };
+
+    static_assert(sizeof(IndexHeader) == segment_detail::INDEX_HEADER_SIZE, "index header size");
+
+    struct SegmentHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t id;
+        uint8_t reserved[segment_detail::SEGMENT_HEADER_SIZE - 20];
+    };
+
+    struct SegmentInfo {
+        uint32_t records = 0;
+        uint32_t live = 0;
+    };
+
+    static bool occupied(const Slot& slot) {
+        return slot.sighting_segment != 0 || slot.metadata_segment != 0;
+    }
+
+    IndexHeader& index_header() {
+        return *static_cast<IndexHeader*>(m_index_map);
+    }
+
+    std::string segment_path(uint32_t id) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "segment-%08u.dat", id);
+        return m_config.directory + "/" + name;
+    }
+
+    std::string index_path() const {
+        return m_config.directory + "/index.bin";
+    }
+
+    // --- Index ---
+
+    // Slot positions are persisted, so this must use the fixed hash
+    size_t probe_start(const InfoHash& hash) const {
+        return StableInfoHashHasher()(hash) & (m_capacity - 1);
+    }
+
+    const Slot* find(const InfoHash& hash) const {
+        for (size_t i = probe_start(hash);; i = (i + 1) & (m_capacity - 1)) {
+            const Slot& slot = m_slots[i];
+            if (!occupied(slot)) return nullptr;
+            if (std::memcmp(slot.info_hash, hash.bytes.data(), InfoHash::SIZE) == 0) return &slot;
+        }
+    }
+
+    // A new slot stays unoccupied until its first record is appended, so
+    // callers must append before releasing the lock
+    Slot& find_or_insert(const InfoHash& hash) {
+        if ((m_count + 1) * 4 > m_capacity * 3) {
+            grow_index();
+        }
+        for (size_t i = probe_start(hash);; i = (i + 1) & (m_capacity - 1)) {
+            Slot& slot = m_slots[i];
+            if (!occupied(slot)) {
+                std::memset(&slot, 0, sizeof(slot));
+                std::memcpy(slot.info_hash, hash.bytes.data(), InfoHash::SIZE);
+                m_count++;
+                index_header().count = m_count;
+                return slot;
+            }
+            if (std::memcmp(slot.info_hash, hash.bytes.data(), InfoHash::SIZE) == 0) return slot;
+        }
+    }
+
+    bool map_index(const std::string& path, uint64_t capacity, bool create, std::string& error) {
+        size_t size = segment_detail::INDEX_HEADER_SIZE + capacity * sizeof(Slot);
+        int fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        if (create && ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            error = "cannot size " + path + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            error = "cannot map " + path + ": " + std::strerror(errno);
+            return false;
+        }
+
+        if (m_index_map) {
+            ::munmap(m_index_map, m_index_size);
+        }
+        m_index_map = map;
+        m_index_size = size;
+        m_slots = reinterpret_cast<Slot*>(static_cast<char*>(map) + segment_detail::INDEX_HEADER_SIZE);
+        m_capacity = capacity;
+        if (create) {
+            IndexHeader& header = index_header();
+            std::memcpy(header.magic, segment_detail::INDEX_MAGIC, sizeof(header.magic));
+            header.version = segment_detail::VERSION;
+            header.slot_size = sizeof(Slot);
+            header.capacity = capacity;
+            header.count = 0;
+            header.clean = 0;
+            m_count = 0;
+        }
+        return true;
+    }
+
+    bool open_index(std::string& error) {
+        std::string path = index_path();
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && static_cast<size_t>(st.st_size) >= segment_detail::INDEX_HEADER_SIZE) {
+            IndexHeader header{};
+            int fd = ::open(path.c_str(), O_RDONLY);
+            bool read_ok = fd >= 0 && ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+            if (fd >= 0) ::close(fd);
+
+            bool usable = read_ok && header.clean == 1 &&
+                std::memcmp(header.magic, segment_detail::INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == segment_detail::VERSION && header.slot_size == sizeof(Slot) &&
+                header.capacity >= 16 && (header.capacity & (header.capacity - 1)) == 0 &&
+                static_cast<size_t>(st.st_size) == segment_detail::INDEX_HEADER_SIZE + header.capacity * sizeof(Slot);
+            if (usable && map_index(path, header.capacity, false, error)) {
+                m_count = header.count;
+                count_live();
+                // Dirty until the next clean close
+                index_header().clean = 0;
+                ::msync(m_index_map, segment_detail::INDEX_HEADER_SIZE, MS_SYNC);
+                return true;
+            }
+        }
+        return rebuild_index(error);
+    }
+
+    size_t index_capacity_for(size_t entries) const {
+        size_t capacity = 16;
+        while (capacity < m_config.initial_index_slots || entries * 4 > capacity * 3) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    // Replay every segment in write order; the last record of each type
+    // for a hash is its current one
+    bool rebuild_index(std::string& error) {
+        uint64_t total_records = 0;
+        for (const auto& pair : m_segments) {
+            total_records += pair.second.records;
+        }
+        if (!map_index(index_path(), index_capacity_for(static_cast<size_t>(total_records)), true, error)) {
+            return false;
+        }
+
+        for (auto& pair : m_segments) {
+            pair.second.live = 0;
+            scan_segment(pair.first, [this, &pair](uint32_t record_index, const SegmentRecord& record) {
+                InfoHash hash = InfoHash::from_bytes(record.info_hash);
+                Slot& slot = find_or_insert(hash);
+                if (record.type == static_cast<uint8_t>(SegmentRecordType::SIGHTING)) {
+                    slot.flags = record.flags;
+                    slot.source = record.source;
+                    slot.first_seen = record.first_seen;
+                    slot.last_seen = record.last_seen;
+                    slot.sightings = record.sightings;
+                    slot.peer_count = record.peer_count;
+                    slot.sighting_segment = pair.first;
+                    slot.sighting_record = record_index;
+                } else {
+                    slot.metadata_segment = pair.first;
+                    slot.metadata_record = record_index;
+                }
+            });
+        }
+        count_live();
+        m_index_rebuilt = true;
+        return true;
+    }
+
+    void count_live() {
+        for (auto& pair : m_segments) {
+            pair.second.live = 0;
+        }
+        for (size_t i = 0; i < m_capacity; ++i) {
+            const Slot& slot = m_slots[i];
+            for (uint32_t segment : {slot.sighting_segment, slot.metadata_segment}) {
+                auto it = m_segments.find(segment);
+                if (it != m_segments.end()) it->second.live++;
+            }
+        }
+    }
+
+    void grow_index() {
+        std::vector<Slot> occupied_slots;
+        occupied_slots.reserve(m_count);
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (occupied(m_slots[i])) occupied_slots.push_back(m_slots[i]);
+        }
+
+        std::string error;
+        std::string temp = index_path() + ".tmp";
+        size_t old_capacity = m_capacity;
+        void* old_map = m_index_map;
+        size_t old_size = m_index_size;
+        m_index_map = nullptr; // Keep the old mapping until the new one is in place
+        if (!map_index(temp, old_capacity * 2, true, error)) {
+            m_index_map = old_map;
+            m_index_size = old_size;
+            m_slots = reinterpret_cast<Slot*>(static_cast<char*>(old_map) + segment_detail::INDEX_HEADER_SIZE);
+            m_capacity = old_capacity;
+            m_write_errors++;
+            log("Index resize failed: " + error);
+            return;
+        }
+        ::munmap(old_map, old_size);
+
+        for (const Slot& slot : occupied_slots) {
+            InfoHash hash = InfoHash::from_bytes(slot.info_hash);
+            for (size_t i = probe_start(hash);; i = (i + 1) & (m_capacity - 1)) {
+                if (!occupied(m_slots[i])) {
+                    m_slots[i] = slot;
+                    break;
+                }
+            }
+        }
+        m_count = occupied_slots.size();
+        index_header().count = m_count;
+        std::rename(temp.c_str(), index_path().c_str());
+    }
+
+    // --- Segments ---
+
+    bool load_segments(std::string& error) {
+        DIR* dir = ::opendir(m_config.directory.c_str());
+        if (!dir) {
+            error = "cannot read " + m_config.directory + ": " + std::strerror(errno);
+            return false;
+        }
+        while (struct dirent* entry = ::readdir(dir)) {
+            unsigned id = 0;
+            char tail = 0;
+            if (std::sscanf(entry->d_name, "segment-%8u.da%c", &id, &tail) == 2 && tail == 't' && id > 0) {
+                m_segments[id] = SegmentInfo();
+            }
+        }
+        ::closedir(dir);
+
+        // Drop torn tails; a record with a bad checksum ends its segment
+        for (auto& pair : m_segments) {
+            uint32_t valid = 0;
+            scan_segment(pair.first, [&valid](uint32_t record_index, const SegmentRecord&) {
+                valid = record_index + 1;
+            });
+            std::string path = segment_path(pair.first);
+            struct stat st;
+            off_t expected = static_cast<off_t>(segment_detail::SEGMENT_HEADER_SIZE + uint64_t(valid) * segment_detail::RECORD_SIZE);
+            if (::stat(path.c_str(), &st) == 0 && st.st_size != expected) {
+                log("Truncating " + path + " to " + std::to_string(valid) + " records");
+                if (::truncate(path.c_str(), expected) != 0) {
+                    m_write_errors++;
+                }
+            }
+            pair.second.records = valid;
+        }
+        return true;
+    }
+
+    // Call visit(record_index, record) for each valid record, in order
+    template <typename Visitor>
+    void scan_segment(uint32_t id, Visitor&& visit) const {
+        int fd = ::open(segment_path(id).c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st;
+        SegmentHeader header;
+        if (::fstat(fd, &st) != 0 ||
+            ::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+            std::memcmp(header.magic, segment_detail::SEGMENT_MAGIC, sizeof(header.magic)) != 0 ||
+            header.record_size != segment_detail::RECORD_SIZE) {
+            ::close(fd);
+            return;
+        }
+
+        size_t length = static_cast<size_t>(st.st_size);
+        void* map = length > 0 ? ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (map == MAP_FAILED) return;
+
+        const char* base = static_cast<const char*>(map);
+        size_t count = (length - segment_detail::SEGMENT_HEADER_SIZE) / segment_detail::RECORD_SIZE;
+        for (size_t i = 0; i < count; ++i) {
+            SegmentRecord record;
+            std::memcpy(&record, base + segment_detail::SEGMENT_HEADER_SIZE + i * segment_detail::RECORD_SIZE, sizeof(record));
+            if (record.checksum != segment_detail::record_checksum(record)) break;
+            visit(static_cast<uint32_t>(i), record);
+        }
+        ::munmap(map, length);
+    }
+
+    bool open_active(std::string& error) {
+        if (!m_segments.empty() && m_segments.rbegin()->second.records < m_segment_records) {
+            m_active_id = m_segments.rbegin()->first;
+            m_active_fd = ::open(segment_path(m_active_id).c_str(), O_RDWR | O_APPEND);
+            if (m_active_fd < 0) {
+                error = "cannot open " + segment_path(m_active_id) + ": " + std::strerror(errno);
+                return false;
+            }
+            m_flushed_records = m_segments[m_active_id].records;
+            return true;
+        }
+        return start_segment(m_segments.empty() ? 1 : m_segments.rbegin()->first + 1, error);
+    }
+
+    bool start_segment(uint32_t id, std::string& error) {
+        std::string path = segment_path(id);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (fd < 0) {
+            error = "cannot create " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        SegmentHeader header{};
+        std::memcpy(header.magic, segment_detail::SEGMENT_MAGIC, sizeof(header.magic));
+        header.version = segment_detail::VERSION;
+        header.record_size = segment_detail::RECORD_SIZE;
+        header.id = id;
+        if (::write(fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header))) {
+            error = "cannot write " + path + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+
+        m_active_id = id;
+        m_active_fd = fd;
+        m_flushed_records = 0;
+        m_segments[id] = SegmentInfo();
+        return true;
+    }
+
+    void seal_active() {
+        sync_locked();
+        ::close(m_active_fd);
+        m_active_fd = -1;
+        m_segments_sealed++;
+
+        std::string error;
+        if (!start_segment(m_active_id + 1, error)) {
+            m_write_errors++;
+            log("Cannot start a new segment: " + error);
+        }
+    }
+
+    // --- Records ---
+
+    void append_sighting(Slot& slot) {
+        SegmentRecord record{};
+        std::memcpy(record.info_hash, slot.info_hash, sizeof(record.info_hash));
+        record.type = static_cast<uint8_t>(SegmentRecordType::SIGHTING);
+        record.source = slot.source;
+        record.flags = slot.flags;
+        record.first_seen = slot.first_seen;
+        record.last_seen = slot.last_seen;
+        record.sightings = slot.sightings;
+        record.peer_count = slot.peer_count;
+
+        release(slot.sighting_segment);
+        append(record, slot.sighting_segment, slot.sighting_record);
+    }
+
+    // The record a slot pointed at is now dead
+    void release(uint32_t segment) {
+        if (segment == 0) return;
+        auto it = m_segments.find(segment);
+        if (it != m_segments.end() && it->second.live > 0) {
+            it->second.live--;
+        }
+    }
+
+    void append(SegmentRecord& record, uint32_t& segment, uint32_t& record_index) {
+        if (m_active_fd < 0) {
+            m_write_errors++;
+            return;
+        }
+        SegmentInfo& active = m_segments[m_active_id];
+        record.checksum = segment_detail::record_checksum(record);
+        m_pending.append(reinterpret_cast<const char*>(&record), sizeof(record));
+
+        segment = m_active_id;
+        record_index = active.records++;
+        active.live++;
+        m_records_appended++;
+
+        if (m_pending.size() >= segment_detail::WRITE_BUFFER_BYTES) {
+            flush_locked();
+        }
+        if (active.records >= m_segment_records) {
+            seal_active();
+        }
+    }
+
+    bool read_record(uint32_t segment, uint32_t record_index, SegmentRecord& out) const {
+        if (segment == m_active_id && record_index >= m_flushed_records) {
+            size_t offset = static_cast<size_t>(record_index - m_flushed_records) * segment_detail::RECORD_SIZE;
+            if (offset + sizeof(out) > m_pending.size()) return false;
+            std::memcpy(&out, m_pending.data() + offset, sizeof(out));
+            return true;
+        }
+
+        off_t offset = static_cast<off_t>(segment_detail::SEGMENT_HEADER_SIZE + uint64_t(record_index) * segment_detail::RECORD_SIZE);
+        bool ok = false;
+        if (segment == m_active_id) {
+            ok = ::pread(m_active_fd, &out, sizeof(out), offset) == static_cast<ssize_t>(sizeof(out));
+        } else {
+            int fd = ::open(segment_path(segment).c_str(), O_RDONLY);
+            if (fd >= 0) {
+                ok = ::pread(fd, &out, sizeof(out), offset) == static_cast<ssize_t>(sizeof(out));
+                ::close(fd);
+            }
+        }
+        return ok && out.checksum == segment_detail::record_checksum(out);
+    }
+
+    bool flush_locked() {
+        size_t written = 0;
+        while (written < m_pending.size()) {
+            ssize_t result = ::write(m_active_fd, m_pending.data() + written, m_pending.size() - written);
+            if (result < 0) {
+                if (errno == EINTR) continue;
+                m_write_errors++;
+                log("Segment write failed: " + std::string(std::strerror(errno)));
+                // Cut a partly written record off the file and keep the
+                // rest buffered; the next flush retries it
+                size_t whole = written - written % segment_detail::RECORD_SIZE;
+                m_flushed_records += static_cast<uint32_t>(whole / segment_detail::RECORD_SIZE);
+                if (whole != written &&
+                    ::ftruncate(m_active_fd, static_cast<off_t>(segment_detail::SEGMENT_HEADER_SIZE +
+                                uint64_t(m_flushed_records) * segment_detail::RECORD_SIZE)) != 0) {
+                    m_write_errors++;
+                }
+                m_pending.erase(0, whole);
+                return false;
+            }
+            written += static_cast<size_t>(result);
+        }
+        m_flushed_records += static_cast<uint32_t>(m_pending.size() / segment_detail::RECORD_SIZE);
+        m_pending.clear();
+        return true;
+    }
+
+    bool sync_locked() {
+        if (m_active_fd < 0) return false;
+        bool ok = flush_locked();
+        if (::fdatasync(m_active_fd) != 0) {
+            m_write_errors++;
+            ok = false;
+        }
+        if (m_index_map) {
+            ::msync(m_index_map, m_index_size, MS_ASYNC);
+        }
+        return ok;
+    }
+
+    // --- Maintenance ---
+
+    // Copy the live records of a sealed segment to the active one, then
+    // delete it once the copies are on disk
+    bool compact_segment(uint32_t id) {
+        std::vector<std::pair<uint32_t, SegmentRecord>> records;
+        scan_segment(id, [&records](uint32_t record_index, const SegmentRecord& record) {
+            records.emplace_back(record_index, record);
+        });
+
+        for (size_t start = 0; start < records.size(); start += segment_detail::COMPACTION_CHUNK) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t end = std::min(records.size(), start + segment_detail::COMPACTION_CHUNK);
+            for (size_t i = start; i < end; ++i) {
+                uint32_t record_index = records[i].first;
+                SegmentRecord& record = records[i].second;
+                const Slot* found = find(InfoHash::from_bytes(record.info_hash));
+                if (!found) continue;
+                Slot& slot = const_cast<Slot&>(*found);
+
+                bool sighting = record.type == static_cast<uint8_t>(SegmentRecordType::SIGHTING);
+                uint32_t& segment = sighting ? slot.sighting_segment : slot.metadata_segment;
+                uint32_t& index = sighting ? slot.sighting_record : slot.metadata_record;
+                if (segment != id || index != record_index) continue; // Superseded
+
+                release(segment);
+                append(record, segment, index);
+                m_records_copied++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_segments.find(id);
+        if (it == m_segments.end() || it->second.live != 0 || !sync_locked()) {
+            return false;
+        }
+
+        std::string path = segment_path(id);
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0) {
+            m_bytes_reclaimed += static_cast<uint64_t>(st.st_size);
+        }
+        ::unlink(path.c_str());
+        m_segments.erase(it);
+        m_segments_compacted++;
+        log("Compacted " + path + " (" + std::to_string(records.size()) + " records scanned)");
+        return true;
+    }
+
+    void maintenance_loop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop_requested) {
+            m_maintenance_cv.wait_for(lock, m_config.maintenance_interval, [this]() { return m_stop_requested.load(); });
+            if (m_stop_requested) break;
+
+            sync_locked();
+            lock.unlock();
+            compact();
+            lock.lock();
+        }
+    }
+
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[SegmentStore] " + message);
+        }
+    }
+
+    SegmentStoreConfig m_config;
+    std::function<void(const std::string&)> m_log_callback;
+    const uint32_t m_segment_records;
+
+    mutable std::mutex m_mutex;
+    bool m_open;
+    std::atomic<bool> m_stop_requested;
+    std::condition_variable m_maintenance_cv;
+    std::thread m_maintenance_thread;
+
+    // Index
+    void* m_index_map;
+    size_t m_index_size;
+    Slot* m_slots;
+    size_t m_capacity;
+    size_t m_count;
+
+    // Segments (ids ascending = write order); the last one is active
+    std::map<uint32_t, SegmentInfo> m_segments;
+    uint32_t m_active_id;
+    int m_active_fd;
+    uint32_t m_flushed_records;  // Active records already written to the file
+    std::string m_pending;       // Appended records not yet written
+
+    // Statistics
+    std::atomic<uint64_t> m_records_appended;
+    std::atomic<uint64_t> m_records_copied;
+    std::atomic<uint64_t> m_segments_sealed;
+    std::atomic<uint64_t> m_segments_compacted;
+    std::atomic<uint64_t> m_bytes_reclaimed;
+    std::atomic<uint64_t> m_write_errors;
+    bool m_index_rebuilt;
+};
+
+} // namespace dht_crawler
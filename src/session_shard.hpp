@@ -0,0 +1,156 @@
+/*
+ * Session Shards for Multi-Core Crawling
+ *
+ * One libtorrent session carries all of its DHT traffic on a single network
+ * thread and all of its alerts through a single queue, so a crawl on one
+ * session stops scaling after a few cores no matter how many query workers
+ * feed it. A SessionShard is one extra session with its own listen port,
+ * its own DHT node, its own alert thread (an AlertDispatcher run loop) and
+ * its own query workers. The workers draw their targets from one slice of
+ * the 160-bit keyspace, so shards spread over the DHT instead of repeating
+ * each other's lookups.
+ *
+ * The crawler registers its sighting handlers on every shard's dispatcher.
+ * What the shards share is already safe to use concurrently: the lock-free
+ * query dedup filter, the MPSC decode stage of the ingest pipeline and the
+ * sharded discovery store behind it.
+ *
+ * libtorrent derives a session's node ID from its external address (BEP 42)
+ * and picks a fresh one per session, so every shard has a distinct ID.
+ * Shards are seeded with the primary session's routing table nodes, never
+ * its node IDs.
+ */
+
+#pragma once
+
+#ifndef DISABLE_LIBTORRENT
+#include <libtorrent/session.hpp>
+#include <libtorrent/session_params.hpp>
+#include <libtorrent/disabled_disk_io.hpp>
+#include <libtorrent/alert_types.hpp>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "alert_dispatcher.hpp"
+#include "concurrent_dht_manager.hpp"
+#include "info_hash.hpp"
+#include "query_dedup_filter.hpp"
+
+#ifndef DISABLE_LIBTORRENT
+
+namespace dht_crawler {
+
+struct SessionShardConfig {
+    uint32_t index = 1;         // Shard number; the primary session is shard 0
+    uint32_t count = 1;         // Total sessions, primary included
+    int listen_port = 6882;     // UDP/TCP port of this shard's session
+    int num_workers = 4;        // Query workers feeding this shard
+};
+
+class SessionShard {
+public:
+    SessionShard(const SessionShardConfig& config, lt::session_params params,
+                 std::shared_ptr<QueryDedupFilter> query_filter,
+                 std::function<void(const std::string&)> log_callback = nullptr)
+        : m_config(config)
+        , m_log_callback(log_callback)
+        , m_running(false)
+        , m_bootstrapped(false)
+    {
+        params.settings.set_str(lt::settings_pack::listen_interfaces,
+                                "0.0.0.0:" + std::to_string(config.listen_port));
+        // A shard only crawls the DHT and never holds a torrent, so it gets
+        // no storage or disk threads
+        params.disk_io_constructor = lt::disabled_disk_io_constructor;
+        m_session = std::make_unique<lt::session>(std::move(params));
+        m_dispatcher = std::make_unique<AlertDispatcher>(m_session.get(), log_callback);
+        m_dispatcher->on<lt::dht_bootstrap_alert>([this](lt::dht_bootstrap_alert*) {
+            if (!m_bootstrapped.exchange(true)) {
+                log("DHT bootstrap completed");
+            }
+        });
+
+        m_queries = std::make_unique<ConcurrentDHTManager>(m_session.get(), config.num_workers, 1000);
+        m_queries->set_query_filter(query_filter);
+        m_queries->set_keyspace(KeyspaceSlice{config.index, config.count});
+    }
+
+    ~SessionShard() {
+        stop();
+    }
+
+    SessionShard(const SessionShard&) = delete;
+    SessionShard& operator=(const SessionShard&) = delete;
+
+    /**
+     * Handlers must be registered before start(); the dispatcher is only
+     * used by the shard's own alert thread after that
+     */
+    AlertDispatcher& dispatcher() { return *m_dispatcher; }
+    ConcurrentDHTManager& queries() { return *m_queries; }
+    lt::session& session() { return *m_session; }
+
+    void start() {
+        if (m_running.exchange(true)) return;
+        m_dispatcher->apply_alert_mask();
+        m_alert_thread = std::thread([this]() {
+            m_dispatcher->run([this]() { return m_running.load(); });
+        });
+        m_queries->start();
+        log("Started on port " + std::to_string(m_config.listen_port));
+    }
+
+    // Stops query generation first, then the alert thread
+    void stop() {
+        if (!m_running.load()) return;
+        m_queries->stop();
+        m_running = false;
+        if (m_alert_thread.joinable()) {
+            m_alert_thread.join();
+        }
+    }
+
+    uint32_t index() const { return m_config.index; }
+    int listen_port() const { return m_config.listen_port; }
+    bool bootstrapped() const { return m_bootstrapped.load(); }
+    int get_total_queries_sent() const { return m_queries->get_total_queries_sent(); }
+
+    void print_statistics() const {
+        KeyspaceSlice slice = m_queries->get_keyspace();
+        std::cout << "=== Session Shard " << m_config.index << "/" << m_config.count << " Statistics ===" << std::endl;
+        std::cout << "Port: " << m_config.listen_port << (m_bootstrapped ? " (bootstrapped)" : " (bootstrapping)") << std::endl;
+        std::cout << "Keyspace: " << std::hex << slice.begin() << "-" << (slice.end() - 1) << std::dec << " (top 32 bits)" << std::endl;
+        std::cout << "Queries sent: " << m_queries->get_total_queries_sent() << std::endl;
+        std::cout << "Alerts dispatched: " << m_dispatcher->get_alerts_dispatched() << std::endl;
+        std::cout << "==========================================" << std::endl;
+    }
+
+private:
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[SessionShard " + std::to_string(m_config.index) + "] " + message);
+        }
+    }
+
+    SessionShardConfig m_config;
+    std::function<void(const std::string&)> m_log_callback;
+
+    std::unique_ptr<lt::session> m_session;
+    std::unique_ptr<AlertDispatcher> m_dispatcher;
+    std::unique_ptr<ConcurrentDHTManager> m_queries;
+    std::thread m_alert_thread;
+
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_bootstrapped;
+};
+
+} // namespace dht_crawler
+
+#endif // DISABLE_LIBTORRENT
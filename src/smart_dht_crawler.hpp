@@ -16,6 +16,9 @@
 #include <libtorrent/alert_types.hpp>
 #endif
 
+#include "info_hash.hpp"
+#include "peer_endpoint.hpp"
+
 #include <vector>
 #include <string>
 #include <map>
@@ -159,7 +162,7 @@ public:
         std::string source;  // "incoming_query", "peer_reply", "announce"
         std::chrono::steady_clock::time_point observed_time;
         int peer_count;
-        std::vector<std::string> peer_addresses;
+        PeerEndpointList peer_addresses;
     };
 
     PassiveObservationManager(std::function<void(const std::string&)> log_callback = nullptr)
@@ -171,7 +174,7 @@ public:
 
     // Record observed infohash from incoming DHT traffic
     void record_observation(const std::string& infohash, const std::string& source, 
-                          int peer_count = 0, const std::vector<std::string>& peers = {}) {
+                          int peer_count = 0, const PeerEndpointList& peers = {}) {
         std::lock_guard<std::mutex> lock(m_observations_mutex);
         
         ObservedInfo info;
@@ -330,13 +333,9 @@ public:
         
         // Query high-priority infohashes first
         for (const auto& hash_str : priority_hashes) {
-            if (hash_str.length() == 40) {  // Valid hex hash
-                // Convert hex to binary
-                lt::sha1_hash target;
-                for (int i = 0; i < 20; ++i) {
-                    std::string byte_str = hash_str.substr(i * 2, 2);
-                    target[i] = static_cast<unsigned char>(std::stoi(byte_str, nullptr, 16));
-                }
+            InfoHash hash;
+            if (InfoHash::from_hex(hash_str, hash)) {  // Valid hex hash
+                lt::sha1_hash target = hash.to_sha1();
                 
                 if (m_rate_limiter.send_query(target, "get_peers")) {
                     log("Sent smart query for priority hash: " + hash_str.substr(0, 8) + "...");
@@ -361,7 +360,7 @@ public:
 
     // Record observation from incoming traffic
     void record_incoming_observation(const std::string& infohash, const std::string& source,
-                                   int peer_count = 0, const std::vector<std::string>& peers = {}) {
+                                   int peer_count = 0, const PeerEndpointList& peers = {}) {
         m_passive_observer.record_observation(infohash, source, peer_count, peers);
     }
 
@@ -0,0 +1,334 @@
+/*
+ * Hierarchical Timer Wheel
+ *
+ * Deadlines are kept in four levels of 256 slots; level n holds timers due
+ * within 256^(n+1) ticks of the current tick. Scheduling links a node into
+ * one slot, cancelling unlinks it, and each tick empties one level-0 slot.
+ * A timer further out sits in a coarser level and moves down one level each
+ * time the level below wraps, so it is touched at most four times over its
+ * life. All three operations are O(1) however many timers are live, where
+ * scanning a map of start times costs O(n) on every check. A deadline past
+ * the top level's reach (2^32 ticks) is parked in its farthest slot and
+ * placed again from its real deadline each time that slot cascades.
+ *
+ * Time is a steady clock quantized to ticks (the tick length is chosen per
+ * wheel). A timer fires on the first advance() at or after the tick its
+ * deadline rounds up to, never early. Nodes live in a slab with a free list
+ * and are named by id (slab index + generation), so cancelling a timer that
+ * already fired or was cancelled is a harmless no-op.
+ *
+ * The wheel does no locking; its owner serializes access. Handlers run from
+ * advance() may schedule and cancel timers but must not call advance() or
+ * clear().
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace dht_crawler {
+
+template <typename Payload>
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint64_t;
+
+    static constexpr TimerId INVALID_TIMER = 0;
+
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10),
+                        Clock::time_point start = Clock::now())
+        : m_tick(std::max(tick, std::chrono::milliseconds(1)))
+        , m_start(start)
+        , m_current(0)
+        , m_size(0)
+        , m_free_head(NIL)
+        , m_scheduled(0)
+        , m_cancelled(0)
+        , m_expired(0)
+        , m_cascaded(0) {
+        m_heads.fill(NIL);
+        m_level_size.fill(0);
+    }
+
+    /**
+     * Fire payload once, delay from now
+     */
+    TimerId schedule(std::chrono::milliseconds delay, Payload payload) {
+        return schedule_at(Clock::now() + delay, std::move(payload));
+    }
+
+    /**
+     * Fire payload once at deadline (a deadline already passed fires on
+     * the next tick)
+     */
+    TimerId schedule_at(Clock::time_point deadline, Payload payload) {
+        uint64_t tick = std::max(tick_at_or_after(deadline), m_current + 1);
+        uint32_t index = allocate();
+        Node& node = m_nodes[index];
+        node.payload = std::move(payload);
+        node.deadline = tick;
+        link(index);
+        m_size++;
+        m_scheduled++;
+        return (static_cast<uint64_t>(node.generation) << 32) | index;
+    }
+
+    /**
+     * @return false if the timer already fired or was cancelled
+     */
+    bool cancel(TimerId id) {
+        uint32_t index = static_cast<uint32_t>(id);
+        if (index >= m_nodes.size()) return false;
+        Node& node = m_nodes[index];
+        if (node.generation != static_cast<uint32_t>(id >> 32) || node.state == FREE || node.cancelled) {
+            return false;
+        }
+
+        if (node.state == EXPIRING) {
+            node.cancelled = true; // Detached by advance(); it skips the node
+        } else {
+            unlink(index);
+            release(index);
+        }
+        m_size--;
+        m_cancelled++;
+        return true;
+    }
+
+    /**
+     * Move the wheel to now, calling handler(Payload&) for every timer that
+     * came due, in tick order
+     * @return Number of timers fired
+     */
+    template <typename Handler>
+    size_t advance(Clock::time_point now, Handler&& handler) {
+        uint64_t target = tick_at(now);
+        size_t fired = 0;
+
+        while (m_current < target) {
+            if (m_size == 0) {
+                m_current = target;
+                break;
+            }
+            if (m_level_size[0] == 0) {
+                // Nothing can fire before the next cascade; skip to it
+                m_current = std::min(target - 1, m_current | SLOT_MASK);
+            }
+
+            ++m_current;
+            if ((m_current & SLOT_MASK) == 0) {
+                cascade();
+            }
+            fired += expire(static_cast<uint32_t>(m_current & SLOT_MASK), handler);
+        }
+        return fired;
+    }
+
+    /**
+     * Time from now until the next timer can fire, capped at max_wait. It is
+     * never later than the next cascade, so a caller sleeping on it may
+     * wake early but never late.
+     */
+    std::chrono::milliseconds time_until_next(Clock::time_point now, std::chrono::milliseconds max_wait) const {
+        if (m_size == 0) return max_wait;
+
+        // Coarser timers can come due at the next cascade, so level 0 only
+        // needs scanning up to it
+        uint64_t next = (m_current | SLOT_MASK) + 1;
+        if (m_level_size[0] > 0) {
+            for (uint64_t tick = m_current + 1; tick < next; ++tick) {
+                if (m_heads[tick & SLOT_MASK] != NIL) {
+                    next = tick;
+                    break;
+                }
+            }
+        }
+
+        auto due = m_start + m_tick * static_cast<int64_t>(next);
+        if (due <= now) return std::chrono::milliseconds(0);
+        return std::min(max_wait, std::chrono::ceil<std::chrono::milliseconds>(due - now));
+    }
+
+    /**
+     * Drop every timer without firing it
+     */
+    void clear() {
+        for (uint32_t index = 0; index < m_nodes.size(); ++index) {
+            if (m_nodes[index].state != FREE) {
+                release(index);
+            }
+        }
+        m_heads.fill(NIL);
+        m_level_size.fill(0);
+        m_size = 0;
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    std::chrono::milliseconds tick() const { return m_tick; }
+
+    uint64_t get_scheduled() const { return m_scheduled; }
+    uint64_t get_cancelled() const { return m_cancelled; }
+    uint64_t get_expired() const { return m_expired; }
+    uint64_t get_cascaded() const { return m_cascaded; }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_DELTA = (1ull << (LEVELS * SLOT_BITS)) - 1;
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    enum State : uint8_t { FREE, LINKED, EXPIRING };
+
+    struct Node {
+        Payload payload{};
+        uint64_t deadline = 0;   // Tick
+        uint32_t prev = NIL;
+        uint32_t next = NIL;     // Also the free list link
+        uint32_t generation = 1; // Never 0, so no id equals INVALID_TIMER
+        uint16_t bucket = 0;     // level * SLOTS + slot
+        State state = FREE;
+        bool cancelled = false;  // Cancelled while EXPIRING
+    };
+
+    uint64_t tick_at(Clock::time_point time) const {
+        if (time <= m_start) return 0;
+        return static_cast<uint64_t>((time - m_start) / m_tick);
+    }
+
+    uint64_t tick_at_or_after(Clock::time_point time) const {
+        if (time <= m_start) return 0;
+        auto elapsed = time - m_start;
+        uint64_t ticks = static_cast<uint64_t>(elapsed / m_tick);
+        return elapsed % m_tick == Clock::duration::zero() ? ticks : ticks + 1;
+    }
+
+    uint32_t allocate() {
+        if (m_free_head != NIL) {
+            uint32_t index = m_free_head;
+            m_free_head = m_nodes[index].next;
+            return index;
+        }
+        m_nodes.emplace_back();
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+
+    void release(uint32_t index) {
+        Node& node = m_nodes[index];
+        node.payload = Payload{};
+        node.state = FREE;
+        node.cancelled = false;
+        node.prev = NIL;
+        if (++node.generation == 0) node.generation = 1;
+        node.next = m_free_head;
+        m_free_head = index;
+    }
+
+    // Place a node by how far its deadline is from the current tick
+    void link(uint32_t index) {
+        Node& node = m_nodes[index];
+        uint64_t target = std::min(node.deadline, m_current + MAX_DELTA);
+        uint64_t delta = target > m_current ? target - m_current : 0;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (1ull << ((level + 1) * SLOT_BITS))) {
+            ++level;
+        }
+        uint32_t bucket = level * SLOTS + static_cast<uint32_t>((target >> (level * SLOT_BITS)) & SLOT_MASK);
+
+        node.bucket = static_cast<uint16_t>(bucket);
+        node.state = LINKED;
+        node.prev = NIL;
+        node.next = m_heads[bucket];
+        if (node.next != NIL) m_nodes[node.next].prev = index;
+        m_heads[bucket] = index;
+        m_level_size[level]++;
+    }
+
+    void unlink(uint32_t index) {
+        Node& node = m_nodes[index];
+        if (node.prev != NIL) {
+            m_nodes[node.prev].next = node.next;
+        } else {
+            m_heads[node.bucket] = node.next;
+        }
+        if (node.next != NIL) m_nodes[node.next].prev = node.prev;
+        m_level_size[node.bucket / SLOTS]--;
+    }
+
+    // Take a whole slot's list out of the wheel
+    uint32_t detach(uint32_t bucket) {
+        uint32_t head = m_heads[bucket];
+        m_heads[bucket] = NIL;
+        for (uint32_t index = head; index != NIL; index = m_nodes[index].next) {
+            m_level_size[bucket / SLOTS]--;
+        }
+        return head;
+    }
+
+    // The level below wrapped: redistribute the slots of the levels above
+    // that now cover the next stretch of ticks
+    void cascade() {
+        for (int level = 1; level < LEVELS; ++level) {
+            uint32_t slot = static_cast<uint32_t>((m_current >> (level * SLOT_BITS)) & SLOT_MASK);
+            uint32_t index = detach(level * SLOTS + slot);
+            while (index != NIL) {
+                uint32_t next = m_nodes[index].next;
+                link(index);
+                m_cascaded++;
+                index = next;
+            }
+            if (slot != 0) break;
+        }
+    }
+
+    template <typename Handler>
+    size_t expire(uint32_t slot, Handler& handler) {
+        uint32_t index = detach(slot);
+        for (uint32_t i = index; i != NIL; i = m_nodes[i].next) {
+            m_nodes[i].state = EXPIRING;
+        }
+
+        size_t fired = 0;
+        while (index != NIL) {
+            Node& node = m_nodes[index];
+            uint32_t next = node.next;
+            bool cancelled = node.cancelled;
+            Payload payload = std::move(node.payload);
+            release(index);
+
+            if (!cancelled) {
+                m_size--;
+                m_expired++;
+                fired++;
+                handler(payload);
+            }
+            index = next;
+        }
+        return fired;
+    }
+
+    std::chrono::milliseconds m_tick;
+    Clock::time_point m_start;
+    uint64_t m_current;
+    size_t m_size;
+
+    std::vector<Node> m_nodes;
+    uint32_t m_free_head;
+    std::array<uint32_t, LEVELS * SLOTS> m_heads;
+    std::array<size_t, LEVELS> m_level_size;
+
+    uint64_t m_scheduled;
+    uint64_t m_cancelled;
+    uint64_t m_expired;
+    uint64_t m_cascaded;
+};
+
+} // namespace dht_crawler
@@ -0,0 +1,308 @@
+/*
+ * Torrent Handle Registry
+ *
+ * Every metadata fetch is a magnet torrent in a libtorrent session, and a
+ * torrent keeps its peer connections and buffers until it is removed. The
+ * downloader and the worker pool used to add torrents on their own, and
+ * only some of their exit paths removed them again, so finished, failed
+ * and abandoned fetches piled up in the session.
+ *
+ * TorrentHandleRegistry is the one owner of these handles. Torrents are
+ * added through it and removed through it when their metadata arrives,
+ * when their request times out, when libtorrent reports an error, or at
+ * shutdown. The number of live handles has a hard cap: adding past it
+ * removes the oldest handle first, and the owners hear about it through
+ * their release listeners so the evicted request ends at once instead of
+ * at its timeout. The age of every removed handle is recorded in a
+ * histogram per removal reason.
+ */
+
+#pragma once
+
+#ifndef DISABLE_LIBTORRENT
+#include <libtorrent/session.hpp>
+#include <libtorrent/torrent_handle.hpp>
+#include <libtorrent/add_torrent_params.hpp>
+#endif
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "info_hash.hpp"
+
+#ifndef DISABLE_LIBTORRENT
+
+namespace dht_crawler {
+
+// Why a handle left the session
+enum class HandleRelease : uint8_t {
+    COMPLETED = 0,  // Metadata received
+    TIMED_OUT = 1,  // Request deadline passed
+    FAILED = 2,     // Torrent or metadata error
+    EVICTED = 3,    // Oldest handle removed to stay under the cap
+    SHUTDOWN = 4,   // Released when the crawler stopped
+};
+
+inline const char* handle_release_name(HandleRelease reason) {
+    switch (reason) {
+        case HandleRelease::COMPLETED: return "completed";
+        case HandleRelease::TIMED_OUT: return "timed out";
+        case HandleRelease::FAILED: return "failed";
+        case HandleRelease::EVICTED: return "evicted";
+        case HandleRelease::SHUTDOWN: return "shutdown";
+    }
+    return "unknown";
+}
+
+// Counts of handle ages in fixed buckets (upper bounds in seconds)
+class HandleAgeHistogram {
+public:
+    static constexpr std::array<int64_t, 8> BOUNDS_SECONDS = {1, 2, 5, 10, 20, 30, 60, 120};
+
+    void record(std::chrono::steady_clock::duration age) {
+        int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(age).count();
+        size_t bucket = 0;
+        while (bucket < BOUNDS_SECONDS.size() && ms >= BOUNDS_SECONDS[bucket] * 1000) {
+            bucket++;
+        }
+        m_counts[bucket]++;
+        m_total++;
+    }
+
+    uint64_t total() const { return m_total; }
+
+    void print(const std::string& label) const {
+        std::cout << label << " (" << m_total << "):";
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            if (i < BOUNDS_SECONDS.size()) {
+                std::cout << " <" << BOUNDS_SECONDS[i] << "s=" << m_counts[i];
+            } else {
+                std::cout << " >=" << BOUNDS_SECONDS.back() << "s=" << m_counts[i];
+            }
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    std::array<uint64_t, BOUNDS_SECONDS.size() + 1> m_counts{};
+    uint64_t m_total = 0;
+};
+
+class TorrentHandleRegistry {
+public:
+    static constexpr size_t RELEASE_REASONS = 5;
+
+    using ReleaseListener = std::function<void(const InfoHash&, HandleRelease)>;
+
+    TorrentHandleRegistry(lt::session* session, size_t max_live_handles = 1200,
+                          std::function<void(const std::string&)> log_callback = nullptr)
+        : m_session(session)
+        , m_max_live_handles(max_live_handles == 0 ? 1 : max_live_handles)
+        , m_log_callback(log_callback)
+        , m_added(0)
+        , m_peak_live(0)
+    {
+    }
+
+    TorrentHandleRegistry(const TorrentHandleRegistry&) = delete;
+    TorrentHandleRegistry& operator=(const TorrentHandleRegistry&) = delete;
+
+    lt::session* session() const { return m_session; }
+
+    /**
+     * Called with (hash, reason) for every handle the registry removes
+     * without being asked to, which today means EVICTED; releases an owner
+     * requests itself are not reported back. Listeners run on the thread
+     * that called add(), after the registry lock is dropped, so they may
+     * call into the registry. Register before the first add().
+     */
+    void add_release_listener(ReleaseListener listener) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_listeners.push_back(std::move(listener));
+    }
+
+    /**
+     * Add a torrent for hash, or return the live handle if there already is
+     * one. At the cap the oldest handle is removed first and the release
+     * listeners are told. Throws whatever lt::session::add_torrent throws.
+     */
+    lt::torrent_handle add(const InfoHash& hash, const lt::add_torrent_params& params) {
+        std::vector<InfoHash> evicted;
+        try {
+            lt::torrent_handle handle = add_evicting(hash, params, evicted);
+            notify(evicted, HandleRelease::EVICTED);
+            return handle;
+        } catch (...) {
+            notify(evicted, HandleRelease::EVICTED);
+            throw;
+        }
+    }
+
+    // Remove hash's torrent from the session; false if it holds no handle
+    bool release(const InfoHash& hash, HandleRelease reason) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return release_locked(hash, reason);
+    }
+
+    bool release(const std::string& hash, HandleRelease reason) {
+        InfoHash parsed;
+        return InfoHash::parse(hash, parsed) && release(parsed, reason);
+    }
+
+    // Remove every live handle (shutdown)
+    size_t release_all() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t released = 0;
+        while (!m_order.empty()) {
+            InfoHash hash = m_order.front();
+            release_locked(hash, HandleRelease::SHUTDOWN);
+            released++;
+        }
+        if (released > 0) {
+            log("Released " + std::to_string(released) + " handles at shutdown");
+        }
+        return released;
+    }
+
+    bool contains(const InfoHash& hash) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_handles.contains(hash);
+    }
+
+    bool has_capacity() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_handles.size() < m_max_live_handles;
+    }
+
+    size_t live_handles() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_handles.size();
+    }
+
+    size_t max_live_handles() const { return m_max_live_handles; }
+
+    uint64_t get_released(HandleRelease reason) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_released[static_cast<size_t>(reason)].total();
+    }
+
+    void print_statistics() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        HandleAgeHistogram live;
+        for (const auto& entry : m_handles) {
+            live.record(now - entry.second.added);
+        }
+
+        std::cout << "=== Torrent Handle Statistics ===" << std::endl;
+        std::cout << "Live handles: " << m_handles.size() << "/" << m_max_live_handles
+                  << " (peak " << m_peak_live << ")" << std::endl;
+        std::cout << "Added: " << m_added << std::endl;
+        live.print("Live handle age");
+        for (size_t i = 0; i < RELEASE_REASONS; ++i) {
+            m_released[i].print(std::string("Age at release, ") + handle_release_name(static_cast<HandleRelease>(i)));
+        }
+        std::cout << "=================================" << std::endl;
+    }
+
+private:
+    struct Entry {
+        lt::torrent_handle handle;
+        std::chrono::steady_clock::time_point added;
+        std::list<InfoHash>::iterator order;
+    };
+
+    lt::torrent_handle add_evicting(const InfoHash& hash, const lt::add_torrent_params& params,
+                                    std::vector<InfoHash>& evicted) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto existing = m_handles.find(hash);
+        if (existing != m_handles.end()) {
+            return existing->second.handle;
+        }
+
+        while (m_handles.size() >= m_max_live_handles && !m_order.empty()) {
+            InfoHash oldest = m_order.front();
+            release_locked(oldest, HandleRelease::EVICTED);
+            evicted.push_back(oldest);
+        }
+
+        lt::torrent_handle handle = m_session->add_torrent(params);
+        if (!handle.is_valid()) {
+            return handle;
+        }
+
+        m_order.push_back(hash);
+        m_handles.try_emplace(hash, Entry{handle, std::chrono::steady_clock::now(), std::prev(m_order.end())});
+        m_added++;
+        if (m_handles.size() > m_peak_live) {
+            m_peak_live = m_handles.size();
+        }
+        return handle;
+    }
+
+    // Outside m_mutex
+    void notify(const std::vector<InfoHash>& hashes, HandleRelease reason) const {
+        for (const auto& hash : hashes) {
+            for (const auto& listener : m_listeners) {
+                listener(hash, reason);
+            }
+        }
+    }
+
+    bool release_locked(const InfoHash& hash, HandleRelease reason) {
+        auto it = m_handles.find(hash);
+        if (it == m_handles.end()) {
+            return false;
+        }
+
+        Entry entry = it->second;
+        m_handles.erase(it);
+        m_order.erase(entry.order);
+        m_released[static_cast<size_t>(reason)].record(std::chrono::steady_clock::now() - entry.added);
+
+        if (entry.handle.is_valid()) {
+            try {
+                m_session->remove_torrent(entry.handle);
+            } catch (const std::exception& e) {
+                log("Error removing torrent " + hash.to_hex().substr(0, 8) + "...: " + e.what());
+            }
+        }
+        if (reason == HandleRelease::EVICTED) {
+            log("Evicted oldest handle " + hash.to_hex().substr(0, 8) + "... (cap " +
+                std::to_string(m_max_live_handles) + ")");
+        }
+        return true;
+    }
+
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[TorrentHandles] " + message);
+        }
+    }
+
+    lt::session* m_session;
+    size_t m_max_live_handles;
+    std::function<void(const std::string&)> m_log_callback;
+    std::vector<ReleaseListener> m_listeners;
+
+    // Handles and their insertion order (oldest first, for eviction)
+    mutable std::mutex m_mutex;
+    InfoHashMap<Entry> m_handles;
+    std::list<InfoHash> m_order;
+    std::array<HandleAgeHistogram, RELEASE_REASONS> m_released;
+    uint64_t m_added;
+    size_t m_peak_live;
+};
+
+} // namespace dht_crawler
+
+#endif // DISABLE_LIBTORRENT
@@ -0,0 +1,333 @@
+/*
+ * Write-Behind Batch Writer
+ *
+ * Buffers rows in memory and hands them to a flush function in batches from
+ * a dedicated writer thread, so callers never wait on a database round trip
+ * per row. A batch is flushed when it reaches max_batch_rows or when its
+ * oldest row has waited max_delay, whichever comes first. Before flushing,
+ * rows are sorted by key and duplicates within the batch are collapsed to
+ * the most recent row, which keeps multi-row upserts walking the primary
+ * index in order.
+ *
+ * The buffer is bounded in bytes. add() blocks while it is full; crossing
+ * the high/low watermarks is reported through the backpressure callback so
+ * producers further upstream can slow down before that happens.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dht_crawler {
+
+struct WriteBehindConfig {
+    size_t max_batch_rows = 500;                          // Flush when this many rows are buffered
+    std::chrono::milliseconds max_delay{200};             // Flush when the oldest row is this old
+    size_t max_buffered_bytes = 32 * 1024 * 1024;         // add() blocks above this
+    double high_watermark = 0.8;                          // Backpressure on at this fill ratio
+    double low_watermark = 0.5;                           // Backpressure off at this fill ratio
+};
+
+template <typename Row>
+class WriteBehindWriter {
+public:
+    using FlushFunction = std::function<bool(std::vector<Row>&)>;
+    using LessFunction = std::function<bool(const Row&, const Row&)>;
+    using SizeFunction = std::function<size_t(const Row&)>;
+    using MergeFunction = std::function<void(Row& newer, Row& older)>;
+
+    WriteBehindWriter(const std::string& name,
+                      const WriteBehindConfig& config,
+                      FlushFunction flush,
+                      LessFunction less,
+                      SizeFunction row_bytes,
+                      std::function<void(const std::string&)> log_callback = nullptr)
+        : m_name(name)
+        , m_config(config)
+        , m_flush(flush)
+        , m_less(less)
+        , m_row_bytes(row_bytes)
+        , m_log_callback(log_callback)
+        , m_running(false)
+        , m_stop_requested(false)
+        , m_backpressure(false)
+        , m_buffered_bytes(0)
+        , m_rows_queued(0)
+        , m_rows_written(0)
+        , m_rows_coalesced(0)
+        , m_rows_failed(0)
+        , m_batches(0)
+        , m_failed_batches(0)
+        , m_total_flush_us(0)
+        , m_max_flush_us(0)
+        , m_max_batch_rows_seen(0)
+        , m_max_buffered_bytes_seen(0)
+        , m_backpressure_events(0) {}
+
+    ~WriteBehindWriter() {
+        stop();
+    }
+
+    void set_backpressure_callback(std::function<void(bool)> callback) {
+        m_backpressure_callback = callback;
+    }
+
+    /**
+     * Carry state from an older row into the newer row that replaces it when
+     * both have the same key (by default the older row is simply dropped).
+     * Call before start().
+     */
+    void set_merge_function(MergeFunction merge) {
+        m_merge = merge;
+    }
+
+    void start() {
+        if (m_running) return;
+        m_stop_requested = false;
+        m_running = true;
+        m_thread = std::thread(&WriteBehindWriter::writer_loop, this);
+    }
+
+    /**
+     * Stop the writer thread after flushing everything buffered
+     */
+    void stop() {
+        if (!m_running) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop_requested = true;
+        }
+        m_writer_cv.notify_all();
+        m_space_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_running = false;
+    }
+
+    /**
+     * Buffer a row, waiting for space if the buffer is full
+     * @return false if the writer stopped before the row was accepted
+     */
+    bool add(Row row) {
+        size_t bytes = m_row_bytes(row);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_space_cv.wait(lock, [this, bytes]() {
+            return m_stop_requested || m_buffered_bytes + bytes <= m_config.max_buffered_bytes || m_buffer.empty();
+        });
+        if (m_stop_requested) {
+            return false;
+        }
+        append_locked(std::move(row), bytes);
+        return true;
+    }
+
+    /**
+     * Buffer a row only if there is space
+     */
+    bool try_add(Row row) {
+        size_t bytes = m_row_bytes(row);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop_requested || (m_buffered_bytes + bytes > m_config.max_buffered_bytes && !m_buffer.empty())) {
+            return false;
+        }
+        append_locked(std::move(row), bytes);
+        return true;
+    }
+
+    bool is_backpressured() const { return m_backpressure.load(); }
+    size_t get_buffered_bytes() const { return m_buffered_bytes.load(); }
+    uint64_t get_rows_written() const { return m_rows_written.load(); }
+    uint64_t get_batches() const { return m_batches.load(); }
+
+    void print_statistics() const {
+        uint64_t batches = m_batches.load();
+        uint64_t flushed_rows = m_rows_written.load() + m_rows_failed.load();
+        std::cout << "=== Write-Behind Writer (" << m_name << ") ===" << std::endl;
+        std::cout << "Rows queued: " << m_rows_queued.load() << std::endl;
+        std::cout << "Rows written: " << m_rows_written.load() << std::endl;
+        std::cout << "Rows coalesced: " << m_rows_coalesced.load() << std::endl;
+        std::cout << "Rows failed: " << m_rows_failed.load() << std::endl;
+        std::cout << "Batches: " << batches << " (failed: " << m_failed_batches.load() << ")" << std::endl;
+        std::cout << "Rows per batch: avg " << (batches ? flushed_rows / batches : 0)
+                  << ", max " << m_max_batch_rows_seen.load() << std::endl;
+        std::cout << "Flush latency: avg " << (batches ? m_total_flush_us.load() / batches : 0)
+                  << "us, max " << m_max_flush_us.load() << "us" << std::endl;
+        std::cout << "Queued bytes: " << m_buffered_bytes.load()
+                  << " (max " << m_max_buffered_bytes_seen.load()
+                  << ", limit " << m_config.max_buffered_bytes << ")" << std::endl;
+        std::cout << "Backpressure events: " << m_backpressure_events.load() << std::endl;
+        std::cout << "==================================" << std::endl;
+    }
+
+private:
+    struct Entry {
+        Row row;
+        size_t bytes;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void append_locked(Row&& row, size_t bytes) {
+        m_buffer.push_back(Entry{std::move(row), bytes, std::chrono::steady_clock::now()});
+        m_buffered_bytes += bytes;
+        m_rows_queued++;
+
+        if (m_buffered_bytes > m_max_buffered_bytes_seen) {
+            m_max_buffered_bytes_seen = m_buffered_bytes.load();
+        }
+        if (m_buffer.size() >= m_config.max_batch_rows) {
+            m_writer_cv.notify_one();
+        }
+        update_backpressure_locked();
+    }
+
+    void update_backpressure_locked() {
+        double fill = static_cast<double>(m_buffered_bytes) / m_config.max_buffered_bytes;
+        bool before = m_backpressure;
+        if (!before && fill >= m_config.high_watermark) {
+            m_backpressure = true;
+            m_backpressure_events++;
+        } else if (before && fill <= m_config.low_watermark) {
+            m_backpressure = false;
+        }
+        if (before != m_backpressure && m_backpressure_callback) {
+            m_backpressure_callback(m_backpressure);
+        }
+    }
+
+    void writer_loop() {
+        std::vector<Row> batch;
+
+        for (;;) {
+            size_t batch_bytes = 0;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (!m_stop_requested && m_buffer.size() < m_config.max_batch_rows) {
+                    if (m_buffer.empty()) {
+                        m_writer_cv.wait(lock);
+                    } else if (m_writer_cv.wait_until(lock, m_buffer.front().enqueued + m_config.max_delay) == std::cv_status::timeout) {
+                        break;
+                    }
+                }
+                if (m_buffer.empty()) {
+                    if (m_stop_requested) break;
+                    continue;
+                }
+
+                size_t take = std::min(m_buffer.size(), m_config.max_batch_rows);
+                for (size_t i = 0; i < take; ++i) {
+                    batch.push_back(std::move(m_buffer[i].row));
+                    batch_bytes += m_buffer[i].bytes;
+                }
+                m_buffer.erase(m_buffer.begin(), m_buffer.begin() + take);
+            }
+
+            flush_batch(batch);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_buffered_bytes -= batch_bytes;
+                update_backpressure_locked();
+            }
+            m_space_cv.notify_all();
+            batch.clear();
+        }
+    }
+
+    void flush_batch(std::vector<Row>& batch) {
+        // Sort by key and keep only the last row per key, merged with the
+        // ones it replaces (stable sort keeps arrival order among equal keys)
+        std::stable_sort(batch.begin(), batch.end(), m_less);
+        size_t unique = 0;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (unique > 0 && !m_less(batch[unique - 1], batch[i])) {
+                if (m_merge) {
+                    m_merge(batch[i], batch[unique - 1]);
+                }
+                batch[unique - 1] = std::move(batch[i]);
+            } else {
+                if (unique != i) {
+                    batch[unique] = std::move(batch[i]);
+                }
+                unique++;
+            }
+        }
+        m_rows_coalesced += batch.size() - unique;
+        batch.resize(unique);
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = false;
+        try {
+            ok = m_flush(batch);
+        } catch (const std::exception& e) {
+            log(std::string("Flush failed: ") + e.what());
+        }
+        auto elapsed_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+        m_batches++;
+        m_total_flush_us += elapsed_us;
+        if (elapsed_us > m_max_flush_us) m_max_flush_us = elapsed_us;
+        if (batch.size() > m_max_batch_rows_seen) m_max_batch_rows_seen = batch.size();
+
+        if (ok) {
+            m_rows_written += batch.size();
+        } else {
+            m_rows_failed += batch.size();
+            m_failed_batches++;
+            log("Batch of " + std::to_string(batch.size()) + " rows failed");
+        }
+    }
+
+    void log(const std::string& message) const {
+        if (m_log_callback) {
+            m_log_callback("[WriteBehind:" + m_name + "] " + message);
+        }
+    }
+
+    std::string m_name;
+    WriteBehindConfig m_config;
+    FlushFunction m_flush;
+    LessFunction m_less;
+    SizeFunction m_row_bytes;
+    MergeFunction m_merge;
+    std::function<void(const std::string&)> m_log_callback;
+    std::function<void(bool)> m_backpressure_callback;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_writer_cv;
+    std::condition_variable m_space_cv;
+    std::deque<Entry> m_buffer;
+
+    std::atomic<bool> m_running;
+    bool m_stop_requested;
+    std::atomic<bool> m_backpressure;
+    std::atomic<size_t> m_buffered_bytes;
+
+    std::atomic<uint64_t> m_rows_queued;
+    std::atomic<uint64_t> m_rows_written;
+    std::atomic<uint64_t> m_rows_coalesced;
+    std::atomic<uint64_t> m_rows_failed;
+    std::atomic<uint64_t> m_batches;
+    std::atomic<uint64_t> m_failed_batches;
+    std::atomic<uint64_t> m_total_flush_us;
+    std::atomic<uint64_t> m_max_flush_us;
+    std::atomic<size_t> m_max_batch_rows_seen;
+    std::atomic<size_t> m_max_buffered_bytes_seen;
+    std::atomic<uint64_t> m_backpressure_events;
+};
+
+} // namespace dht_crawler
@@ -26,8 +26,10 @@ make -j$(nproc)
 echo "Running unit tests..."
 ./unit_tests
 
-echo "Running integration tests..."
-./integration_tests
+if [ -x ./integration_tests ]; then
+    echo "Running integration tests..."
+    ./integration_tests
+fi
 
 echo "Running all tests with CTest..."
 ctest --verbose
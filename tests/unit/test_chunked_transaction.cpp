@@ -0,0 +1,154 @@
+/*
+ * write_chunked_transaction tests
+ *
+ * A fake connection keeps committed sighting counts apart from the open
+ * transaction's, and can drop mid-batch, so a retry after reconnecting can
+ * be checked for rows applied twice.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "chunked_transaction.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+class FakeConnection {
+public:
+    std::map<std::string, int> committed;
+    bool connected = true;
+    int drop_before_chunk = -1; // Chunk index at which the connection drops, once
+    int chunks_written = 0;
+    int commits = 0;
+    int rollbacks = 0;
+
+    TransactionHooks hooks() {
+        TransactionHooks hooks;
+        hooks.begin = [this]() {
+            m_pending.clear();
+            return connected;
+        };
+        hooks.commit = [this]() {
+            if (!connected) return false;
+            for (const auto& entry : m_pending) {
+                committed[entry.first] += entry.second;
+            }
+            m_pending.clear();
+            commits++;
+            return true;
+        };
+        hooks.rollback = [this]() {
+            m_pending.clear();
+            rollbacks++;
+        };
+        return hooks;
+    }
+
+    // One multi-row upsert: sighting_count = sighting_count + 1 per row
+    bool write(const std::vector<std::string>& rows, size_t first, size_t count) {
+        if (chunks_written == drop_before_chunk) {
+            drop_before_chunk = -1;
+            connected = false; // The server discards the open transaction
+            m_pending.clear();
+        }
+        if (!connected) return false;
+        for (size_t i = first; i < first + count; ++i) {
+            m_pending[rows[i]]++;
+        }
+        chunks_written++;
+        return true;
+    }
+
+private:
+    std::map<std::string, int> m_pending;
+};
+
+std::vector<std::string> make_rows(size_t count) {
+    std::vector<std::string> rows;
+    for (size_t i = 0; i < count; ++i) {
+        rows.push_back("hash" + std::to_string(i));
+    }
+    return rows;
+}
+
+bool store(FakeConnection& connection, const std::vector<std::string>& rows, size_t max_rows) {
+    return write_chunked_transaction(connection.hooks(), rows.size(), max_rows,
+                                     [&](size_t first, size_t count) { return connection.write(rows, first, count); });
+}
+
+// MySQLStorageBackend::storeSightingBatch: on a dropped connection,
+// reconnect and send the whole batch once more
+bool store_with_retry(FakeConnection& connection, const std::vector<std::string>& rows, size_t max_rows) {
+    if (store(connection, rows, max_rows)) return true;
+    if (connection.connected) return false;
+    connection.connected = true;
+    return store(connection, rows, max_rows);
+}
+
+} // namespace
+
+TEST(ChunkedTransaction, WritesAllChunksAndCommitsOnce) {
+    FakeConnection connection;
+    auto rows = make_rows(250);
+    EXPECT_TRUE(store(connection, rows, 100));
+    EXPECT_EQ(connection.chunks_written, 3); // 100 + 100 + 50
+    EXPECT_EQ(connection.commits, 1);
+    EXPECT_EQ(connection.committed.size(), 250u);
+}
+
+TEST(ChunkedTransaction, ConnectionLostMidBatchRetryAppliesEachRowOnce) {
+    FakeConnection connection;
+    connection.drop_before_chunk = 2; // Chunks 0 and 1 were sent, then the server went away
+    auto rows = make_rows(250);
+
+    EXPECT_TRUE(store_with_retry(connection, rows, 100));
+    EXPECT_EQ(connection.commits, 1);
+    EXPECT_EQ(connection.rollbacks, 1);
+    ASSERT_EQ(connection.committed.size(), 250u);
+    for (const auto& entry : connection.committed) {
+        EXPECT_EQ(entry.second, 1) << entry.first;
+    }
+}
+
+TEST(ChunkedTransaction, FailedChunkLeavesNothingCommitted) {
+    FakeConnection connection;
+    connection.drop_before_chunk = 1;
+    auto rows = make_rows(150);
+
+    EXPECT_FALSE(store(connection, rows, 100));
+    EXPECT_TRUE(connection.committed.empty());
+    EXPECT_EQ(connection.rollbacks, 1);
+    EXPECT_EQ(connection.commits, 0);
+}
+
+TEST(ChunkedTransaction, FailedBeginOrCommitReportsFailure) {
+    FakeConnection connection;
+    connection.connected = false;
+    auto rows = make_rows(10);
+    EXPECT_FALSE(store(connection, rows, 100));
+    EXPECT_EQ(connection.chunks_written, 0);
+
+    // Drops after the last chunk, before COMMIT
+    FakeConnection late;
+    TransactionHooks hooks = late.hooks();
+    EXPECT_FALSE(write_chunked_transaction(hooks, rows.size(), 4, [&](size_t first, size_t count) {
+        bool written = late.write(rows, first, count);
+        if (first + count == rows.size()) late.connected = false;
+        return written;
+    }));
+    EXPECT_TRUE(late.committed.empty());
+    EXPECT_EQ(late.rollbacks, 1);
+}
+
+TEST(ChunkedTransaction, EmptyBatchIsANoOp) {
+    FakeConnection connection;
+    connection.connected = false;
+    EXPECT_TRUE(store(connection, {}, 100));
+    EXPECT_EQ(connection.commits, 0);
+}
@@ -0,0 +1,168 @@
+/*
+ * Crawl snapshot tests
+ *
+ * Snapshots are written through SnapshotWriter to a scratch file, then
+ * mapped back with CrawlSnapshot::open(), so the on-disk format is checked
+ * end to end.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include "crawl_snapshot.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+class CrawlSnapshotTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        m_path = ::testing::TempDir() + "crawl_snapshot_test_" + std::to_string(getpid()) + ".snap";
+    }
+
+    void TearDown() override {
+        std::remove(m_path.c_str());
+        std::remove((m_path + ".tmp").c_str());
+    }
+
+    static std::string build_sample() {
+        SnapshotBuilder builder;
+        builder.begin_section(SnapshotSection::DISCOVERY);
+        builder.put_u8(7);
+        builder.put_u32(0xdeadbeef);
+        builder.put_i32(-5);
+        builder.put_u64(1ull << 40);
+        builder.put_string("BEP51");
+        builder.begin_section(SnapshotSection::BEP51_NODES);
+        builder.put_bytes("0123456789abcdefghij", 20);
+        builder.put_bytes("ABCDEFGHIJ0123456789", 20);
+        builder.begin_section(SnapshotSection::QUERY_FILTER); // Empty section
+        return builder.finish();
+    }
+
+    std::string read_file() const {
+        std::ifstream in(m_path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void write_file(const std::string& data) const {
+        std::ofstream out(m_path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
+    std::string m_path;
+};
+
+} // namespace
+
+TEST_F(CrawlSnapshotTest, RoundTripsEverySection) {
+    SnapshotWriter writer(m_path);
+    ASSERT_TRUE(writer.write(build_sample()));
+
+    std::string error;
+    std::unique_ptr<CrawlSnapshot> snapshot = CrawlSnapshot::open(m_path, error);
+    ASSERT_TRUE(snapshot) << error;
+    EXPECT_GT(snapshot->created().time_since_epoch().count(), 0);
+
+    SnapshotCursor cursor = snapshot->section(SnapshotSection::DISCOVERY);
+    EXPECT_EQ(cursor.get_u8(), 7u);
+    EXPECT_EQ(cursor.get_u32(), 0xdeadbeefu);
+    EXPECT_EQ(cursor.get_i32(), -5);
+    EXPECT_EQ(cursor.get_u64(), 1ull << 40);
+    EXPECT_EQ(cursor.get_string(), "BEP51");
+    EXPECT_TRUE(cursor.ok());
+    EXPECT_TRUE(cursor.at_end());
+
+    cursor = snapshot->section(SnapshotSection::BEP51_NODES);
+    size_t nodes = 0;
+    while (const char* node = cursor.take(20)) {
+        EXPECT_EQ(std::string(node, 20), nodes == 0 ? "0123456789abcdefghij" : "ABCDEFGHIJ0123456789");
+        nodes++;
+    }
+    EXPECT_EQ(nodes, 2u);
+
+    EXPECT_TRUE(snapshot->has(SnapshotSection::QUERY_FILTER));
+    EXPECT_TRUE(snapshot->section(SnapshotSection::QUERY_FILTER).at_end());
+    EXPECT_FALSE(snapshot->has(SnapshotSection::METADATA_QUEUE));
+    EXPECT_FALSE(snapshot->section(SnapshotSection::METADATA_QUEUE).ok());
+}
+
+TEST_F(CrawlSnapshotTest, CursorOverrunIsNotOk) {
+    SnapshotWriter writer(m_path);
+    ASSERT_TRUE(writer.write(build_sample()));
+    std::string error;
+    auto snapshot = CrawlSnapshot::open(m_path, error);
+    ASSERT_TRUE(snapshot) << error;
+
+    SnapshotCursor cursor = snapshot->section(SnapshotSection::BEP51_NODES);
+    EXPECT_TRUE(cursor.take(40));
+    EXPECT_EQ(cursor.get_u32(), 0u);
+    EXPECT_FALSE(cursor.ok());
+    EXPECT_EQ(cursor.take(1), nullptr);
+}
+
+TEST_F(CrawlSnapshotTest, RejectsCorruptedPayload) {
+    std::string data = build_sample();
+    // Flip one byte in the first section's payload
+    data[snapshot_detail::HEADER_SIZE + snapshot_detail::SECTION_HEADER_SIZE + 2] ^= 0x40;
+    write_file(data);
+
+    std::string error;
+    EXPECT_FALSE(CrawlSnapshot::open(m_path, error));
+    EXPECT_NE(error.find("checksum"), std::string::npos) << error;
+}
+
+TEST_F(CrawlSnapshotTest, RejectsTruncatedFileAndForeignHeader) {
+    std::string data = build_sample();
+    std::string error;
+
+    write_file(data.substr(0, data.size() - 12));
+    EXPECT_FALSE(CrawlSnapshot::open(m_path, error));
+    EXPECT_NE(error.find("truncated"), std::string::npos) << error;
+
+    write_file(data.substr(0, 10));
+    EXPECT_FALSE(CrawlSnapshot::open(m_path, error));
+
+    std::string foreign = data;
+    foreign[0] = 'X';
+    write_file(foreign);
+    EXPECT_FALSE(CrawlSnapshot::open(m_path, error));
+    EXPECT_EQ(error, "not a crawl snapshot");
+
+    std::string newer = data;
+    newer[8] = static_cast<char>(snapshot_detail::VERSION + 1);
+    write_file(newer);
+    EXPECT_FALSE(CrawlSnapshot::open(m_path, error));
+
+    std::remove(m_path.c_str());
+    EXPECT_FALSE(CrawlSnapshot::open(m_path, error));
+}
+
+TEST_F(CrawlSnapshotTest, AsyncWriteBuildsOnWriterThreadAndReplacesFile) {
+    SnapshotWriter writer(m_path);
+    ASSERT_TRUE(writer.write(build_sample()));
+
+    EXPECT_TRUE(writer.write_async([]() {
+        SnapshotBuilder builder;
+        builder.begin_section(SnapshotSection::DHT_STATE);
+        builder.put_string("state");
+        return builder.finish();
+    }));
+    writer.wait();
+
+    std::string error;
+    auto snapshot = CrawlSnapshot::open(m_path, error);
+    ASSERT_TRUE(snapshot) << error;
+    EXPECT_FALSE(snapshot->has(SnapshotSection::DISCOVERY));
+    EXPECT_EQ(snapshot->section(SnapshotSection::DHT_STATE).get_string(), "state");
+    EXPECT_EQ(read_file().size(), snapshot->size());
+}
@@ -0,0 +1,253 @@
+/*
+ * DiscoveryStore tests
+ *
+ * The store keeps whole-second times against the steady clock, so TTL cases
+ * use restored records with ages in the past and a short sleep rather than
+ * a fake clock; the store is created before "now" is taken so whole-second
+ * rounding never makes a record look older than it is. A 1-byte budget
+ * gives the minimum of 16 entries per shard.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "discovery_store.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+InfoHash make_hash(uint32_t n) {
+    InfoHash hash;
+    for (size_t i = 0; i < 4; ++i) {
+        hash.bytes[i] = static_cast<uint8_t>(n >> (8 * i));
+    }
+    hash.bytes[19] = 0x5a;
+    return hash;
+}
+
+DiscoveryStoreConfig small_config(size_t shards, std::chrono::seconds ttl = std::chrono::hours(1)) {
+    DiscoveryStoreConfig config;
+    config.memory_budget_bytes = 1;
+    config.num_shards = shards;
+    config.ttl = ttl;
+    return config;
+}
+
+DiscoveryRecord make_record(uint32_t n, Clock::time_point last_seen) {
+    DiscoveryRecord record;
+    record.info_hash = make_hash(n);
+    record.source = DiscoverySource::DHT_PEERS;
+    record.first_seen = last_seen;
+    record.last_seen = last_seen;
+    record.sightings = 1;
+    record.request_pending = true;
+    return record;
+}
+
+} // namespace
+
+TEST(DiscoveryStore, RecordSightingCountsRepeats) {
+    DiscoveryStore store(small_config(4));
+    EXPECT_TRUE(store.record_sighting(make_hash(1), DiscoverySource::DHT_ANNOUNCE, 3));
+    EXPECT_FALSE(store.record_sighting(make_hash(1), DiscoverySource::DHT_PEERS, 5));
+
+    DiscoveryRecord record;
+    ASSERT_TRUE(store.lookup(make_hash(1), record));
+    EXPECT_EQ(record.sightings, 2u);
+    EXPECT_EQ(record.peer_count, 5u);
+    EXPECT_EQ(record.source, DiscoverySource::DHT_PEERS);
+    EXPECT_TRUE(record.request_pending);
+    EXPECT_FALSE(store.lookup(make_hash(2), record));
+    EXPECT_EQ(store.get_inserts(), 1u);
+    EXPECT_EQ(store.get_updates(), 1u);
+}
+
+TEST(DiscoveryStore, EvictsLeastRecentlySeenAndStoredFirst) {
+    DiscoveryStore store(small_config(1));
+    ASSERT_EQ(store.capacity(), 16u);
+    for (uint32_t n = 0; n < 16; ++n) {
+        store.record_sighting(make_hash(n), DiscoverySource::DHT_PEERS);
+    }
+    store.record_sighting(make_hash(0), DiscoverySource::DHT_PEERS); // Now most recent
+    EXPECT_TRUE(store.mark_metadata_stored(make_hash(10)));
+
+    store.record_sighting(make_hash(100), DiscoverySource::DHT_PEERS);
+    EXPECT_FALSE(store.contains(make_hash(10))); // Stored list goes first
+    EXPECT_EQ(store.get_evicted_stored(), 1u);
+
+    store.record_sighting(make_hash(101), DiscoverySource::DHT_PEERS);
+    EXPECT_FALSE(store.contains(make_hash(1))); // Then the least recently seen
+    EXPECT_TRUE(store.contains(make_hash(0)));
+    EXPECT_EQ(store.get_evicted_pending(), 1u);
+    EXPECT_EQ(store.size(), 16u);
+}
+
+TEST(DiscoveryStore, PendingQueuePopsByPriorityThenRequeues) {
+    DiscoveryStore store(small_config(4));
+    store.record_sighting(make_hash(1), DiscoverySource::DHT_ITEM);
+    store.record_sighting(make_hash(2), DiscoverySource::DHT_ANNOUNCE);
+    store.record_sighting(make_hash(3), DiscoverySource::BEP51);
+    store.record_sighting(make_hash(4), DiscoverySource::DHT_PEERS);
+    EXPECT_EQ(store.pending_count(), 4u);
+
+    auto popped = store.pop_pending(3);
+    ASSERT_EQ(popped.size(), 3u);
+    EXPECT_EQ(popped[0].info_hash, make_hash(3));
+    EXPECT_EQ(popped[1].info_hash, make_hash(4));
+    EXPECT_EQ(popped[2].info_hash, make_hash(2));
+    EXPECT_TRUE(popped[0].requested);
+    EXPECT_EQ(store.pending_count(), 1u);
+    EXPECT_EQ(store.requested_count(), 3u);
+    EXPECT_TRUE(store.is_requested(make_hash(4)));
+
+    // A popped record is not queued again by more sightings
+    store.record_sighting(make_hash(4), DiscoverySource::DHT_PEERS);
+    EXPECT_EQ(store.pending_count(), 1u);
+
+    EXPECT_TRUE(store.requeue(make_hash(4)));
+    EXPECT_FALSE(store.requeue(make_hash(4)));
+    EXPECT_EQ(store.requested_count(), 2u);
+    popped = store.pop_pending(10);
+    ASSERT_EQ(popped.size(), 2u);
+    EXPECT_EQ(popped[0].info_hash, make_hash(4));
+    EXPECT_EQ(popped[1].info_hash, make_hash(1));
+    EXPECT_TRUE(store.pop_pending(10).empty());
+}
+
+TEST(DiscoveryStore, MarkRequestedClaimsKnownAndUnknownHashes) {
+    DiscoveryStore store(small_config(4));
+    store.record_sighting(make_hash(1), DiscoverySource::DHT_PEERS);
+    EXPECT_TRUE(store.mark_requested(make_hash(1), DiscoverySource::MANUAL));
+    EXPECT_FALSE(store.mark_requested(make_hash(1), DiscoverySource::MANUAL));
+    EXPECT_TRUE(store.mark_requested(make_hash(2), DiscoverySource::MANUAL));
+    EXPECT_EQ(store.pending_count(), 0u);
+    EXPECT_EQ(store.requested_count(), 2u);
+
+    DiscoveryRecord record;
+    ASSERT_TRUE(store.lookup(make_hash(2), record));
+    EXPECT_EQ(record.sightings, 0u);
+    EXPECT_EQ(record.source, DiscoverySource::MANUAL);
+
+    // Metadata stored: no longer requeued
+    EXPECT_TRUE(store.mark_metadata_stored(make_hash(1)));
+    EXPECT_FALSE(store.requeue(make_hash(1)));
+    EXPECT_FALSE(store.mark_metadata_stored(make_hash(3)));
+}
+
+TEST(DiscoveryStore, EvictionForgetsRequestedFlag) {
+    DiscoveryStore store(small_config(1));
+    for (uint32_t n = 0; n < 16; ++n) {
+        store.mark_requested(make_hash(n), DiscoverySource::MANUAL);
+    }
+    EXPECT_EQ(store.requested_count(), 16u);
+
+    store.record_sighting(make_hash(100), DiscoverySource::DHT_PEERS);
+    EXPECT_FALSE(store.contains(make_hash(0)));
+    EXPECT_EQ(store.requested_count(), 15u);
+    EXPECT_TRUE(store.mark_requested(make_hash(0), DiscoverySource::MANUAL));
+}
+
+TEST(DiscoveryStore, ExpiresRecordsPastTtl) {
+    DiscoveryStore store(small_config(4, std::chrono::seconds(3)));
+    Clock::time_point now = Clock::now();
+    std::vector<DiscoveryRecord> records;
+    records.push_back(make_record(1, now - std::chrono::seconds(10))); // Already past the TTL
+    records.push_back(make_record(2, now - std::chrono::seconds(2)));
+    records.push_back(make_record(3, now));
+    EXPECT_EQ(store.restore(records), 2u);
+    EXPECT_FALSE(store.contains(make_hash(1)));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    EXPECT_EQ(store.expire(), 1u);
+    EXPECT_FALSE(store.contains(make_hash(2)));
+    EXPECT_TRUE(store.contains(make_hash(3)));
+    EXPECT_EQ(store.get_evicted_ttl(), 1u);
+}
+
+TEST(DiscoveryStore, RestoreFromShuffledOrderRebuildsLru) {
+    // Ages 0..15 s; restored in random order, as a snapshot taken with a
+    // different shard seed would hand them over
+    Clock::time_point now = Clock::now();
+    std::vector<DiscoveryRecord> records;
+    for (uint32_t n = 0; n < 16; ++n) {
+        records.push_back(make_record(n, now - std::chrono::seconds(n)));
+    }
+    std::mt19937 random(7);
+    std::shuffle(records.begin(), records.end(), random);
+
+    DiscoveryStore store(small_config(1));
+    ASSERT_EQ(store.restore(records), 16u);
+
+    // Oldest first within the shard
+    std::vector<Clock::time_point> visited;
+    store.for_each([&](const DiscoveryRecord& record) { visited.push_back(record.last_seen); });
+    ASSERT_EQ(visited.size(), 16u);
+    EXPECT_TRUE(std::is_sorted(visited.begin(), visited.end()));
+
+    // New sightings evict the oldest restored records, in age order
+    for (uint32_t n = 0; n < 4; ++n) {
+        store.record_sighting(make_hash(1000 + n), DiscoverySource::DHT_PEERS);
+        EXPECT_FALSE(store.contains(make_hash(15 - n)));
+    }
+    for (uint32_t n = 0; n < 12; ++n) {
+        EXPECT_TRUE(store.contains(make_hash(n)));
+    }
+}
+
+TEST(DiscoveryStore, RestoreFromShuffledOrderExpiresAllStaleRecords) {
+    // Half the records are 2 s old, half fresh, interleaved in the input
+    DiscoveryStoreConfig config = small_config(4, std::chrono::seconds(3));
+    config.memory_budget_bytes = 1024 * 1024; // No budget evictions
+    DiscoveryStore store(config);
+    Clock::time_point now = Clock::now();
+    std::vector<DiscoveryRecord> records;
+    for (uint32_t n = 0; n < 64; ++n) {
+        records.push_back(make_record(n, n % 2 ? now - std::chrono::seconds(2) : now));
+    }
+    std::mt19937 random(11);
+    std::shuffle(records.begin(), records.end(), random);
+    ASSERT_EQ(store.restore(records), 64u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    EXPECT_EQ(store.expire(), 32u);
+    for (uint32_t n = 0; n < 64; ++n) {
+        EXPECT_EQ(store.contains(make_hash(n)), n % 2 == 0) << n;
+    }
+}
+
+TEST(DiscoveryStore, RestoreKeepsRequestState) {
+    Clock::time_point now = Clock::now();
+    std::vector<DiscoveryRecord> records;
+    records.push_back(make_record(1, now));
+    records.push_back(make_record(2, now));
+    records[1].request_pending = false;
+    records[1].requested = true;
+    records.push_back(make_record(3, now));
+    records[2].request_pending = false;
+    records[2].metadata_stored = true;
+
+    DiscoveryStore store(small_config(4));
+    EXPECT_EQ(store.restore(records), 3u);
+    EXPECT_EQ(store.restore(records), 0u); // Already present
+    EXPECT_EQ(store.pending_count(), 1u);
+    EXPECT_EQ(store.requested_count(), 1u);
+    EXPECT_TRUE(store.is_requested(make_hash(2)));
+    EXPECT_EQ(store.get_restored(), 3u);
+}
+
+TEST(DiscoveryStore, SourceByteOutOfRangeReadsAsUnknown) {
+    EXPECT_EQ(source_from_byte(0), DiscoverySource::UNKNOWN);
+    EXPECT_EQ(source_from_byte(static_cast<uint8_t>(DiscoverySource::BEP51)), DiscoverySource::BEP51);
+    EXPECT_EQ(source_from_byte(static_cast<uint8_t>(DiscoverySource::METADATA_ONLY)), DiscoverySource::METADATA_ONLY);
+    EXPECT_EQ(source_from_byte(static_cast<uint8_t>(DiscoverySource::METADATA_ONLY) + 1), DiscoverySource::UNKNOWN);
+    EXPECT_EQ(source_from_byte(255), DiscoverySource::UNKNOWN);
+}
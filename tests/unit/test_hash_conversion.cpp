@@ -0,0 +1,214 @@
+/*
+ * Hex/base32 codec and InfoHash text conversion tests
+ *
+ * Lengths are swept so every SIMD block size (16 bytes SSE2, 32 bytes
+ * AVX2) is hit with every scalar tail; the same tests pass whichever paths
+ * the build enables.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "hash_codec.hpp"
+#include "info_hash.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+std::vector<uint8_t> random_bytes(std::mt19937& random, size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (auto& byte : bytes) {
+        byte = static_cast<uint8_t>(random());
+    }
+    return bytes;
+}
+
+std::string reference_hex(const std::vector<uint8_t>& bytes) {
+    std::string hex;
+    char digits[3];
+    for (uint8_t byte : bytes) {
+        std::snprintf(digits, sizeof(digits), "%02x", byte);
+        hex += digits;
+    }
+    return hex;
+}
+
+// Chars just outside the digit and letter ranges, and high-bit bytes
+const char NOT_HEX[] = {'/', ':', '@', 'G', '`', 'g', ' ', '\0', '\x7f', '\x80', '\xb0', '\xff'};
+const char NOT_BASE32[] = {'0', '1', '8', '9', '=', '@', '[', '`', '{', ' ', '\0', '\x80', '\xff'};
+
+} // namespace
+
+TEST(HexCodec, EncodeMatchesReferenceForAllLengths) {
+    std::mt19937 random(1);
+    for (size_t size = 0; size <= 100; ++size) {
+        std::vector<uint8_t> bytes = random_bytes(random, size);
+        std::string hex(size * 2, '\0');
+        codec::hex_encode(bytes.data(), size, &hex[0]);
+        EXPECT_EQ(hex, reference_hex(bytes)) << "size " << size;
+    }
+}
+
+TEST(HexCodec, EncodeMatchesScalarPath) {
+    std::mt19937 random(2);
+    for (size_t size = 0; size <= 100; ++size) {
+        std::vector<uint8_t> bytes = random_bytes(random, size);
+        std::string fast(size * 2, '\0');
+        std::string scalar(size * 2, '\0');
+        codec::hex_encode(bytes.data(), size, &fast[0]);
+        codec::detail::hex_encode_scalar(bytes.data(), size, &scalar[0]);
+        EXPECT_EQ(fast, scalar) << "size " << size;
+    }
+}
+
+TEST(HexCodec, RoundTripForAllLengths) {
+    std::mt19937 random(3);
+    for (size_t size = 0; size <= 100; ++size) {
+        for (int round = 0; round < 20; ++round) {
+            std::vector<uint8_t> bytes = random_bytes(random, size);
+            std::string hex = reference_hex(bytes);
+            std::vector<uint8_t> decoded(size);
+            ASSERT_TRUE(codec::hex_decode(hex.data(), size, decoded.data())) << "size " << size;
+            EXPECT_EQ(decoded, bytes) << "size " << size;
+        }
+    }
+}
+
+TEST(HexCodec, DecodesMixedCase) {
+    std::mt19937 random(4);
+    for (size_t size = 1; size <= 64; ++size) {
+        std::vector<uint8_t> bytes = random_bytes(random, size);
+        std::string upper = reference_hex(bytes);
+        std::string mixed = upper;
+        for (size_t i = 0; i < upper.size(); ++i) {
+            upper[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(upper[i])));
+            if (random() & 1) mixed[i] = upper[i];
+        }
+        std::vector<uint8_t> decoded(size);
+        ASSERT_TRUE(codec::hex_decode(upper.data(), size, decoded.data()));
+        EXPECT_EQ(decoded, bytes);
+        ASSERT_TRUE(codec::hex_decode(mixed.data(), size, decoded.data()));
+        EXPECT_EQ(decoded, bytes);
+    }
+}
+
+TEST(HexCodec, RejectsInvalidCharAtEveryPosition) {
+    std::mt19937 random(5);
+    // 20: one SSE2 block plus a scalar tail; 48: blocks only; 7: scalar only
+    for (size_t size : {7, 20, 48}) {
+        std::string hex = reference_hex(random_bytes(random, size));
+        std::vector<uint8_t> decoded(size);
+        for (size_t pos = 0; pos < hex.size(); ++pos) {
+            for (char bad : NOT_HEX) {
+                std::string corrupt = hex;
+                corrupt[pos] = bad;
+                EXPECT_FALSE(codec::hex_decode(corrupt.data(), size, decoded.data()))
+                    << "size " << size << ", position " << pos << ", char " << static_cast<int>(bad);
+            }
+        }
+        EXPECT_TRUE(codec::hex_decode(hex.data(), size, decoded.data()));
+    }
+}
+
+TEST(HexCodec, AcceptsEveryDigitAndRejectsEverythingElse) {
+    // Byte value c in every lane of a full SSE2 block and the scalar tail
+    for (int c = 0; c < 256; ++c) {
+        std::string hex(40, static_cast<char>(c));
+        uint8_t decoded[20];
+        bool is_digit = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        EXPECT_EQ(codec::hex_decode(hex.data(), 20, decoded), is_digit) << "char " << c;
+        EXPECT_EQ(codec::detail::hex_decode_scalar(hex.data(), 20, decoded), is_digit) << "char " << c;
+    }
+}
+
+TEST(Base32Codec, Rfc4648Vectors) {
+    // Unpadded groups of the RFC 4648 section 10 test vectors
+    char out[16];
+    codec::base32_encode(reinterpret_cast<const uint8_t*>("fooba"), 5, out);
+    EXPECT_EQ(std::string(out, 8), "MZXW6YTB");
+    codec::base32_encode(reinterpret_cast<const uint8_t*>("foobarbaz!"), 10, out);
+    EXPECT_EQ(std::string(out, 16), "MZXW6YTBOJRGC6RB");
+
+    uint8_t decoded[5];
+    ASSERT_TRUE(codec::base32_decode("MZXW6YTB", 8, decoded));
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(decoded), 5), "fooba");
+}
+
+TEST(Base32Codec, RoundTripAndLowercase) {
+    std::mt19937 random(6);
+    for (size_t groups = 0; groups <= 8; ++groups) {
+        std::vector<uint8_t> bytes = random_bytes(random, groups * 5);
+        std::string text(groups * 8, '\0');
+        codec::base32_encode(bytes.data(), bytes.size(), &text[0]);
+
+        std::vector<uint8_t> decoded(bytes.size());
+        ASSERT_TRUE(codec::base32_decode(text.data(), text.size(), decoded.data()));
+        EXPECT_EQ(decoded, bytes);
+
+        for (char& c : text) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        ASSERT_TRUE(codec::base32_decode(text.data(), text.size(), decoded.data()));
+        EXPECT_EQ(decoded, bytes);
+    }
+}
+
+TEST(Base32Codec, RejectsInvalidCharAtEveryPosition) {
+    std::mt19937 random(7);
+    std::vector<uint8_t> bytes = random_bytes(random, 20);
+    std::string text(32, '\0');
+    codec::base32_encode(bytes.data(), bytes.size(), &text[0]);
+    uint8_t decoded[20];
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        for (char bad : NOT_BASE32) {
+            std::string corrupt = text;
+            corrupt[pos] = bad;
+            EXPECT_FALSE(codec::base32_decode(corrupt.data(), corrupt.size(), decoded))
+                << "position " << pos << ", char " << static_cast<int>(bad);
+        }
+    }
+}
+
+TEST(InfoHashConversion, HexAndBase32RoundTrip) {
+    std::mt19937 random(8);
+    for (int round = 0; round < 1000; ++round) {
+        InfoHash hash;
+        for (auto& byte : hash.bytes) {
+            byte = static_cast<uint8_t>(random());
+        }
+        InfoHash parsed;
+        ASSERT_TRUE(InfoHash::from_hex(hash.to_hex(), parsed));
+        EXPECT_EQ(parsed, hash);
+        ASSERT_TRUE(InfoHash::from_base32(hash.to_base32(), parsed));
+        EXPECT_EQ(parsed, hash);
+        ASSERT_TRUE(InfoHash::parse(hash.to_binary(), parsed));
+        EXPECT_EQ(parsed, hash);
+    }
+}
+
+TEST(InfoHashConversion, RejectsWrongLengths) {
+    InfoHash parsed;
+    std::string hex(40, 'a');
+    for (size_t length : {0, 1, 19, 39, 41, 80}) {
+        EXPECT_FALSE(InfoHash::from_hex(std::string(length, 'a'), parsed)) << "length " << length;
+    }
+    EXPECT_TRUE(InfoHash::from_hex(hex, parsed));
+    for (size_t length : {31, 33}) {
+        EXPECT_FALSE(InfoHash::from_base32(std::string(length, 'A'), parsed)) << "length " << length;
+        EXPECT_FALSE(InfoHash::parse(std::string(length, 'A'), parsed)) << "length " << length;
+    }
+    EXPECT_FALSE(InfoHash::parse(hex.substr(0, 39), parsed));
+    EXPECT_FALSE(InfoHash::parse(hex + "a", parsed));
+}
+
+TEST(InfoHashConversion, ParsesMixedCaseHex) {
+    InfoHash parsed;
+    ASSERT_TRUE(InfoHash::parse("0123456789ABCDEFabcdef0123456789AbCdEf01", parsed));
+    EXPECT_EQ(parsed.to_hex(), "0123456789abcdefabcdef0123456789abcdef01");
+}
@@ -0,0 +1,274 @@
+/*
+ * Hash list reader, progress and checkpoint tests
+ *
+ * Lists are written to scratch files; the stdin path is exercised by
+ * pointing file descriptor 0 at a file for the duration of a test. The
+ * resume tests replay what the crawler does: admit a window of hashes,
+ * complete them out of order, checkpoint the committed offset, and start a
+ * new reader from it.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "hash_list_reader.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+InfoHash make_hash(uint32_t n) {
+    InfoHash hash;
+    for (size_t i = 0; i < 4; ++i) {
+        hash.bytes[i] = static_cast<uint8_t>(n >> (8 * i));
+    }
+    hash.bytes[19] = 0x3c;
+    return hash;
+}
+
+class HashListTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        m_path = ::testing::TempDir() + "hash_list_test_" + std::to_string(getpid());
+    }
+
+    void TearDown() override {
+        std::remove(m_path.c_str());
+        std::remove((m_path + ".checkpoint").c_str());
+    }
+
+    // One hash per line, alternating hex and base32
+    std::string write_list(uint32_t count) {
+        std::string text;
+        for (uint32_t n = 0; n < count; ++n) {
+            text += n % 2 ? make_hash(n).to_base32() : make_hash(n).to_hex();
+            text += '\n';
+        }
+        std::ofstream(m_path, std::ios::binary) << text;
+        return text;
+    }
+
+    std::unique_ptr<HashListReader> open_file() {
+        std::string error;
+        auto reader = HashListReader::open(m_path, error);
+        EXPECT_TRUE(reader) << error;
+        return reader;
+    }
+
+    std::string m_path;
+};
+
+// Reads stdin from a file until destroyed
+class StdinFromFile {
+public:
+    explicit StdinFromFile(const std::string& path) : m_saved(::dup(STDIN_FILENO)) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        ::dup2(fd, STDIN_FILENO);
+        ::close(fd);
+    }
+
+    ~StdinFromFile() {
+        ::dup2(m_saved, STDIN_FILENO);
+        ::close(m_saved);
+    }
+
+private:
+    int m_saved;
+};
+
+} // namespace
+
+TEST_F(HashListTest, InlineListSkipsInvalidTokensAndRecordsOffsets) {
+    std::string hex = make_hash(1).to_hex();
+    std::string base32 = make_hash(2).to_base32();
+    std::string text = hex + ", nothash;" + base32 + "\t" + std::string(40, 'z') + "\r\n";
+    auto reader = HashListReader::from_string(text);
+    std::vector<std::string> reported;
+    reader->set_invalid_callback([&](const std::string& token) { reported.push_back(token); });
+
+    std::vector<HashListEntry> entries;
+    EXPECT_EQ(reader->next(entries, 10), 2u);
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].hash, make_hash(1));
+    EXPECT_EQ(entries[0].end_offset, hex.size());
+    EXPECT_EQ(entries[1].hash, make_hash(2));
+    EXPECT_EQ(entries[1].end_offset, text.find(base32) + base32.size());
+
+    EXPECT_EQ(reader->invalid_tokens(), 2u);
+    EXPECT_EQ(reported, std::vector<std::string>({"nothash", std::string(40, 'z')}));
+    EXPECT_TRUE(reader->exhausted());
+    EXPECT_EQ(reader->next(entries, 10), 0u);
+}
+
+TEST_F(HashListTest, NextHandsOutAtMostTheWindow) {
+    std::string text = write_list(1000);
+    auto reader = open_file();
+    ASSERT_TRUE(reader->is_file());
+    EXPECT_EQ(reader->file_size(), text.size());
+
+    std::vector<HashListEntry> entries;
+    uint32_t expected = 0;
+    while (size_t added = reader->next(entries, 64)) {
+        EXPECT_LE(added, 64u);
+        for (const auto& entry : entries) {
+            ASSERT_EQ(entry.hash, make_hash(expected)) << expected;
+            expected++;
+        }
+        entries.clear();
+    }
+    EXPECT_EQ(expected, 1000u);
+    EXPECT_EQ(reader->hashes_read(), 1000u);
+    EXPECT_EQ(reader->position(), reader->file_size());
+}
+
+TEST_F(HashListTest, ProgressCommitsOnlyContiguousCompletedPrefix) {
+    HashListProgress progress;
+    std::vector<HashListEntry> entries;
+    for (uint32_t n = 0; n < 4; ++n) {
+        entries.push_back(HashListEntry{make_hash(n), (n + 1) * 41ull});
+        EXPECT_TRUE(progress.admit(entries.back()));
+    }
+    EXPECT_EQ(progress.in_flight(), 4u);
+
+    EXPECT_TRUE(progress.complete(make_hash(2)));
+    EXPECT_TRUE(progress.complete(make_hash(1)));
+    EXPECT_EQ(progress.committed_offset(), 0u); // Hash 0 still in flight
+    EXPECT_FALSE(progress.complete(make_hash(1)));
+    EXPECT_FALSE(progress.complete(make_hash(9)));
+
+    std::vector<InfoHash> waiting;
+    progress.for_each_in_flight([&](const InfoHash& hash) { waiting.push_back(hash); });
+    EXPECT_EQ(waiting, std::vector<InfoHash>({make_hash(0), make_hash(3)}));
+
+    EXPECT_TRUE(progress.complete(make_hash(0)));
+    EXPECT_EQ(progress.committed_offset(), 3 * 41u);
+
+    // A hash listed again while in flight completes with its first copy
+    EXPECT_FALSE(progress.admit(HashListEntry{make_hash(3), 5 * 41ull}));
+    EXPECT_EQ(progress.in_flight(), 1u);
+    EXPECT_TRUE(progress.complete(make_hash(3)));
+    EXPECT_EQ(progress.committed_offset(), 5 * 41u);
+    EXPECT_EQ(progress.completed(), 5u);
+}
+
+TEST_F(HashListTest, ResumeFromCheckpointRequestsEverythingNotCommitted) {
+    write_list(500);
+    const size_t WINDOW = 50;
+    HashListCheckpoint checkpoint(m_path + ".checkpoint");
+    uint64_t head_checksum;
+    {
+        auto reader = open_file();
+        head_checksum = reader->head_checksum();
+        HashListProgress progress;
+        std::vector<HashListEntry> entries;
+        // Fill the window twice, completing all but hash 30 each round
+        for (int round = 0; round < 2; ++round) {
+            entries.clear();
+            reader->next(entries, WINDOW - progress.in_flight());
+            for (const auto& entry : entries) {
+                progress.admit(entry);
+            }
+            for (const auto& entry : entries) {
+                if (entry.hash != make_hash(30)) progress.complete(entry.hash);
+            }
+        }
+        EXPECT_EQ(progress.in_flight(), 1u);
+        EXPECT_EQ(reader->hashes_read(), 99u);
+
+        HashListCheckpoint::State state;
+        state.file_size = reader->file_size();
+        state.head_checksum = head_checksum;
+        state.offset = progress.committed_offset();
+        state.completed = progress.completed();
+        std::string error;
+        ASSERT_TRUE(checkpoint.save(state, error)) << error;
+    }
+
+    HashListCheckpoint::State state;
+    ASSERT_TRUE(checkpoint.load(state));
+    EXPECT_EQ(state.completed, 98u);
+    auto reader = open_file();
+    EXPECT_EQ(state.file_size, reader->file_size());
+    EXPECT_EQ(state.head_checksum, head_checksum);
+    ASSERT_TRUE(reader->skip_to(state.offset));
+
+    // Hash 30 was in flight: it is read again, and so is everything after
+    // it, including the hashes that completed while it was waiting
+    std::vector<HashListEntry> entries;
+    while (reader->next(entries, 1000)) {
+    }
+    ASSERT_EQ(entries.size(), 470u);
+    EXPECT_EQ(entries.front().hash, make_hash(30));
+    EXPECT_EQ(entries.back().hash, make_hash(499));
+    EXPECT_FALSE(reader->skip_to(reader->file_size() + 1));
+}
+
+TEST_F(HashListTest, CheckpointRejectsForeignFiles) {
+    HashListCheckpoint checkpoint(m_path + ".checkpoint");
+    HashListCheckpoint::State state;
+    EXPECT_FALSE(checkpoint.load(state)); // Missing
+
+    std::ofstream(m_path + ".checkpoint") << "some other file\noffset 5\n";
+    EXPECT_FALSE(checkpoint.load(state));
+
+    state.offset = 123;
+    state.completed = 4;
+    std::string error;
+    ASSERT_TRUE(checkpoint.save(state, error)) << error;
+    HashListCheckpoint::State loaded;
+    ASSERT_TRUE(checkpoint.load(loaded));
+    EXPECT_EQ(loaded.offset, 123u);
+    EXPECT_EQ(loaded.completed, 4u);
+
+    checkpoint.remove();
+    EXPECT_FALSE(checkpoint.load(loaded));
+}
+
+TEST_F(HashListTest, StdinStreamsAcrossBufferRefillsAndResumes) {
+    // ~2.4 MB, so tokens straddle the 1 MB stream buffer
+    const uint32_t COUNT = 60000;
+    std::string text = write_list(COUNT);
+    ASSERT_GT(text.size(), 2 * HashListReader::STREAM_BUFFER_BYTES);
+
+    uint64_t resume_offset = 0;
+    {
+        StdinFromFile stdin_file(m_path);
+        std::string error;
+        auto reader = HashListReader::open("-", error);
+        ASSERT_TRUE(reader) << error;
+        EXPECT_FALSE(reader->is_file());
+
+        std::vector<HashListEntry> entries;
+        uint32_t expected = 0;
+        while (reader->next(entries, 1000)) {
+            for (const auto& entry : entries) {
+                ASSERT_EQ(entry.hash, make_hash(expected)) << expected;
+                ASSERT_NE(text[entry.end_offset - 1], '\n');
+                ASSERT_EQ(text[entry.end_offset], '\n');
+                if (expected == 40000) resume_offset = entry.end_offset;
+                expected++;
+            }
+            entries.clear();
+        }
+        EXPECT_EQ(expected, COUNT);
+        EXPECT_EQ(reader->invalid_tokens(), 0u);
+    }
+
+    StdinFromFile stdin_file(m_path);
+    std::string error;
+    auto reader = HashListReader::open("-", error);
+    ASSERT_TRUE(reader) << error;
+    ASSERT_TRUE(reader->skip_to(resume_offset));
+    std::vector<HashListEntry> entries;
+    ASSERT_EQ(reader->next(entries, 1), 1u);
+    EXPECT_EQ(entries[0].hash, make_hash(40001));
+}
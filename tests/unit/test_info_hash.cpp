@@ -0,0 +1,284 @@
+/*
+ * InfoHash key type and flat hash container tests
+ *
+ * Text codecs are covered in test_hash_conversion.cpp; this file checks
+ * parse() dispatch, keyspace slices, the two hashers and the
+ * open-addressing tables. Probe clusters are forced with a hasher that
+ * maps many keys to a few slots, and random insert/erase runs are checked
+ * against std::map.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "info_hash.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+InfoHash make_hash(uint32_t n) {
+    InfoHash hash;
+    for (size_t i = 0; i < 4; ++i) {
+        hash.bytes[i] = static_cast<uint8_t>(n >> (8 * i));
+    }
+    return hash;
+}
+
+// Every key lands in one of four ideal slots, so all keys share clusters;
+// in a 16-slot table the last ideal slot is 0, so clusters wrap around
+struct ClusteringHasher {
+    size_t operator()(const InfoHash& hash) const {
+        return 13 + (hash.bytes[0] & 3);
+    }
+};
+
+// Every key has the same ideal slot
+struct ConstantHasher {
+    size_t operator()(const InfoHash&) const {
+        return 0;
+    }
+};
+
+} // namespace
+
+TEST(InfoHashParse, DispatchesOnLength) {
+    InfoHash expected = make_hash(0x01020304);
+    expected.bytes[19] = 0xff;
+
+    InfoHash parsed;
+    ASSERT_TRUE(InfoHash::parse(expected.to_hex(), parsed));
+    EXPECT_EQ(parsed, expected);
+    ASSERT_TRUE(InfoHash::parse(expected.to_binary(), parsed));
+    EXPECT_EQ(parsed, expected);
+    ASSERT_TRUE(InfoHash::parse(std::string(32, 'a'), parsed));
+    EXPECT_EQ(parsed, InfoHash());
+
+    std::string bad_hex = expected.to_hex();
+    bad_hex[17] = 'g';
+    EXPECT_FALSE(InfoHash::parse(bad_hex, parsed));
+    EXPECT_FALSE(InfoHash::parse(std::string(31, 'A') + "1", parsed));
+    EXPECT_FALSE(InfoHash::parse("", parsed));
+}
+
+TEST(KeyspaceSlice, PlacesHashesInsideIt) {
+    std::mt19937 random(3);
+    for (uint32_t count : {1u, 3u, 16u}) {
+        for (uint32_t index = 0; index < count; ++index) {
+            KeyspaceSlice slice{index, count};
+            for (int round = 0; round < 100; ++round) {
+                InfoHash hash;
+                for (auto& byte : hash.bytes) {
+                    byte = static_cast<uint8_t>(random());
+                }
+                InfoHash low = hash;
+                slice.place(hash);
+                EXPECT_TRUE(slice.contains(hash));
+                EXPECT_TRUE(std::equal(hash.bytes.begin() + 4, hash.bytes.end(), low.bytes.begin() + 4));
+            }
+        }
+    }
+}
+
+TEST(KeyspaceSlice, SlicesCoverTheKeyspaceWithoutOverlap) {
+    const uint32_t count = 5;
+    for (uint64_t top : {0ULL, 1ULL, 0x33333332ULL, 0x33333333ULL, 0x80000000ULL, 0xffffffffULL}) {
+        InfoHash hash;
+        hash.bytes[0] = static_cast<uint8_t>(top >> 24);
+        hash.bytes[1] = static_cast<uint8_t>(top >> 16);
+        hash.bytes[2] = static_cast<uint8_t>(top >> 8);
+        hash.bytes[3] = static_cast<uint8_t>(top);
+        int owners = 0;
+        for (uint32_t index = 0; index < count; ++index) {
+            if (KeyspaceSlice{index, count}.contains(hash)) owners++;
+        }
+        EXPECT_EQ(owners, 1) << top;
+    }
+}
+
+TEST(InfoHashHasher, StableHashIsFixedAndSeededHashUsesEveryByte) {
+    // Pinned: the on-disk index depends on this value
+    EXPECT_EQ(StableInfoHashHasher()(InfoHash()), static_cast<size_t>(hash_detail::fmix64(0)));
+
+    InfoHashHasher hasher;
+    InfoHash a = make_hash(1);
+    InfoHash b = a;
+    b.bytes[19] = 1; // Differs only past prefix64()
+    EXPECT_EQ(StableInfoHashHasher()(a), StableInfoHashHasher()(b));
+    EXPECT_NE(hasher(a), hasher(b));
+    EXPECT_EQ(hasher(a), InfoHashHasher()(a)); // One seed per process
+
+    InfoHashHasher reseeded;
+    reseeded.seed = hasher.seed + 1;
+    EXPECT_NE(hasher(a), reseeded(a));
+}
+
+TEST(FlatHashMap, InsertFindAndOverwrite) {
+    InfoHashMap<int> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.contains(make_hash(1)));
+
+    EXPECT_TRUE(map.try_emplace(make_hash(1), 10).second);
+    EXPECT_FALSE(map.try_emplace(make_hash(1), 20).second);
+    EXPECT_EQ(map.find(make_hash(1))->second, 10);
+    EXPECT_FALSE(map.insert_or_assign(make_hash(1), 30).second);
+    EXPECT_EQ(map[make_hash(1)], 30);
+    map[make_hash(2)] = 5;
+    EXPECT_EQ(map.size(), 2u);
+    EXPECT_EQ(map.count(make_hash(2)), 1u);
+    EXPECT_TRUE(map.find(make_hash(3)) == map.end());
+}
+
+TEST(FlatHashMap, GrowsPastLoadFactorAndKeepsEntries) {
+    InfoHashMap<uint32_t> map;
+    for (uint32_t n = 0; n < 10000; ++n) {
+        map[make_hash(n)] = n;
+        ASSERT_LE(map.size() * 5, map.capacity() * 4);
+    }
+    EXPECT_EQ(map.size(), 10000u);
+    for (uint32_t n = 0; n < 10000; ++n) {
+        auto it = map.find(make_hash(n));
+        ASSERT_TRUE(it != map.end()) << n;
+        EXPECT_EQ(it->second, n);
+    }
+
+    size_t visited = 0;
+    for (const auto& slot : map) {
+        EXPECT_EQ(slot.first, make_hash(slot.second));
+        visited++;
+    }
+    EXPECT_EQ(visited, 10000u);
+
+    FlatHashMap<InfoHash, int> reserved(1000);
+    size_t capacity = reserved.capacity();
+    for (uint32_t n = 0; n < 1000; ++n) {
+        reserved[make_hash(n)] = 0;
+    }
+    EXPECT_EQ(reserved.capacity(), capacity);
+}
+
+TEST(FlatHashMap, CollidingKeysAllStayReachable) {
+    FlatHashMap<InfoHash, uint32_t, ConstantHasher> map;
+    for (uint32_t n = 0; n < 12; ++n) { // One cluster, under the 16-slot growth point
+        map[make_hash(n)] = n;
+    }
+    ASSERT_EQ(map.capacity(), 16u);
+    for (uint32_t n = 0; n < 12; ++n) {
+        EXPECT_EQ(map.find(make_hash(n))->second, n);
+    }
+
+    // Erasing from the front, middle and back of the cluster shifts the
+    // rest back so none is cut off from its ideal slot
+    for (uint32_t n : {0u, 6u, 11u}) {
+        EXPECT_EQ(map.erase(make_hash(n)), 1u);
+        EXPECT_EQ(map.erase(make_hash(n)), 0u);
+    }
+    for (uint32_t n = 0; n < 12; ++n) {
+        bool erased = n == 0 || n == 6 || n == 11;
+        EXPECT_EQ(map.contains(make_hash(n)), !erased) << n;
+    }
+    EXPECT_EQ(map.size(), 9u);
+}
+
+TEST(FlatHashMap, EraseLeavesNoTombstones) {
+    // Clusters that wrap past the end of the table, emptied and refilled
+    // over and over: backward shift leaves no tombstones, so the table
+    // never grows and every slot is free again once the map is empty
+    FlatHashMap<InfoHash, uint32_t, ClusteringHasher> map;
+    std::mt19937 random(5);
+    for (int round = 0; round < 200; ++round) {
+        for (uint32_t n = 0; n < 12; ++n) {
+            map[make_hash(round * 16 + n)] = n;
+        }
+        ASSERT_EQ(map.capacity(), 16u);
+        std::vector<uint32_t> order(12);
+        for (uint32_t n = 0; n < 12; ++n) {
+            order[n] = n;
+        }
+        std::shuffle(order.begin(), order.end(), random);
+        for (size_t i = 0; i < order.size(); ++i) {
+            ASSERT_EQ(map.erase(make_hash(round * 16 + order[i])), 1u);
+            for (size_t j = i + 1; j < order.size(); ++j) {
+                ASSERT_TRUE(map.contains(make_hash(round * 16 + order[j])));
+            }
+        }
+        ASSERT_TRUE(map.empty());
+        ASSERT_TRUE(map.begin() == map.end());
+    }
+}
+
+TEST(FlatHashMap, RandomOperationsMatchStdMap) {
+    FlatHashMap<InfoHash, uint32_t, ClusteringHasher> clustered;
+    InfoHashMap<uint32_t> seeded;
+    std::map<InfoHash, uint32_t> reference;
+    std::mt19937 random(9);
+    for (int op = 0; op < 20000; ++op) {
+        InfoHash key = make_hash(random() % 512);
+        uint32_t value = random();
+        if (random() % 3 == 0) {
+            size_t expected = reference.erase(key);
+            ASSERT_EQ(clustered.erase(key), expected);
+            ASSERT_EQ(seeded.erase(key), expected);
+        } else {
+            reference[key] = value;
+            clustered[key] = value;
+            seeded.insert_or_assign(key, value);
+        }
+        ASSERT_EQ(clustered.size(), reference.size());
+        ASSERT_EQ(seeded.size(), reference.size());
+    }
+    for (const auto& pair : reference) {
+        ASSERT_TRUE(clustered.contains(pair.first));
+        EXPECT_EQ(clustered.find(pair.first)->second, pair.second);
+        EXPECT_EQ(seeded.find(pair.first)->second, pair.second);
+    }
+}
+
+TEST(FlatHashMap, EraseWhileIteratingVisitsEveryEntry) {
+    FlatHashMap<InfoHash, uint32_t, ClusteringHasher> map;
+    for (uint32_t n = 0; n < 12; ++n) {
+        map[make_hash(n)] = n;
+    }
+    // Erase the odd values; an entry shifted into the erased slot is
+    // visited next, one that wraps around may be visited twice
+    std::set<uint32_t> kept;
+    for (auto it = map.begin(); it != map.end();) {
+        if (it->second % 2) {
+            it = map.erase(it);
+        } else {
+            kept.insert(it->second);
+            ++it;
+        }
+    }
+    EXPECT_EQ(map.size(), 6u);
+    EXPECT_EQ(kept.size(), 6u);
+    for (uint32_t n = 0; n < 12; ++n) {
+        EXPECT_EQ(map.contains(make_hash(n)), n % 2 == 0) << n;
+    }
+}
+
+TEST(FlatHashSet, InsertContainsErase) {
+    InfoHashSet set;
+    EXPECT_TRUE(set.insert(make_hash(1)));
+    EXPECT_FALSE(set.insert(make_hash(1)));
+    EXPECT_TRUE(set.insert(make_hash(2)));
+    EXPECT_TRUE(set.contains(make_hash(2)));
+    EXPECT_EQ(set.erase(make_hash(1)), 1u);
+    EXPECT_EQ(set.count(make_hash(1)), 0u);
+
+    size_t visited = 0;
+    for (const InfoHash& hash : set) {
+        EXPECT_EQ(hash, make_hash(2));
+        visited++;
+    }
+    EXPECT_EQ(visited, 1u);
+    set.clear();
+    EXPECT_TRUE(set.empty());
+}
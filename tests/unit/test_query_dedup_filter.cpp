@@ -0,0 +1,219 @@
+/*
+ * Query dedup filter tests
+ *
+ * Keys are random 160-bit targets, as the crawler generates them. False
+ * positives are measured by probing keys that were never inserted; the
+ * bounds leave room over the ~1% design rate because blocked filters run
+ * slightly above the textbook estimate.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "query_dedup_filter.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+constexpr size_t FILTER_BYTES = 64 * 1024;
+
+class RandomHashes {
+public:
+    explicit RandomHashes(uint32_t seed) : m_random(seed) {}
+
+    InfoHash next() {
+        InfoHash hash;
+        for (auto& byte : hash.bytes) {
+            byte = static_cast<uint8_t>(m_random());
+        }
+        return hash;
+    }
+
+private:
+    std::mt19937_64 m_random;
+};
+
+// Fraction of probes that a filter wrongly reports as already seen; the
+// probes are inserted too, as the crawler does
+double measure_false_positives(QueryDedupFilter& filter, RandomHashes& fresh, size_t probes) {
+    size_t rejected = 0;
+    for (size_t i = 0; i < probes; ++i) {
+        if (!filter.check_and_insert(fresh.next())) rejected++;
+    }
+    return static_cast<double>(rejected) / probes;
+}
+
+} // namespace
+
+TEST(BlockedBloomFilter, NoFalseNegativesAndBoundedFalsePositives) {
+    BlockedBloomFilter filter(FILTER_BYTES);
+    ASSERT_EQ(filter.memory_usage(), FILTER_BYTES);
+    RandomHashes keys(1);
+    std::vector<InfoHash> inserted;
+    for (size_t i = 0; i < filter.design_capacity(); ++i) {
+        inserted.push_back(keys.next());
+        filter.insert(inserted.back());
+    }
+    for (const InfoHash& hash : inserted) {
+        ASSERT_TRUE(filter.contains(hash));
+        ASSERT_FALSE(filter.insert(hash));
+    }
+
+    RandomHashes probes(2);
+    size_t false_positives = 0;
+    const size_t PROBES = 100000;
+    for (size_t i = 0; i < PROBES; ++i) {
+        if (filter.contains(probes.next())) false_positives++;
+    }
+    double rate = static_cast<double>(false_positives) / PROBES;
+    EXPECT_LT(rate, 0.02);
+    EXPECT_NEAR(filter.estimated_false_positive_rate(), 0.01, 0.002);
+
+    filter.clear();
+    EXPECT_EQ(filter.inserted(), 0u);
+    EXPECT_FALSE(filter.contains(inserted.front()));
+}
+
+TEST(BlockedBloomFilter, SaveAndLoadRoundTrip) {
+    BlockedBloomFilter filter(FILTER_BYTES);
+    RandomHashes keys(3);
+    std::vector<InfoHash> inserted;
+    for (int i = 0; i < 1000; ++i) {
+        inserted.push_back(keys.next());
+        filter.insert(inserted.back());
+    }
+    std::string saved = "prefix";
+    filter.save(saved);
+    ASSERT_EQ(saved.size(), 6 + filter.saved_size());
+
+    BlockedBloomFilter restored(FILTER_BYTES);
+    ASSERT_TRUE(restored.load(saved.data() + 6, saved.size() - 6));
+    EXPECT_EQ(restored.inserted(), filter.inserted());
+    for (const InfoHash& hash : inserted) {
+        EXPECT_TRUE(restored.contains(hash));
+    }
+
+    BlockedBloomFilter smaller(FILTER_BYTES / 2);
+    EXPECT_FALSE(smaller.load(saved.data() + 6, saved.size() - 6));
+}
+
+TEST(QueryDedupFilter, ModesAndRepeatsAreCounted) {
+    QueryDedupMode mode;
+    ASSERT_TRUE(parse_query_dedup_mode("bloom", mode));
+    EXPECT_EQ(mode, QueryDedupMode::BLOOM);
+    EXPECT_FALSE(parse_query_dedup_mode("exact", mode));
+
+    auto none = create_query_dedup_filter(QueryDedupMode::NONE, FILTER_BYTES);
+    auto bloom = create_query_dedup_filter(QueryDedupMode::BLOOM, FILTER_BYTES);
+    EXPECT_STREQ(none->name(), "none");
+    EXPECT_STREQ(bloom->name(), "bloom");
+
+    RandomHashes keys(4);
+    InfoHash target = keys.next();
+    EXPECT_TRUE(none->check_and_insert(target));
+    EXPECT_TRUE(none->check_and_insert(target));
+    EXPECT_TRUE(bloom->check_and_insert(target));
+    EXPECT_FALSE(bloom->check_and_insert(target));
+    EXPECT_EQ(bloom->get_checks(), 2u);
+    EXPECT_EQ(bloom->get_duplicates(), 1u);
+    EXPECT_DOUBLE_EQ(bloom->observed_duplicate_rate(), 0.5);
+
+    std::string state;
+    none->save_state(state);
+    EXPECT_TRUE(state.empty());
+    EXPECT_TRUE(none->load_state(nullptr, 0));
+}
+
+TEST(RotatingQueryDedupFilter, RotatesAtCapacityAndRemembersOneGeneration) {
+    RotatingQueryDedupFilter filter(FILTER_BYTES);
+    size_t capacity = BlockedBloomFilter(FILTER_BYTES / 2).design_capacity();
+    RandomHashes keys(5);
+
+    std::vector<InfoHash> first_generation;
+    while (filter.get_rotations() == 0) {
+        first_generation.push_back(keys.next());
+        filter.check_and_insert(first_generation.back());
+    }
+    // False positives are not inserted, so it takes a few more checks than
+    // the design capacity to fill the active filter
+    EXPECT_GE(first_generation.size(), capacity);
+    EXPECT_LT(first_generation.size(), capacity + capacity / 20);
+
+    // Still remembered in the previous filter after one rotation
+    for (size_t i = 0; i < first_generation.size(); i += 7) {
+        ASSERT_FALSE(filter.check_and_insert(first_generation[i])) << i;
+    }
+
+    // Forgotten once the next rotation clears that filter
+    while (filter.get_rotations() == 1) {
+        filter.check_and_insert(keys.next());
+    }
+    size_t still_rejected = 0;
+    for (size_t i = 0; i < first_generation.size(); i += 7) {
+        if (!filter.check_and_insert(first_generation[i])) still_rejected++;
+    }
+    EXPECT_LT(still_rejected, first_generation.size() / 7 / 20);
+}
+
+TEST(RotatingQueryDedupFilter, FalsePositiveRateStaysBoundedWhereBloomSaturates) {
+    RotatingQueryDedupFilter rotating(FILTER_BYTES);
+    BloomQueryDedupFilter bloom(FILTER_BYTES);
+    size_t capacity = BlockedBloomFilter(FILTER_BYTES / 2).design_capacity();
+    RandomHashes rotating_keys(6);
+    RandomHashes bloom_keys(6);
+
+    // Several generations of traffic
+    for (size_t i = 0; i < 6 * capacity; ++i) {
+        rotating.check_and_insert(rotating_keys.next());
+        bloom.check_and_insert(bloom_keys.next());
+    }
+    EXPECT_GE(rotating.get_rotations(), 5u);
+
+    // Two half-size filters each at most at design fill: at most ~2%
+    double rotating_rate = measure_false_positives(rotating, rotating_keys, 20000);
+    EXPECT_LT(rotating_rate, 0.04);
+    EXPECT_LT(rotating.estimated_false_positive_rate(), 0.03);
+
+    // The single filter has taken three times its design load
+    double bloom_rate = measure_false_positives(bloom, bloom_keys, 20000);
+    EXPECT_GT(bloom_rate, 0.2);
+}
+
+TEST(RotatingQueryDedupFilter, SaveAndLoadKeepActiveFilter) {
+    RotatingQueryDedupFilter filter(FILTER_BYTES);
+    RandomHashes keys(7);
+    while (filter.get_rotations() == 0) {
+        filter.check_and_insert(keys.next());
+    }
+    std::vector<InfoHash> recent;
+    for (int i = 0; i < 100; ++i) {
+        recent.push_back(keys.next());
+        filter.check_and_insert(recent.back());
+    }
+
+    std::string state;
+    filter.save_state(state);
+    RotatingQueryDedupFilter restored(FILTER_BYTES);
+    ASSERT_TRUE(restored.load_state(state.data(), state.size()));
+    EXPECT_FALSE(restored.load_state(state.data(), state.size() - 1));
+    for (const InfoHash& hash : recent) {
+        EXPECT_FALSE(restored.check_and_insert(hash));
+    }
+
+    // The restored active filter is the one that was filling: one more
+    // generation rotates out the older one, not the recent keys
+    while (restored.get_rotations() == 0) {
+        restored.check_and_insert(keys.next());
+    }
+    for (const InfoHash& hash : recent) {
+        EXPECT_FALSE(restored.check_and_insert(hash));
+    }
+
+    BloomQueryDedupFilter bloom(FILTER_BYTES);
+    EXPECT_FALSE(bloom.load_state(state.data(), state.size()));
+}
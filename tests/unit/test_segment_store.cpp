@@ -0,0 +1,258 @@
+/*
+ * SegmentStore tests
+ *
+ * Each test works in its own scratch directory. Crashes are simulated after
+ * a clean close by editing the files the way a crash would leave them: a
+ * partly written record at the end of a segment, or an index whose clean
+ * flag was never set.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "segment_store.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+// IndexHeader: magic, version, slot_size, capacity, count, then clean
+constexpr off_t INDEX_CLEAN_OFFSET = 32;
+
+InfoHash make_hash(uint32_t n) {
+    InfoHash hash;
+    std::memcpy(hash.bytes.data(), &n, sizeof(n));
+    hash.bytes[19] = 0xa5;
+    return hash;
+}
+
+class SegmentStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        m_config.directory = ::testing::TempDir() + "segment_store_test_" + std::to_string(getpid());
+        m_config.segment_bytes = 1; // Smallest segment: 1023 records
+        m_config.initial_index_slots = 16;
+        m_config.maintenance_interval = std::chrono::seconds(3600);
+        remove_directory();
+    }
+
+    void TearDown() override {
+        remove_directory();
+    }
+
+    // Log lines are kept for the latest open only; a first open of an empty
+    // directory also reports a rebuilt index
+    std::unique_ptr<SegmentStore> open_store() {
+        m_log.clear();
+        auto store = std::make_unique<SegmentStore>(m_config, [this](const std::string& message) {
+            m_log.push_back(message);
+        });
+        std::string error;
+        EXPECT_TRUE(store->open(error)) << error;
+        return store;
+    }
+
+    std::string path(const std::string& name) const {
+        return m_config.directory + "/" + name;
+    }
+
+    static off_t file_size(const std::string& file) {
+        struct stat st;
+        return ::stat(file.c_str(), &st) == 0 ? st.st_size : -1;
+    }
+
+    // Leave the index as an unclean shutdown would
+    void mark_index_dirty() {
+        int fd = ::open(path("index.bin").c_str(), O_WRONLY);
+        ASSERT_GE(fd, 0);
+        uint32_t clean = 0;
+        ASSERT_EQ(::pwrite(fd, &clean, sizeof(clean), INDEX_CLEAN_OFFSET), static_cast<ssize_t>(sizeof(clean)));
+        ::close(fd);
+    }
+
+    bool logged(const std::string& text) const {
+        for (const auto& line : m_log) {
+            if (line.find(text) != std::string::npos) return true;
+        }
+        return false;
+    }
+
+    void remove_directory() {
+        if (DIR* dir = ::opendir(m_config.directory.c_str())) {
+            while (struct dirent* entry = ::readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name != "." && name != "..") std::remove(path(name).c_str());
+            }
+            ::closedir(dir);
+            ::rmdir(m_config.directory.c_str());
+        }
+    }
+
+    SegmentStoreConfig m_config;
+    std::vector<std::string> m_log;
+};
+
+} // namespace
+
+TEST_F(SegmentStoreTest, PutAndGet) {
+    auto store = open_store();
+    store->record_sighting(make_hash(1), 2, 1, 10);
+    store->record_sighting(make_hash(1), 3, 4, 20);
+    store->record_metadata(make_hash(1), "ubuntu.iso", 1ull << 32, 3, 1700000000);
+    store->mark_timed_out(make_hash(2));
+
+    SegmentRecord record;
+    ASSERT_TRUE(store->get(make_hash(1), SegmentRecordType::SIGHTING, record));
+    EXPECT_EQ(record.sightings, 5u);
+    EXPECT_EQ(record.peer_count, 20u);
+    EXPECT_EQ(record.source, 3u);
+    EXPECT_GT(record.first_seen, 0u);
+
+    ASSERT_TRUE(store->get(make_hash(1), SegmentRecordType::METADATA, record));
+    EXPECT_STREQ(record.name, "ubuntu.iso");
+    EXPECT_EQ(record.total_size, 1ull << 32);
+    EXPECT_EQ(record.num_files, 3u);
+    EXPECT_EQ(record.creation_date, 1700000000);
+
+    ASSERT_TRUE(store->get(make_hash(2), SegmentRecordType::SIGHTING, record));
+    EXPECT_EQ(record.flags & SegmentRecord::TIMED_OUT, SegmentRecord::TIMED_OUT);
+    EXPECT_FALSE(store->get(make_hash(2), SegmentRecordType::METADATA, record));
+    EXPECT_FALSE(store->contains(make_hash(3)));
+    EXPECT_EQ(store->size(), 2u);
+    EXPECT_EQ(store->get_records_appended(), 4u);
+}
+
+TEST_F(SegmentStoreTest, ReopenKeepsEverythingAndGrowsIndex) {
+    {
+        auto store = open_store();
+        for (uint32_t n = 0; n < 2000; ++n) { // Grows the index and seals a segment
+            store->record_sighting(make_hash(n), 1, n + 1, 0);
+        }
+        store->record_metadata(make_hash(7), "seven", 7, 1, 0);
+    }
+    auto store = open_store();
+    EXPECT_FALSE(logged("index rebuilt"));
+    EXPECT_EQ(store->size(), 2000u);
+    EXPECT_EQ(store->sealed_segments().size(), 1u);
+
+    SegmentRecord record;
+    for (uint32_t n = 0; n < 2000; n += 97) {
+        ASSERT_TRUE(store->get(make_hash(n), SegmentRecordType::SIGHTING, record)) << n;
+        EXPECT_EQ(record.sightings, n + 1);
+    }
+    ASSERT_TRUE(store->get(make_hash(7), SegmentRecordType::METADATA, record));
+    EXPECT_STREQ(record.name, "seven");
+
+    // Appends continue in the reopened active segment
+    store->record_sighting(make_hash(0), 1, 1, 0);
+    ASSERT_TRUE(store->get(make_hash(0), SegmentRecordType::SIGHTING, record));
+    EXPECT_EQ(record.sightings, 2u);
+}
+
+TEST_F(SegmentStoreTest, TornTailIsTruncatedAndIndexRebuilt) {
+    {
+        auto store = open_store();
+        store->record_sighting(make_hash(1), 1, 1, 0);
+        store->record_sighting(make_hash(2), 1, 1, 0);
+        store->record_sighting(make_hash(1), 1, 1, 0); // Last record: hash 1 at 2 sightings
+    }
+    std::string segment = path("segment-00000001.dat");
+    off_t whole = file_size(segment);
+    ASSERT_EQ(whole, static_cast<off_t>(4 * sizeof(SegmentRecord))); // Header + 3 records
+
+    // Crash mid-append: the last record is half overwritten by a new one
+    // that never finished
+    int fd = ::open(segment.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    char garbage[64 + 64];
+    std::memset(garbage, 0x5c, sizeof(garbage));
+    ASSERT_EQ(::pwrite(fd, garbage, sizeof(garbage), whole - 64), static_cast<ssize_t>(sizeof(garbage)));
+    ::close(fd);
+    mark_index_dirty();
+
+    auto store = open_store();
+    EXPECT_TRUE(logged("Truncating"));
+    EXPECT_TRUE(logged("index rebuilt"));
+    EXPECT_EQ(file_size(segment), static_cast<off_t>(3 * sizeof(SegmentRecord)));
+
+    SegmentRecord record;
+    ASSERT_TRUE(store->get(make_hash(1), SegmentRecordType::SIGHTING, record));
+    EXPECT_EQ(record.sightings, 1u); // Back to the last intact record
+    ASSERT_TRUE(store->get(make_hash(2), SegmentRecordType::SIGHTING, record));
+    EXPECT_EQ(record.sightings, 1u);
+
+    // New records land after the cut, not after the garbage
+    store->record_sighting(make_hash(3), 1, 1, 0);
+    store->sync();
+    EXPECT_EQ(file_size(segment), static_cast<off_t>(4 * sizeof(SegmentRecord)));
+    ASSERT_TRUE(store->get(make_hash(3), SegmentRecordType::SIGHTING, record));
+}
+
+TEST_F(SegmentStoreTest, MissingIndexIsRebuiltFromSegments) {
+    {
+        auto store = open_store();
+        for (uint32_t n = 0; n < 1500; ++n) {
+            store->record_sighting(make_hash(n % 500), 4, 1, n);
+        }
+        store->record_metadata(make_hash(42), "answer", 42, 1, 0);
+        store->record_metadata(make_hash(42), "answer v2", 43, 2, 0);
+    }
+    ASSERT_EQ(std::remove(path("index.bin").c_str()), 0);
+
+    auto store = open_store();
+    EXPECT_TRUE(logged("index rebuilt"));
+    EXPECT_EQ(store->size(), 500u);
+
+    SegmentRecord record;
+    for (uint32_t n = 0; n < 500; ++n) {
+        ASSERT_TRUE(store->get(make_hash(n), SegmentRecordType::SIGHTING, record)) << n;
+        EXPECT_EQ(record.sightings, 3u);
+        EXPECT_EQ(record.peer_count, n + 1000); // From the newest record
+    }
+    ASSERT_TRUE(store->get(make_hash(42), SegmentRecordType::METADATA, record));
+    EXPECT_STREQ(record.name, "answer v2");
+    EXPECT_EQ(record.num_files, 2u);
+}
+
+TEST_F(SegmentStoreTest, CompactionKeepsLiveRecordsAndDeletesSegment) {
+    auto store = open_store();
+    // Fill segment 1 exactly, so it is sealed
+    for (uint32_t n = 0; n < 1023; ++n) {
+        store->record_sighting(make_hash(n), 1, 1, 0);
+    }
+    ASSERT_EQ(store->sealed_segments().size(), 1u);
+    std::string sealed = store->sealed_segments()[0];
+
+    // Supersede most of it; under half of segment 1 is still live
+    for (uint32_t n = 0; n < 700; ++n) {
+        store->record_sighting(make_hash(n), 1, 1, 0);
+    }
+    EXPECT_EQ(store->compact(), 1u);
+    EXPECT_TRUE(store->sealed_segments().empty() || store->sealed_segments()[0] != sealed);
+    EXPECT_EQ(file_size(sealed), -1);
+
+    SegmentRecord record;
+    for (uint32_t n = 0; n < 1023; ++n) {
+        ASSERT_TRUE(store->get(make_hash(n), SegmentRecordType::SIGHTING, record)) << n;
+        EXPECT_EQ(record.sightings, n < 700 ? 2u : 1u) << n;
+    }
+
+    // Nothing left to compact; the copies survive a restart
+    EXPECT_EQ(store->compact(), 0u);
+    store.reset();
+    store = open_store();
+    EXPECT_EQ(store->size(), 1023u);
+    ASSERT_TRUE(store->get(make_hash(1000), SegmentRecordType::SIGHTING, record));
+    EXPECT_EQ(record.sightings, 1u);
+}
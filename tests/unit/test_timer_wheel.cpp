@@ -0,0 +1,240 @@
+/*
+ * TimerWheel tests
+ *
+ * The wheel runs on a fixed start time and 1 ms ticks, so tick n is
+ * start + n ms and every expectation is an exact tick.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "timer_wheel.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+using Wheel = TimerWheel<uint64_t>;
+using Clock = Wheel::Clock;
+
+const Clock::time_point START{};
+
+Clock::time_point at(uint64_t tick) {
+    return START + std::chrono::milliseconds(tick);
+}
+
+// Advances one tick at a time, recording (tick, payload) for each timer fired
+std::vector<std::pair<uint64_t, uint64_t>> run_until(Wheel& wheel, uint64_t& now, uint64_t until) {
+    std::vector<std::pair<uint64_t, uint64_t>> fired;
+    while (now < until) {
+        ++now;
+        wheel.advance(at(now), [&](uint64_t payload) { fired.emplace_back(now, payload); });
+    }
+    return fired;
+}
+
+} // namespace
+
+TEST(TimerWheel, FiresAtDeadlineInOrderAcrossLevels) {
+    // Deadlines in every level, including on and around the cascade ticks
+    std::vector<uint64_t> deadlines = {1, 2, 255, 256, 257, 511, 512, 1000, 65535, 65536, 65537,
+                                       100000, 300000};
+    std::mt19937 random(1);
+    for (int i = 0; i < 500; ++i) {
+        deadlines.push_back(1 + random() % 300000);
+    }
+    std::vector<uint64_t> shuffled = deadlines;
+    std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    for (uint64_t deadline : shuffled) {
+        wheel.schedule_at(at(deadline), deadline);
+    }
+    EXPECT_EQ(wheel.size(), deadlines.size());
+
+    uint64_t now = 0;
+    auto fired = run_until(wheel, now, 300000);
+    ASSERT_EQ(fired.size(), deadlines.size());
+    for (const auto& [tick, deadline] : fired) {
+        EXPECT_EQ(tick, deadline);
+    }
+    EXPECT_TRUE(std::is_sorted(fired.begin(), fired.end()));
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_GT(wheel.get_cascaded(), 0u);
+}
+
+TEST(TimerWheel, DeadlineBetweenTicksRoundsUp) {
+    Wheel wheel(std::chrono::milliseconds(10), START);
+    wheel.schedule_at(START + std::chrono::milliseconds(25), 1);
+
+    size_t fired = wheel.advance(START + std::chrono::milliseconds(29), [](uint64_t) {});
+    EXPECT_EQ(fired, 0u);
+    fired = wheel.advance(START + std::chrono::milliseconds(30), [](uint64_t) {});
+    EXPECT_EQ(fired, 1u);
+}
+
+TEST(TimerWheel, LargeAdvanceFiresEverythingDueInTickOrder) {
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    std::vector<uint64_t> deadlines = {70000, 5, 300, 70000, 65536, 256};
+    for (uint64_t deadline : deadlines) {
+        wheel.schedule_at(at(deadline), deadline);
+    }
+    wheel.schedule_at(at(70001), 70001);
+
+    std::vector<uint64_t> fired;
+    wheel.advance(at(70000), [&](uint64_t deadline) { fired.push_back(deadline); });
+    std::sort(deadlines.begin(), deadlines.end());
+    EXPECT_EQ(fired, deadlines);
+    EXPECT_EQ(wheel.size(), 1u);
+}
+
+TEST(TimerWheel, CancelledTimersNeverFire) {
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    std::vector<Wheel::TimerId> ids;
+    for (uint64_t deadline = 1; deadline <= 2000; ++deadline) {
+        ids.push_back(wheel.schedule_at(at(deadline * 50), deadline * 50));
+    }
+    for (size_t i = 0; i < ids.size(); i += 2) {
+        EXPECT_TRUE(wheel.cancel(ids[i]));
+        EXPECT_FALSE(wheel.cancel(ids[i])); // Second cancel is a no-op
+    }
+    EXPECT_EQ(wheel.size(), 1000u);
+
+    uint64_t now = 0;
+    auto fired = run_until(wheel, now, 100000);
+    ASSERT_EQ(fired.size(), 1000u);
+    for (size_t i = 0; i < fired.size(); ++i) {
+        EXPECT_EQ(fired[i].second, (2 * i + 2) * 50); // Only the odd-numbered ones
+    }
+    EXPECT_EQ(wheel.get_cancelled(), 1000u);
+    EXPECT_EQ(wheel.get_expired(), 1000u);
+}
+
+TEST(TimerWheel, CancelAfterFireOrOnStaleIdIsNoOp) {
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    Wheel::TimerId first = wheel.schedule_at(at(10), 1);
+    wheel.advance(at(10), [](uint64_t) {});
+    EXPECT_FALSE(wheel.cancel(first));
+    EXPECT_FALSE(wheel.cancel(Wheel::INVALID_TIMER));
+
+    // The slot is reused with a new generation; the old id must not touch it
+    Wheel::TimerId second = wheel.schedule_at(at(20), 2);
+    EXPECT_NE(first, second);
+    EXPECT_FALSE(wheel.cancel(first));
+    EXPECT_EQ(wheel.size(), 1u);
+    EXPECT_TRUE(wheel.cancel(second));
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, CancelAfterCascade) {
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    // Level 1 -> 0 at tick 768, and level 2 -> 1 at tick 65536
+    Wheel::TimerId near = wheel.schedule_at(at(1000), 1000);
+    Wheel::TimerId far = wheel.schedule_at(at(100000), 100000);
+    Wheel::TimerId kept = wheel.schedule_at(at(100001), 100001);
+
+    uint64_t now = 0;
+    EXPECT_TRUE(run_until(wheel, now, 800).empty());
+    uint64_t cascaded = wheel.get_cascaded();
+    EXPECT_GT(cascaded, 0u);
+    EXPECT_TRUE(wheel.cancel(near));
+
+    EXPECT_TRUE(run_until(wheel, now, 70000).empty());
+    EXPECT_GT(wheel.get_cascaded(), cascaded);
+    EXPECT_TRUE(wheel.cancel(far));
+
+    auto fired = run_until(wheel, now, 200000);
+    ASSERT_EQ(fired.size(), 1u);
+    EXPECT_EQ(fired[0].first, 100001u);
+    EXPECT_EQ(fired[0].second, 100001u);
+    EXPECT_FALSE(wheel.cancel(kept));
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, HandlerMayScheduleAndCancel) {
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    Wheel::TimerId same_tick = wheel.schedule_at(at(5), 2);
+    wheel.schedule_at(at(5), 1);
+
+    std::vector<std::pair<uint64_t, uint64_t>> fired;
+    uint64_t now = 0;
+    while (now < 20) {
+        ++now;
+        wheel.advance(at(now), [&](uint64_t payload) {
+            fired.emplace_back(now, payload);
+            if (payload == 1) {
+                wheel.cancel(same_tick);            // Detached but not yet run
+                wheel.schedule_at(at(now), 3);      // Already due: next tick
+                wheel.schedule_at(at(now + 10), 4);
+            }
+        });
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> expected = {{5, 1}, {6, 3}, {15, 4}};
+    EXPECT_EQ(fired, expected);
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, FarFutureDeadlineBeyondTopLevelIsNotEarly) {
+    // Past 2^32 ticks the deadline cannot be placed directly; it is parked
+    // and re-placed by cascading, and must still fire on its own tick
+    const uint64_t deadline = (1ull << 32) + (1ull << 31) + 12345;
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    wheel.schedule_at(at(deadline), deadline);
+    Wheel::TimerId cancelled = wheel.schedule_at(at(deadline + 1), deadline + 1);
+    wheel.schedule_at(at(10), 10);
+
+    std::vector<std::pair<uint64_t, uint64_t>> fired;
+    uint64_t reached = 0;
+    auto advance_to = [&](uint64_t tick) {
+        wheel.advance(at(tick), [&](uint64_t payload) { fired.emplace_back(tick, payload); });
+        reached = tick;
+    };
+
+    advance_to(1ull << 32); // Where a clamped deadline would have fired
+    ASSERT_EQ(fired.size(), 1u);
+    EXPECT_EQ(fired[0].second, 10u);
+    EXPECT_EQ(wheel.size(), 2u);
+
+    EXPECT_TRUE(wheel.cancel(cancelled));
+    advance_to(deadline - 1);
+    EXPECT_EQ(fired.size(), 1u);
+    advance_to(deadline);
+    ASSERT_EQ(fired.size(), 2u);
+    EXPECT_EQ(fired[1].second, deadline);
+    advance_to(deadline + 100);
+    EXPECT_EQ(fired.size(), 2u);
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(reached, deadline + 100);
+}
+
+TEST(TimerWheel, TimeUntilNextNeverLate) {
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    const auto max_wait = std::chrono::milliseconds(1000000);
+    EXPECT_EQ(wheel.time_until_next(START, max_wait), max_wait);
+
+    wheel.schedule_at(at(40), 40);
+    EXPECT_EQ(wheel.time_until_next(START, max_wait), std::chrono::milliseconds(40));
+
+    // A coarser timer: the wait ends no later than the next cascade
+    Wheel far_wheel(std::chrono::milliseconds(1), START);
+    far_wheel.schedule_at(at(5000), 5000);
+    auto wait = far_wheel.time_until_next(START, max_wait);
+    EXPECT_GT(wait.count(), 0);
+    EXPECT_LE(wait, std::chrono::milliseconds(5000));
+}
+
+TEST(TimerWheel, ClearDropsEverythingWithoutFiring) {
+    Wheel wheel(std::chrono::milliseconds(1), START);
+    Wheel::TimerId id = wheel.schedule_at(at(10), 1);
+    wheel.schedule_at(at(100000), 2);
+    wheel.clear();
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_FALSE(wheel.cancel(id));
+    EXPECT_EQ(wheel.advance(at(200000), [](uint64_t) {}), 0u);
+}
@@ -0,0 +1,161 @@
+/*
+ * TorrentHandleRegistry tests
+ *
+ * Runs against an offline lt::session: no DHT, local discovery or port
+ * mapping, loopback listen socket, disabled disk I/O, and torrents added
+ * paused, so a magnet torrent gets a valid handle without any network
+ * traffic. Needs libtorrent; the file is empty in DISABLE_LIBTORRENT
+ * builds.
+ */
+
+#ifndef DISABLE_LIBTORRENT
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "metadata_session.hpp"
+#include "torrent_handle_registry.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+InfoHash make_hash(uint32_t n) {
+    InfoHash hash;
+    for (size_t i = 0; i < 4; ++i) {
+        hash.bytes[i] = static_cast<uint8_t>(n >> (8 * i));
+    }
+    hash.bytes[19] = 0x77;
+    return hash;
+}
+
+class TorrentHandleRegistryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        lt::settings_pack settings;
+        settings.set_str(lt::settings_pack::listen_interfaces, "127.0.0.1:0");
+        settings.set_bool(lt::settings_pack::enable_dht, false);
+        settings.set_bool(lt::settings_pack::enable_lsd, false);
+        settings.set_bool(lt::settings_pack::enable_upnp, false);
+        settings.set_bool(lt::settings_pack::enable_natpmp, false);
+        m_session = std::make_unique<lt::session>(metadata_only_params(std::move(settings)));
+    }
+
+    lt::add_torrent_params params_for(const InfoHash& hash) const {
+        lt::add_torrent_params params = hash.to_add_torrent_params();
+        params.save_path = ::testing::TempDir();
+        params.flags |= lt::torrent_flags::paused;
+        params.flags &= ~lt::torrent_flags::auto_managed;
+        return params;
+    }
+
+    lt::torrent_handle add(TorrentHandleRegistry& registry, uint32_t n) {
+        lt::torrent_handle handle = registry.add(make_hash(n), params_for(make_hash(n)));
+        EXPECT_TRUE(handle.is_valid()) << n;
+        return handle;
+    }
+
+    std::unique_ptr<lt::session> m_session;
+};
+
+} // namespace
+
+TEST_F(TorrentHandleRegistryTest, AddReturnsExistingHandleForSameHash) {
+    TorrentHandleRegistry registry(m_session.get(), 10);
+    lt::torrent_handle first = add(registry, 1);
+    lt::torrent_handle again = add(registry, 1);
+    EXPECT_TRUE(first == again);
+    EXPECT_EQ(registry.live_handles(), 1u);
+    EXPECT_TRUE(registry.contains(make_hash(1)));
+    EXPECT_EQ(m_session->get_torrents().size(), 1u);
+}
+
+TEST_F(TorrentHandleRegistryTest, CapEvictsOldestAndNotifiesOutsideTheLock) {
+    TorrentHandleRegistry registry(m_session.get(), 3);
+    std::vector<std::pair<InfoHash, HandleRelease>> released;
+    // Queried from another thread while the listener runs: if add() still
+    // held the registry lock, these would not finish until it returned
+    std::vector<std::future<std::pair<bool, size_t>>> seen_by_listener;
+    registry.add_release_listener([&](const InfoHash& hash, HandleRelease reason) {
+        released.emplace_back(hash, reason);
+        auto future = std::async(std::launch::async, [&registry, hash]() {
+            return std::make_pair(registry.contains(hash), registry.live_handles());
+        });
+        EXPECT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        seen_by_listener.push_back(std::move(future));
+    });
+
+    for (uint32_t n = 0; n < 3; ++n) {
+        add(registry, n);
+    }
+    EXPECT_TRUE(released.empty());
+    EXPECT_FALSE(registry.has_capacity());
+
+    add(registry, 3);
+    ASSERT_EQ(released.size(), 1u);
+    EXPECT_EQ(released[0].first, make_hash(0));
+    EXPECT_EQ(released[0].second, HandleRelease::EVICTED);
+    ASSERT_EQ(seen_by_listener.size(), 1u);
+    std::pair<bool, size_t> seen = seen_by_listener[0].get();
+    EXPECT_FALSE(seen.first);       // Already gone from the registry
+    EXPECT_EQ(seen.second, 3u);     // And the new handle already in it
+
+    EXPECT_FALSE(registry.contains(make_hash(0)));
+    EXPECT_TRUE(registry.contains(make_hash(3)));
+    EXPECT_EQ(registry.live_handles(), 3u);
+    EXPECT_EQ(registry.get_released(HandleRelease::EVICTED), 1u);
+}
+
+TEST_F(TorrentHandleRegistryTest, ListenerMayCallBackIntoRegistry) {
+    TorrentHandleRegistry registry(m_session.get(), 2);
+    // An owner reacting to an eviction by releasing another of its handles
+    registry.add_release_listener([&registry](const InfoHash& hash, HandleRelease) {
+        if (hash == make_hash(0)) {
+            EXPECT_TRUE(registry.release(make_hash(1), HandleRelease::FAILED));
+        }
+    });
+    add(registry, 0);
+    add(registry, 1);
+    add(registry, 2);
+    EXPECT_EQ(registry.live_handles(), 1u);
+    EXPECT_TRUE(registry.contains(make_hash(2)));
+    EXPECT_EQ(registry.get_released(HandleRelease::FAILED), 1u);
+}
+
+TEST_F(TorrentHandleRegistryTest, OwnerReleasesAreCountedButNotReported) {
+    TorrentHandleRegistry registry(m_session.get(), 10);
+    size_t notifications = 0;
+    registry.add_release_listener([&](const InfoHash&, HandleRelease) { notifications++; });
+
+    for (uint32_t n = 0; n < 5; ++n) {
+        add(registry, n);
+    }
+    EXPECT_TRUE(registry.release(make_hash(0), HandleRelease::COMPLETED));
+    EXPECT_FALSE(registry.release(make_hash(0), HandleRelease::COMPLETED));
+    EXPECT_TRUE(registry.release(make_hash(1).to_hex(), HandleRelease::TIMED_OUT));
+    EXPECT_FALSE(registry.release(std::string("not a hash"), HandleRelease::TIMED_OUT));
+    EXPECT_EQ(registry.release_all(), 3u);
+
+    EXPECT_EQ(notifications, 0u);
+    EXPECT_EQ(registry.get_released(HandleRelease::COMPLETED), 1u);
+    EXPECT_EQ(registry.get_released(HandleRelease::TIMED_OUT), 1u);
+    EXPECT_EQ(registry.get_released(HandleRelease::SHUTDOWN), 3u);
+    EXPECT_EQ(registry.live_handles(), 0u);
+}
+
+TEST_F(TorrentHandleRegistryTest, ZeroCapStillHoldsOneHandle) {
+    TorrentHandleRegistry registry(m_session.get(), 0);
+    EXPECT_EQ(registry.max_live_handles(), 1u);
+    add(registry, 0);
+    add(registry, 1);
+    EXPECT_EQ(registry.live_handles(), 1u);
+    EXPECT_TRUE(registry.contains(make_hash(1)));
+}
+
+#endif // DISABLE_LIBTORRENT
@@ -0,0 +1,194 @@
+/*
+ * WriteBehindWriter tests
+ *
+ * Rows are (key, value) pairs; the flush function records every batch it
+ * is handed and can be held closed to let the buffer fill. Timing checks
+ * use generous margins: they only tell "flushed by the delay" apart from
+ * "flushed at once" and "never flushed".
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "write_behind_writer.hpp"
+
+using namespace dht_crawler;
+
+namespace {
+
+using Row = std::pair<uint32_t, uint32_t>;
+using Clock = std::chrono::steady_clock;
+
+class BatchRecorder {
+public:
+    bool flush(std::vector<Row>& batch) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_gate_cv.wait(lock, [this]() { return m_open; });
+        m_batches.push_back(batch);
+        m_rows += batch.size();
+        m_flushed_cv.notify_all();
+        return true;
+    }
+
+    // Wait until at least rows rows have been flushed
+    bool wait_for_rows(size_t rows, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_flushed_cv.wait_for(lock, timeout, [this, rows]() { return m_rows >= rows; });
+    }
+
+    void set_open(bool open) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_open = open;
+        m_gate_cv.notify_all();
+    }
+
+    std::vector<std::vector<Row>> batches() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_batches;
+    }
+
+    size_t rows() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rows;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_flushed_cv;
+    std::condition_variable m_gate_cv;
+    std::vector<std::vector<Row>> m_batches;
+    size_t m_rows = 0;
+    bool m_open = true;
+};
+
+WriteBehindConfig make_config(size_t batch_rows, std::chrono::milliseconds delay) {
+    WriteBehindConfig config;
+    config.max_batch_rows = batch_rows;
+    config.max_delay = delay;
+    config.max_buffered_bytes = 1000;
+    return config;
+}
+
+class Writer : public WriteBehindWriter<Row> {
+public:
+    Writer(BatchRecorder& recorder, const WriteBehindConfig& config)
+        : WriteBehindWriter<Row>("test", config,
+              [&recorder](std::vector<Row>& batch) { return recorder.flush(batch); },
+              [](const Row& a, const Row& b) { return a.first < b.first; },
+              [](const Row&) { return size_t(10); }) {}
+};
+
+} // namespace
+
+TEST(WriteBehindWriter, FlushesFullBatchWithoutWaitingForDelay) {
+    BatchRecorder recorder;
+    Writer writer(recorder, make_config(10, std::chrono::hours(1)));
+    writer.start();
+
+    for (uint32_t n = 0; n < 9; ++n) {
+        ASSERT_TRUE(writer.add(Row(n, n)));
+    }
+    EXPECT_FALSE(recorder.wait_for_rows(1, std::chrono::milliseconds(100)));
+
+    ASSERT_TRUE(writer.add(Row(9, 9)));
+    ASSERT_TRUE(recorder.wait_for_rows(10, std::chrono::seconds(5)));
+    auto batches = recorder.batches();
+    ASSERT_EQ(batches.size(), 1u);
+    EXPECT_EQ(batches[0].size(), 10u);
+    writer.stop(); // Counters are updated after the flush function returns
+    EXPECT_EQ(writer.get_batches(), 1u);
+    EXPECT_EQ(writer.get_buffered_bytes(), 0u);
+}
+
+TEST(WriteBehindWriter, FlushesPartialBatchAfterDelay) {
+    BatchRecorder recorder;
+    Writer writer(recorder, make_config(100, std::chrono::milliseconds(300)));
+    writer.start();
+
+    Clock::time_point added = Clock::now();
+    ASSERT_TRUE(writer.add(Row(1, 1)));
+    ASSERT_TRUE(writer.add(Row(2, 2)));
+    ASSERT_TRUE(recorder.wait_for_rows(2, std::chrono::seconds(5)));
+    auto waited = Clock::now() - added;
+    EXPECT_GE(waited, std::chrono::milliseconds(250));
+
+    auto batches = recorder.batches();
+    ASSERT_EQ(batches.size(), 1u);
+    EXPECT_EQ(batches[0].size(), 2u);
+}
+
+TEST(WriteBehindWriter, StopDrainsEverythingBuffered) {
+    BatchRecorder recorder;
+    Writer writer(recorder, make_config(10, std::chrono::hours(1)));
+    writer.start();
+    recorder.set_open(false);
+
+    for (uint32_t n = 0; n < 25; ++n) {
+        ASSERT_TRUE(writer.add(Row(n, n)));
+    }
+    recorder.set_open(true);
+    writer.stop();
+
+    EXPECT_EQ(recorder.rows(), 25u);
+    EXPECT_EQ(writer.get_rows_written(), 25u);
+    EXPECT_EQ(writer.get_buffered_bytes(), 0u);
+    for (const auto& batch : recorder.batches()) {
+        EXPECT_LE(batch.size(), 10u);
+    }
+    EXPECT_FALSE(writer.add(Row(99, 99)));
+    EXPECT_FALSE(writer.try_add(Row(99, 99)));
+}
+
+TEST(WriteBehindWriter, SortsBatchAndKeepsNewestRowPerKey) {
+    BatchRecorder recorder;
+    Writer writer(recorder, make_config(6, std::chrono::hours(1)));
+    writer.set_merge_function([](Row& newer, Row& older) { newer.second += older.second; });
+    writer.start();
+
+    for (Row row : {Row(3, 1), Row(1, 1), Row(3, 10), Row(2, 1), Row(1, 100), Row(3, 1000)}) {
+        ASSERT_TRUE(writer.add(row));
+    }
+    ASSERT_TRUE(recorder.wait_for_rows(3, std::chrono::seconds(5)));
+    auto batches = recorder.batches();
+    ASSERT_EQ(batches.size(), 1u);
+    std::vector<Row> expected = {Row(1, 101), Row(2, 1), Row(3, 1011)};
+    EXPECT_EQ(batches[0], expected);
+}
+
+TEST(WriteBehindWriter, BackpressureFollowsWatermarks) {
+    BatchRecorder recorder;
+    Writer writer(recorder, make_config(100, std::chrono::milliseconds(1)));
+    std::mutex mutex;
+    std::vector<bool> transitions;
+    writer.set_backpressure_callback([&](bool on) {
+        std::lock_guard<std::mutex> lock(mutex);
+        transitions.push_back(on);
+    });
+    writer.start();
+    recorder.set_open(false);
+
+    // 10 bytes per row against a 1000-byte buffer: on at 80 rows
+    for (uint32_t n = 0; n < 79; ++n) {
+        ASSERT_TRUE(writer.add(Row(n, n)));
+    }
+    EXPECT_FALSE(writer.is_backpressured());
+    ASSERT_TRUE(writer.add(Row(79, 79)));
+    EXPECT_TRUE(writer.is_backpressured());
+
+    for (uint32_t n = 80; n < 100; ++n) {
+        ASSERT_TRUE(writer.try_add(Row(n, n)));
+    }
+    EXPECT_FALSE(writer.try_add(Row(100, 100))); // Full
+
+    recorder.set_open(true);
+    writer.stop();
+    EXPECT_FALSE(writer.is_backpressured());
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(transitions, std::vector<bool>({true, false}));
+}